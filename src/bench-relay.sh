@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Latency of single urgent labels sent while a long batch prints, through
+# an urgent lane of the relay and through the same lane as the batch. The
+# printer is emulated by relaybench, by default at 400 KB/s. Ports 8120,
+# 8121 and 9121 on localhost must be free.
+#
+# Usage: ./bench-relay.sh [relaybench options]
+#
+
+run() {
+	./relaybench "$@" &
+	bench=$!
+	./tpclrelay $queue 2>/dev/null &
+	relay=$!
+	wait $bench
+	kill $relay
+	wait $relay 2>/dev/null
+}
+
+printf "%-8s " urgent
+queue=127.0.0.1:8120+127.0.0.1:8121=127.0.0.1:9121
+run "$@" 8120 8121 9121
+
+printf "%-8s " shared
+queue=127.0.0.1:8120=127.0.0.1:9121
+run "$@" 8120 8120 9121
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Compare encoder throughput of the build flavours on the tpclbench corpus.
+# Every flavour is run three times and the fastest run is reported. The
+# last row is the -O2 build in low latency mode (tpclbench -L), for its
+# time to first byte.
+#
+# Usage: ./bench.sh [tpclbench options]
+#
+
+MAKE=${MAKE:-make}
+
+run() {
+	best=""
+	for i in 1 2 3; do
+		line=`./tpclbench "$@"` || exit 1
+		rate=`echo "$line" | awk '{ print $6 }'`
+		if test -z "$best" || awk "BEGIN { exit !($rate > $bestrate) }"; then
+			best="$line"
+			bestrate=$rate
+		fi
+	done
+	echo "$best" | awk '{ printf "%10.1f %12.1f %10.3f\n", $6, $8, $12 }'
+}
+
+printf "%-12s %10s %12s %10s\n" flavour labels/s "raster MB/s" "first ms"
+
+for flavour in "-O0" "-O2" "-O3" "-O3 -flto" pgo; do
+	$MAKE clean >/dev/null 2>&1
+	if test "$flavour" = pgo; then
+		$MAKE pgo PGOGOAL=tpclbench >/dev/null 2>&1
+	elif test "$flavour" = "-O3 -flto"; then
+		$MAKE tpclbench OPTFLAGS="$flavour" AR=gcc-ar >/dev/null 2>&1
+	else
+		$MAKE tpclbench OPTFLAGS="$flavour" >/dev/null 2>&1
+	fi
+
+	if test ! -x tpclbench; then
+		echo "$flavour: build failed"
+		continue
+	fi
+
+	printf "%-12s " "$flavour"
+	run "$@"
+done
+
+$MAKE clean >/dev/null 2>&1
+$MAKE tpclbench OPTFLAGS="-O2" >/dev/null 2>&1
+
+if test -x tpclbench; then
+	printf "%-12s " "-O2 -L"
+	run -L "$@"
+fi
+
+$MAKE clean >/dev/null 2>&1
@@ -0,0 +1,687 @@
+/*
+ *   Service metrics for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   metricsNew()      - Create the metrics of a service.
+ *   metricsDelete()   - Free the metrics of a service.
+ *   metricsGet()      - Get the counters of a printer in a shard.
+ *   metricsAdd()      - Add to a counter.
+ *   metricsSet()      - Set a gauge.
+ *   metricsObserve()  - Add a duration to a histogram.
+ *   metricsFormat()   - Format all metrics in Prometheus text format.
+ *   metricsListen()   - Listen for scrapes on a TCP port or Unix socket.
+ *   metricsServe()    - Answer one scrape on a listening socket.
+ *   metricsResponse() - Build the HTTP response to a scrape request.
+ *   Append()          - Append formatted text to a buffer.
+ *   AppendHist()      - Append a histogram of all printers.
+ *   Sum()             - Add the counters of a shard to a total.
+ *
+ * Counters are kept in shards. Each shard has exactly one writer, a thread
+ * or a forked worker process, so updates need neither locks nor atomic
+ * read-modify-write instructions; the shards live in shared memory and
+ * are summed up when scraped. Printers are registered by name in a table
+ * common to all shards.
+ */
+
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Name states...
+ */
+#define NAME_FREE     0			/* Unused */
+#define NAME_CLAIMED  1			/* Being registered */
+#define NAME_READY    2			/* Registered */
+
+#define METRICS_TIMEOUT 1000		/* Scrape I/O timeout in ms */
+
+
+/*
+ * Types...
+ */
+typedef struct metrics_name_s		/* Registered printer */
+{
+  int		state;			/* NAME_xxx */
+  char		name[METRICS_NAME];	/* Printer name */
+} metrics_name_t;
+
+struct metrics_s			/* Metrics of a service */
+{
+  size_t		size;		/* Bytes mapped */
+  int			num_shards;	/* Number of shards */
+  time_t		start;		/* Service start time */
+  metrics_name_t	names[METRICS_PRINTERS];
+					/* Printer names */
+  metrics_counters_t	counters[];	/* Counters, shard by shard */
+};
+
+typedef struct metrics_buffer_s		/* Growing text buffer */
+{
+  char		*data;			/* Text */
+  size_t	len,			/* Length of text */
+		size;			/* Allocated bytes */
+} metrics_buffer_t;
+
+
+/*
+ * Local globals...
+ */
+static const double	Bounds[METRICS_BUCKETS] =
+{					/* Upper bounds of buckets in seconds */
+  0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0
+};
+static metrics_counters_t Discard;	/* Counters without metrics */
+
+
+/*
+ * Local functions...
+ */
+static void	Append(metrics_buffer_t *buf, const char *format, ...)
+		__attribute__((format(printf, 2, 3)));
+static void	AppendHist(metrics_buffer_t *buf, metrics_t *m,
+		           metrics_counters_t *totals, int count,
+		           const char *name, const char *help, size_t offset);
+static void	Sum(metrics_counters_t *total, const metrics_counters_t *c);
+
+
+/*
+ * 'metricsNew()' - Create the metrics of a service.
+ *
+ * The metrics are mapped shared, so shards may be written by forked
+ * workers and read by their parent.
+ */
+metrics_t *				/* O - Metrics or NULL on error */
+metricsNew(int num_shards)		/* I - Number of writers */
+{
+  metrics_t	*m;			/* Metrics */
+  size_t	size;			/* Bytes to map */
+
+
+  if (num_shards < 1)
+    num_shards = 1;
+
+  size = sizeof(metrics_t) + (size_t)num_shards * METRICS_PRINTERS *
+                                 sizeof(metrics_counters_t);
+
+  if ((m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                -1, 0)) == MAP_FAILED)
+    return (NULL);
+
+  m->size       = size;
+  m->num_shards = num_shards;
+  m->start      = time(NULL);
+
+  return (m);
+}
+
+
+/*
+ * 'metricsDelete()' - Free the metrics of a service.
+ */
+void
+metricsDelete(metrics_t *m)		/* I - Metrics */
+{
+  if (m)
+    munmap(m, m->size);
+}
+
+
+/*
+ * 'metricsGet()' - Get the counters of a printer in a shard.
+ *
+ * The printer is registered on first use. Without metrics, or once all
+ * printers are taken, the counters are still valid but not reported.
+ */
+metrics_counters_t *			/* O - Counters */
+metricsGet(metrics_t  *m,		/* I - Metrics or NULL */
+           int        shard,		/* I - Shard of the caller */
+           const char *printer)		/* I - Printer name */
+{
+  int		i;			/* Looping var */
+  int		state;			/* Name state */
+  char		name[METRICS_NAME],	/* Name usable as label value */
+		*ptr;			/* Pointer into name */
+
+
+  if (!m || shard < 0 || shard >= m->num_shards || !printer)
+    return (&Discard);
+
+  snprintf(name, sizeof(name), "%s", printer);
+
+  for (ptr = name; *ptr; ptr ++)
+    if (*ptr == '\"' || *ptr == '\\' || *ptr == '\n')
+      *ptr = '_';
+
+  for (i = 0; i < METRICS_PRINTERS; i ++)
+  {
+    state = __atomic_load_n(&m->names[i].state, __ATOMIC_ACQUIRE);
+
+    if (state == NAME_FREE)
+    {
+      if (!__atomic_compare_exchange_n(&m->names[i].state, &state,
+                                       NAME_CLAIMED, 0, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_ACQUIRE))
+      {
+        i --;				/* Lost the race, look again */
+        continue;
+      }
+
+      strcpy(m->names[i].name, name);
+      __atomic_store_n(&m->names[i].state, NAME_READY, __ATOMIC_RELEASE);
+      break;
+    }
+
+    while (state == NAME_CLAIMED)
+    {
+      sched_yield();
+      state = __atomic_load_n(&m->names[i].state, __ATOMIC_ACQUIRE);
+    }
+
+    if (!strcmp(m->names[i].name, name))
+      break;
+  }
+
+  if (i >= METRICS_PRINTERS)
+    return (&Discard);
+
+  return (m->counters + shard * METRICS_PRINTERS + i);
+}
+
+
+/*
+ * 'metricsAdd()' - Add to a counter.
+ *
+ * Only the owner of a shard writes to it, so a plain load and store is
+ * enough; readers see either the old or the new value.
+ */
+void
+metricsAdd(unsigned long long *counter,	/* I - Counter */
+           unsigned long long value)	/* I - Value to add */
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                   __ATOMIC_RELAXED);
+}
+
+
+/*
+ * 'metricsSet()' - Set a gauge.
+ */
+void
+metricsSet(long long *gauge,		/* I - Gauge */
+           long long value)		/* I - New value */
+{
+  __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * 'metricsObserve()' - Add a duration to a histogram.
+ */
+void
+metricsObserve(metrics_hist_t *hist,	/* I - Histogram */
+               double         seconds)	/* I - Duration */
+{
+  int	i;				/* Looping var */
+
+
+  if (seconds < 0.0)
+    seconds = 0.0;
+
+  for (i = 0; i < METRICS_BUCKETS; i ++)
+    if (seconds <= Bounds[i])
+      break;
+
+  metricsAdd(hist->counts + i, 1);
+  metricsAdd(&hist->usecs, (unsigned long long)(seconds * 1000000.0));
+}
+
+
+/*
+ * 'metricsFormat()' - Format all metrics in Prometheus text format.
+ *
+ * Service-wide metrics are passed in as preformatted text.
+ */
+char *					/* O - Text, free() when done */
+metricsFormat(metrics_t  *m,		/* I - Metrics */
+              const char *extra)	/* I - Service metrics or NULL */
+{
+  int			i, j,		/* Looping vars */
+			count = 0;	/* Registered printers */
+  metrics_counters_t	*totals,	/* Counters summed over shards */
+			*t;		/* Current total */
+  metrics_buffer_t	buf;		/* Output buffer */
+  static const struct
+  {
+    const char	*name,			/* Metric name */
+		*type,			/* Metric type */
+		*help;			/* Description */
+    size_t	offset;			/* Offset in counters */
+  }			values[] =	/* Plain values */
+  {
+    { "tpcl_jobs_total", "counter", "Jobs started.",
+      offsetof(metrics_counters_t, jobs) },
+    { "tpcl_pages_total", "counter", "Label images printed.",
+      offsetof(metrics_counters_t, pages) },
+    { "tpcl_labels_total", "counter", "Labels issued, including copies.",
+      offsetof(metrics_counters_t, labels) },
+    { "tpcl_input_bytes_total", "counter", "Bytes taken in.",
+      offsetof(metrics_counters_t, bytes_in) },
+    { "tpcl_output_bytes_total", "counter", "Bytes sent to the printer.",
+      offsetof(metrics_counters_t, bytes_out) },
+    { "tpcl_reconnects_total", "counter", "Reconnects to the printer.",
+      offsetof(metrics_counters_t, reconnects) },
+    { "tpcl_queue_bytes", "gauge", "Bytes waiting to be sent.",
+      offsetof(metrics_counters_t, queued) }
+  };
+
+
+  memset(&buf, 0, sizeof(buf));
+
+  if ((totals = calloc(METRICS_PRINTERS, sizeof(metrics_counters_t))) == NULL)
+    return (NULL);
+
+  for (i = 0; i < METRICS_PRINTERS; i ++)
+  {
+    if (__atomic_load_n(&m->names[i].state, __ATOMIC_ACQUIRE) != NAME_READY)
+      break;
+
+    for (j = 0; j < m->num_shards; j ++)
+      Sum(totals + i, m->counters + j * METRICS_PRINTERS + i);
+  }
+
+  count = i;
+
+  Append(&buf, "# HELP tpcl_uptime_seconds Time since the service started.\n"
+               "# TYPE tpcl_uptime_seconds gauge\n"
+               "tpcl_uptime_seconds %ld\n"
+               "# HELP tpcl_printers Printers seen.\n"
+               "# TYPE tpcl_printers gauge\n"
+               "tpcl_printers %d\n", (long)(time(NULL) - m->start), count);
+
+  if (extra)
+    Append(&buf, "%s", extra);
+
+  for (j = 0; j < (int)(sizeof(values) / sizeof(values[0])); j ++)
+  {
+    Append(&buf, "# HELP %s %s\n# TYPE %s %s\n", values[j].name,
+           values[j].help, values[j].name, values[j].type);
+
+    for (i = 0; i < count; i ++)
+    {
+      if (!strcmp(values[j].type, "gauge"))
+        Append(&buf, "%s{printer=\"%s\"} %lld\n", values[j].name,
+               m->names[i].name,
+               *(long long *)((char *)(totals + i) + values[j].offset));
+      else
+        Append(&buf, "%s{printer=\"%s\"} %llu\n", values[j].name,
+               m->names[i].name,
+               *(unsigned long long *)((char *)(totals + i) +
+                                       values[j].offset));
+    }
+  }
+
+  Append(&buf, "# HELP tpcl_compression_ratio Input bytes per output byte.\n"
+               "# TYPE tpcl_compression_ratio gauge\n");
+
+  for (i = 0, t = totals; i < count; i ++, t ++)
+    Append(&buf, "tpcl_compression_ratio{printer=\"%s\"} %.3f\n",
+           m->names[i].name,
+           t->bytes_out ? (double)t->bytes_in / (double)t->bytes_out : 0.0);
+
+  AppendHist(&buf, m, totals, count, "tpcl_encode_seconds",
+             "Time to encode a label image.",
+             offsetof(metrics_counters_t, encode));
+  AppendHist(&buf, m, totals, count, "tpcl_write_stall_seconds",
+             "Time writes to the printer were blocked.",
+             offsetof(metrics_counters_t, stall));
+
+  free(totals);
+
+  return (buf.data);
+}
+
+
+/*
+ * 'metricsListen()' - Listen for scrapes on a TCP port or Unix socket.
+ *
+ * Addresses containing a slash are Unix sockets, anything else is
+ * [host:]port with the host defaulting to localhost.
+ */
+int					/* O - Listening socket or -1 */
+metricsListen(const char *address)	/* I - Address */
+{
+  int			fd = -1,	/* Listening socket */
+			on = 1;		/* Socket option value */
+  char			host[256],	/* Host name */
+			*port;		/* Port number */
+  struct sockaddr_un	addr;		/* Unix socket address */
+  struct addrinfo	hints,		/* Address hints */
+			*ai,		/* Addresses */
+			*cur;		/* Current address */
+
+
+  if (strchr(address, '/'))
+  {
+    if (strlen(address) >= sizeof(addr.sun_path))
+    {
+      errno = ENAMETOOLONG;
+      return (-1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address);
+
+    unlink(address);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return (-1);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+      close(fd);
+      return (-1);
+    }
+  }
+  else
+  {
+    snprintf(host, sizeof(host), "%s", address);
+    if ((port = strrchr(host, ':')) != NULL)
+      *port++ = '\0';
+    else
+    {
+      strcpy(host, "localhost");
+      port = (char *)address;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    if (getaddrinfo(host[0] ? host : NULL, port, &hints, &ai))
+    {
+      errno = EADDRNOTAVAIL;
+      return (-1);
+    }
+
+    for (cur = ai; cur; cur = cur->ai_next)
+    {
+      if ((fd = socket(cur->ai_family, cur->ai_socktype,
+                       cur->ai_protocol)) < 0)
+        continue;
+
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+      if (!bind(fd, cur->ai_addr, cur->ai_addrlen))
+        break;
+
+      close(fd);
+      fd = -1;
+    }
+
+    freeaddrinfo(ai);
+
+    if (fd < 0)
+      return (-1);
+  }
+
+  if (listen(fd, 16))
+  {
+    close(fd);
+    return (-1);
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  return (fd);
+}
+
+
+/*
+ * 'metricsServe()' - Answer one scrape on a listening socket.
+ *
+ * The request and response are small, so they are handled in place with
+ * short timeouts instead of an event loop.
+ */
+void
+metricsServe(int        fd,		/* I - Listening socket */
+             metrics_t  *m,		/* I - Metrics */
+             const char *extra)		/* I - Service metrics or NULL */
+{
+  int		client;			/* Client connection */
+  char		request[1024],		/* Request */
+		*response;		/* Response */
+  size_t	len = 0,		/* Bytes of request */
+		length;			/* Bytes of response */
+  ssize_t	bytes;			/* Bytes read or written */
+  struct pollfd	pfd;			/* Client poll */
+
+
+  if ((client = accept(fd, NULL, NULL)) < 0)
+    return;
+
+  pfd.fd     = client;
+  pfd.events = POLLIN;
+
+  request[0] = '\0';
+
+  while (len < sizeof(request) - 1 && !strstr(request, "\r\n\r\n") &&
+         !strstr(request, "\n\n"))
+  {
+    if (poll(&pfd, 1, METRICS_TIMEOUT) <= 0 ||
+        (bytes = read(client, request + len, sizeof(request) - 1 - len)) <= 0)
+      break;
+
+    len += (size_t)bytes;
+    request[len] = '\0';
+  }
+
+  if ((response = metricsResponse(m, request, extra, &length)) != NULL)
+  {
+    pfd.events = POLLOUT;
+
+    for (len = 0; len < length; len += (size_t)bytes)
+      if (poll(&pfd, 1, METRICS_TIMEOUT) <= 0 ||
+          (bytes = write(client, response + len, length - len)) <= 0)
+        break;
+
+    free(response);
+  }
+
+  close(client);
+}
+
+
+/*
+ * 'metricsResponse()' - Build the HTTP response to a scrape request.
+ *
+ * Both "/" and "/metrics" are answered with the metrics.
+ */
+char *					/* O - Response, free() when done */
+metricsResponse(metrics_t  *m,		/* I - Metrics */
+                const char *request,	/* I - Request as received */
+                const char *extra,	/* I - Service metrics or NULL */
+                size_t     *length)	/* O - Bytes of response */
+{
+  char			*body = NULL;	/* Metrics text */
+  const char		*status;	/* HTTP status */
+  metrics_buffer_t	buf;		/* Response */
+
+
+  memset(&buf, 0, sizeof(buf));
+
+  if (strncmp(request, "GET ", 4))
+    status = "405 Method Not Allowed";
+  else if (strncmp(request + 4, "/ ", 2) && strncmp(request + 4, "/metrics ", 9))
+    status = "404 Not Found";
+  else if ((body = metricsFormat(m, extra)) == NULL)
+    status = "500 Internal Server Error";
+  else
+    status = "200 OK";
+
+  Append(&buf, "HTTP/1.0 %s\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %lu\r\n"
+               "Connection: close\r\n"
+               "\r\n%s", status,
+         (unsigned long)(body ? strlen(body) : strlen(status) + 1),
+         body ? body : status);
+
+  if (!body)
+    Append(&buf, "\n");
+
+  free(body);
+
+  if (buf.data)
+    *length = buf.len;
+
+  return (buf.data);
+}
+
+
+/*
+ * 'Append()' - Append formatted text to a buffer.
+ */
+static void
+Append(metrics_buffer_t *buf,		/* I - Buffer */
+       const char       *format,	/* I - printf-style format */
+       ...)				/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+  int		bytes;			/* Bytes formatted */
+  size_t	size;			/* New size */
+  char		*data;			/* New text */
+
+
+  for (;;)
+  {
+    va_start(ap, format);
+    bytes = vsnprintf(buf->data ? buf->data + buf->len : NULL,
+                      buf->size - buf->len, format, ap);
+    va_end(ap);
+
+    if (bytes < 0)
+      return;
+
+    if (buf->len + (size_t)bytes < buf->size)
+    {
+      buf->len += (size_t)bytes;
+      return;
+    }
+
+    size = buf->size ? buf->size * 2 : 4096;
+    while (size <= buf->len + (size_t)bytes)
+      size *= 2;
+
+    if ((data = realloc(buf->data, size)) == NULL)
+      return;
+
+    buf->data = data;
+    buf->size = size;
+  }
+}
+
+
+/*
+ * 'AppendHist()' - Append a histogram of all printers.
+ */
+static void
+AppendHist(metrics_buffer_t   *buf,	/* I - Buffer */
+           metrics_t          *m,	/* I - Metrics */
+           metrics_counters_t *totals,	/* I - Counters of all printers */
+           int                count,	/* I - Number of printers */
+           const char         *name,	/* I - Metric name */
+           const char         *help,	/* I - Description */
+           size_t             offset)	/* I - Offset of histogram */
+{
+  int			i, j;		/* Looping vars */
+  unsigned long long	total;		/* Cumulative count */
+  metrics_hist_t	*hist;		/* Current histogram */
+
+
+  Append(buf, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+  for (i = 0; i < count; i ++)
+  {
+    hist = (metrics_hist_t *)((char *)(totals + i) + offset);
+
+    for (j = 0, total = 0; j < METRICS_BUCKETS; j ++)
+    {
+      total += hist->counts[j];
+      Append(buf, "%s_bucket{printer=\"%s\",le=\"%g\"} %llu\n", name,
+             m->names[i].name, Bounds[j], total);
+    }
+
+    total += hist->counts[METRICS_BUCKETS];
+
+    Append(buf, "%s_bucket{printer=\"%s\",le=\"+Inf\"} %llu\n"
+                "%s_sum{printer=\"%s\"} %.6f\n"
+                "%s_count{printer=\"%s\"} %llu\n",
+           name, m->names[i].name, total,
+           name, m->names[i].name, (double)hist->usecs / 1000000.0,
+           name, m->names[i].name, total);
+  }
+}
+
+
+/*
+ * 'Sum()' - Add the counters of a shard to a total.
+ */
+static void
+Sum(metrics_counters_t       *total,	/* I - Total */
+    const metrics_counters_t *c)	/* I - Counters of one shard */
+{
+  int	i;				/* Looping var */
+
+
+#define SUM(field) total->field += __atomic_load_n(&c->field, __ATOMIC_RELAXED)
+
+  SUM(jobs);
+  SUM(pages);
+  SUM(labels);
+  SUM(bytes_in);
+  SUM(bytes_out);
+  SUM(reconnects);
+  SUM(queued);
+  SUM(encode.usecs);
+  SUM(stall.usecs);
+
+  for (i = 0; i <= METRICS_BUCKETS; i ++)
+  {
+    SUM(encode.counts[i]);
+    SUM(stall.counts[i]);
+  }
+
+#undef SUM
+}
@@ -0,0 +1,76 @@
+/*
+ *   Service metrics for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stddef.h>
+
+/*
+ * Limits...
+ */
+#define METRICS_PRINTERS 64		/* Printers tracked */
+#define METRICS_NAME     64		/* Longest printer name */
+#define METRICS_BUCKETS  12		/* Histogram buckets without +Inf */
+
+
+/*
+ * Types...
+ */
+typedef struct metrics_hist_s		/* Histogram of durations */
+{
+  unsigned long long	counts[METRICS_BUCKETS + 1],
+					/* Observations per bucket */
+			usecs;		/* Sum of observations in usecs */
+} metrics_hist_t;
+
+typedef struct metrics_counters_s	/* Counters of one printer */
+{
+  unsigned long long	jobs,		/* Jobs started */
+			pages,		/* Pages or label images */
+			labels,		/* Labels issued, with copies */
+			bytes_in,	/* Bytes taken in */
+			bytes_out,	/* Bytes sent to the printer */
+			reconnects;	/* Reconnects to the printer */
+  long long		queued;		/* Bytes waiting for the printer */
+  metrics_hist_t	encode,		/* Encode time per page */
+			stall;		/* Time writes were blocked */
+} metrics_counters_t;
+
+typedef struct metrics_s metrics_t;	/* Metrics of a service */
+
+
+/*
+ * Prototypes...
+ */
+extern metrics_t	*metricsNew(int num_shards);
+extern void		metricsDelete(metrics_t *m);
+extern metrics_counters_t *metricsGet(metrics_t *m, int shard,
+			              const char *printer);
+extern void		metricsAdd(unsigned long long *counter,
+			           unsigned long long value);
+extern void		metricsSet(long long *gauge, long long value);
+extern void		metricsObserve(metrics_hist_t *hist, double seconds);
+extern char		*metricsFormat(metrics_t *m, const char *extra);
+extern int		metricsListen(const char *address);
+extern void		metricsServe(int fd, metrics_t *m, const char *extra);
+extern char		*metricsResponse(metrics_t *m, const char *request,
+			                 const char *extra, size_t *length);
+
+#endif /* !_METRICS_H_ */
@@ -0,0 +1,193 @@
+#
+#   Model table generator for the Toshiba TEC TPCL tools.
+#
+#   Copyright 2026 by Mark Dornbach
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Reads tectpcl2.drv and writes the C tables of tpclmodel.c: one entry per
+# ModelName with its sizes, resolutions, media types and print speeds, and
+# the default choices of the options all models share. Settings of outer
+# groups are inherited by the models inside, like ppdc does.
+#
+#   awk -f mkmodels.awk tectpcl2.drv > tpclmodels.h
+#
+
+function push(	k)
+{
+  for (k in Fields)
+    State[Depth + 1, k] = State[Depth, k]
+
+  Depth ++
+}
+
+function choices(opt, value, def,	k)
+{
+  k = (opt == "Resolution") ? "res" : (opt == "MediaType") ? "media" : "speed"
+
+  if (State[Depth, k "_depth"] != Depth)
+  {
+    State[Depth, k]            = ""
+    State[Depth, k "_default"] = ""
+    State[Depth, k "_depth"]   = Depth
+  }
+
+  State[Depth, k] = State[Depth, k] (State[Depth, k] == "" ? "" : " ") value
+
+  if (def || State[Depth, k "_default"] == "")
+    State[Depth, k "_default"] = value
+}
+
+function media(names,	n, i, list, bits)
+{
+  n    = split(names, list, " ")
+  bits = ""
+
+  for (i = 1; i <= n; i ++)
+    bits = bits (bits == "" ? "" : " | ") "TPCL_MEDIA_BIT(TPCL_MEDIA_" toupper(list[i]) ")"
+
+  return (bits == "" ? "TPCL_MEDIA_BIT(TPCL_MEDIA_DIRECT)" : bits)
+}
+
+function list(values, size,	n, i, items, out)
+{
+  n   = split(values, items, " ")
+  out = ""
+
+  for (i = 1; i <= size; i ++)
+    out = out (i > 1 ? ", " : "") (i <= n ? items[i] : 0)
+
+  return ("{ " out " }")
+}
+
+function emit(	name, d)
+{
+  name = State[Depth, "pcfile"]
+  sub(/\.ppd$/, "", name)
+
+  if (split(State[Depth, "res"], d, " ") > 2 ||
+      split(State[Depth, "speed"], d, " ") > 4)
+  {
+    print "mkmodels.awk: too many choices for " State[Depth, "model"] > "/dev/stderr"
+    exit 1
+  }
+
+  Models = Models sprintf("  { \"%s\", \"%s\",\n    %s, %d, %s, %s, %s, %s,\n    %s, TPCL_MEDIA_%s,\n    %s, %d },\n",
+                          name, State[Depth, "model"], list(State[Depth, "res"], 2),
+                          State[Depth, "res_default"], State[Depth, "min_w"],
+                          State[Depth, "min_l"], State[Depth, "max_w"],
+                          State[Depth, "max_l"], media(State[Depth, "media"]),
+                          toupper(State[Depth, "media_default"] == "" ? "Direct" : State[Depth, "media_default"]),
+                          list(State[Depth, "speed"], 4), State[Depth, "speed_default"])
+}
+
+BEGIN {
+  split("model pcfile min_w min_l max_w max_l res res_default res_depth media media_default media_depth speed speed_default speed_depth", f, " ")
+  for (i in f)
+    Fields[f[i]] = 1
+
+  Depth  = 0
+  Option = ""
+}
+
+# Strip comments, skip blank lines...
+{
+  sub(/\/\/.*$/, "")
+}
+
+/^[ \t]*$/ {
+  next
+}
+
+/^[ \t]*\{/ {
+  push()
+  next
+}
+
+/^[ \t]*\}/ {
+  if (State[Depth, "model"] != "" && State[Depth, "model"] != State[Depth - 1, "model"])
+    emit()
+
+  Depth --
+  next
+}
+
+/^[ \t]*ModelName / {
+  match($0, /"[^"]*"/)
+  State[Depth, "model"] = substr($0, RSTART + 1, RLENGTH - 2)
+  next
+}
+
+/^[ \t]*PCFileName / {
+  match($0, /"[^"]*"/)
+  State[Depth, "pcfile"] = substr($0, RSTART + 1, RLENGTH - 2)
+  next
+}
+
+/^[ \t]*MinSize / {
+  State[Depth, "min_w"] = $2
+  State[Depth, "min_l"] = $3
+  next
+}
+
+/^[ \t]*MaxSize / {
+  State[Depth, "max_w"] = $2
+  State[Depth, "max_l"] = $3
+  next
+}
+
+/^[ \t]*\*?Resolution / {
+  match($0, /"[0-9]+dpi/)
+  choices("Resolution", substr($0, RSTART + 1, RLENGTH - 4), $1 ~ /^\*/)
+  next
+}
+
+/^[ \t]*Option / {
+  match($0, /"[^"\/]*/)
+  Option = substr($0, RSTART + 1, RLENGTH - 1)
+  next
+}
+
+/^[ \t]*\*?Choice / {
+  match($0, /"[^"\/]*/)
+  value = substr($0, RSTART + 1, RLENGTH - 1)
+
+  if (Option == "MediaType" || Option == "tePrintRate")
+    choices(Option, value, $1 ~ /^\*/)
+  else if (Depth == 0 && ($1 ~ /^\*/ || !(Option in Defaults)))
+  {
+    if (!(Option in Defaults))
+      Order[++ NumDefaults] = Option
+
+    Defaults[Option] = value
+  }
+  next
+}
+
+END {
+  print "/*"
+  print " * Generated from tectpcl2.drv by mkmodels.awk, do not edit."
+  print " */"
+  print ""
+  print "static const tpcl_model_t Models[] =\t/* Models of the drv file */"
+  print "{"
+  printf "%s", Models
+  print "};"
+  print ""
+  print "static const char * const Defaults[][2] =\t/* Defaults of shared options */"
+  print "{"
+  for (i = 1; i <= NumDefaults; i ++)
+    printf "  { \"%s\", \"%s\" }%s\n", Order[i], Defaults[Order[i]], i < NumDefaults ? "," : ""
+  print "};"
+}
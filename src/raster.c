@@ -0,0 +1,640 @@
+/*
+ *   CUPS raster reader for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   rasterOpen()        - Start reading a raster stream.
+ *   rasterClose()       - Free a raster stream.
+ *   rasterReadHeader()  - Read the header of the next page.
+ *   rasterReadLine()    - Get the next line of the page.
+ *   rasterReadPixels()  - Copy the next line of the page.
+ *   rasterIsTPCL()      - Check whether the stream is TPCL already.
+ *   rasterPassThrough() - Copy the stream unchanged.
+ *
+ *   RasterFill()        - Make sure enough input is buffered.
+ *   RasterDecode()      - Decode the next lines into the ring.
+ *   RasterRun()         - Fill a run of repeated bytes.
+ *   RasterCopy()        - Copy literal bytes.
+ *
+ * Reads version 2 and 3 CUPS raster, i.e. what cupsRasterOpen() returns
+ * for every current CUPS filter chain, in either byte order. Input is
+ * read in large blocks, and up to RASTER_ROWS lines are decoded at a time
+ * into a ring of 64-byte aligned lines. Repeated lines are decoded once
+ * and handed out again, not copied. Runs are expanded with 16-byte SSE2
+ * or NEON stores, which may write up to 15 bytes past a run; lines and
+ * the input buffer have room for that.
+ *
+ * CUPS hands the raster to the filter through a pipe of 64 KiB, so every
+ * read() returns at most that much and the filter wakes up once per 64 KiB.
+ * Pipes are grown to RASTER_PIPE where the kernel permits. Streams that
+ * are TPCL already, such as precompiled jobs being printed again, are
+ * passed on with splice(), which moves the data from pipe to pipe without
+ * copying it through the filter.
+ */
+
+#define _GNU_SOURCE
+#include "raster.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__SSE2__) && !defined(RASTER_SCALAR)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(RASTER_SCALAR)
+#  include <arm_neon.h>
+#endif /* __SSE2__ && !RASTER_SCALAR */
+
+
+/*
+ * Constants...
+ */
+#define RASTER_READ	262144		/* Bytes per read() */
+#define RASTER_ROWS	32		/* Lines decoded at a time */
+#define RASTER_SLACK	16		/* Overrun of wide stores and loads */
+#define RASTER_PIPE	1048576		/* Pipe size to ask for */
+#define RASTER_SPLICE	1048576		/* Bytes per splice() */
+
+#define RASTER_SYNC_V2	0x52615332	/* "RaS2", compressed */
+#define RASTER_REV_V2	0x32536152
+#define RASTER_SYNC_V3	0x52615333	/* "RaS3", uncompressed */
+#define RASTER_REV_V3	0x33536152
+
+
+/*
+ * Types...
+ */
+struct raster_s				/* Raster stream being read */
+{
+  int		fd,			/* File to read from */
+		sync,			/* Non-zero once the sync word was read */
+		swapped,		/* Non-zero for the other byte order */
+		compressed,		/* Non-zero for version 2 */
+		splice,			/* Non-zero while splice() works */
+		eof;			/* Non-zero at end of file or error */
+  unsigned char	*in;			/* Input buffer */
+  size_t	insize,			/* Size of input buffer */
+		inpos,			/* Next byte to decode */
+		inlen;			/* Bytes in input buffer */
+  unsigned	bpp,			/* Bytes per pixel */
+		bytes,			/* Bytes per line */
+		remaining;		/* Lines left on the page */
+  unsigned char	*rows;			/* Decoded lines */
+  size_t	stride,			/* Bytes between lines */
+		rowsize;		/* Size of line buffer */
+  unsigned	repeat[RASTER_ROWS],	/* Times each decoded line is used */
+		num_rows,		/* Lines decoded */
+		row,			/* Current line in ring */
+		left;			/* Uses left of the current line */
+};
+
+
+/*
+ * Local functions...
+ */
+static int	RasterFill(raster_t *r, size_t need);
+static int	RasterDecode(raster_t *r);
+static void	RasterRun(unsigned char *dst, const unsigned char *pixel,
+		          unsigned bpp, unsigned bytes);
+static void	RasterCopy(unsigned char *dst, const unsigned char *src,
+		           unsigned bytes);
+
+
+/*
+ * 'rasterOpen()' - Start reading a raster stream.
+ *
+ * Nothing is read until the first header is asked for. The file is not
+ * closed by rasterClose(). A pipe is grown to RASTER_PIPE, or to the
+ * largest size the pipe limits of the user allow.
+ */
+raster_t *				/* O - Raster stream or NULL */
+rasterOpen(int fd)			/* I - File to read from */
+{
+  raster_t	*r;			/* Raster stream */
+  struct stat	info;			/* Type of file */
+  int		size;			/* Pipe size to try */
+
+
+  if ((r = calloc(1, sizeof(raster_t))) == NULL)
+    return (NULL);
+
+  r->fd     = fd;
+  r->splice = 1;
+  r->insize = 2 * RASTER_READ;
+
+#ifdef F_SETPIPE_SZ
+  if (!fstat(fd, &info) && S_ISFIFO(info.st_mode))
+    for (size = RASTER_PIPE; size > 65536; size /= 2)
+      if (fcntl(fd, F_GETPIPE_SZ) >= size || fcntl(fd, F_SETPIPE_SZ, size) >= 0)
+        break;
+#else
+  (void)info;
+  (void)size;
+#endif /* F_SETPIPE_SZ */
+
+  if (posix_memalign((void **)&r->in, 64, r->insize + RASTER_SLACK))
+  {
+    free(r);
+    return (NULL);
+  }
+
+  return (r);
+}
+
+
+/*
+ * 'rasterClose()' - Free a raster stream.
+ */
+void
+rasterClose(raster_t *r)		/* I - Raster stream */
+{
+  if (!r)
+    return;
+
+  free(r->in);
+  free(r->rows);
+  free(r);
+}
+
+
+/*
+ * 'rasterReadHeader()' - Read the header of the next page.
+ *
+ * Lines of the previous page that were not read are skipped.
+ */
+int					/* O - 1 on success, 0 at end or on error */
+rasterReadHeader(
+    raster_t            *r,		/* I - Raster stream */
+    cups_page_header2_t *header)	/* O - Page header */
+{
+  unsigned	sync,			/* Sync word */
+		*word;			/* Word to swap */
+  int		i;			/* Looping var */
+  size_t	stride;			/* New distance between lines */
+  unsigned char	*rows;			/* New line buffer */
+
+
+  while (r->remaining > 0)
+    if (!rasterReadLine(r))
+      return (0);
+
+  if (!r->sync)
+  {
+    if (RasterFill(r, sizeof(sync)) < (int)sizeof(sync))
+      return (0);
+
+    memcpy(&sync, r->in + r->inpos, sizeof(sync));
+    r->inpos += sizeof(sync);
+
+    switch (sync)
+    {
+      case RASTER_SYNC_V2 :
+          r->compressed = 1;
+          break;
+      case RASTER_REV_V2 :
+          r->compressed = 1;
+          r->swapped    = 1;
+          break;
+      case RASTER_SYNC_V3 :
+          break;
+      case RASTER_REV_V3 :
+          r->swapped = 1;
+          break;
+      default :
+          r->eof = 1;
+          errno  = EINVAL;
+          return (0);
+    }
+
+    r->sync = 1;
+  }
+
+  if (RasterFill(r, sizeof(cups_page_header2_t)) <
+          (int)sizeof(cups_page_header2_t))
+    return (0);
+
+  memcpy(header, r->in + r->inpos, sizeof(cups_page_header2_t));
+  r->inpos += sizeof(cups_page_header2_t);
+
+ /*
+  * All numbers of the header are 32 bits, from AdvanceDistance to the
+  * end of cupsReal...
+  */
+  if (r->swapped)
+    for (i = 81, word = &header->AdvanceDistance; i > 0; i --, word ++)
+      *word = __builtin_bswap32(*word);
+
+  if (header->cupsColorOrder != CUPS_ORDER_CHUNKED)
+    r->bpp = (header->cupsBitsPerColor + 7) / 8;
+  else
+    r->bpp = (header->cupsBitsPerPixel + 7) / 8;
+
+  if (r->bpp == 0)
+    r->bpp = 1;
+
+  if (header->cupsBytesPerLine == 0 || header->cupsHeight == 0 ||
+      header->cupsBytesPerLine % r->bpp ||
+      header->cupsBytesPerLine > 0x1000000)
+  {
+    r->eof = 1;
+    errno  = EINVAL;
+    return (0);
+  }
+
+  r->bytes     = header->cupsBytesPerLine;
+  r->remaining = header->cupsHeight;
+
+  if (header->cupsColorOrder == CUPS_ORDER_PLANAR)
+    r->remaining *= header->cupsNumColors;
+
+  r->num_rows = 0;
+  r->row      = 0;
+  r->left     = 0;
+
+ /*
+  * Lines are 64-byte aligned with room for the overrun of wide stores...
+  */
+  stride = ((size_t)r->bytes + RASTER_SLACK + 63) & ~(size_t)63;
+
+  if (stride * RASTER_ROWS > r->rowsize)
+  {
+    free(r->rows);
+
+    if (posix_memalign((void **)&rows, 64, stride * RASTER_ROWS))
+    {
+      r->rows    = NULL;
+      r->rowsize = 0;
+      r->eof     = 1;
+      return (0);
+    }
+
+    r->rows    = rows;
+    r->rowsize = stride * RASTER_ROWS;
+  }
+
+  r->stride = stride;
+
+ /*
+  * A compressed line takes at most twice its size plus the repeat byte,
+  * the input buffer always holds one...
+  */
+  if (2 * (size_t)r->bytes + 1 + RASTER_READ > r->insize)
+  {
+    r->insize = 2 * (size_t)r->bytes + 1 + RASTER_READ;
+
+    if ((rows = realloc(r->in, r->insize + RASTER_SLACK)) == NULL)
+    {
+      r->eof = 1;
+      return (0);
+    }
+
+    r->in = rows;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'rasterReadLine()' - Get the next line of the page.
+ *
+ * The line stays valid until the next call.
+ */
+const unsigned char *			/* O - Line or NULL at end or on error */
+rasterReadLine(raster_t *r)		/* I - Raster stream */
+{
+  if (r->remaining == 0)
+    return (NULL);
+
+  if (r->left == 0)
+  {
+    if (++ r->row >= r->num_rows && RasterDecode(r))
+    {
+      r->remaining = 0;
+      return (NULL);
+    }
+
+    r->left = r->repeat[r->row];
+  }
+
+  r->left --;
+  r->remaining --;
+
+  return (r->rows + r->row * r->stride);
+}
+
+
+/*
+ * 'rasterReadPixels()' - Copy the next line of the page.
+ *
+ * Works like cupsRasterReadPixels() for callers reading whole lines.
+ */
+unsigned				/* O - Bytes copied or 0 */
+rasterReadPixels(raster_t      *r,	/* I - Raster stream */
+                 unsigned char *p,	/* O - Line */
+                 unsigned      len)	/* I - Bytes to copy */
+{
+  const unsigned char	*line;		/* Next line */
+
+
+  if ((line = rasterReadLine(r)) == NULL)
+    return (0);
+
+  if (len > r->bytes)
+    len = r->bytes;
+
+  memcpy(p, line, len);
+
+  return (len);
+}
+
+
+/*
+ * 'rasterIsTPCL()' - Check whether the stream is TPCL already.
+ *
+ * Must be called before the first header is read. TPCL streams start with
+ * the "{" of their first command, raster streams with a sync word.
+ */
+int					/* O - 1 for TPCL, 0 otherwise */
+rasterIsTPCL(raster_t *r)		/* I - Raster stream */
+{
+  if (r->sync || RasterFill(r, 1) < 1)
+    return (0);
+
+  return (r->in[r->inpos] == '{');
+}
+
+
+/*
+ * 'rasterPassThrough()' - Copy the stream unchanged.
+ *
+ * Call until it returns 0. Input already read is written first, then the
+ * rest is moved with splice() in chunks of RASTER_SPLICE bytes. splice()
+ * needs a pipe on one side; otherwise the data goes through the input
+ * buffer with read() and write(). Interrupted calls return -1 with errno
+ * set to EINTR, so the caller can check for a cancel.
+ */
+ssize_t					/* O - Bytes written, 0 at end, -1 on error */
+rasterPassThrough(raster_t *r,		/* I - Raster stream */
+                  int      fd)		/* I - File to write to */
+{
+  ssize_t	count;			/* Bytes moved */
+
+
+  if (r->inpos >= r->inlen && !r->eof)
+  {
+#ifdef SPLICE_F_MOVE
+    if (r->splice)
+    {
+      if ((count = splice(r->fd, NULL, fd, NULL, RASTER_SPLICE,
+                          SPLICE_F_MOVE | SPLICE_F_MORE)) == 0)
+        r->eof = 1;
+
+      if (count >= 0 || errno != EINVAL)
+        return (count);
+
+      r->splice = 0;
+    }
+#endif /* SPLICE_F_MOVE */
+
+    if ((count = read(r->fd, r->in, r->insize)) <= 0)
+    {
+      if (count == 0)
+        r->eof = 1;
+
+      return (count);
+    }
+
+    r->inpos = 0;
+    r->inlen = (size_t)count;
+  }
+
+  if (r->inpos >= r->inlen)
+    return (0);
+
+  if ((count = write(fd, r->in + r->inpos, r->inlen - r->inpos)) > 0)
+    r->inpos += (size_t)count;
+
+  return (count);
+}
+
+
+/*
+ * 'RasterFill()' - Make sure enough input is buffered.
+ */
+static int				/* O - Bytes available, -1 on error */
+RasterFill(raster_t *r,			/* I - Raster stream */
+           size_t   need)		/* I - Bytes needed */
+{
+  ssize_t	count;			/* Bytes read */
+
+
+  if (r->inlen - r->inpos >= need || r->eof)
+    return ((int)(r->inlen - r->inpos < need ? r->inlen - r->inpos : need));
+
+  if (r->inpos > 0)
+  {
+    memmove(r->in, r->in + r->inpos, r->inlen - r->inpos);
+    r->inlen -= r->inpos;
+    r->inpos  = 0;
+  }
+
+  while (r->inlen < need)
+  {
+    if ((count = read(r->fd, r->in + r->inlen, r->insize - r->inlen)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      r->eof = 1;
+      return (-1);
+    }
+    else if (count == 0)
+    {
+      r->eof = 1;
+      break;
+    }
+
+    r->inlen += (size_t)count;
+  }
+
+  return ((int)(r->inlen < need ? r->inlen : need));
+}
+
+
+/*
+ * 'RasterDecode()' - Decode the next lines into the ring.
+ */
+static int				/* O - 0 on success, -1 on error */
+RasterDecode(raster_t *r)		/* I - Raster stream */
+{
+  unsigned	lines,			/* Lines covered by decoded lines */
+		count,			/* Length of run */
+		left;			/* Bytes left in line */
+  unsigned char	*dst;			/* Current position in line */
+  const unsigned char *in,		/* Current position in input */
+		*end;			/* End of input */
+  size_t	need;			/* Input needed for a line */
+
+
+  r->num_rows = 0;
+  r->row      = 0;
+  need        = r->compressed ? 2 * (size_t)r->bytes + 1 : r->bytes;
+
+  for (lines = 0; r->num_rows < RASTER_ROWS && lines < r->remaining;
+       r->num_rows ++)
+  {
+    dst = r->rows + r->num_rows * r->stride;
+
+    if (RasterFill(r, need) <= 0)
+      break;
+
+    in  = r->in + r->inpos;
+    end = r->in + r->inlen;
+
+    if (!r->compressed)
+    {
+      if (in + r->bytes > end)
+        break;
+
+      memcpy(dst, in, r->bytes);
+      r->inpos += r->bytes;
+      r->repeat[r->num_rows] = 1;
+      lines ++;
+      continue;
+    }
+
+   /*
+    * A repeat count for the line, then runs of repeated pixels (0 to 127
+    * for 1 to 128 times) and literal pixels (128 to 255 for 129 to 2)...
+    */
+    r->repeat[r->num_rows] = *in++ + 1u;
+
+    for (left = r->bytes; left > 0; left -= count, dst += count)
+    {
+      if (in >= end)
+        break;
+
+      if (*in & 128)
+      {
+        count = (257u - *in++) * r->bpp;
+        if (count > left)
+          count = left;
+
+        if (in + count > end)
+          break;
+
+        RasterCopy(dst, in, count);
+        in += count;
+      }
+      else
+      {
+        count = (*in++ + 1u) * r->bpp;
+        if (count > left)
+          count = left;
+
+        if (in + r->bpp > end || count < r->bpp)
+          break;
+
+        RasterRun(dst, in, r->bpp, count);
+        in += r->bpp;
+      }
+    }
+
+    if (left > 0)
+      break;
+
+    r->inpos = (size_t)(in - r->in);
+    lines   += r->repeat[r->num_rows];
+  }
+
+  if (r->num_rows == 0)
+  {
+    r->eof = 1;
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'RasterRun()' - Fill a run of repeated bytes.
+ */
+static void
+RasterRun(unsigned char       *dst,	/* O - Destination */
+          const unsigned char *pixel,	/* I - Pixel to repeat */
+          unsigned            bpp,	/* I - Bytes per pixel */
+          unsigned            bytes)	/* I - Bytes to fill */
+{
+  unsigned	i;			/* Looping var */
+
+
+  if (bpp == 1)
+  {
+#if defined(__SSE2__) && !defined(RASTER_SCALAR)
+    __m128i	v = _mm_set1_epi8((char)*pixel);
+
+    for (i = 0; i < bytes; i += 16)
+      _mm_storeu_si128((__m128i *)(dst + i), v);
+#elif defined(__ARM_NEON) && !defined(RASTER_SCALAR)
+    uint8x16_t	v = vdupq_n_u8(*pixel);
+
+    for (i = 0; i < bytes; i += 16)
+      vst1q_u8(dst + i, v);
+#else
+    (void)i;
+    memset(dst, *pixel, bytes);
+#endif /* __SSE2__ && !RASTER_SCALAR */
+    return;
+  }
+
+ /*
+  * Wider pixels are doubled up...
+  */
+  memcpy(dst, pixel, bpp);
+
+  for (i = bpp; i < bytes; i *= 2)
+    memcpy(dst + i, dst, bytes - i < i ? bytes - i : i);
+}
+
+
+/*
+ * 'RasterCopy()' - Copy literal bytes.
+ */
+static void
+RasterCopy(unsigned char       *dst,	/* O - Destination */
+           const unsigned char *src,	/* I - Source */
+           unsigned            bytes)	/* I - Bytes to copy */
+{
+#if defined(__SSE2__) && !defined(RASTER_SCALAR)
+  unsigned	i;			/* Looping var */
+
+  for (i = 0; i < bytes; i += 16)
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_loadu_si128((const __m128i *)(src + i)));
+#elif defined(__ARM_NEON) && !defined(RASTER_SCALAR)
+  unsigned	i;			/* Looping var */
+
+  for (i = 0; i < bytes; i += 16)
+    vst1q_u8(dst + i, vld1q_u8(src + i));
+#else
+  memcpy(dst, src, bytes);
+#endif /* __SSE2__ && !RASTER_SCALAR */
+}
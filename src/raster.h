@@ -0,0 +1,44 @@
+/*
+ *   CUPS raster reader for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RASTER_H_
+#define _RASTER_H_
+
+#include <cups/raster.h>
+#include <sys/types.h>
+
+
+/*
+ * Types...
+ */
+typedef struct raster_s raster_t;	/* Raster stream being read */
+
+
+/*
+ * Prototypes...
+ */
+extern raster_t	*rasterOpen(int fd);
+extern void	rasterClose(raster_t *r);
+extern int	rasterReadHeader(raster_t *r, cups_page_header2_t *header);
+extern const unsigned char *rasterReadLine(raster_t *r);
+extern unsigned	rasterReadPixels(raster_t *r, unsigned char *p, unsigned len);
+extern int	rasterIsTPCL(raster_t *r);
+extern ssize_t	rasterPassThrough(raster_t *r, int fd);
+
+#endif /* !_RASTER_H_ */
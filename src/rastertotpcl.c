@@ -30,15 +30,45 @@
  *
  * Contents:
  *
+ *   Option()       - Get the choice of an option.
  *   Setup()        - Prepare the printer for printing.
  *   StartPage()    - Start a page of graphics.
+ *   PageSettings() - Get the settings of a page from its header and the PPD.
  *   EndPage()      - Finish a page of graphics.
  *   CancelJob()    - Cancel the current job...
+ *   CatchCancel()  - Set the handler of the cancel signal.
  *   OutputLine()   - Output a line of graphics.
+ *   WriteOutput()  - Write encoded data to stdout.
+ *   Now()          - Get the monotonic time in seconds.
+ *   PoolWait()     - Wait for a change in a page pool.
+ *   PageOutput()   - Collect encoded data of a page.
+ *   EncodePages()  - Encode pages of a parallel job.
+ *   WritePages()   - Write encoded pages in order.
+ *   PrintParallel() - Convert the pages of a job on all cores.
+ *   PassThrough()  - Send a job that is TPCL already.
+ *   OpenPPD()      - Open a PPD file, from the cache of a daemon worker.
+ *   PrintJob()     - Convert a raster job.
+ *   WarmWorker()   - Prepare a daemon worker for its first job.
+ *   WorkerJob()    - Convert a raster job in a daemon worker.
+ *   Daemon()       - Run as prefork filter daemon.
  *   main()         - Main entry and processing of driver.
  *
- *   TOPIXCompress() - Compress output into TEC's TOPIX format.
- *   TOPIXCompressOutputBuffer() - Send current contents of TOPIX data to stdout.
+ * TPCL commands and TOPIX compression are generated by tpcl.c, the
+ * raster is decoded by raster.c.
+ *
+ * Started as "rastertotpcl --daemon", the filter keeps a pool of warm
+ * worker processes (see tpcld.c); filters started by CUPS then hand their
+ * jobs to a worker instead of loading the PPD and allocating buffers for
+ * every job. Workers count jobs, pages, bytes, encode time and write
+ * stalls per queue; "-p" serves them for Prometheus.
+ *
+ * With teParallel, the pages of a job are read in full and encoded by a
+ * thread per core, each with an encoder of its own; a writer thread sends
+ * the encoded pages in order. The output is the same as page by page.
+ *
+ * Label settings are limited to what the model supports, from the model
+ * table of libtpcl (see tpclmodel.c). Without a PPD file the model is
+ * named by the "teModel" option and the table provides the defaults.
  *
  * This driver should support all Toshiba TEC Label Printers with support for TPCL (TEC
  * Printer Command Language) and TOPIX Compression for graphics.
@@ -48,146 +78,221 @@
 #include <cups/cups.h>
 #include <cups/ppd.h>
 #include <cups/raster.h>
+#include "raster.h"
+#include "tpcl.h"
+#include "tpcld.h"
+#include "tpclmodel.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <math.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
 
 /*
  * Model number constants...
  */
 #define INTSIZE		20 			/* MAXIMUM CHARACTERS INTEGER */
+#define DAEMON_LINE	512			/* Line buffer reserved by workers */
+#define PARALLEL_MAX	16			/* Most encoder threads of a job */
+
+/*
+ * States of a page slot...
+ */
+#define SLOT_FREE	0			/* Not in use */
+#define SLOT_READ	1			/* Graphics read, to be encoded */
+#define SLOT_ENCODED	2			/* Encoded, to be written */
 
 /*
- * TEC Graphics Modes
+ * Types...
  */
-#define TEC_GMODE_TOPIX   3
-#define TEC_GMODE_HEX_AND 1
-#define TEC_GMODE_HEX_OR  5
+typedef struct ppd_cache_s		/* PPD file kept by daemon workers */
+{
+  char		*filename;		/* File name */
+  time_t	mtime;			/* Modification time when loaded */
+  ppd_file_t	*ppd;			/* PPD file */
+} ppd_cache_t;
+
+typedef struct page_slot_s		/* Page of a parallel job */
+{
+  int		state;			/* SLOT_xxx */
+  tpcl_page_t	page;			/* Page settings */
+  unsigned	lines;			/* Lines read */
+  int		labels;			/* Labels issued by the page */
+  unsigned char	*raster;		/* Graphics of the page */
+  size_t	raster_size;		/* Size of raster buffer */
+  unsigned char	*output;		/* Encoded page */
+  size_t	outlen,			/* Bytes of encoded page */
+		outsize;		/* Size of output buffer */
+  double	encoding;		/* Encode time */
+} page_slot_t;
+
+typedef struct page_pool_s		/* Pages of a parallel job */
+{
+  pthread_mutex_t lock;			/* Lock for the counters and states */
+  pthread_cond_t cond;			/* Signaled on every change */
+  page_slot_t	slots[2 * PARALLEL_MAX];/* Pages in flight */
+  int		num_slots,		/* Slots in use */
+		next_read,		/* Next page to read */
+		next_encode,		/* Next page to encode */
+		next_write,		/* Next page to write */
+		done,			/* Non-zero after the last page */
+		error;			/* Non-zero after an output error */
+  size_t	bytes;			/* Bytes written */
+} page_pool_t;
 
 
 /*
  * Globals...
  */
-static unsigned char	*Buffer;		     /* Output buffer */
-static unsigned char	*LastBuffer;		 /* Last buffer */
-static unsigned char  *CompBuffer;     /* Byte array of whole image */
-unsigned char         *CompBufferPtr;  /* Pointer to current position in CompBuffer */
-int   CompLastLine;   /* Last line number sent to TOPIX output */
+static const unsigned char *Buffer;	     /* Current line */
+static tpcl_job_t	*Job = NULL;		 /* Output state */
 int   Page,           /* Current page */
-      Feed,           /* Number of lines to skip */
-      Canceled,		    /* Non-zero if job is canceled */
-      Gmode; 			    /* Tec Graphics mode */
+      Canceled;		    /* Non-zero if job is canceled */
 
 int		ModelNumber; 		/* cupsModelNumber attribute (not currently in use) */
 
+static int		DaemonMode = 0;	/* Non-zero in the filter daemon */
+static const tpcl_model_t *Model = NULL;/* Printer model, if known */
+static int		NumOptions = 0;	/* Number of job options */
+static cups_option_t	*Options = NULL;/* Job options */
+static ppd_cache_t	*PPDs = NULL;	/* Loaded PPD files */
+static int		NumPPDs = 0;	/* Number of loaded PPD files */
+static metrics_counters_t *Metrics;	/* Counters of the current queue */
+static double		Encoding,	/* Encode time of current page */
+			Stalled;	/* Write time of current page */
+static int		Threads = 0;	/* Encoder threads, 0 for none */
+
 /*
  * Prototypes...
  */
+const char *Option(ppd_file_t *ppd, const char *name);
 void Setup(ppd_file_t *ppd);
 void StartPage(ppd_file_t *ppd, cups_page_header2_t *header);
+void PageSettings(ppd_file_t *ppd, cups_page_header2_t *header,
+                  tpcl_page_t *settings);
 void EndPage(ppd_file_t *ppd, cups_page_header2_t *header);
 void CancelJob(int sig);
+void CatchCancel(void (*handler)(int));
 void OutputLine(ppd_file_t *ppd, cups_page_header2_t *header, int y);
+ssize_t WriteOutput(void *data, const void *buffer, size_t bytes);
+double Now(void);
+void PoolWait(page_pool_t *pool);
+ssize_t PageOutput(void *data, const void *buffer, size_t bytes);
+void *EncodePages(void *data);
+void *WritePages(void *data);
+size_t PrintParallel(ppd_file_t *ppd, raster_t *ras);
+size_t PassThrough(raster_t *ras);
+ppd_file_t *OpenPPD(const char *filename);
+int PrintJob(int argc, char *argv[], const char *ppdfile);
+void WarmWorker(void);
+int WorkerJob(int argc, char *argv[], const char *ppdfile);
+int Daemon(int argc, char *argv[]);
+
+/*
+ * 'Option()' - Get the choice of an option.
+ *
+ * The marked choice of the PPD file; without a PPD file, the job option
+ * or the default of the model, which is the one of its PPD file.
+ */
+const char *				/* O - Choice, "" if unknown */
+Option(ppd_file_t *ppd,			/* I - PPD file or NULL */
+       const char *name)		/* I - Option name */
+{
+  ppd_choice_t	*choice;		/* Marked choice */
+  const char	*value;			/* Value of option */
+
+
+  if (ppd && (choice = ppdFindMarkedChoice(ppd, name)) != NULL)
+    return (choice->choice);
+
+  if ((value = cupsGetOption(name, NumOptions, Options)) == NULL &&
+      (value = tpclModelDefault(Model, name)) == NULL)
+    value = "";
+
+  return (value);
+}
 
-void TOPIXCompress(ppd_file_t *ppd, cups_page_header2_t *header, int y);
-void TOPIXCompressOutputBuffer(ppd_file_t *ppd, cups_page_header2_t *header, int y);
 
 /*
  * 'Setup()' - Prepare the printer for printing.
  */
 void Setup(ppd_file_t *ppd)			/* I - PPD file */
 {
-  char		*Fadjm;			/* Fine adjust printing position */
-  char		*Radj;			/* Ribbon adjust parameter */
-  ppd_choice_t	*choice;		/* Marked choice */
-  /* initialize Fadjm */
-  Fadjm = (char *) malloc(INTSIZE +2); /* Advanced parameters for printer */
-  Radj  = (char *) malloc(INTSIZE +2); /* Ribbon ajust parameter */
+  tpcl_setup_t	setup;			/* Printer setup */
 
   /*
    * Get the model number from the PPD file.
    * This is not yet used for anything.
    */
-  ModelNumber = ppd->model_number;
-
-  /*
-   * Always send a reset command. Helps with reliability on failed jobs.
-   */
-  puts("{WS|}");
+  ModelNumber = ppd ? ppd->model_number : 0;
 
   /*
    * Modification to take in consideration feed ajust reverse feed etc
    */
-  strcpy(Fadjm,"{AX;"); /* Place command start */
+  memset(&setup, 0, sizeof(setup));
+
   /* feed adjust */
-  choice = ppdFindMarkedChoice(ppd, "FAdjSgn");
-  switch (atoi(choice->choice))
-  {
-    case 0 :
-      strcat(Fadjm,"+");
-      break;
-    case 1 :
-      strcat(Fadjm,"-");
-      break;
-    default :
-      strcat(Fadjm,"+");
-      break;
-  }
-  choice = ppdFindMarkedChoice(ppd, "FAdjV");
-  strcat(Fadjm,choice->choice);
+  setup.feed_adjust = atoi(Option(ppd, "FAdjV"));
+  if (!strcmp(Option(ppd, "FAdjSgn"), "1"))
+    setup.feed_adjust = -setup.feed_adjust;
 
   /* Cut adjust peel adjust */
-  choice = ppdFindMarkedChoice(ppd, "CAdjSgn");
-  switch (atoi(choice->choice))
-  {
-    case 0 :
-      strcat(Fadjm,",+");
-      break;
-    case 1 :
-      strcat(Fadjm,",-");
-      break;
-    default :
-      strcat(Fadjm,",+");
-      break;
-  }
-  choice = ppdFindMarkedChoice(ppd, "CAdjV");
-  strcat(Fadjm,choice->choice);
+  setup.cut_adjust = atoi(Option(ppd, "CAdjV"));
+  if (!strcmp(Option(ppd, "CAdjSgn"), "1"))
+    setup.cut_adjust = -setup.cut_adjust;
 
   /* back feed adjust */
-  choice = ppdFindMarkedChoice(ppd, "RAdjSgn");
-  switch (atoi(choice->choice))
-  {
-    case 0 :
-      strcat(Fadjm,",+");
-      break;
-    case 1 :
-      strcat(Fadjm,",-");
-      break;
-    default :
-      strcat(Fadjm,",+");
-      break;
-  }
+  setup.backfeed_adjust = atoi(Option(ppd, "RAdjV"));
+  if (!strcmp(Option(ppd, "RAdjSgn"), "1"))
+    setup.backfeed_adjust = -setup.backfeed_adjust;
+
+  /* Ribbon Motor setup parameters */
+  setup.ribbon_forward = atoi(Option(ppd, "RbnAdjFwd")); /* value for take up motor */
+  setup.ribbon_back = atoi(Option(ppd, "RbnAdjBck"));
+
+  /*
+   * Low latency mode sends the first TOPIX bands of a page early, so
+   * the printer starts receiving while the page is still encoded...
+   */
+  if (!strcmp(Option(ppd, "teLatency"), "1"))
+    tpclSetLatency(Job, TPCL_BAND_LINES, TPCL_BAND_MSECS);
+  else
+    tpclSetLatency(Job, 0, 0);
+
+  /*
+   * Parallel encoding holds whole pages back, so it is left off in low
+   * latency mode...
+   */
+  Threads = 0;
 
-  choice = ppdFindMarkedChoice(ppd, "RAdjV");
-  strcat(Fadjm,choice->choice);
+  if (!strcmp(Option(ppd, "teParallel"), "1") &&
+      strcmp(Option(ppd, "teLatency"), "1"))
+  {
+    Threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
 
-  /* close the command */
-  strcat(Fadjm,"|}");
-  /* send the command */
-  puts(Fadjm); /*send advanced parameters */
+    if (Threads > PARALLEL_MAX)
+      Threads = PARALLEL_MAX;
+    else if (Threads < 2)
+      Threads = 0;
+  }
 
-  /* Send ribbon Motor setup parameters */
-  strcpy(Radj,"{RM;");	/* start command for ribbon */
-  choice = ppdFindMarkedChoice(ppd, "RbnAdjFwd");
-  strcat(Radj,choice->choice); /* value for take up motor */
-  choice = ppdFindMarkedChoice(ppd, "RbnAdjBck");
-  strcat(Radj,choice->choice);
-  strcat(Radj,"|}");
-  puts(Radj);
+  /*
+   * Banners on continuous media are sent in segments, so the printer
+   * starts printing early and the label size stays within 4 digits...
+   */
+  tpclSetSegment(Job, TPCL_SEGMENT_LENGTH);
 
+  /*
+   * Always starts with a reset command. Helps with reliability on failed
+   * jobs.
+   */
+  tpclStartJob(Job, &setup);
 }
 
 
@@ -198,18 +303,31 @@ void
 StartPage(ppd_file_t         *ppd,	/* I - PPD file */
           cups_page_header2_t *header)	/* I - Page header */
 {
-  ppd_choice_t  *choice;		/* Marked choice */
-  int           labelgap;		/* length of labelgap */
-  int           labelpitch; /* label pitch, distance from start of one label to the next */
-  int         	length;			/* Effective label length */
-  int 		      width;			/* Effective label width */
-  char		      *Fadjt;			/* Fine adjust temperature */
+  tpcl_page_t   page;			/* Page settings */
 
-#if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
-  struct sigaction action;		/* Actions for POSIX signals */
-#endif /* HAVE_SIGACTION && !HAVE_SIGSET */
+  /*
+   * Register a signal handler to eject the current page if the
+   * job is canceled.
+   */
+  CatchCancel(CancelJob);
+
+  PageSettings(ppd, header, &page);
 
-  Fadjt = (char *) malloc(INTSIZE +2);
+  tpclStartPage(Job, &page);
+}
+
+
+/*
+ * 'PageSettings()' - Get the settings of a page from its header and the PPD.
+ */
+void
+PageSettings(ppd_file_t          *ppd,	/* I - PPD file */
+             cups_page_header2_t *header,	/* I - Page header */
+             tpcl_page_t         *settings)	/* O - Page settings */
+{
+  const char    *choice;		/* Choice of option */
+  tpcl_page_t   page;			/* Page settings */
+  int           changed;		/* Settings changed for the model */
 
   /*
    * Show page device dictionary...
@@ -258,23 +376,7 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   fprintf(stderr, "DEBUG: cupsColorSpace = %d\n", header->cupsColorSpace);
   fprintf(stderr, "DEBUG: cupsCompression = %d\n", header->cupsCompression);
 
-  /*
-   * Register a signal handler to eject the current page if the
-   * job is canceled.
-   */
-#ifdef HAVE_SIGSET /* Use System V signals over POSIX to avoid bugs */
-  sigset(SIGTERM, CancelJob);
-#elif defined(HAVE_SIGACTION)
-  memset(&action, 0, sizeof(action));
-
-  sigemptyset(&action.sa_mask);
-  action.sa_handler = CancelJob;
-  sigaction(SIGTERM, &action, NULL);
-#else
-  signal(SIGTERM, CancelJob);
-#endif /* HAVE_SIGSET */
-
-  // printf("{XJ;Page Start|}");
+  memset(&page, 0, sizeof(page));
 
   /*
    * First paper size Dxxxx,xxxx,xxxx
@@ -283,142 +385,124 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
    */
 
   /* Get labelgap for printing */
-  choice = ppdFindMarkedChoice(ppd, "Gap");
-  labelgap = atoi(choice->choice) * 10;
+  page.gap = atoi(Option(ppd, "Gap")) * 10;
 
   /* Calculate page widths and heights */
-  length = (int) (header->cupsPageSize[1] * 254/72);
-  labelpitch = length + labelgap;
-  width = (int) (header->cupsPageSize[0] * 254/72);
+  page.length = (int) (header->cupsPageSize[1] * 254/72);
+  page.width  = (int) (header->cupsPageSize[0] * 254/72);
 
-  /* Send label size, assume gap is same all the way round */
-  printf("{D%04d,%04d,%04d,%04d|}\n",labelpitch, width, length, width + labelgap);
+  /*
+   * Temperature fine adjust, uses number from PPD less 11.
+   */
+  if (header->cupsCompression >= 1 && header->cupsCompression <= 21)
+    page.darkness = (int)header->cupsCompression - 11;
 
   /*
-   * Place the right command in the parameter AY temperature fine adjust
-   * Uses number from PPD less 11.
+   * Set with or without ribbon mode from media type
    */
-  switch (header->cupsCompression)
-  {
-    case 1 :
-      strcpy(Fadjt,"{AY;-10,");
+  if (!strcmp(header->MediaType, "Thermal"))
+    page.media = TPCL_MEDIA_THERMAL;
+  else if (!strcmp(header->MediaType, "Thermal2"))
+    page.media = TPCL_MEDIA_THERMAL2;
+  else
+    page.media = TPCL_MEDIA_DIRECT;
+
+  /* Get graphics mode from ppd file for graphics drawing */
+  switch (atoi(Option(ppd, "teGraphicsMode"))) {
+    case 5:
+      page.gmode = TEC_GMODE_NIBBLE_OR; // OR drawing nibble mode
       break;
-    case 2 :
-      strcpy(Fadjt,"{AY;-09,");
+    case 4:
+      page.gmode = TEC_GMODE_NIBBLE_AND; // AND drawing nibble mode
       break;
-    case 3 :
-      strcpy(Fadjt,"{AY;-08,");
+    case 3:
+      page.gmode = TEC_GMODE_HEX_OR; // OR drawing hex mode
       break;
-    case 4 :
-      strcpy(Fadjt,"{AY;-07,");
+    case 2:
+      page.gmode = TEC_GMODE_HEX_AND; // AND drawing hex mode
       break;
+    case 1:
+    default:
+      page.gmode = TEC_GMODE_TOPIX;
+  }
+
+  page.bytes_per_line = header->cupsBytesPerLine;
+  page.lines          = header->cupsHeight;
+  page.copies         = (int)header->NumCopies;
+
+  /*
+   * Set media tracking...
+   */
+  choice = Option(ppd, "teMediaTracking");
+  if (choice[0] >= '0' && choice[0] <= '4')
+    page.detect = choice[0] - '0';
+
+  /*
+   * Set print mode...
+   */
+  page.mode = 'C';
+  if (header->CutMedia) /* coupe active */
+    page.eject = 1;
+  else
+  {
+    choice = Option(ppd, "tePrintMode");
+    if (!strcmp(choice, "1"))
+      page.mode = 'D';
+    else if (!strcmp(choice, "2"))
+      page.mode = 'E';
+    else if (!strcmp(choice, "3"))
+      page.eject = 1;
+  }
+
+  /*
+   * Set print rate, the speed is selected from the printer parameter
+   * choice...
+   */
+  page.speed = '3';
+  choice = Option(ppd, "tePrintRate");
+  switch (atoi(choice))
+  {
+    case 2 :
+    case 3 :
+    case 4 :
     case 5 :
-      strcpy(Fadjt,"{AY;-06,");
-      break;
     case 6 :
-      strcpy(Fadjt,"{AY;-05,");
-      break;
-    case 7 :
-      strcpy(Fadjt,"{AY;-04,");
-      break;
     case 8 :
-      strcpy(Fadjt,"{AY;-03,");
-      break;
-    case 9 :
-      strcpy(Fadjt,"{AY;-02,");
+      page.speed = choice[0];
       break;
     case 10 :
-      strcpy(Fadjt,"{AY;-01,");
-      break;
-    case 11 :
-      strcpy(Fadjt,"{AY;+00,");
-      break;
-    case 12 :
-      strcpy(Fadjt,"{AY;+01,");
-      break;
-    case 13 :
-      strcpy(Fadjt,"{AY;+02,");
-      break;
-    case 14 :
-      strcpy(Fadjt,"{AY;+03,");
-      break;
-    case 15 :
-      strcpy(Fadjt,"{AY;+04,");
-      break;
-    case 16 :
-      strcpy(Fadjt,"{AY;+05,");
-      break;
-    case 17 :
-      strcpy(Fadjt,"{AY;+06,");
-      break;
-    case 18 :
-      strcpy(Fadjt,"{AY;+07,");
-      break;
-    case 19 :
-      strcpy(Fadjt,"{AY;+08,");
-      break;
-    case 20 :
-      strcpy(Fadjt,"{AY;+09,");
-      break;
-    case 21 :
-      strcpy(Fadjt,"{AY;+10,");
+      page.speed = 'A';
       break;
   }
 
   /*
-   * Completing fine adjust according to Thermal or direct printing
+   * Manage the cut option every label or end of batch print
    */
-  if (strcmp(header->MediaType, "Direct") == 0)
-    strcat(Fadjt,"1|}");
-  else // Thermal transfer mode, with or without ribbon saving
-    strcat(Fadjt,"0|}");
+  page.cut_interval = header->cupsRowStep == 1 ? 1 : 0;
 
   /*
-   * Send parameter to printer
+   * Version 1.2 Mirror option not managed local management
    */
-  puts(Fadjt);
-
-  //printf("{T|}\n");   /* Feed one sheet of paper */
-  printf("{C|}\n"); 	/* clear image buffer */
-
-  /* Get graphics mode from ppd file for graphics drawing */
-  choice = ppdFindMarkedChoice(ppd,"teGraphicsMode");
-  switch (atoi(choice->choice)) {
-    case 3:
-      Gmode = TEC_GMODE_HEX_OR; // OR drawing hex mode
-      break;
-    case 2:
-      Gmode = TEC_GMODE_HEX_AND; // AND drawing hex mode
-      break;
-    case 1:
-    default:
-      Gmode = TEC_GMODE_TOPIX;
-  }
+  page.mirror = atoi(Option(ppd, "PrintOrient"));
 
-  // Only print the graphics if NOT in TOPIX mode!
-  if (Gmode != TEC_GMODE_TOPIX)
-  {
-    printf("{SG;0000,0000,%04d,%04d,%d,", header->cupsBytesPerLine * 8, header->cupsHeight, Gmode);
-  }
-  else
+  /*
+   * Keep the label within what the model supports...
+   */
+  if (Model && (changed = tpclModelCheck(Model, &page)) != 0)
   {
-    /*
-     * Allocate buffers for 8 dots per byte graphics ready for TOPIX compression
-     */
-    LastBuffer = malloc(header->cupsBytesPerLine);
-    memset(LastBuffer, 0, header->cupsBytesPerLine);
-    // Allocate big chunk of memory for parts of TOPIX image
-    CompBuffer = malloc(0xFFFF);
-    memset(CompBuffer, 0, 0xFFFF);
-    CompBufferPtr = CompBuffer;
-    CompLastLine = 0;
+    if (changed & (TPCL_CHECK_WIDTH | TPCL_CHECK_LENGTH))
+      fprintf(stderr, "WARNING: Label size changed to %.1f x %.1f mm for "
+              "the %s.\n", page.width / 10.0, page.length / 10.0,
+              Model->model);
+    if (changed & TPCL_CHECK_MEDIA)
+      fprintf(stderr, "WARNING: Media type not supported by the %s.\n",
+              Model->model);
+    if (changed & TPCL_CHECK_SPEED)
+      fprintf(stderr, "WARNING: Print speed changed to %c for the %s.\n",
+              page.speed, Model->model);
   }
 
-  /*
-   * Allocate memory for a line of graphics...
-   */
-  Buffer = malloc(header->cupsBytesPerLine);
-  Feed   = 0;
+  *settings = page;
 }
 
 
@@ -429,211 +513,42 @@ void
 EndPage(ppd_file_t *ppd,		/* I - PPD file */
         cups_page_header2_t *header)	/* I - Page header */
 {
-  char		      *Dummy;			/* dummy chars workaround bev4t last tcp packet lost bug V1.1G*/
-  unsigned int 	Tmedia;			/* type of media */
-  char          *Tmode;			/* Print mode */
-  unsigned int  Tmirror;		/* Mirror print */
-  unsigned int  tstat;			/* with or without status */
-  unsigned int  detect;			/* type of label sensor*/
-  char  	      *Tspeed;		/* print Speed */
-  unsigned int  Tcut;			  /* Cut quantity */
-  unsigned int  CutActive;	/* Activate cutter */
-  ppd_choice_t  *choice;		/* Marked choice */
-
-#if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
-  struct sigaction action;		/* Actions for POSIX signals */
-#endif /* HAVE_SIGACTION && !HAVE_SIGSET */
-
-  Dummy = (char *) malloc(600);
-  Tmode = (char *) malloc(INTSIZE +2);
-  Tspeed = (char *) malloc(INTSIZE +2);
-  detect = 0;
-  CutActive =0;
+  double	start = Now();		/* Start of encoding */
+  int		canceled;		/* Canceled before the label ended */
 
-  memset(Dummy, 0, 600);
-  /* Initialise printing defaults */
-	Tmedia =0;
-	Tmirror=0;
-	tstat =0;
-	strcpy(Tmode,"C\0");
-	strcpy(Tspeed,"3\0");
+  (void)ppd;
 
   /*
-   * Terminate sending graphics.
-   * If not in TOPIX mode, we also need to close the raw graphics output.
+   * Terminate sending graphics and eject, or clear the image buffer in
+   * case of error...
    */
-  if (Gmode == TEC_GMODE_TOPIX)
-    TOPIXCompressOutputBuffer(ppd, header, 0);
-  else
-    printf("|}\n");
-
-
-  if (Canceled)
-  {
-    /*
-     * Ramclear in case of error
-     */
-    puts("{WR|}");
-
-  } else {
-
-    /*
-     * Set media tracking...
-     */
-    if (ppdIsMarked(ppd, "teMediaTracking", "0"))
-      detect = 0;
-    else if (ppdIsMarked(ppd, "teMediaTracking", "1"))
-      detect = 1;
-    else if (ppdIsMarked(ppd, "teMediaTracking", "2"))
-      detect = 2;
-    else if (ppdIsMarked(ppd, "teMediaTracking", "3"))
-      detect= 3;
-    else if (ppdIsMarked(ppd, "teMediaTracking", "4"))
-      detect = 4;
-
-    //	printf("{XJ;End Page %d|}",detect);
-    /*
-     * Set print mode...
-     */
-    if (header->CutMedia) /* coupe active */
-    {
-      strcpy(Tmode,"C\0");
-      CutActive =1;
-    }
-    else
-    {
-      if ((choice = ppdFindMarkedChoice(ppd, "tePrintMode")) != NULL &&
-        strcmp(choice->choice, "0"))
-      {
-        strcpy(Tmode,"C\0");
-        if (!strcmp(choice->choice,"1"))
-          strcpy(Tmode,"D\0");
-        else if (!strcmp(choice->choice, "2"))
-          strcpy(Tmode,"E\0");
-        else if (!strcmp(choice->choice, "3"))
-        {
-          strcpy(Tmode,"C\0");
-          CutActive =1;
-        }
-      }
-    }
-    /*
-     * Set print rate...
-     */
-    choice = ppdFindMarkedChoice(ppd, "tePrintRate");
-
-    /* The speed is selected from the printer parameter choice */
-    switch (atoi(choice->choice))
-    {
-      case 2 :
-        strcpy(Tspeed,"2\0");
-        break;
-      case 3 :
-        strcpy(Tspeed,"3\0");
-        break;
-      case 4 :
-        strcpy(Tspeed,"4\0");
-        break;
-      case 5 :
-        strcpy(Tspeed,"5\0");
-        break;
-      case 6 :
-        strcpy(Tspeed,"6\0");
-        break;
-      case 8 :
-        strcpy(Tspeed,"8\0");
-        break;
-      case 10 :
-        strcpy(Tspeed,"A\0");
-        break;
-    }
-
-    /*
-     * Set with or without ribbon mode from media type
-     */
-    if (!strcmp(header->MediaType, "Direct"))
-      Tmedia = 0;
-    else if (!strcmp(header->MediaType, "Thermal"))
-      Tmedia = 1;
-    else if (!strcmp(header->MediaType,"Thermal2"))
-      Tmedia = 2;
-
-    /* status response */
-    tstat = 0;
-
-    /*
-     * Manage the cut option every label or end of batch print
-     */
-    switch (header->cupsRowStep)
-    {
-      case 0 :
-        Tcut =0;
-        break;
-      case 1 :
-        Tcut =1;
-        break;
-      case 999 :
-        Tcut =0;
-        break;
-      default:
-        Tcut= 0;
-        break;
-    }
-
-    /*
-     * Version 1.2 Mirror option not managed local management
-     */
-    if ((choice = ppdFindMarkedChoice(ppd, "PrintOrient")) != NULL)
-      Tmirror = atoi(choice->choice);
-    else
-      Tmirror = 0;
-
-    /*
-     * End the label and eject...
-     */
-    // printf("{PV00;0010,%4d,0020,0020,A,00,B=----Hello Linux World From S.K.E----- |}\n",header->PageSize[1]*254/72 - 50);
-    // printf("{PC01;0010,%4d,05,05,O,00,B= Only Man gives names and value to things (P.Kong)|}\n",header->PageSize[1]*254/72 - 30);
-    printf("{XS;I,%04d,%03d%d%s%s%d%d%d|}\n",header->NumCopies,Tcut,detect,Tmode,Tspeed,Tmedia,Tmirror,tstat);
-
-    /* Send eject command if cut active */
-    if (CutActive > 0)
-      printf("{IB|}\n");
-
-      // To avoid Zerowindow Error at the end of the stream
-      // https://github.com/icrebollo/rastertotpcl/commit/46704d69a4ebd2dcfe1d98136c683dc7bfb7e7b4
-      printf("%1024s","");
-
-  } // Not Cancelled
-
-  fflush(stdout);
-
-  write(1, Dummy, 600);
+  canceled = Canceled;
+  tpclEndPage(Job, canceled);
 
   /*
-   * Unregister the signal handler...
+   * Reset the printer if the job was canceled while the label went out...
    */
+  if (Canceled && !canceled)
+    tpclCancel(Job);
 
-#ifdef HAVE_SIGSET /* Use System V signals over POSIX to avoid bugs */
-  sigset(SIGTERM, SIG_IGN);
-#elif defined(HAVE_SIGACTION)
+  /*
+   * Count the page, leaving out the time spent waiting for the printer...
+   */
+  Encoding += Now() - start;
 
-  memset(&action, 0, sizeof(action));
+  metricsAdd(&Metrics->pages, 1);
+  metricsAdd(&Metrics->labels, header->NumCopies > 0 ? header->NumCopies : 1);
+  metricsObserve(&Metrics->encode, Encoding - Stalled);
 
-  sigemptyset(&action.sa_mask);
-  action.sa_handler = SIG_IGN;
-  sigaction(SIGTERM, &action, NULL);
-#else
-  signal(SIGTERM, SIG_IGN);
-#endif /* HAVE_SIGSET */
+  Encoding = 0.0;
+  Stalled  = 0.0;
 
   /*
-   * Free memory...
+   * Unregister the signal handler...
    */
-  if (Gmode == TEC_GMODE_TOPIX) {
-    free(LastBuffer);
-    free(CompBuffer);
-  }
-  free(Buffer);
+  CatchCancel(SIG_IGN);
+
+  Buffer = NULL;			/* Owned by the raster reader */
 }
 
 
@@ -647,198 +562,600 @@ CancelJob(int sig)			/* I - Signal */
   * Tell the main loop to stop...
   */
   (void)sig;
-  Canceled = 1;
+  __atomic_store_n(&Canceled, 1, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * 'CatchCancel()' - Set the handler of the cancel signal.
+ */
+void
+CatchCancel(void (*handler)(int))	/* I - Signal handler or SIG_IGN */
+{
+#if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
+  struct sigaction action;		/* Actions for POSIX signals */
+#endif /* HAVE_SIGACTION && !HAVE_SIGSET */
+
+
+#ifdef HAVE_SIGSET /* Use System V signals over POSIX to avoid bugs */
+  sigset(SIGTERM, handler);
+#elif defined(HAVE_SIGACTION)
+  memset(&action, 0, sizeof(action));
+
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = handler;
+  sigaction(SIGTERM, &action, NULL);
+#else
+  signal(SIGTERM, handler);
+#endif /* HAVE_SIGSET */
 }
 
 
 /*
  * 'OutputLine()' - Output a line of graphics.
- *
- * Some versions of this method check to see if the Buffer has data, this doesn't.
- * Empty lines can often be skipped if the buffer is checked.
  */
 void
 OutputLine(ppd_file_t           *ppd,	    /* I - PPD file */
            cups_page_header2_t  *header,	/* I - Page header */
            int                  y)	      /* I - Line number */
 {
+  double	start = Now();		/* Start of encoding */
 
-  if (Gmode == TEC_GMODE_TOPIX) {
-    TOPIXCompress(ppd, header, y);
-  } else {
-    // Hex Output
-    fwrite(Buffer, 1, header->cupsBytesPerLine, stdout);
-  }
+  (void)ppd;
+  (void)header;
 
-}
+  tpclWriteLine(Job, Buffer, (unsigned)y);
 
+  Encoding += Now() - start;
+}
 
 
 /*
- * 'TOPIXCompress()' - Apply TOPIX compression mechanism to current data in buffers
+ * 'WriteOutput()' - Write encoded data to stdout.
  */
-void
-TOPIXCompress(ppd_file_t         *ppd,	    /* I - PPD file */
-              cups_page_header2_t *header,	/* I - Page header */
-              int                y)         /* Line number */
+ssize_t
+WriteOutput(void       *data,		/* I - Unused */
+            const void *buffer,		/* I - Data */
+            size_t     bytes)		/* I - Number of bytes */
 {
-  int               i;              /* Index into Buffer */
-  int               max;            /* Max number of items per line */
-  unsigned char     line[8][9][9] = {0};  /* Current line */
-  int               l1, l2, l3;     /* Current Positions in line */
-  unsigned char     cl1, cl2, cl3;  /* Current Characters */
+  ssize_t	count;			/* Bytes written */
+  double	start = Now(),		/* Start of write */
+		elapsed;		/* Time spent writing */
 
-  int               width;          /* Max width of the line */
-  unsigned char     xor;      /* Current XORed character */
-  unsigned char     *ptr;     /* Pointer into the Compressed Line Buffer */
+  (void)data;
 
+  while ((count = write(1, buffer, bytes)) < 0 && errno == EINTR);
 
-  width = header->cupsBytesPerLine;
-  max = 8 * 9 * 9;
+  elapsed  = Now() - start;
+  Stalled += elapsed;
+  metricsObserve(&Metrics->stall, elapsed);
 
-  /*
-   * Ensure that we will not overrun the buffer by sending
-   * to stdout when we get to the danger zone (width + ((width / 8) * 3))
-   * This will create multiple graphics objects depending on the size of the image.
-   */
-  if ((CompBufferPtr - CompBuffer) > (0xFFFF - (width + (ceil(width / 8) * 3)))) {
-    TOPIXCompressOutputBuffer(ppd, header, y);
-    memset(LastBuffer, 0, header->cupsBytesPerLine);
-  }
+  return (count);
+}
 
-  /*
-   * Perform XOR on raw data for TOPIX data
-   */
-  cl1 = 0;
-  i = 0;
-  for (l1 = 0; l1 <= 7 && i < width; l1++)
-  {
-    cl2 = 0;
-    for (l2 = 1; l2 <= 8 && i < width; l2++)
+
+/*
+ * 'Now()' - Get the monotonic time in seconds.
+ */
+double					/* O - Time in seconds */
+Now(void)
+{
+  struct timespec	ts;		/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+
+/*
+ * 'OpenPPD()' - Open a PPD file, from the cache of a daemon worker.
+ */
+ppd_file_t *				/* O - PPD file or NULL */
+OpenPPD(const char *filename)		/* I - PPD file name */
+{
+  int		i;			/* Looping var */
+  struct stat	info;			/* File information */
+  ppd_cache_t	*cache;			/* New cache entries */
+  ppd_file_t	*ppd;			/* PPD file */
+
+
+  if (!DaemonMode)
+    return (filename ? ppdOpenFile(filename) : NULL);
+
+  if (!filename || stat(filename, &info))
+    return (NULL);
+
+  for (i = 0; i < NumPPDs; i ++)
+    if (!strcmp(PPDs[i].filename, filename))
     {
-      cl3 = 0;
-      for (l3 = 1; l3 <= 8 && i < width; l3++, i++)
+      if (PPDs[i].mtime == info.st_mtime)
+        return (PPDs[i].ppd);
+
+      if ((ppd = ppdOpenFile(filename)) != NULL)
       {
-        xor = Buffer[i] ^ LastBuffer[i];
-        line[l1][l2][l3] = xor;
-        if (xor > 0) {
-          // There is a change! Ensure its recorded
-          cl3 |= (1 << (8 - l3));
-        }
-      } // L3
+        ppdClose(PPDs[i].ppd);
+        PPDs[i].ppd   = ppd;
+        PPDs[i].mtime = info.st_mtime;
+      }
+
+      return (ppd);
+    }
 
-      line[l1][l2][0] = cl3;
-      if (cl3 != 0)
-        cl2 |= (1 << (8 - l2));
-    } // L2
+  if ((ppd = ppdOpenFile(filename)) == NULL)
+    return (NULL);
 
-    line[l1][0][0] = cl2;
-    if (cl2 != 0)
-      cl1 |= (1 << (7 - l1));
-  } // L1
+  if ((cache = realloc(PPDs, (size_t)(NumPPDs + 1) * sizeof(ppd_cache_t))) ==
+          NULL)
+  {
+    ppdClose(ppd);
+    return (NULL);
+  }
 
+  PPDs                   = cache;
+  PPDs[NumPPDs].filename = strdup(filename);
+  PPDs[NumPPDs].mtime    = info.st_mtime;
+  PPDs[NumPPDs].ppd      = ppd;
+  NumPPDs ++;
 
-  // Always add CL1 for line
-  *CompBufferPtr = cl1;
-  CompBufferPtr++;
+  return (ppd);
+}
 
-  /*
-   * Copy the line into the compressed buffer with all the
-   * white space removed.
-   */
-  if (cl1 > 0) {
-    ptr = &line[0][0][0];
-    for(i = 0; i < max; i++) {
-      if (*ptr != 0) {
-        *CompBufferPtr = *ptr;
-        CompBufferPtr++;
-      }
-      ptr++;
+
+/*
+ * 'PoolWait()' - Wait for a change in a page pool.
+ *
+ * The wait is limited, so threads notice a cancel that nobody signals.
+ */
+void
+PoolWait(page_pool_t *pool)		/* I - Page pool */
+{
+  struct timespec	until;		/* End of wait */
+
+
+  clock_gettime(CLOCK_REALTIME, &until);
+
+  if ((until.tv_nsec += 100000000) >= 1000000000)
+  {
+    until.tv_sec ++;
+    until.tv_nsec -= 1000000000;
+  }
+
+  pthread_cond_timedwait(&pool->cond, &pool->lock, &until);
+}
+
+
+/*
+ * 'PageOutput()' - Collect encoded data of a page.
+ */
+ssize_t					/* O - Bytes taken or -1 on error */
+PageOutput(void       *data,		/* I - Page slot */
+           const void *buffer,		/* I - Data */
+           size_t     bytes)		/* I - Number of bytes */
+{
+  page_slot_t	*slot = *(page_slot_t **)data;
+					/* Page being encoded */
+  unsigned char	*temp;			/* New output buffer */
+  size_t	size;			/* New size of output buffer */
+
+
+  if (slot->outlen + bytes > slot->outsize)
+  {
+    for (size = slot->outsize ? slot->outsize : 65536;
+         size < slot->outlen + bytes; size *= 2);
+
+    if ((temp = realloc(slot->output, size)) == NULL)
+      return (-1);
+
+    slot->output  = temp;
+    slot->outsize = size;
+  }
+
+  memcpy(slot->output + slot->outlen, buffer, bytes);
+  slot->outlen += bytes;
+
+  return ((ssize_t)bytes);
+}
+
+
+/*
+ * 'EncodePages()' - Encode pages of a parallel job.
+ *
+ * Every thread encodes the next page that was read into the output buffer
+ * of its slot, using an encoder of its own.
+ */
+void *					/* O - NULL */
+EncodePages(void *data)			/* I - Page pool */
+{
+  page_pool_t	*pool = (page_pool_t *)data;
+					/* Page pool */
+  page_slot_t	*slot = NULL;		/* Page being encoded */
+  tpcl_job_t	*job;			/* Encoder */
+  unsigned	y;			/* Current line */
+  double	start;			/* Start of encoding */
+
+
+  if ((job = tpclJobNew(PageOutput, &slot)) == NULL)
+  {
+    pthread_mutex_lock(&pool->lock);
+    pool->error = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return (NULL);
+  }
+
+  tpclSetSegment(job, TPCL_SEGMENT_LENGTH);
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (;;)
+  {
+    if (pool->error || __atomic_load_n(&Canceled, __ATOMIC_RELAXED))
+      break;
+    else if (pool->next_encode < pool->next_read)
+    {
+      slot = pool->slots + pool->next_encode % pool->num_slots;
+      pool->next_encode ++;
+
+      pthread_mutex_unlock(&pool->lock);
+
+      start        = Now();
+      slot->outlen = 0;
+
+      tpclJobReset(job);
+      tpclStartPage(job, &slot->page);
+
+      for (y = 0; y < slot->lines; y ++)
+        tpclWriteLine(job, slot->raster + y * slot->page.bytes_per_line, y);
+
+      tpclEndPage(job, 0);
+
+      slot->encoding = Now() - start;
+
+      pthread_mutex_lock(&pool->lock);
+
+      if (tpclJobError(job))
+        pool->error = 1;
+
+      slot->state = SLOT_ENCODED;
+      pthread_cond_broadcast(&pool->cond);
     }
+    else if (pool->done)
+      break;
+    else
+      PoolWait(pool);
   }
 
-  /*
-   * Copy line into last buffer ready for next loop
-   */
-  memcpy(LastBuffer, Buffer, header->cupsBytesPerLine);
+  pthread_mutex_unlock(&pool->lock);
+
+  tpclJobDelete(job);
+
+  return (NULL);
 }
 
+
 /*
- * 'TOPIXCompressOutputBuffer()' - Send a set of data to output.
+ * 'WritePages()' - Write encoded pages in order.
  *
- * Set y to 0 if this is the last line.
+ * A page that has started to go out is always completed, so a cancel
+ * leaves the printer between two commands.
  */
-void TOPIXCompressOutputBuffer(ppd_file_t          *ppd,	   /* PPD file */
-                               cups_page_header2_t *header,	 /* Page header */
-                               int                 y)        /* Line number */
+void *					/* O - NULL */
+WritePages(void *data)			/* I - Page pool */
 {
-  unsigned short len;
-  unsigned short belen; /* Big-endian short! */
+  page_pool_t	*pool = (page_pool_t *)data;
+					/* Page pool */
+  page_slot_t	*slot;			/* Page to write */
+  size_t	pos;			/* Bytes of page written */
+  ssize_t	count;			/* Bytes written at a time */
 
-  len = (unsigned short) (CompBufferPtr - CompBuffer);
-  if (len == 0)
-    return;
 
-  fprintf(stderr, "DEBUG: Sending output with length: %04x \n", len);
+  pthread_mutex_lock(&pool->lock);
 
-  // Convert into Big Endian (This may be OS dependant!)
-  belen = (len << 8 | len >> 8);
+  for (;;)
+  {
+    slot = pool->slots + pool->next_write % pool->num_slots;
 
-  /*
-   * Output the complete graphics line to STDOUT
-   */
-  printf("{SG;0000,%04d,%04d,%04d,%d,", CompLastLine, header->cupsBytesPerLine * 8, 300, Gmode);
-  fwrite(&belen, 2, 1, stdout);       // Length of data
-  fwrite(CompBuffer, 1, len, stdout); // Data
-  printf("|}\n");
-  fflush(stdout);
+    if (__atomic_load_n(&Canceled, __ATOMIC_RELAXED) || pool->error ||
+        (pool->done && pool->next_write == pool->next_read))
+      break;
+    else if (pool->next_write == pool->next_read ||
+             slot->state != SLOT_ENCODED)
+    {
+      PoolWait(pool);
+      continue;
+    }
 
-  if (y) CompLastLine = y;
+    pthread_mutex_unlock(&pool->lock);
 
-  /*
-   * Reset the Compressed Buffer
-   */
-  memset(CompBuffer, 0, 0xFFFF);
-  CompBufferPtr = CompBuffer;
+    Stalled = 0.0;
+
+    for (pos = 0; pos < slot->outlen; pos += (size_t)count)
+      if ((count = WriteOutput(NULL, slot->output + pos,
+                               slot->outlen - pos)) <= 0)
+        break;
+
+    metricsAdd(&Metrics->pages, 1);
+    metricsAdd(&Metrics->labels, slot->labels);
+    metricsObserve(&Metrics->encode, slot->encoding);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pos < slot->outlen)
+      pool->error = 1;
+
+    pool->bytes += pos;
+    slot->state  = SLOT_FREE;
+    pool->next_write ++;
+
+    pthread_cond_broadcast(&pool->cond);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return (NULL);
 }
 
 
+/*
+ * 'PrintParallel()' - Convert the pages of a job on all cores.
+ *
+ * The calling thread reads the pages into free slots; encoder threads
+ * and the writer take them from there. Up to two pages per thread are in
+ * flight, each with the graphics of the whole page.
+ */
+size_t					/* O - Bytes written */
+PrintParallel(ppd_file_t    *ppd,	/* I - PPD file */
+              raster_t      *ras)	/* I - Raster stream */
+{
+  page_pool_t		*pool;		/* Page pool */
+  page_slot_t		*slot;		/* Page being read */
+  cups_page_header2_t	header;		/* Page header from file */
+  pthread_t		threads[PARALLEL_MAX + 1];
+					/* Encoders and writer */
+  sigset_t		mask,		/* Signals blocked in threads */
+			oldmask;	/* Signals blocked before */
+  unsigned char		*temp;		/* New raster buffer */
+  size_t		size,		/* Size of page graphics */
+			bytes;		/* Bytes written */
+  unsigned		y;		/* Current line */
+  int			i,		/* Looping var */
+			num_threads = 0;/* Threads started */
+
+
+  if ((pool = calloc(1, sizeof(page_pool_t))) == NULL)
+  {
+    fputs("ERROR: Unable to allocate page buffers!\n", stderr);
+    return (0);
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+
+  pool->num_slots = 2 * Threads;
+
+ /*
+  * The setup goes out before the first page...
+  */
+  tpclFlush(Job);
+
+ /*
+  * Start the threads with the cancel signal blocked, so it interrupts the
+  * reader...
+  */
+  CatchCancel(CancelJob);
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+  for (i = 0; i < Threads; i ++)
+    if (!pthread_create(threads + num_threads, NULL, EncodePages, pool))
+      num_threads ++;
+
+  if (num_threads > 0 &&
+      !pthread_create(threads + num_threads, NULL, WritePages, pool))
+    num_threads ++;
+  else
+  {
+    fputs("ERROR: Unable to start encoder threads!\n", stderr);
+    pool->error = 1;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+  fprintf(stderr, "DEBUG: Encoding pages with %d threads.\n", num_threads - 1);
+
+  while (!pool->error && rasterReadHeader(ras, &header))
+  {
+   /*
+    * Wait for a free slot...
+    */
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->next_read - pool->next_write >= pool->num_slots &&
+           !pool->error && !Canceled)
+      PoolWait(pool);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->error || Canceled)
+      break;
+
+    Page++;
+    fprintf(stderr, "PAGE: %d 1\n", Page);
+
+    slot = pool->slots + pool->next_read % pool->num_slots;
+
+    PageSettings(ppd, &header, &slot->page);
+
+    slot->labels = header.NumCopies > 0 ? (int)header.NumCopies : 1;
+    size         = (size_t)header.cupsBytesPerLine * header.cupsHeight;
+
+    if (size > slot->raster_size)
+    {
+      if ((temp = realloc(slot->raster, size)) == NULL)
+      {
+        fputs("ERROR: Unable to allocate page buffers!\n", stderr);
+        pool->error = 1;
+        break;
+      }
+
+      slot->raster      = temp;
+      slot->raster_size = size;
+    }
+
+   /*
+    * Read the graphics of the page...
+    */
+    for (y = 0; y < header.cupsHeight && !Canceled; y++)
+    {
+      if ((y & 15) == 0)
+        fprintf(stderr, "INFO: Printing page %d, %d%% complete...\n", Page,
+	        100 * y / header.cupsHeight);
+
+      if (rasterReadPixels(ras, slot->raster +
+                                (size_t)y * header.cupsBytesPerLine,
+                           header.cupsBytesPerLine) < 1)
+        break;
+
+      metricsAdd(&Metrics->bytes_in, header.cupsBytesPerLine);
+    }
+
+    if (Canceled)
+      break;
+
+    slot->lines = y;
+
+    pthread_mutex_lock(&pool->lock);
+
+    slot->state = SLOT_READ;
+    pool->next_read ++;
+
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+ /*
+  * Let the threads finish the pages read so far...
+  */
+  pthread_mutex_lock(&pool->lock);
+  pool->done = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < num_threads; i ++)
+    pthread_join(threads[i], NULL);
+
+  CatchCancel(SIG_IGN);
+
+  if (Canceled)
+    tpclCancel(Job);
+
+  bytes = pool->bytes;
+
+  for (i = 0; i < pool->num_slots; i ++)
+  {
+    free(pool->slots[i].raster);
+    free(pool->slots[i].output);
+  }
+
+  pthread_cond_destroy(&pool->cond);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+
+  return (bytes);
+}
+
 
 /*
- * 'main()' - Main entry and processing of driver.
+ * 'PassThrough()' - Send a job that is TPCL already.
+ *
+ * Precompiled jobs, e.g. captured filter output printed again, go to the
+ * printer unchanged; the PPD options are not applied. A canceled job is
+ * ended with a printer reset.
  */
+size_t					/* O - Bytes written */
+PassThrough(raster_t *ras)		/* I - Job stream */
+{
+  ssize_t	count;			/* Bytes moved */
+  size_t	bytes = 0;		/* Bytes written */
+  double	start = Now();		/* Start of job */
+
+
+  fputs("INFO: Sending TPCL job unchanged...\n", stderr);
+  fputs("PAGE: 1 1\n", stderr);
+
+  CatchCancel(CancelJob);
+
+  while (!Canceled && (count = rasterPassThrough(ras, 1)) != 0)
+  {
+    if (count < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
 
+      perror("ERROR: Unable to send TPCL job - ");
+      break;
+    }
+
+    bytes += (size_t)count;
+  }
+
+  CatchCancel(SIG_IGN);
+
+  if (Canceled)
+    tpclCancel(Job);
+
+  fprintf(stderr, "DEBUG: Sent %lu bytes of TPCL in %.3f s.\n",
+          (unsigned long)bytes, Now() - start);
+
+  return (bytes);
+}
+
+
+/*
+ * 'PrintJob()' - Convert a raster job.
+ */
 int					/* O - Exit status */
-main(int  argc,				/* I - Number of command-line arguments */
-     char *argv[])			/* I - Command-line arguments */
+PrintJob(int        argc,		/* I - Number of command-line arguments */
+         char       *argv[],		/* I - Command-line arguments */
+         const char *ppdfile)		/* I - PPD file name */
 {
   int           			fd;		  /* File descriptor */
-  cups_raster_t		    *ras;		/* Raster stream for printing */
+  raster_t		    *ras;		/* Raster stream for printing */
   cups_page_header2_t	header;	/* Page header from file */
   int                 y;      /* Current line */
   ppd_file_t          *ppd;   /* PPD file */
   int                 num_options;	/* Number of options */
   cups_option_t       *options;	/* Options */
+  char                queue[256],	/* Queue name */
+                      *ptr;		/* Pointer into queue name */
+  size_t              sent;		/* Bytes written outside of Job */
 
 
-  /*
-   * Make sure status messages are not buffered...
-   */
-  setbuf(stderr, NULL);
-
-  /*
-   * Check command-line...
-   */
   if (argc < 6 || argc > 7)
   {
-    /*
-     * We don't have the correct number of arguments; write an error message
-     * and return.
-     */
     fputs("ERROR: rastertotec job-id user title copies options [file]\n", stderr);
     return (1);
   }
 
+ /*
+  * Count the job for its queue; CUPS names PPD files after the queue...
+  */
+  if ((ptr = strrchr(ppdfile ? ppdfile : "", '/')) != NULL)
+    snprintf(queue, sizeof(queue), "%s", ptr + 1);
+  else
+    snprintf(queue, sizeof(queue), "%s", ppdfile ? ppdfile : "unknown");
+
+  if ((ptr = strrchr(queue, '.')) != NULL && !strcmp(ptr, ".ppd"))
+    *ptr = '\0';
+
+  Metrics = tpcldMetrics(queue);
+  metricsAdd(&Metrics->jobs, 1);
+
  /*
   * Open the page stream...
   */
@@ -854,24 +1171,76 @@ main(int  argc,				/* I - Number of command-line arguments */
   else
     fd = 0;
 
-  ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
+  if ((ras = rasterOpen(fd)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate raster buffers!\n", stderr);
+    if (fd != 0)
+      close(fd);
+    return (1);
+  }
+
+  /*
+   * Jobs that are TPCL already need neither the PPD nor the encoder...
+   */
+  Canceled = 0;
+
+  if (rasterIsTPCL(ras))
+  {
+    sent = PassThrough(ras);
+
+    rasterClose(ras);
+    if (fd != 0)
+      close(fd);
+
+    metricsAdd(&Metrics->bytes_in, sent);
+    metricsAdd(&Metrics->bytes_out, sent);
+
+    if (sent == 0)
+      fputs("ERROR: No pages found!\n", stderr);
+    else
+      fputs("INFO: Ready to print.\n", stderr);
+    return (sent == 0);
+  }
 
  /*
   * Open the PPD file and apply options...
   */
   num_options = cupsParseOptions(argv[5], 0, &options);
 
-  if ((ppd = ppdOpenFile(getenv("PPD"))) != NULL)
+  NumOptions = num_options;
+  Options    = options;
+
+  if ((ppd = OpenPPD(ppdfile)) != NULL)
   {
     ppdMarkDefaults(ppd);
     cupsMarkOptions(ppd, num_options, options);
+
+    if ((Model = tpclModelFind(ppd->pcfilename)) == NULL)
+      Model = tpclModelFind(ppd->modelname);
   }
   else
   {
-    fputs("ERROR: Missing PPD file required for defaults!", stderr);
+    /*
+     * Without a PPD file, as in batch runs, the model table of libtpcl
+     * provides the defaults...
+     */
+    Model = tpclModelFind(cupsGetOption("teModel", num_options, options));
+  }
+
+  if (!ppd && !Model)
+  {
+    fputs("ERROR: Missing PPD file or teModel option required for "
+          "defaults!\n", stderr);
+    rasterClose(ras);
+    if (fd != 0)
+      close(fd);
+    cupsFreeOptions(num_options, options);
     return(1);
   }
 
+  if (Model)
+    fprintf(stderr, "DEBUG: Printer model %s.\n", Model->model);
+
   /*
    * Initialize the print device...
    */
@@ -882,8 +1251,12 @@ main(int  argc,				/* I - Number of command-line arguments */
    */
   Page     = 0;
   Canceled = 0;
+  sent     = 0;
 
-  while (cupsRasterReadHeader2(ras, &header))
+  if (Threads)
+    sent = PrintParallel(ppd, ras);
+
+  while (!Threads && rasterReadHeader(ras, &header))
   {
     /*
      * Write a status message with the page number and number of copies.
@@ -899,6 +1272,9 @@ main(int  argc,				/* I - Number of command-line arguments */
     /*
      * Loop for each line on the page...
      */
+    Encoding = 0.0;
+    Stalled  = 0.0;
+
     for (y = 0; y < header.cupsHeight && !Canceled; y++)
     {
       /*
@@ -911,9 +1287,11 @@ main(int  argc,				/* I - Number of command-line arguments */
       /*
        * Read a line of graphics...
        */
-      if (cupsRasterReadPixels(ras, Buffer, header.cupsBytesPerLine) < 1)
+      if ((Buffer = rasterReadLine(ras)) == NULL)
         break;
 
+      metricsAdd(&Metrics->bytes_in, header.cupsBytesPerLine);
+
       /*
        * Write it to the printer...
        */
@@ -931,16 +1309,26 @@ main(int  argc,				/* I - Number of command-line arguments */
   /*
    * Close the raster stream...
    */
-  cupsRasterClose(ras);
+  rasterClose(ras);
   if (fd != 0)
     close(fd);
 
   /*
    * Close the PPD file and free the options...
    */
-  ppdClose(ppd);
+  if (!DaemonMode && ppd)
+    ppdClose(ppd);
   cupsFreeOptions(num_options, options);
 
+  NumOptions = 0;
+  Options    = NULL;
+
+  if (tpclJobFirstByte(Job) >= 0.0)
+    fprintf(stderr, "DEBUG: Time to first byte %.3f ms, %lu bytes sent.\n",
+            tpclJobFirstByte(Job) * 1000.0, (unsigned long)tpclJobBytes(Job));
+
+  metricsAdd(&Metrics->bytes_out, tpclJobBytes(Job) + sent);
+
   /*
    * If no pages were printed, send an error message...
    */
@@ -950,3 +1338,169 @@ main(int  argc,				/* I - Number of command-line arguments */
     fputs("INFO: Ready to print.\n", stderr);
   return (Page == 0);
 }
+
+
+/*
+ * 'WarmWorker()' - Prepare a daemon worker for its first job.
+ */
+void
+WarmWorker(void)
+{
+  if ((Job = tpclJobNew(WriteOutput, NULL)) != NULL)
+    tpclJobReserve(Job, DAEMON_LINE);
+}
+
+
+/*
+ * 'WorkerJob()' - Convert a raster job in a daemon worker.
+ */
+int					/* O - Exit status */
+WorkerJob(int        argc,		/* I - Number of command-line arguments */
+          char       *argv[],		/* I - Command-line arguments */
+          const char *ppdfile)		/* I - PPD file name */
+{
+  if (!Job)
+  {
+    fputs("ERROR: Unable to allocate output buffers!\n", stderr);
+    return (1);
+  }
+
+  tpclJobReset(Job);
+
+  return (PrintJob(argc, argv, ppdfile));
+}
+
+
+/*
+ * 'Daemon()' - Run as prefork filter daemon.
+ *
+ * PPD files named on the command line, or all PPD files of named
+ * directories, are loaded before the workers are started, so every worker
+ * shares them.
+ */
+int					/* O - Exit status */
+Daemon(int  argc,			/* I - Number of command-line arguments */
+       char *argv[])			/* I - Command-line arguments */
+{
+  int		i,			/* Looping var */
+		ch,			/* Option character */
+		min_workers = 2,	/* Workers kept running */
+		max_workers = 8;	/* Most workers at a time */
+  const char	*sockname = TPCLD_SOCKET,
+					/* Socket to listen on */
+		*metrics = NULL;	/* Metrics address */
+  char		filename[1024];		/* PPD file name */
+  DIR		*dir;			/* PPD directory */
+  struct dirent	*dent;			/* Directory entry */
+  size_t	len;			/* Length of file name */
+
+
+  DaemonMode = 1;
+  optind     = 2;
+
+  while ((ch = getopt(argc, argv, "m:M:p:s:")) != -1)
+  {
+    switch (ch)
+    {
+      case 'm' :
+          min_workers = atoi(optarg);
+          break;
+      case 'M' :
+          max_workers = atoi(optarg);
+          break;
+      case 'p' :
+          metrics = optarg;
+          break;
+      case 's' :
+          sockname = optarg;
+          break;
+      default :
+          fputs("Usage: rastertotpcl --daemon [-m min] [-M max] "
+                "[-p [host:]port|socket] [-s socket] "
+                "[ppd-file|ppd-dir ...]\n", stderr);
+          return (1);
+    }
+  }
+
+  for (i = optind; i < argc; i ++)
+  {
+    if ((dir = opendir(argv[i])) == NULL)
+    {
+      if (!OpenPPD(argv[i]))
+        fprintf(stderr, "ERROR: Unable to load PPD file %s.\n", argv[i]);
+      continue;
+    }
+
+    while ((dent = readdir(dir)) != NULL)
+    {
+      if ((len = strlen(dent->d_name)) < 5 ||
+          strcmp(dent->d_name + len - 4, ".ppd"))
+        continue;
+
+      snprintf(filename, sizeof(filename), "%s/%s", argv[i], dent->d_name);
+      OpenPPD(filename);
+    }
+
+    closedir(dir);
+  }
+
+  fprintf(stderr, "INFO: Loaded %d PPD files.\n", NumPPDs);
+
+  return (tpcldRun(sockname, min_workers, max_workers, metrics, WarmWorker,
+                   WorkerJob));
+}
+
+
+/*
+ * 'main()' - Main entry and processing of driver.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  const char	*sockname;		/* Socket of filter daemon */
+  int		status;			/* Exit status */
+
+
+  /*
+   * Make sure status messages are not buffered...
+   */
+  setbuf(stderr, NULL);
+
+  if (argc > 1 && !strcmp(argv[1], "--daemon"))
+    return (Daemon(argc, argv));
+
+  /*
+   * Check command-line...
+   */
+  if (argc < 6 || argc > 7)
+  {
+    /*
+     * We don't have the correct number of arguments; write an error message
+     * and return.
+     */
+    fputs("ERROR: rastertotec job-id user title copies options [file]\n", stderr);
+    return (1);
+  }
+
+  /*
+   * Hand the job to a running filter daemon, if any...
+   */
+  if ((sockname = getenv("TPCLD_SOCKET")) == NULL)
+    sockname = TPCLD_SOCKET;
+
+  if ((status = tpcldSubmit(sockname, argc, argv)) >= 0)
+    return (status);
+
+  if ((Job = tpclJobNew(WriteOutput, NULL)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate output buffers!\n", stderr);
+    return (1);
+  }
+
+  status = PrintJob(argc, argv, getenv("PPD"));
+  tpclJobDelete(Job);
+
+  return (status);
+}
@@ -0,0 +1,466 @@
+/*
+ *   Urgent lane benchmark for tpclrelay.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   Usage()     - Show program usage.
+ *   Now()       - Return the time in seconds.
+ *   AddLabel()  - Append a label to a job.
+ *   Connect()   - Connect to the relay.
+ *   Printer()   - Emulate a slow printer.
+ *   SendBatch() - Send the batch job.
+ *   Compare()   - Compare two latencies for qsort().
+ *   main()      - Time urgent labels sent behind a batch.
+ *
+ * The benchmark emulates a printer that takes data at a fixed rate
+ * (400 KB/s by default) with a small socket buffer, like a label printer
+ * on a slow network interface. The relay is started with this printer as
+ * its only member, see bench-relay.sh. Once the relay has connected, a
+ * batch of labels is sent to the batch port, and then single urgent
+ * labels at fixed intervals to the urgent port. The latency of an urgent
+ * label is the time from connecting to the relay until its {PC01;...}
+ * field reaches the printer. With the same port for both, the urgent
+ * labels queue behind the batch like any other job.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+ * Constants...
+ */
+#define BENCH_URGENT  1000		/* Most urgent labels */
+#define BENCH_PAYLOAD 4000		/* Graphics bytes per label */
+
+
+/*
+ * Globals...
+ */
+static int	PrinterFd = -1;		/* Listening socket of the printer */
+static double	Rate = 400000.0;	/* Printer speed in bytes/sec */
+static volatile int Connected = 0;	/* Relay connected to the printer */
+static double	Seen[BENCH_URGENT];	/* Arrival of urgent labels */
+static volatile int NumSeen = 0;	/* Urgent labels arrived */
+static int	NumUrgent = 40;		/* Urgent labels to send */
+
+
+/*
+ * Local functions...
+ */
+static void	Usage(void);
+static double	Now(void);
+static size_t	AddLabel(char *job, const char *size, const char *name);
+static int	Connect(int port);
+static void	*Printer(void *data);
+static void	*SendBatch(void *data);
+static int	Compare(const void *a, const void *b);
+
+
+/*
+ * 'Usage()' - Show program usage.
+ */
+static void
+Usage(void)
+{
+  fputs("Usage: relaybench [options] batch-port urgent-port printer-port\n"
+        "Options:\n"
+        "  -i ms           Interval of urgent labels (default 100)\n"
+        "  -n labels       Labels in the batch (default 600)\n"
+        "  -r bytes/sec    Printer speed (default 400000)\n"
+        "  -u labels       Number of urgent labels (default 40)\n",
+        stderr);
+  exit(1);
+}
+
+
+/*
+ * 'Now()' - Return the time in seconds.
+ */
+static double				/* O - Monotonic time in seconds */
+Now(void)
+{
+  struct timespec ts;			/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((double)ts.tv_sec + ts.tv_nsec / 1000000000.0);
+}
+
+
+/*
+ * 'AddLabel()' - Append a label to a job.
+ *
+ * The label has a size command, a name field and an image of
+ * BENCH_PAYLOAD bytes; the buffer needs BENCH_PAYLOAD + 256 bytes.
+ */
+static size_t				/* O - Bytes added */
+AddLabel(char       *job,		/* I - End of job */
+         const char *size,		/* I - Label size command */
+         const char *name)		/* I - Label name */
+{
+  size_t	bytes;			/* Bytes added */
+  int		i;			/* Looping var */
+
+
+  bytes = (size_t)sprintf(job, "%s{AY;+00,1|}\n{C|}\n{PC01;%s|}\n"
+                               "{SG;0000,0000,0832,0300,3,", size, name);
+
+  job[bytes ++] = (char)(BENCH_PAYLOAD >> 8);
+  job[bytes ++] = (char)(BENCH_PAYLOAD & 255);
+
+  for (i = 0; i < BENCH_PAYLOAD; i ++)
+    job[bytes ++] = (char)((i & 3) == 3 ? 0x41 : 0x80);
+
+  bytes += (size_t)sprintf(job + bytes, "|}\n{XS;I,0001,0002C3000|}\n");
+
+  return (bytes);
+}
+
+
+/*
+ * 'Connect()' - Connect to the relay.
+ */
+static int				/* O - Socket or -1 on error */
+Connect(int port)			/* I - Port on localhost */
+{
+  int			fd;		/* Socket */
+  struct sockaddr_in	addr;		/* Relay address */
+
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons((unsigned short)port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return (-1);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+  {
+    close(fd);
+    return (-1);
+  }
+
+  return (fd);
+}
+
+
+/*
+ * 'Printer()' - Emulate a slow printer.
+ *
+ * Data is read in small chunks and the reader sleeps until the printer
+ * would have taken it at the emulated rate.
+ */
+static void *				/* O - Unused */
+Printer(void *data)			/* I - Unused */
+{
+  int		fd;			/* Connection from the relay */
+  char		buffer[4096 + 32],	/* Data with the tail of the last read */
+		*ptr;			/* Name of an urgent label */
+  ssize_t	bytes;			/* Bytes read */
+  size_t	tail = 0;		/* Bytes kept from the last read */
+  double	start,			/* Start of connection */
+		ahead;			/* Seconds ahead of the printer */
+  unsigned long long total = 0;		/* Bytes read */
+  int		label;			/* Number of urgent label */
+  struct timespec ts;			/* Time to sleep */
+
+
+  (void)data;
+
+  if ((fd = accept(PrinterFd, NULL, NULL)) < 0)
+  {
+    perror("relaybench: accept");
+    exit(1);
+  }
+
+  Connected = 1;
+  start     = Now();
+
+  while ((bytes = read(fd, buffer + tail, 4096)) > 0)
+  {
+    total += (unsigned long long)bytes;
+    bytes += (ssize_t)tail;
+
+    for (ptr = buffer;
+         (ptr = memmem(ptr, (size_t)(buffer + bytes - ptr), "PC01;URG-",
+                       9)) != NULL;
+         ptr += 9)
+    {
+      if (memchr(ptr, '|', (size_t)(buffer + bytes - ptr)) == NULL)
+        break;
+
+      label = atoi(ptr + 9);
+      if (label >= 0 && label < NumUrgent && Seen[label] == 0.0)
+      {
+        Seen[label] = Now();
+        NumSeen ++;
+      }
+    }
+
+    tail = (size_t)bytes < 32 ? (size_t)bytes : 32;
+    memmove(buffer, buffer + bytes - tail, tail);
+
+    if ((ahead = total / Rate - (Now() - start)) > 0.0)
+    {
+      ts.tv_sec  = (time_t)ahead;
+      ts.tv_nsec = (long)((ahead - ts.tv_sec) * 1000000000.0);
+      nanosleep(&ts, NULL);
+    }
+  }
+
+  close(fd);
+
+  return (NULL);
+}
+
+
+/*
+ * 'SendBatch()' - Send the batch job.
+ */
+static void *				/* O - Unused */
+SendBatch(void *data)			/* I - Batch port and labels */
+{
+  int		*args = data;		/* Port and number of labels */
+  int		fd,			/* Connection to the relay */
+		i;			/* Looping var */
+  char		*job,			/* Batch job */
+		name[32];		/* Label name */
+  size_t	bytes;			/* Length of job */
+
+
+  if ((job = malloc((size_t)args[1] * (BENCH_PAYLOAD + 256) + 256)) == NULL)
+  {
+    perror("relaybench");
+    exit(1);
+  }
+
+  bytes = (size_t)sprintf(job, "{WS|}\n{AX;+000,+000,+00|}\n{RM;-00-00|}\n");
+
+  for (i = 0; i < args[1]; i ++)
+  {
+    snprintf(name, sizeof(name), "BATCH-%d", i);
+    bytes += AddLabel(job + bytes, "{D0508,1040,0488,1060|}\n", name);
+  }
+
+  if ((fd = Connect(args[0])) < 0)
+  {
+    perror("relaybench: batch");
+    exit(1);
+  }
+
+  for (i = 0; bytes > 0; )
+  {
+    ssize_t sent = write(fd, job + i, bytes);
+
+    if (sent <= 0)
+      break;
+
+    i     += (int)sent;
+    bytes -= (size_t)sent;
+  }
+
+  shutdown(fd, SHUT_WR);
+  close(fd);
+  free(job);
+
+  return (NULL);
+}
+
+
+/*
+ * 'Compare()' - Compare two latencies for qsort().
+ */
+static int				/* O - Result of comparison */
+Compare(const void *a,			/* I - First latency */
+        const void *b)			/* I - Second latency */
+{
+  double	da = *(const double *)a,/* First latency */
+		db = *(const double *)b;/* Second latency */
+
+
+  return (da < db ? -1 : da > db);
+}
+
+
+/*
+ * 'main()' - Time urgent labels sent behind a batch.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			ch,		/* Option */
+			i,		/* Looping var */
+			interval = 100,	/* Interval of urgent labels in ms */
+			urgent_port,	/* Port of urgent lane */
+			args[2],	/* Batch port and labels */
+			fds[BENCH_URGENT],
+					/* Connections of urgent labels */
+			one = 1,	/* Socket option value */
+			rcvbuf = 8192;	/* Receive buffer of the printer */
+  char			*job,		/* Urgent job */
+			name[32];	/* Label name */
+  size_t		bytes;		/* Length of urgent job */
+  double		sent[BENCH_URGENT],
+					/* Start of urgent labels */
+			latency[BENCH_URGENT],
+					/* Latency of urgent labels in ms */
+			deadline;	/* End of waiting */
+  struct sockaddr_in	addr;		/* Printer address */
+  pthread_t		printer,	/* Printer thread */
+			batch;		/* Batch thread */
+  struct timespec	ts;		/* Interval of urgent labels */
+
+
+  args[1] = 600;
+
+  while ((ch = getopt(argc, argv, "i:n:r:u:")) != -1)
+  {
+    switch (ch)
+    {
+      case 'i' :
+          if ((interval = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'n' :
+          if ((args[1] = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'r' :
+          if ((Rate = atof(optarg)) < 1000.0)
+            Usage();
+          break;
+      case 'u' :
+          if ((NumUrgent = atoi(optarg)) < 1 || NumUrgent > BENCH_URGENT)
+            Usage();
+          break;
+      default :
+          Usage();
+    }
+  }
+
+  if (argc - optind != 3)
+    Usage();
+
+  args[0]     = atoi(argv[optind]);
+  urgent_port = atoi(argv[optind + 1]);
+
+ /*
+  * Listen as the printer, with a small buffer like a printer has...
+  */
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons((unsigned short)atoi(argv[optind + 2]));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ((PrinterFd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      setsockopt(PrinterFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      setsockopt(PrinterFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                 sizeof(rcvbuf)) ||
+      bind(PrinterFd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(PrinterFd, 1))
+  {
+    perror("relaybench: printer");
+    return (1);
+  }
+
+  pthread_create(&printer, NULL, Printer, NULL);
+
+  for (deadline = Now() + 10.0; !Connected && Now() < deadline;)
+    usleep(10000);
+
+  if (!Connected)
+  {
+    fputs("relaybench: The relay did not connect to the printer.\n", stderr);
+    return (1);
+  }
+
+ /*
+  * Start the batch and send the urgent labels while it prints...
+  */
+  pthread_create(&batch, NULL, SendBatch, args);
+  usleep(500000);
+
+  if ((job = malloc(BENCH_PAYLOAD + 256 + 8)) == NULL)
+  {
+    perror("relaybench");
+    return (1);
+  }
+
+  ts.tv_sec  = interval / 1000;
+  ts.tv_nsec = (interval % 1000) * 1000000L;
+
+  for (i = 0; i < NumUrgent; i ++)
+  {
+    snprintf(name, sizeof(name), "URG-%d", i);
+    bytes = (size_t)sprintf(job, "{WS|}\n");
+    bytes += AddLabel(job + bytes, "{D0300,0600,0280,0620|}\n", name);
+
+    sent[i] = Now();
+
+    if ((fds[i] = Connect(urgent_port)) < 0 ||
+        write(fds[i], job, bytes) != (ssize_t)bytes)
+    {
+      perror("relaybench: urgent");
+      return (1);
+    }
+
+    shutdown(fds[i], SHUT_WR);
+    nanosleep(&ts, NULL);
+  }
+
+  for (deadline = Now() + 60.0; NumSeen < NumUrgent && Now() < deadline;)
+    usleep(10000);
+
+ /*
+  * Report...
+  */
+  for (i = 0, ch = 0; i < NumUrgent; i ++)
+  {
+    close(fds[i]);
+
+    if (Seen[i] > 0.0)
+      latency[ch ++] = (Seen[i] - sent[i]) * 1000.0;
+  }
+
+  if (!ch)
+  {
+    puts("no urgent labels arrived");
+    return (1);
+  }
+
+  qsort(latency, (size_t)ch, sizeof(double), Compare);
+
+  printf("%d/%d urgent labels, p50 %.0f ms, p99 %.0f ms\n", ch, NumUrgent,
+         latency[ch / 2], latency[(int)(ch * 0.99)]);
+
+  free(job);
+
+  return (ch == NumUrgent ? 0 : 1);
+}
@@ -0,0 +1,1476 @@
+/*
+ *   TPCL command generation and TOPIX encoder for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2010 by Sam Lown
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   tpclVersion()    - Return the version of the library.
+ *   tpclJobNew()     - Create the output state of a job.
+ *   tpclJobDelete()  - Free a job and its buffers.
+ *   tpclJobReset()   - Prepare a job for reuse, keeping its buffers.
+ *   tpclJobAlloc()   - Allocate page memory from the arena of a job.
+ *   tpclJobReserve() - Allocate and pre-fault the TOPIX buffers.
+ *   tpclSetLatency() - Send the first bands of a page early.
+ *   tpclSetSegment() - Split long labels on continuous media.
+ *   tpclStartJob()   - Send the printer setup.
+ *   tpclStartPage()  - Start a page of graphics.
+ *   tpclWriteLine()  - Output a line of graphics.
+ *   tpclEndPage()    - Finish a page of graphics and issue the label.
+ *   tpclCancel()     - Cancel a job and reset the printer.
+ *   tpclFlush()      - Send buffered output to the callback.
+ *   tpclJobBytes()   - Return the bytes sent to the output callback.
+ *   tpclJobPages()   - Return the number of pages finished.
+ *   tpclJobError()   - Return whether the output callback failed.
+ *   tpclJobFirstByte() - Return the time until the first output.
+ *   tpclJobAllocs()  - Return the heap allocations made for a job.
+ *   tpclEstimateLine() - Return the TOPIX size of a line.
+ *   tpclEstimatePage() - Estimate the encoded size of a page.
+ *
+ *   tpclElapsed()    - Seconds since a point in time.
+ *   tpclArenaReset() - Release all page memory of a job.
+ *   tpclStartSegment() - Start a segment of a page.
+ *   tpclEndSegment() - Issue a segment of a page.
+ *   tpclOutputNibbles() - Buffer a line of graphics in nibble mode.
+ *   tpclPadLines()   - Buffer blank lines of raw graphics.
+ *   tpclNibbles()    - Convert graphics to ASCII nibbles.
+ *
+ *   TOPIXCompress()             - Compress a line into TEC's TOPIX format.
+ *   TOPIXCompressOutputBuffer() - Send current contents of TOPIX data.
+ *
+ * All state lives in the job, so any number of jobs can be encoded at the
+ * same time, e.g. by the threads of a printer application. Output goes
+ * through a callback, which makes the same code usable for stdout, a
+ * device connection or a memory buffer.
+ *
+ * This file, tpclparse.c, tpclprint.c and tpclmodel.c make up libtpcl. The
+ * job is opaque, so its layout can change without breaking programs linked
+ * against the shared library. tpcl_setup_t and tpcl_page_t are allocated
+ * by the caller and only change with the major version.
+ */
+
+#include "tpcl.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * Most TOPIX bytes a line of w bytes can take...
+ */
+#define TOPIX_LINE_MAX(w) ((w) + ((w) + 7) / 8 + ((w) + 63) / 64 + 1)
+
+
+/*
+ * Dummy chars sent after every label, workaround for the lost last TCP
+ * packet bug of the B-EV4T firmware V1.1G...
+ */
+static const unsigned char tpclDummy[600] = { 0 };
+
+
+/*
+ * Types...
+ */
+struct tpcl_job_s			/* Output state of a job */
+{
+  tpcl_write_cb_t cb;			/* Output callback */
+  void		*data;			/* Callback data */
+  int		error;			/* Non-zero after an output error */
+  tpcl_page_t	page;			/* Current page */
+  unsigned char	*last_buffer,		/* Previous line for TOPIX */
+		*comp_buffer,		/* TOPIX data of the current band */
+		*comp_ptr;		/* End of TOPIX data */
+  unsigned	comp_last_line,		/* First line of the current band */
+		comp_size;		/* Size of last_buffer */
+  unsigned char	out[8192];		/* Output buffer */
+  size_t	outlen;			/* Bytes in output buffer */
+  size_t	bytes,			/* Bytes sent to the callback */
+		page_bytes;		/* Bytes sent before the current segment */
+  unsigned	page_lines;		/* Raw lines written on the current segment */
+  int		segment;		/* Longest segment in 0.1 mm, 0 for none */
+  unsigned	seg_lines,		/* Lines per segment, 0 for whole page */
+		seg_first,		/* First line of the current segment */
+		seg_height;		/* Lines of the current segment */
+  int		in_page;		/* Non-zero between start and end of page */
+  int		pages;			/* Pages finished */
+  unsigned	band_first,		/* Lines of first band, 0 for no early bands */
+		band_lines,		/* Lines of next early band */
+		band_msecs;		/* Time limit of early bands in ms */
+  struct timespec start,		/* Start of job */
+		band_start;		/* Start of current band */
+  double	first_byte;		/* Seconds until first output, -1 before */
+  unsigned char	*arena;			/* Page memory */
+  size_t	arena_size,		/* Size of arena */
+		arena_used,		/* Bytes handed out since page start */
+		arena_peak;		/* Most bytes needed by a page */
+  void		*arena_extra;		/* Blocks allocated past the arena */
+  unsigned char	*copy;			/* Output of a segmented page */
+  size_t	copy_len,		/* Bytes in copy */
+		copy_size;		/* Size of copy */
+  int		copying;		/* Non-zero while keeping the output */
+  unsigned	allocs;			/* Heap allocations for buffers */
+};
+
+
+/*
+ * Local functions...
+ */
+static int	tpclOutput(tpcl_job_t *job, const void *buffer, size_t bytes);
+static int	tpclPrintf(tpcl_job_t *job, const char *format, ...)
+		__attribute__((format(printf, 2, 3)));
+static int	tpclSend(tpcl_job_t *job, const void *buffer, size_t bytes);
+static double	tpclElapsed(const struct timespec *since);
+static int	tpclArenaReset(tpcl_job_t *job, size_t bytes);
+static void	tpclStartSegment(tpcl_job_t *job);
+static void	tpclEndSegment(tpcl_job_t *job, int last);
+static void	tpclOutputNibbles(tpcl_job_t *job, const unsigned char *line,
+		                  size_t bytes);
+static void	tpclPadLines(tpcl_job_t *job, unsigned lines);
+static void	tpclNibbles(unsigned char *dst, const unsigned char *src,
+		            size_t bytes);
+static void	TOPIXCompress(tpcl_job_t *job, const unsigned char *line,
+		              unsigned y);
+static void	TOPIXCompressOutputBuffer(tpcl_job_t *job, unsigned y);
+
+
+/*
+ * 'tpclVersion()' - Return the version of the library.
+ */
+int					/* O - Major * 100 + minor version */
+tpclVersion(void)
+{
+  return (TPCL_VERSION_MAJOR * 100 + TPCL_VERSION_MINOR);
+}
+
+
+/*
+ * 'tpclJobNew()' - Create the output state of a job.
+ *
+ * A job is reused for any number of print jobs with tpclJobReset(), so its
+ * buffers are only allocated once.
+ */
+tpcl_job_t *				/* O - New job or NULL on error */
+tpclJobNew(tpcl_write_cb_t cb,		/* I - Output callback */
+           void            *data)	/* I - Callback data */
+{
+  tpcl_job_t	*job;			/* New job */
+
+
+  if ((job = calloc(1, sizeof(tpcl_job_t))) == NULL)
+    return (NULL);
+
+  job->cb         = cb;
+  job->data       = data;
+  job->first_byte = -1.0;
+
+  clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+  return (job);
+}
+
+
+/*
+ * 'tpclJobDelete()' - Free a job and its buffers.
+ */
+void
+tpclJobDelete(tpcl_job_t *job)		/* I - Job */
+{
+  if (!job)
+    return;
+
+  job->arena_peak = 0;
+  tpclArenaReset(job, 0);
+
+  free(job->arena);
+  free(job->copy);
+  free(job->last_buffer);
+  free(job->comp_buffer);
+  free(job);
+}
+
+
+/*
+ * 'tpclJobReset()' - Prepare a job for reuse, keeping its buffers.
+ *
+ * The output callback and latency settings are kept as well.
+ */
+void
+tpclJobReset(tpcl_job_t *job)		/* I - Job */
+{
+  job->error      = 0;
+  job->outlen     = 0;
+  job->bytes      = 0;
+  job->pages      = 0;
+  job->in_page    = 0;
+  job->copying    = 0;
+  job->first_byte = -1.0;
+
+  tpclArenaReset(job, 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &job->start);
+}
+
+
+/*
+ * 'tpclJobAlloc()' - Allocate page memory from the arena of a job.
+ *
+ * The memory is not cleared and stays valid until the next page is
+ * started. Once the arena has grown to what a page needs, following pages
+ * of the same size do not touch the heap at all.
+ */
+void *					/* O - Memory or NULL on error */
+tpclJobAlloc(tpcl_job_t *job,		/* I - Job */
+             size_t     bytes)		/* I - Number of bytes */
+{
+  void		**block;		/* Block past the arena */
+
+
+  bytes = (bytes + 15) & ~(size_t)15;
+  job->arena_used += bytes;
+
+  if (job->arena_used > job->arena_peak)
+    job->arena_peak = job->arena_used;
+
+  if (job->arena_used <= job->arena_size)
+    return (job->arena + job->arena_used - bytes);
+
+ /*
+  * Memory handed out must stay in place, so the arena cannot grow until
+  * the next page; chain a block of its own until then...
+  */
+  if ((block = malloc(16 + bytes)) == NULL)
+    return (NULL);
+
+  job->allocs ++;
+
+  block[0]         = job->arena_extra;
+  job->arena_extra = block;
+
+  return ((unsigned char *)block + 16);
+}
+
+
+/*
+ * 'tpclJobReserve()' - Allocate and pre-fault the TOPIX buffers.
+ *
+ * The page arena is sized for a line buffer as well. Called by
+ * tpclStartPage() as needed; long-running callers may call it up front,
+ * so the first page does not pay for allocations and page faults.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclJobReserve(tpcl_job_t *job,		/* I - Job */
+               unsigned   bytes_per_line)
+					/* I - Bytes per line of graphics */
+{
+  unsigned char	*temp;			/* New line buffer */
+
+
+  if (bytes_per_line > job->comp_size)
+  {
+    if ((temp = realloc(job->last_buffer, bytes_per_line)) == NULL)
+    {
+      job->error = 1;
+      return (-1);
+    }
+
+    job->last_buffer = temp;
+    job->comp_size   = bytes_per_line;
+    job->allocs ++;
+  }
+
+  if (!job->comp_buffer)
+  {
+    if ((job->comp_buffer = malloc(TPCL_TOPIX_BUFFER)) == NULL)
+    {
+      job->error = 1;
+      return (-1);
+    }
+
+    job->allocs ++;
+
+   /*
+    * Fault the pages in once; the buffer is only ever written before it
+    * is read, so it is not cleared again...
+    */
+    memset(job->comp_buffer, 0, TPCL_TOPIX_BUFFER);
+  }
+
+  if (tpclArenaReset(job, bytes_per_line))
+  {
+    job->error = 1;
+    return (-1);
+  }
+
+  memset(job->last_buffer, 0, bytes_per_line);
+
+  return (0);
+}
+
+
+/*
+ * 'tpclSetLatency()' - Send the first bands of a page early.
+ *
+ * Normally TOPIX data is only sent when the buffer is nearly full or the
+ * page ends, so the printer receives nothing of a typical label until it
+ * has been encoded completely. In low latency mode the first band is sent
+ * after the given number of lines or milliseconds, whichever comes first,
+ * and every following band is twice as long as the previous one, so the
+ * printer can start receiving while the rest of the page is encoded.
+ */
+void
+tpclSetLatency(tpcl_job_t *job,		/* I - Job */
+               unsigned   lines,	/* I - Lines of first band, 0 to disable */
+               unsigned   msecs)	/* I - Time limit of a band in ms, 0 for none */
+{
+  job->band_first = lines;
+  job->band_msecs = msecs;
+}
+
+
+/*
+ * 'tpclSetSegment()' - Split long labels on continuous media.
+ *
+ * Labels on continuous media (detect 0) longer than the given length are
+ * sent as segments of equal length, each a label of its own with no gap
+ * between them, so the printer starts printing after the first segment
+ * and no coordinate exceeds its 4 digits. Segments are issued once each;
+ * for more copies the output of the whole label is kept and sent again,
+ * which takes as much memory as the encoded label.
+ */
+void
+tpclSetSegment(tpcl_job_t *job,		/* I - Job */
+               int        length)	/* I - Longest segment in 0.1 mm, 0 to disable */
+{
+  if (length < 0)
+    length = 0;
+  else if (length > 9999)
+    length = 9999;
+
+  job->segment = length;
+}
+
+
+/*
+ * 'tpclStartJob()' - Send the printer setup.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclStartJob(tpcl_job_t         *job,	/* I - Job */
+             const tpcl_setup_t *setup)	/* I - Printer setup */
+{
+ /*
+  * Always send a reset command. Helps with reliability on failed jobs.
+  */
+  tpclPrintf(job, "{WS|}\n");
+
+ /*
+  * Fine adjust of feed, cut or peel and back feed position...
+  */
+  tpclPrintf(job, "{AX;%+04d,%+04d,%+03d|}\n", setup->feed_adjust,
+             setup->cut_adjust, setup->backfeed_adjust);
+
+ /*
+  * Ribbon motor setup...
+  */
+  tpclPrintf(job, "{RM;%c%02d%c%02d|}\n",
+             setup->ribbon_forward > 0 ? '+' : '-', abs(setup->ribbon_forward),
+             setup->ribbon_back > 0 ? '+' : '-', abs(setup->ribbon_back));
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclStartPage()' - Start a page of graphics.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclStartPage(tpcl_job_t        *job,	/* I - Job */
+              const tpcl_page_t *page)	/* I - Page settings */
+{
+  unsigned	count;			/* Number of segments */
+
+
+  job->page       = *page;
+  job->in_page    = 1;
+  job->seg_lines  = 0;
+  job->seg_first  = 0;
+  job->copying    = 0;
+  job->copy_len   = 0;
+
+ /*
+  * Split a long label on continuous media into segments of equal length,
+  * none of them more than 9999 lines...
+  */
+  if (job->segment > 0 && page->detect == 0 && page->length > job->segment)
+  {
+    count = (unsigned)((page->length + job->segment - 1) / job->segment);
+    if (count < (page->lines + 9998) / 9999)
+      count = (page->lines + 9998) / 9999;
+
+    job->seg_lines = (page->lines + count - 1) / count;
+
+    if (job->seg_lines >= page->lines)
+      job->seg_lines = 0;
+  }
+
+ /*
+  * Keep the output of a segmented label with copies, from its first
+  * command on...
+  */
+  if (job->seg_lines && page->copies > 1)
+  {
+    tpclFlush(job);
+    job->copying = 1;
+  }
+
+  if (tpclArenaReset(job, 0))
+  {
+    job->error = 1;
+    return (-1);
+  }
+
+  /*
+   * TOPIX addresses no more than TPCL_TOPIX_WIDTH bytes of a line, wider
+   * graphics are sent raw...
+   */
+  if (job->page.gmode == TEC_GMODE_TOPIX &&
+      page->bytes_per_line > TPCL_TOPIX_WIDTH)
+    job->page.gmode = TEC_GMODE_HEX_OR;
+
+ /*
+  * Allocate buffers for 8 dots per byte graphics ready for TOPIX
+  * compression; they are kept for the following pages...
+  */
+  if (job->page.gmode == TEC_GMODE_TOPIX &&
+      tpclJobReserve(job, page->bytes_per_line))
+    return (-1);
+
+  job->band_lines = job->band_first;
+
+  tpclStartSegment(job);
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclWriteLine()' - Output a line of graphics.
+ *
+ * Some versions of this method check to see if the Buffer has data, this
+ * doesn't. Empty lines can often be skipped if the buffer is checked.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclWriteLine(tpcl_job_t          *job,	/* I - Job */
+              const unsigned char *line,/* I - Line of graphics */
+              unsigned            y)	/* I - Line number */
+{
+  while (job->seg_lines && y >= job->seg_first + job->seg_height &&
+         job->seg_first + job->seg_height < job->page.lines)
+  {
+    tpclEndSegment(job, 0);
+
+    job->seg_first += job->seg_height;
+    tpclStartSegment(job);
+  }
+
+  y -= job->seg_first;
+
+  if (job->page.gmode == TEC_GMODE_TOPIX)
+    TOPIXCompress(job, line, y);
+  else if (job->page.gmode == TEC_GMODE_NIBBLE_AND ||
+           job->page.gmode == TEC_GMODE_NIBBLE_OR)
+    tpclOutputNibbles(job, line, job->page.bytes_per_line);
+  else
+    tpclOutput(job, line, job->page.bytes_per_line);
+
+  if (job->page.gmode != TEC_GMODE_TOPIX)
+    job->page_lines = y + 1;
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclEndPage()' - Finish a page of graphics and issue the label.
+ *
+ * A canceled page is not issued, see tpclCancel().
+ */
+int					/* O - 0 on success, -1 on error */
+tpclEndPage(tpcl_job_t *job,		/* I - Job */
+            int        canceled)	/* I - Non-zero if job is canceled */
+{
+  tpcl_page_t	*page = &job->page;	/* Current page */
+  int		i;			/* Looping var */
+
+
+  if (canceled)
+  {
+    tpclCancel(job);
+    job->pages ++;
+
+    return (job->error ? -1 : 0);
+  }
+
+  tpclEndSegment(job, 1);
+
+ /*
+  * Send the other copies of a segmented label...
+  */
+  if (job->copying)
+  {
+    tpclFlush(job);
+    job->copying = 0;
+
+    for (i = 1; i < page->copies && !job->error; i ++)
+      tpclSend(job, job->copy, job->copy_len);
+  }
+
+  /* Send eject command if cut active */
+  if (page->eject)
+    tpclPrintf(job, "{IB|}\n");
+
+  // To avoid Zerowindow Error at the end of the stream
+  // https://github.com/icrebollo/rastertotpcl/commit/46704d69a4ebd2dcfe1d98136c683dc7bfb7e7b4
+  tpclPrintf(job, "%1024s", "");
+
+  tpclFlush(job);
+  tpclSend(job, tpclDummy, sizeof(tpclDummy));
+
+  job->in_page = 0;
+  job->pages ++;
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclCancel()' - Cancel a job and reset the printer.
+ *
+ * Output the printer has not seen yet is dropped: the TOPIX band being
+ * collected, and the buffered commands of the segment if none of its data
+ * went out. Raw graphics already started have a fixed length and are
+ * completed with blank lines. The printer is then reset with {WR|}, which
+ * also stops labels it has received but not printed. It may be called
+ * on a page, like tpclEndPage() with canceled set, or between pages.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclCancel(tpcl_job_t *job)		/* I - Job */
+{
+  if (job->in_page && job->page.gmode != TEC_GMODE_TOPIX &&
+      job->bytes != job->page_bytes)
+  {
+    tpclPadLines(job, job->seg_height - job->page_lines);
+    tpclPrintf(job, "|}\n");
+  }
+  else
+    job->outlen = 0;
+
+  if (job->comp_buffer)
+    job->comp_ptr = job->comp_buffer;
+
+  job->in_page = 0;
+  job->copying = 0;
+
+  tpclPrintf(job, "{WR|}\n");
+  tpclFlush(job);
+  tpclSend(job, tpclDummy, sizeof(tpclDummy));
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclFlush()' - Send buffered output to the callback.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclFlush(tpcl_job_t *job)		/* I - Job */
+{
+  if (job->outlen > 0)
+  {
+    tpclSend(job, job->out, job->outlen);
+    job->outlen = 0;
+  }
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclJobBytes()' - Return the bytes sent to the output callback.
+ */
+size_t					/* O - Bytes sent */
+tpclJobBytes(const tpcl_job_t *job)	/* I - Job */
+{
+  return (job->bytes);
+}
+
+
+/*
+ * 'tpclJobPages()' - Return the number of pages finished.
+ */
+int					/* O - Pages finished */
+tpclJobPages(const tpcl_job_t *job)	/* I - Job */
+{
+  return (job->pages);
+}
+
+
+/*
+ * 'tpclJobError()' - Return whether the output callback failed.
+ */
+int					/* O - Non-zero after an output error */
+tpclJobError(const tpcl_job_t *job)	/* I - Job */
+{
+  return (job->error);
+}
+
+
+/*
+ * 'tpclJobFirstByte()' - Return the time until the first output.
+ */
+double					/* O - Seconds, -1 before any output */
+tpclJobFirstByte(const tpcl_job_t *job)	/* I - Job */
+{
+  return (job->first_byte);
+}
+
+
+/*
+ * 'tpclJobAllocs()' - Return the heap allocations made for a job.
+ *
+ * Every malloc() or realloc() libtpcl makes for the arena, the TOPIX
+ * buffers and the copy buffer of the job is counted. Allocations of the
+ * C library or the caller are not; tpclbench wraps malloc() and friends
+ * to see those as well.
+ */
+unsigned				/* O - Number of allocations */
+tpclJobAllocs(const tpcl_job_t *job)	/* I - Job */
+{
+  return (job->allocs);
+}
+
+
+/*
+ * 'tpclEstimateLine()' - Return the TOPIX size of a line.
+ *
+ * The size is exact: the line flag, a flag byte for every 64 and every 8
+ * bytes with changes, and the changed bytes. Changed bytes are counted 8
+ * at a time, without looking at the bytes one by one.
+ */
+size_t					/* O - Bytes of TOPIX data */
+tpclEstimateLine(
+    const unsigned char *prev,		/* I - Previous line or NULL for blank */
+    const unsigned char *line,		/* I - Line of graphics */
+    unsigned            bytes)		/* I - Bytes per line */
+{
+  size_t	size = 1;		/* Size of line */
+  unsigned	i,			/* Byte in line */
+		count;			/* Bytes in word */
+  int		group = 0;		/* Changes in current 64 bytes */
+  uint64_t	a, b,			/* Words of both lines */
+		t;			/* High bit set per changed byte */
+  const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+					/* Low 7 bits of every byte */
+
+
+  for (i = 0; i < bytes; i += 8)
+  {
+    if ((i & 63) == 0)
+    {
+      size  += (size_t)group;
+      group = 0;
+    }
+
+    a = b = 0;
+    count = bytes - i < 8 ? bytes - i : 8;
+
+    memcpy(&a, line + i, count);
+    if (prev)
+      memcpy(&b, prev + i, count);
+
+    if ((a ^= b) == 0)
+      continue;
+
+    t = (((a & low7) + low7) | a) & ~low7;
+
+    size  += 1 + (size_t)(((t >> 7) * 0x0101010101010101ULL) >> 56);
+    group = 1;
+  }
+
+  return (size + (size_t)group);
+}
+
+
+/*
+ * 'tpclEstimatePage()' - Estimate the encoded size of a page.
+ *
+ * Lines equal to the previous one take one byte of TOPIX and are found
+ * with memcmp(). Of the other lines, one in every "step" is measured, at
+ * a pseudo random position so that patterns repeating every few lines do
+ * not skew the sample; a step of 1 measures every changed line, 0 about
+ * 256 of them. The bounds are three standard errors of the sample, kept
+ * within the sizes the lines not measured can take, and allow for the
+ * lines starting a new band. Early bands of the low latency mode add
+ * about 30 bytes each and are not included. Raw graphics have an exact
+ * size.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclEstimatePage(
+    const tpcl_page_t   *page,		/* I - Page settings */
+    const unsigned char *raster,	/* I - Lines of the page */
+    unsigned            step,		/* I - Lines per sample */
+    double              bps,		/* I - Link speed in bits/s, 0 for none */
+    tpcl_estimate_t     *est)		/* O - Estimate */
+{
+  unsigned	bpl = page->bytes_per_line,
+					/* Bytes per line */
+		lines = page->lines,	/* Lines of page */
+		y,			/* Line number */
+		last = 0,		/* Last changed line */
+		changed = 0,		/* Lines differing from the previous */
+		count = 0,		/* Changed lines in current sample */
+		target,			/* Changed line measured in sample */
+		seed = 1;		/* Sample position generator */
+  int		gmode = page->gmode;	/* Graphics mode */
+  size_t	overhead,		/* Commands of the page */
+		line_max,		/* Most bytes of one line */
+		band_max,		/* Fill level closing a band */
+		bands,			/* Graphics bands */
+		cmd_low,		/* Bytes of the shortest band command */
+		cmd_high,		/* Bytes of the longest band command */
+		size;			/* Size of sample line */
+  double	sum,			/* Estimated TOPIX bytes */
+		known = 0.0,		/* Bytes of sampled lines */
+		mean,			/* Mean sample size */
+		sumsq = 0.0,		/* Sum of squared sample sizes */
+		var,			/* Variance of the sizes */
+		error,			/* Sampling error */
+		low, high,		/* Bounds of TOPIX bytes */
+		rest;			/* Changed lines not looked at */
+  const unsigned char *line;		/* Current line */
+
+
+  memset(est, 0, sizeof(tpcl_estimate_t));
+
+  if (!bpl || !lines || (!raster && gmode == TEC_GMODE_TOPIX))
+    return (-1);
+
+  if (gmode == TEC_GMODE_TOPIX && bpl > TPCL_TOPIX_WIDTH)
+    gmode = TEC_GMODE_HEX_OR;
+
+ /*
+  * Label size, temperature, clear, issue and padding...
+  */
+  overhead = (size_t)snprintf(NULL, 0, "{D%04d,%04d,%04d,%04d|}\n",
+                              page->length + page->gap, page->width,
+                              page->length, page->width + page->gap) +
+             (size_t)snprintf(NULL, 0, "{AY;%+03d,%d|}\n", page->darkness,
+                              page->media == TPCL_MEDIA_DIRECT ? 1 : 0) +
+             5 +
+             (size_t)snprintf(NULL, 0, "{XS;I,%04d,%03d%d%c%c%d%d%d|}\n",
+                              page->copies, page->cut_interval, page->detect,
+                              page->mode, page->speed, page->media,
+                              page->mirror, 0) +
+             (page->eject ? 6 : 0) + 1024 + 600;
+
+  if (gmode != TEC_GMODE_TOPIX)
+  {
+   /*
+    * Raw graphics, one command with 2 characters per byte in nibble mode...
+    */
+    est->bytes = overhead + 3 +
+                 (size_t)snprintf(NULL, 0, "{SG;0000,0000,%04u,%04u,%d,",
+                                  bpl * 8, lines, gmode) +
+                 (size_t)bpl * lines *
+                     (gmode == TEC_GMODE_NIBBLE_AND ||
+                      gmode == TEC_GMODE_NIBBLE_OR ? 2 : 1);
+    est->low  = est->high = est->bytes;
+  }
+  else
+  {
+   /*
+    * Lines equal to the previous one take a single byte and are found
+    * with memcmp(); one in every "step" changed lines is measured...
+    */
+    if (step == 0)
+    {
+      for (y = 1, changed = 1; y < lines; y ++)
+        if (memcmp(raster + (size_t)(y - 1) * bpl, raster + (size_t)y * bpl,
+                   bpl))
+          changed ++;
+
+      step    = changed / 256 + 1;
+      changed = 0;
+    }
+
+    target = (seed >> 16) % step;
+
+    for (y = 0; y < lines; y ++)
+    {
+      line = raster + (size_t)y * bpl;
+
+      if (y > 0 && !memcmp(line - bpl, line, bpl))
+        continue;
+
+      changed ++;
+      last = y;
+
+      if (count ++ == target)
+      {
+        size = tpclEstimateLine(y ? line - bpl : NULL, line, bpl);
+
+        known += (double)size;
+        sumsq += (double)size * size;
+        est->sampled ++;
+      }
+
+      if (count == step)
+      {
+        seed   = seed * 1103515245 + 12345;
+        target = (seed >> 16) % step;
+        count  = 0;
+      }
+    }
+
+    if (changed && !est->sampled)
+    {
+     /*
+      * Fewer changed lines than the first sample skips...
+      */
+      line  = raster + (size_t)last * bpl;
+      size  = tpclEstimateLine(last ? line - bpl : NULL, line, bpl);
+      known = (double)size;
+      sumsq = (double)size * size;
+      est->sampled ++;
+    }
+
+   /*
+    * Sampling error, with the finite population correction, and the
+    * bounds of the changed lines not looked at, which take 4 bytes or
+    * more...
+    */
+    line_max = TOPIX_LINE_MAX(bpl);
+    mean     = est->sampled ? known / est->sampled : 0.0;
+    sum      = (double)(lines - changed) + mean * changed;
+    var      = est->sampled > 1 ?
+                   (sumsq - known * mean) / (est->sampled - 1) : 0.0;
+    error    = est->sampled < 2 ? (double)changed * line_max :
+               var > 0.0 ?
+                   3.0 * changed *
+                       sqrt(var / est->sampled *
+                            (1.0 - (double)est->sampled / changed)) : 0.0;
+    low      = sum - error;
+    high     = sum + error;
+    rest     = (double)(changed - est->sampled);
+
+    if (low < (double)(lines - changed) + known + 4.0 * rest)
+      low = (double)(lines - changed) + known + 4.0 * rest;
+    if (high > (double)(lines - changed) + known + line_max * rest)
+      high = (double)(lines - changed) + known + line_max * rest;
+
+   /*
+    * A band is sent once it holds more than band_max bytes; the first line
+    * of every later band is compared to a blank line instead...
+    */
+    band_max = TPCL_TOPIX_BUFFER - line_max;
+    bands    = ((size_t)high + band_max) / (band_max + 1);
+    low     -= (double)(bands - 1) * (line_max - 1);
+    high    += (double)(bands - 1) * (line_max - 1);
+
+    if (low < lines)
+      low = lines;
+
+   /*
+    * Band commands carry the first line of the band, which is 0000 for the
+    * first band and takes 5 digits past line 9999 on long pages...
+    */
+    cmd_low  = 3 + 2 +
+               (size_t)snprintf(NULL, 0, "{SG;0000,0000,%04u,%04d,%d,",
+                                bpl * 8, 300, gmode);
+    cmd_high = 3 + 2 +
+               (size_t)snprintf(NULL, 0, "{SG;0000,%04u,%04u,%04d,%d,",
+                                lines - 1, bpl * 8, 300, gmode);
+
+    est->bytes = overhead + (size_t)(sum + 0.5) + cmd_low +
+                 cmd_high * (((size_t)sum + band_max) / (band_max + 1) - 1);
+    est->low   = overhead + (size_t)low +
+                 cmd_low * (((size_t)low + TPCL_TOPIX_BUFFER - 1) /
+                            TPCL_TOPIX_BUFFER);
+    est->high  = overhead + (size_t)(high + 0.5) + cmd_high * bands;
+  }
+
+  if (bps > 0.0)
+  {
+    est->seconds      = 8.0 * est->bytes / bps;
+    est->seconds_low  = 8.0 * est->low / bps;
+    est->seconds_high = 8.0 * est->high / bps;
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'tpclOutput()' - Buffer output for the callback.
+ */
+static int				/* O - 0 on success, -1 on error */
+tpclOutput(tpcl_job_t *job,		/* I - Job */
+           const void *buffer,		/* I - Data */
+           size_t     bytes)		/* I - Number of bytes */
+{
+  if (job->outlen + bytes > sizeof(job->out))
+  {
+    tpclFlush(job);
+
+    if (bytes >= sizeof(job->out))
+      return (tpclSend(job, buffer, bytes));
+  }
+
+  memcpy(job->out + job->outlen, buffer, bytes);
+  job->outlen += bytes;
+
+  return (0);
+}
+
+
+/*
+ * 'tpclPrintf()' - Format a command for the callback.
+ */
+static int				/* O - 0 on success, -1 on error */
+tpclPrintf(tpcl_job_t *job,		/* I - Job */
+           const char *format,		/* I - printf-style format */
+           ...)				/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+  char		buffer[1100];		/* Command buffer */
+  int		bytes;			/* Length of command */
+
+
+  va_start(ap, format);
+  bytes = vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+
+  if (bytes < 0 || (size_t)bytes >= sizeof(buffer))
+  {
+    job->error = 1;
+    return (-1);
+  }
+
+  return (tpclOutput(job, buffer, (size_t)bytes));
+}
+
+
+/*
+ * 'tpclSend()' - Write data through the callback.
+ */
+static int				/* O - 0 on success, -1 on error */
+tpclSend(tpcl_job_t *job,		/* I - Job */
+         const void *buffer,		/* I - Data */
+         size_t     bytes)		/* I - Number of bytes */
+{
+  const char	*ptr = buffer;		/* Pointer into data */
+  ssize_t	count;			/* Bytes written */
+  size_t	size;			/* New size of copy */
+  unsigned char	*temp;			/* New copy */
+
+
+  if (job->copying)
+  {
+    if (job->copy_len + bytes > job->copy_size)
+    {
+      size = job->copy_size ? job->copy_size : 65536;
+      while (size < job->copy_len + bytes)
+        size *= 2;
+
+      if ((temp = realloc(job->copy, size)) == NULL)
+      {
+        job->error = 1;
+        return (-1);
+      }
+
+      job->copy      = temp;
+      job->copy_size = size;
+      job->allocs ++;
+    }
+
+    memcpy(job->copy + job->copy_len, buffer, bytes);
+    job->copy_len += bytes;
+  }
+
+  while (bytes > 0 && !job->error)
+  {
+    if ((count = (job->cb)(job->data, ptr, bytes)) <= 0)
+    {
+      job->error = 1;
+      break;
+    }
+
+    if (job->first_byte < 0.0)
+      job->first_byte = tpclElapsed(&job->start);
+
+    ptr        += count;
+    bytes      -= (size_t)count;
+    job->bytes += (size_t)count;
+  }
+
+  return (job->error ? -1 : 0);
+}
+
+
+/*
+ * 'tpclElapsed()' - Seconds since a point in time.
+ */
+static double				/* O - Seconds */
+tpclElapsed(const struct timespec *since)	/* I - Start time */
+{
+  struct timespec now;			/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((double)(now.tv_sec - since->tv_sec) +
+          (now.tv_nsec - since->tv_nsec) / 1000000000.0);
+}
+
+
+/*
+ * 'tpclArenaReset()' - Release all page memory of a job.
+ *
+ * Blocks chained by tpclJobAlloc() are freed, and the arena grows to the
+ * most memory any page needed so far, or the given size if larger.
+ */
+static int				/* O - 0 on success, -1 on error */
+tpclArenaReset(tpcl_job_t *job,		/* I - Job */
+               size_t     bytes)	/* I - Bytes to reserve */
+{
+  void		**block;		/* Block past the arena */
+  unsigned char	*temp;			/* New arena */
+
+
+  while ((block = job->arena_extra) != NULL)
+  {
+    job->arena_extra = block[0];
+    free(block);
+  }
+
+  job->arena_used = 0;
+
+  bytes = (bytes + 15) & ~(size_t)15;
+  if (bytes < job->arena_peak)
+    bytes = job->arena_peak;
+
+  if (bytes > job->arena_size)
+  {
+    if ((temp = realloc(job->arena, bytes)) == NULL)
+      return (-1);
+
+    job->arena      = temp;
+    job->arena_size = bytes;
+    job->allocs ++;
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'tpclStartSegment()' - Start a segment of a page.
+ *
+ * A page that is not split is a single segment. Later segments of a page
+ * get a label size and image buffer of their own, the temperature stays.
+ */
+static void
+tpclStartSegment(tpcl_job_t *job)	/* I - Job */
+{
+  tpcl_page_t	*page = &job->page;	/* Current page */
+  int		length,			/* Segment length in 0.1 mm */
+		gap;			/* Gap after the segment in 0.1 mm */
+
+
+  job->page_bytes = job->bytes;
+  job->page_lines = 0;
+
+  if (job->seg_lines)
+  {
+   /*
+    * Segment lengths follow the line positions, so their rounding does not
+    * add up along the label; only the last segment is followed by the gap...
+    */
+    job->seg_height = job->seg_lines;
+    if (job->seg_height > page->lines - job->seg_first)
+      job->seg_height = page->lines - job->seg_first;
+
+    length = (int)(((double)page->length * (job->seg_first + job->seg_height) +
+                    page->lines / 2) / page->lines) -
+             (int)(((double)page->length * job->seg_first + page->lines / 2) /
+                   page->lines);
+    gap    = job->seg_first + job->seg_height < page->lines ? 0 : page->gap;
+  }
+  else
+  {
+    job->seg_height = page->lines;
+    length          = page->length;
+    gap             = page->gap;
+  }
+
+ /*
+  * Send label size, assume gap is same all the way round...
+  */
+  tpclPrintf(job, "{D%04d,%04d,%04d,%04d|}\n", length + gap, page->width,
+             length, page->width + page->gap);
+
+ /*
+  * Temperature fine adjust, for thermal transfer or direct printing...
+  */
+  if (job->seg_first == 0)
+    tpclPrintf(job, "{AY;%+03d,%d|}\n", page->darkness,
+               page->media == TPCL_MEDIA_DIRECT ? 1 : 0);
+
+  tpclPrintf(job, "{C|}\n");		/* clear image buffer */
+
+  if (page->gmode != TEC_GMODE_TOPIX)
+  {
+   /*
+    * Raw graphics are sent as a single graphics command...
+    */
+    tpclPrintf(job, "{SG;0000,0000,%04u,%04u,%d,", page->bytes_per_line * 8,
+               job->seg_height, page->gmode);
+  }
+  else
+  {
+    if (job->seg_first)
+      memset(job->last_buffer, 0, page->bytes_per_line);
+
+    job->comp_ptr       = job->comp_buffer;
+    job->comp_last_line = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &job->band_start);
+  }
+}
+
+
+/*
+ * 'tpclEndSegment()' - Issue a segment of a page.
+ *
+ * Segments before the last are issued once in batch mode without cutting,
+ * so the label comes out in one piece; they are sent right away, which
+ * keeps a cancel from splitting a raw graphics command.
+ */
+static void
+tpclEndSegment(tpcl_job_t *job,		/* I - Job */
+               int        last)		/* I - Non-zero for the last segment */
+{
+  tpcl_page_t	*page = &job->page;	/* Current page */
+
+
+ /*
+  * Terminate sending graphics.
+  * If not in TOPIX mode, we also need to close the raw graphics output.
+  */
+  if (page->gmode == TEC_GMODE_TOPIX)
+    TOPIXCompressOutputBuffer(job, 0);
+  else
+    tpclPrintf(job, "|}\n");
+
+ /*
+  * End the label and eject...
+  */
+  if (last)
+    tpclPrintf(job, "{XS;I,%04d,%03d%d%c%c%d%d%d|}\n",
+               job->seg_lines ? 1 : page->copies, page->cut_interval,
+               page->detect, page->mode, page->speed, page->media,
+               page->mirror, 0);
+  else
+  {
+    tpclPrintf(job, "{XS;I,%04d,%03d%d%c%c%d%d%d|}\n", 1, 0, page->detect,
+               'C', page->speed, page->media, page->mirror, 0);
+    tpclFlush(job);
+  }
+}
+
+
+/*
+ * 'tpclOutputNibbles()' - Buffer a line of graphics in nibble mode.
+ *
+ * The characters are written straight into the output buffer.
+ */
+static void
+tpclOutputNibbles(
+    tpcl_job_t          *job,		/* I - Job */
+    const unsigned char *line,		/* I - Line of graphics */
+    size_t              bytes)		/* I - Bytes in line */
+{
+  size_t	count;			/* Bytes converted at a time */
+
+
+  while (bytes > 0 && !job->error)
+  {
+    if (sizeof(job->out) - job->outlen < 64)
+      tpclFlush(job);
+
+    if ((count = (sizeof(job->out) - job->outlen) / 2) > bytes)
+      count = bytes;
+
+    tpclNibbles(job->out + job->outlen, line, count);
+
+    job->outlen += 2 * count;
+    line        += count;
+    bytes       -= count;
+  }
+}
+
+
+/*
+ * 'tpclPadLines()' - Buffer blank lines of raw graphics.
+ */
+static void
+tpclPadLines(tpcl_job_t *job,		/* I - Job */
+             unsigned   lines)		/* I - Number of lines */
+{
+  size_t	bytes = (size_t)lines * job->page.bytes_per_line,
+					/* Bytes to pad */
+		count;			/* Bytes padded at a time */
+  int		blank = 0;		/* Blank byte */
+
+
+  if (job->page.gmode == TEC_GMODE_NIBBLE_AND ||
+      job->page.gmode == TEC_GMODE_NIBBLE_OR)
+  {
+    bytes *= 2;
+    blank = '0';
+  }
+
+  while (bytes > 0 && !job->error)
+  {
+    if (job->outlen == sizeof(job->out))
+      tpclFlush(job);
+
+    if ((count = sizeof(job->out) - job->outlen) > bytes)
+      count = bytes;
+
+    memset(job->out + job->outlen, blank, count);
+
+    job->outlen += count;
+    bytes       -= count;
+  }
+}
+
+
+/*
+ * 'tpclNibbles()' - Convert graphics to ASCII nibbles.
+ *
+ * Every byte becomes two characters from '0' to '?', high nibble first,
+ * so graphics pass 7-bit links unharmed. Blocks of 16 bytes are converted
+ * with SSE2 or NEON where available.
+ */
+static void
+tpclNibbles(unsigned char       *dst,	/* O - Characters, 2 per byte */
+            const unsigned char *src,	/* I - Graphics */
+            size_t              bytes)	/* I - Number of bytes */
+{
+#ifdef __SSE2__
+  const __m128i	mask  = _mm_set1_epi8(0x0F),
+		ascii = _mm_set1_epi8(0x30);
+  __m128i	v, hi, lo;		/* Bytes and their nibbles */
+
+
+  for (; bytes >= 16; bytes -= 16, src += 16, dst += 32)
+  {
+    v  = _mm_loadu_si128((const __m128i *)src);
+    hi = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), mask), ascii);
+    lo = _mm_or_si128(_mm_and_si128(v, mask), ascii);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+
+#elif defined(__ARM_NEON)
+  const uint8x16_t mask  = vdupq_n_u8(0x0F),
+		ascii = vdupq_n_u8(0x30);
+  uint8x16_t	v;			/* Bytes */
+  uint8x16x2_t	nibbles;		/* High and low nibbles */
+
+
+  for (; bytes >= 16; bytes -= 16, src += 16, dst += 32)
+  {
+    v              = vld1q_u8(src);
+    nibbles.val[0] = vorrq_u8(vshrq_n_u8(v, 4), ascii);
+    nibbles.val[1] = vorrq_u8(vandq_u8(v, mask), ascii);
+
+    vst2q_u8(dst, nibbles);
+  }
+#endif /* __SSE2__ */
+
+  for (; bytes > 0; bytes --, src ++)
+  {
+    *dst++ = (unsigned char)(0x30 | (*src >> 4));
+    *dst++ = (unsigned char)(0x30 | (*src & 0x0F));
+  }
+}
+
+
+/*
+ * 'TOPIXCompress()' - Apply TOPIX compression mechanism to current data in buffers
+ */
+static void
+TOPIXCompress(tpcl_job_t          *job,	/* I - Job */
+              const unsigned char *line,/* I - Line of graphics */
+              unsigned            y)	/* I - Line number */
+{
+  int               i;              /* Index into line */
+  int               max;            /* Max number of items per line */
+  unsigned char     temp[8][9][9] = {{{0}}};  /* Current line */
+  int               l1, l2, l3;     /* Current Positions in line */
+  unsigned char     cl1, cl2, cl3;  /* Current Characters */
+  int               width;          /* Max width of the line */
+  unsigned char     xor;      /* Current XORed character */
+  unsigned char     *ptr;     /* Pointer into the Compressed Line Buffer */
+
+
+  width = (int)job->page.bytes_per_line;
+  max = 8 * 9 * 9;
+
+  /*
+   * Ensure that we will not overrun the buffer by sending
+   * to the output when the next line might not fit; a line takes at most
+   * its bytes plus one flag byte per 8 and per 64 bytes and the line flag.
+   * This will create multiple graphics objects depending on the size of the image.
+   */
+  if ((job->comp_ptr - job->comp_buffer) >
+      (TPCL_TOPIX_BUFFER - TOPIX_LINE_MAX(width))) {
+    TOPIXCompressOutputBuffer(job, y);
+    memset(job->last_buffer, 0, job->page.bytes_per_line);
+  }
+  else if (job->band_lines && y > job->comp_last_line &&
+           (y - job->comp_last_line >= job->band_lines ||
+            (job->band_msecs && (y & 15) == 0 &&
+             tpclElapsed(&job->band_start) * 1000.0 >= job->band_msecs)))
+  {
+   /*
+    * Low latency mode, send this band early and make the next one
+    * twice as long. Once a band would cover the page, only the buffer
+    * size limits the bands again.
+    */
+    TOPIXCompressOutputBuffer(job, y);
+    memset(job->last_buffer, 0, job->page.bytes_per_line);
+
+    job->band_lines *= 2;
+    if (job->band_lines >= job->page.lines)
+      job->band_lines = 0;
+  }
+
+  /*
+   * Perform XOR on raw data for TOPIX data
+   */
+  cl1 = 0;
+  i = 0;
+  for (l1 = 0; l1 <= 7 && i < width; l1++)
+  {
+    cl2 = 0;
+    for (l2 = 1; l2 <= 8 && i < width; l2++)
+    {
+      cl3 = 0;
+      for (l3 = 1; l3 <= 8 && i < width; l3++, i++)
+      {
+        xor = line[i] ^ job->last_buffer[i];
+        temp[l1][l2][l3] = xor;
+        if (xor > 0) {
+          // There is a change! Ensure its recorded
+          cl3 |= (1 << (8 - l3));
+        }
+      } // L3
+
+      temp[l1][l2][0] = cl3;
+      if (cl3 != 0)
+        cl2 |= (1 << (8 - l2));
+    } // L2
+
+    temp[l1][0][0] = cl2;
+    if (cl2 != 0)
+      cl1 |= (1 << (7 - l1));
+  } // L1
+
+
+  // Always add CL1 for line
+  *job->comp_ptr++ = cl1;
+
+  /*
+   * Copy the line into the compressed buffer with all the
+   * white space removed.
+   */
+  if (cl1 > 0) {
+    ptr = &temp[0][0][0];
+    for(i = 0; i < max; i++) {
+      if (*ptr != 0)
+        *job->comp_ptr++ = *ptr;
+      ptr++;
+    }
+  }
+
+  /*
+   * Copy line into last buffer ready for next loop
+   */
+  memcpy(job->last_buffer, line, job->page.bytes_per_line);
+}
+
+
+/*
+ * 'TOPIXCompressOutputBuffer()' - Send a set of data to output.
+ *
+ * Set y to 0 if this is the last line.
+ */
+static void
+TOPIXCompressOutputBuffer(tpcl_job_t *job,	/* I - Job */
+                          unsigned   y)		/* I - Line number */
+{
+  unsigned short len;
+  unsigned char  belen[2]; /* Big-endian length */
+
+  len = (unsigned short) (job->comp_ptr - job->comp_buffer);
+  if (len == 0)
+    return;
+
+  belen[0] = (unsigned char)(len >> 8);
+  belen[1] = (unsigned char)len;
+
+  /*
+   * Output the complete graphics band
+   */
+  tpclPrintf(job, "{SG;0000,%04u,%04u,%04d,%d,", job->comp_last_line,
+             job->page.bytes_per_line * 8, 300, job->page.gmode);
+  tpclOutput(job, belen, 2);                 // Length of data
+  tpclOutput(job, job->comp_buffer, len);   // Data
+  tpclPrintf(job, "|}\n");
+  tpclFlush(job);
+
+  if (y) job->comp_last_line = y;
+
+  /*
+   * Reset the Compressed Buffer, the next band overwrites what it uses
+   */
+  job->comp_ptr = job->comp_buffer;
+
+  clock_gettime(CLOCK_MONOTONIC, &job->band_start);
+}
@@ -0,0 +1,152 @@
+/*
+ *   TPCL command generation and TOPIX encoder for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2010 by Sam Lown
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPCL_H_
+#define _TPCL_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Version of the library API, the major version is the soname of libtpcl...
+ */
+#define TPCL_VERSION_MAJOR 1
+#define TPCL_VERSION_MINOR 6
+
+/*
+ * TEC Graphics Modes
+ */
+#define TEC_GMODE_TOPIX   3
+#define TEC_GMODE_HEX_AND 1
+#define TEC_GMODE_HEX_OR  5
+#define TEC_GMODE_NIBBLE_AND 0		/* ASCII, 4 dots per byte */
+#define TEC_GMODE_NIBBLE_OR  4
+
+/*
+ * Media types for the issue command...
+ */
+#define TPCL_MEDIA_DIRECT   0		/* Direct thermal */
+#define TPCL_MEDIA_THERMAL  1		/* Thermal transfer, ribbon saving */
+#define TPCL_MEDIA_THERMAL2 2		/* Thermal transfer, no ribbon saving */
+
+/*
+ * Size of the TOPIX buffer, the length of a graphics command is 16 bits...
+ */
+#define TPCL_TOPIX_BUFFER 0xFFFF
+
+/*
+ * Widest line TOPIX can describe, in bytes (4096 dots)...
+ */
+#define TPCL_TOPIX_WIDTH 512
+
+/*
+ * Defaults of the low latency mode, the first band of a page is sent after
+ * this many lines or milliseconds, later bands double in size...
+ */
+#define TPCL_BAND_LINES 64
+#define TPCL_BAND_MSECS 20
+
+/*
+ * Longest segment of a label on continuous media, in 0.1 mm; longer labels
+ * are split into segments, see tpclSetSegment()...
+ */
+#define TPCL_SEGMENT_LENGTH 5000
+
+
+/*
+ * Types...
+ */
+typedef ssize_t (*tpcl_write_cb_t)(void *data, const void *buffer,
+                                   size_t bytes);
+					/* Output callback */
+
+typedef struct tpcl_setup_s		/* Printer setup for a job */
+{
+  int		feed_adjust,		/* Feed adjust in 0.1 mm */
+		cut_adjust,		/* Cut or peel adjust in 0.1 mm */
+		backfeed_adjust,	/* Back feed adjust in 0.1 mm */
+		ribbon_forward,		/* Ribbon take-up motor, -15 to 0 */
+		ribbon_back;		/* Ribbon back motor, -15 to 0 */
+} tpcl_setup_t;
+
+typedef struct tpcl_page_s		/* Settings of a page */
+{
+  int		width,			/* Label width in 0.1 mm */
+		length,			/* Label length in 0.1 mm */
+		gap;			/* Label gap in 0.1 mm */
+  unsigned	bytes_per_line,		/* Bytes per line of graphics */
+		lines;			/* Lines of graphics */
+  int		gmode,			/* TEC_GMODE_xxx */
+		darkness,		/* Temperature adjust, -10 to 10 */
+		media,			/* TPCL_MEDIA_xxx */
+		copies,			/* Number of copies */
+		cut_interval,		/* Labels between cuts, 0 for none */
+		detect,			/* Sensor type, 0 to 4 */
+		mirror,			/* Orientation and mirror, 0 to 3 */
+		eject;			/* Non-zero to eject after the label */
+  char		mode,			/* Issue mode ('C', 'D' or 'E') */
+		speed;			/* Issue speed ('2' to 'A') */
+} tpcl_page_t;
+
+typedef struct tpcl_job_s tpcl_job_t;	/* Output state of a job */
+
+typedef struct tpcl_estimate_s		/* Encoded size of a page, estimated */
+{
+  size_t	bytes,			/* Most likely size in bytes */
+		low,			/* Lower bound */
+		high;			/* Upper bound */
+  double	seconds,		/* Transmission time at the link speed */
+		seconds_low,		/* Lower bound */
+		seconds_high;		/* Upper bound */
+  unsigned	sampled;		/* Lines looked at */
+} tpcl_estimate_t;
+
+
+/*
+ * Prototypes...
+ */
+extern int	tpclVersion(void);
+extern tpcl_job_t *tpclJobNew(tpcl_write_cb_t cb, void *data);
+extern void	tpclJobDelete(tpcl_job_t *job);
+extern void	tpclJobReset(tpcl_job_t *job);
+extern void	*tpclJobAlloc(tpcl_job_t *job, size_t bytes);
+extern int	tpclJobReserve(tpcl_job_t *job, unsigned bytes_per_line);
+extern void	tpclSetLatency(tpcl_job_t *job, unsigned lines,
+		               unsigned msecs);
+extern void	tpclSetSegment(tpcl_job_t *job, int length);
+extern int	tpclStartJob(tpcl_job_t *job, const tpcl_setup_t *setup);
+extern int	tpclStartPage(tpcl_job_t *job, const tpcl_page_t *page);
+extern int	tpclWriteLine(tpcl_job_t *job, const unsigned char *line,
+		              unsigned y);
+extern int	tpclEndPage(tpcl_job_t *job, int canceled);
+extern int	tpclCancel(tpcl_job_t *job);
+extern int	tpclFlush(tpcl_job_t *job);
+extern size_t	tpclJobBytes(const tpcl_job_t *job);
+extern int	tpclJobPages(const tpcl_job_t *job);
+extern int	tpclJobError(const tpcl_job_t *job);
+extern double	tpclJobFirstByte(const tpcl_job_t *job);
+extern unsigned	tpclJobAllocs(const tpcl_job_t *job);
+extern size_t	tpclEstimateLine(const unsigned char *prev,
+		                 const unsigned char *line, unsigned bytes);
+extern int	tpclEstimatePage(const tpcl_page_t *page,
+		                 const unsigned char *raster, unsigned step,
+		                 double bps, tpcl_estimate_t *est);
+
+#endif /* !_TPCL_H_ */
@@ -0,0 +1,991 @@
+/*
+ *   Printer application for Toshiba TEC TPCL label printers.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   main()          - Main entry for the printer application.
+ *   AutoAdd()       - Pick a driver for a discovered printer.
+ *   DriverCB()      - Set up the driver data of a printer.
+ *   DeleteCB()      - Free the driver data of a printer.
+ *   EncoderGet()    - Get an encoder from the shared pool.
+ *   EncoderPut()    - Return an encoder to the shared pool.
+ *   PrintFileCB()   - Send a TPCL file to the printer unchanged.
+ *   StartJobCB()    - Start a raster job.
+ *   StartPageCB()   - Start a page of a raster job.
+ *   WriteLineCB()   - Encode a line of graphics.
+ *   EndPageCB()     - Finish a page of a raster job.
+ *   EndJobCB()      - Finish a raster job.
+ *   StatusCB()      - Query the printer status.
+ *   StatsCB()       - Report throughput of all printers.
+ *   StatsPrinter()  - Report throughput of a printer.
+ *   SystemCB()      - Create the printer application system.
+ *   WriteDevice()   - Write encoded data to the printer.
+ *
+ * All models of tectpcl2.drv are served by one process as IPP Everywhere
+ * printers, using the model table of libtpcl (see tpclmodel.h). PAPPL runs
+ * every job in a thread of its own; the TPCL encoder keeps its state in the
+ * job, and encoders with their TOPIX buffers are shared across all printers
+ * through a small pool.
+ */
+
+#include <pappl/pappl.h>
+#include "tpcl.h"
+#include "tpclparse.h"
+#include "tpclmodel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Limits...
+ */
+#define TPCLAPP_POOL    16		/* Idle encoders kept in the pool */
+#define TPCLAPP_STATE   "/var/lib/tpclapp.state"
+					/* Default state file */
+
+
+/*
+ * Types...
+ */
+typedef struct tpclapp_driver_s		/* Driver strings of a model */
+{
+  char		description[256],	/* Driver description */
+		device_id[256];		/* IEEE-1284 device ID */
+} tpclapp_driver_t;
+
+typedef struct tpclapp_stats_s		/* Throughput of a printer */
+{
+  pthread_mutex_t mutex;		/* Lock for counters */
+  const tpcl_model_t *model;		/* Printer model */
+  char		min_size[64],		/* Smallest custom label size */
+		max_size[64];		/* Largest custom label size */
+  unsigned	jobs,			/* Jobs printed */
+		pages;			/* Labels printed */
+  unsigned long long bytes;		/* Bytes sent */
+  double	busy;			/* Seconds spent printing */
+} tpclapp_stats_t;
+
+typedef struct tpclapp_job_s		/* Encoder of a job */
+{
+  struct tpclapp_job_s *next;		/* Next idle encoder */
+  tpcl_job_t	*tpcl;			/* TPCL output state */
+  pappl_device_t *device;		/* Printer connection */
+  struct timespec start;		/* Start of job */
+} tpclapp_job_t;
+
+
+/*
+ * Local functions...
+ */
+static const char	*AutoAdd(const char *device_info,
+			         const char *device_uri,
+			         const char *device_id, void *data);
+static bool		DriverCB(pappl_system_t *system,
+			         const char *driver_name,
+			         const char *device_uri,
+			         const char *device_id,
+			         pappl_pr_driver_data_t *driver_data,
+			         ipp_t **driver_attrs, void *data);
+static void		DeleteCB(pappl_printer_t *printer,
+			         pappl_pr_driver_data_t *driver_data);
+static tpclapp_job_t	*EncoderGet(pappl_device_t *device);
+static void		EncoderPut(tpclapp_job_t *encoder);
+static bool		PrintFileCB(pappl_job_t *job,
+			            pappl_pr_options_t *options,
+			            pappl_device_t *device);
+static bool		StartJobCB(pappl_job_t *job,
+			           pappl_pr_options_t *options,
+			           pappl_device_t *device);
+static bool		StartPageCB(pappl_job_t *job,
+			            pappl_pr_options_t *options,
+			            pappl_device_t *device, unsigned page);
+static bool		WriteLineCB(pappl_job_t *job,
+			            pappl_pr_options_t *options,
+			            pappl_device_t *device, unsigned y,
+			            const unsigned char *line);
+static bool		EndPageCB(pappl_job_t *job,
+			          pappl_pr_options_t *options,
+			          pappl_device_t *device, unsigned page);
+static bool		EndJobCB(pappl_job_t *job,
+			         pappl_pr_options_t *options,
+			         pappl_device_t *device);
+static bool		StatusCB(pappl_printer_t *printer);
+static bool		StatsCB(pappl_client_t *client, void *data);
+static void		StatsPrinter(pappl_printer_t *printer, void *data);
+static pappl_system_t	*SystemCB(int num_options, cups_option_t *options,
+			          void *data);
+static ssize_t		WriteDevice(void *data, const void *buffer,
+			            size_t bytes);
+
+
+/*
+ * Label sizes in points, see the MediaSize list of tectpcl2.drv...
+ */
+static const int Sizes[][2] =
+{
+  {  90,  18 }, {  90, 162 }, { 108,  18 }, { 108,  36 }, { 108,  72 },
+  { 108, 144 }, { 144,  26 }, { 144,  36 }, { 144,  72 }, { 144,  90 },
+  { 144, 288 }, { 144, 396 }, { 162,  36 }, { 162,  90 }, { 162, 288 },
+  { 162, 396 }, { 171, 396 }, { 180,  72 }, { 180, 144 }, { 198,  90 },
+  { 216,  72 }, { 216,  90 }, { 216, 144 }, { 216, 216 }, { 216, 360 },
+  { 234, 144 }, { 234, 360 }, { 234, 396 }, { 252,  72 }, { 288,  72 },
+  { 288, 144 }, { 288, 180 }, { 288, 216 }, { 288, 288 }, { 288, 360 },
+  { 288, 432 }, { 288, 468 }, { 288, 936 }, { 284, 425 }, { 292, 564 },
+  { 432,  72 }, { 432, 144 }, { 432, 216 }, { 432, 288 }, { 432, 360 },
+  { 432, 432 }, { 432, 468 }, { 576,  72 }, { 576, 144 }, { 576, 216 },
+  { 576, 288 }, { 576, 360 }, { 576, 432 }, { 576, 468 }
+};
+
+#define NUM_SIZES (int)(sizeof(Sizes) / sizeof(Sizes[0]))
+#define DEFAULT_SIZE 34			/* w288h360 */
+
+static const char * const Methods[] =	/* tec-print-method values by
+					   TPCL_MEDIA_xxx */
+{
+  "direct-thermal",
+  "thermal-transfer",
+  "thermal-transfer-no-ribbon-saving"
+};
+
+
+/*
+ * Globals...
+ */
+static int		NumDrivers = 0;	/* Number of drivers */
+static pappl_pr_driver_t *Drivers = NULL;
+					/* Drivers for PAPPL, one per model */
+static char		SizeNames[NUM_SIZES][64];
+					/* PWG names of label sizes */
+static pthread_mutex_t	PoolMutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Lock for encoder pool */
+static tpclapp_job_t	*Pool = NULL;	/* Idle encoders */
+static int		PoolSize = 0;	/* Number of idle encoders */
+
+
+/*
+ * 'main()' - Main entry for the printer application.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			i;		/* Looping var */
+  const tpcl_model_t	*model;		/* Current model */
+  tpclapp_driver_t	*strings;	/* Driver strings */
+
+
+  NumDrivers = tpclModelCount();
+
+  if ((Drivers = calloc((size_t)NumDrivers, sizeof(pappl_pr_driver_t))) ==
+          NULL ||
+      (strings = calloc((size_t)NumDrivers, sizeof(tpclapp_driver_t))) ==
+          NULL)
+  {
+    perror("tpclapp");
+    return (1);
+  }
+
+  for (i = 0; i < NumDrivers; i ++)
+  {
+    model = tpclModelIndex(i);
+
+    snprintf(strings[i].description, sizeof(strings[i].description),
+             "Toshiba TEC %s", model->model);
+    snprintf(strings[i].device_id, sizeof(strings[i].device_id),
+             "MFG:TOSHIBA TEC;MDL:%s;CMD:TPCL;", model->model);
+
+    Drivers[i].name        = model->name;
+    Drivers[i].description = strings[i].description;
+    Drivers[i].device_id   = strings[i].device_id;
+    Drivers[i].extension   = (void *)model;
+  }
+
+  for (i = 0; i < NUM_SIZES; i ++)
+    pwgFormatSizeName(SizeNames[i], sizeof(SizeNames[i]), "oe", NULL,
+                      Sizes[i][0] * 2540 / 72, Sizes[i][1] * 2540 / 72, NULL);
+
+  return (papplMainloop(argc, argv, "1.0", NULL, NumDrivers, Drivers,
+                        AutoAdd, DriverCB, NULL, NULL, SystemCB, NULL, NULL));
+}
+
+
+/*
+ * 'AutoAdd()' - Pick a driver for a discovered printer.
+ */
+static const char *			/* O - Driver name or NULL */
+AutoAdd(const char *device_info,	/* I - Device description */
+        const char *device_uri,		/* I - Device URI */
+        const char *device_id,		/* I - IEEE-1284 device ID */
+        void       *data)		/* I - Unused */
+{
+  int			i;		/* Looping var */
+  const char		*mdl;		/* Model in device ID */
+  const tpcl_model_t	*model;		/* Current model */
+
+
+  (void)device_info;
+  (void)device_uri;
+  (void)data;
+
+  if (!device_id || (mdl = strstr(device_id, "MDL:")) == NULL)
+    return (NULL);
+
+  for (i = 0; (model = tpclModelIndex(i)) != NULL; i ++)
+    if (!strncmp(mdl + 4, model->model, strlen(model->model)))
+      return (model->name);
+
+  return (NULL);
+}
+
+
+/*
+ * 'DriverCB()' - Set up the driver data of a printer.
+ */
+static bool				/* O - true on success */
+DriverCB(
+    pappl_system_t         *system,	/* I - System */
+    const char             *driver_name,/* I - Driver name */
+    const char             *device_uri,	/* I - Device URI */
+    const char             *device_id,	/* I - IEEE-1284 device ID */
+    pappl_pr_driver_data_t *driver_data,/* O - Driver data */
+    ipp_t                  **driver_attrs,
+					/* O - Driver attributes */
+    void                   *data)	/* I - Unused */
+{
+  int			i,		/* Looping var */
+			num_methods;	/* Number of print methods */
+  const tpcl_model_t	*model = NULL;	/* Printer model */
+  tpclapp_stats_t	*stats;		/* Throughput counters */
+  const char		*methods[3];	/* Supported print methods */
+
+
+  (void)device_uri;
+  (void)device_id;
+  (void)data;
+
+  for (i = 0; i < NumDrivers; i ++)
+    if (!strcmp(driver_name, Drivers[i].name))
+      model = Drivers[i].extension;
+
+  if (!model)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_ERROR, "Unknown driver '%s'.",
+             driver_name);
+    return (false);
+  }
+
+  if ((stats = calloc(1, sizeof(tpclapp_stats_t))) == NULL)
+    return (false);
+
+  pthread_mutex_init(&stats->mutex, NULL);
+  stats->model = model;
+
+  driver_data->extension     = stats;
+  driver_data->delete_cb     = DeleteCB;
+  driver_data->printfile_cb  = PrintFileCB;
+  driver_data->rstartjob_cb  = StartJobCB;
+  driver_data->rstartpage_cb = StartPageCB;
+  driver_data->rwriteline_cb = WriteLineCB;
+  driver_data->rendpage_cb   = EndPageCB;
+  driver_data->rendjob_cb    = EndJobCB;
+  driver_data->status_cb     = StatusCB;
+  driver_data->format        = "application/vnd.toshiba-tpcl";
+
+  snprintf(driver_data->make_and_model, sizeof(driver_data->make_and_model),
+           "Toshiba TEC %s", model->model);
+
+  driver_data->kind              = PAPPL_KIND_LABEL;
+  driver_data->ppm               = 60;
+  driver_data->color_supported   = PAPPL_COLOR_MODE_MONOCHROME;
+  driver_data->color_default     = PAPPL_COLOR_MODE_MONOCHROME;
+  driver_data->raster_types      = PAPPL_PWG_RASTER_TYPE_BLACK_1;
+  driver_data->force_raster_type = PAPPL_PWG_RASTER_TYPE_BLACK_1;
+  driver_data->quality_default   = IPP_QUALITY_NORMAL;
+  driver_data->orient_default    = IPP_ORIENT_NONE;
+  driver_data->left_right        = 0;
+  driver_data->bottom_top        = 0;
+
+ /*
+  * Resolutions...
+  */
+  for (i = 0; i < 2 && model->resolutions[i]; i ++)
+  {
+    driver_data->x_resolution[i] = model->resolutions[i];
+    driver_data->y_resolution[i] = model->resolutions[i];
+  }
+
+  driver_data->num_resolution = i;
+  driver_data->x_default      = model->resolution;
+  driver_data->y_default      = model->resolution;
+
+ /*
+  * Label sizes that fit the model, plus the range of custom sizes...
+  */
+  for (i = 0; i < NUM_SIZES; i ++)
+    if (Sizes[i][0] >= model->min_width && Sizes[i][0] <= model->max_width &&
+        Sizes[i][1] >= model->min_length && Sizes[i][1] <= model->max_length)
+      driver_data->media[driver_data->num_media ++] = SizeNames[i];
+
+  pwgFormatSizeName(stats->min_size, sizeof(stats->min_size), "roll", "min",
+                    model->min_width * 2540 / 72,
+                    model->min_length * 2540 / 72, NULL);
+  driver_data->media[driver_data->num_media ++] = stats->min_size;
+
+  pwgFormatSizeName(stats->max_size, sizeof(stats->max_size), "roll", "max",
+                    model->max_width * 2540 / 72,
+                    model->max_length * 2540 / 72, NULL);
+  driver_data->media[driver_data->num_media ++] = stats->max_size;
+
+  driver_data->num_source = 1;
+  driver_data->source[0]  = "main-roll";
+
+  driver_data->num_type = 1;
+  driver_data->type[0]  = "labels";
+
+  strcpy(driver_data->media_default.size_name, SizeNames[DEFAULT_SIZE]);
+  driver_data->media_default.size_width  = Sizes[DEFAULT_SIZE][0] * 2540 / 72;
+  driver_data->media_default.size_length = Sizes[DEFAULT_SIZE][1] * 2540 / 72;
+  strcpy(driver_data->media_default.source, "main-roll");
+  strcpy(driver_data->media_default.type, "labels");
+  driver_data->media_default.tracking = PAPPL_MEDIA_TRACKING_GAP;
+  driver_data->media_ready[0]         = driver_data->media_default;
+
+  driver_data->tracking_supported = PAPPL_MEDIA_TRACKING_CONTINUOUS |
+                                    PAPPL_MEDIA_TRACKING_GAP |
+                                    PAPPL_MEDIA_TRACKING_MARK;
+
+ /*
+  * Label modes, darkness and speed...
+  */
+  driver_data->mode_supported  = PAPPL_LABEL_MODE_TEAR_OFF |
+                                 PAPPL_LABEL_MODE_PEEL_OFF |
+                                 PAPPL_LABEL_MODE_CUTTER |
+                                 PAPPL_LABEL_MODE_CUTTER_DELAYED;
+  driver_data->mode_configured = PAPPL_LABEL_MODE_TEAR_OFF;
+
+  driver_data->darkness_supported  = 21;
+  driver_data->darkness_configured = 50;
+
+  driver_data->speed_supported[0] = model->speeds[0] * 2540;
+  for (i = 0; i < 4 && model->speeds[i]; i ++)
+    driver_data->speed_supported[1] = model->speeds[i] * 2540;
+  driver_data->speed_default = model->speed * 2540;
+
+ /*
+  * Print method, chosen per printer like the MediaType option of the PPDs,
+  * the default first...
+  */
+  methods[0] = Methods[model->media_default];
+
+  for (i = TPCL_MEDIA_DIRECT, num_methods = 1; i <= TPCL_MEDIA_THERMAL2; i ++)
+    if ((model->media & TPCL_MEDIA_BIT(i)) && i != model->media_default)
+      methods[num_methods ++] = Methods[i];
+
+  driver_data->num_vendor = 1;
+  driver_data->vendor[0]  = "tec-print-method";
+
+  *driver_attrs = ippNew();
+  ippAddStrings(*driver_attrs, IPP_TAG_PRINTER, IPP_TAG_KEYWORD,
+                "tec-print-method-supported", num_methods, NULL, methods);
+  ippAddString(*driver_attrs, IPP_TAG_PRINTER, IPP_TAG_KEYWORD,
+               "tec-print-method-default", NULL, methods[0]);
+
+  return (true);
+}
+
+
+/*
+ * 'DeleteCB()' - Free the driver data of a printer.
+ */
+static void
+DeleteCB(
+    pappl_printer_t        *printer,	/* I - Printer */
+    pappl_pr_driver_data_t *driver_data)/* I - Driver data */
+{
+  tpclapp_stats_t *stats = driver_data->extension;
+					/* Throughput counters */
+
+
+  (void)printer;
+
+  if (stats)
+  {
+    pthread_mutex_destroy(&stats->mutex);
+    free(stats);
+  }
+}
+
+
+/*
+ * 'EncoderGet()' - Get an encoder from the shared pool.
+ *
+ * Encoders keep their TOPIX buffers, so jobs on any printer reuse them
+ * instead of allocating new ones.
+ */
+static tpclapp_job_t *			/* O - Encoder or NULL */
+EncoderGet(pappl_device_t *device)	/* I - Printer connection */
+{
+  tpclapp_job_t	*encoder;		/* Encoder */
+
+
+  pthread_mutex_lock(&PoolMutex);
+  if ((encoder = Pool) != NULL)
+  {
+    Pool = encoder->next;
+    PoolSize --;
+  }
+  pthread_mutex_unlock(&PoolMutex);
+
+  if (encoder)
+  {
+    tpclJobReset(encoder->tpcl);
+  }
+  else
+  {
+    if ((encoder = calloc(1, sizeof(tpclapp_job_t))) == NULL)
+      return (NULL);
+
+    if ((encoder->tpcl = tpclJobNew(WriteDevice, encoder)) == NULL)
+    {
+      free(encoder);
+      return (NULL);
+    }
+
+    tpclSetSegment(encoder->tpcl, TPCL_SEGMENT_LENGTH);
+  }
+
+  encoder->device = device;
+  encoder->next   = NULL;
+
+  clock_gettime(CLOCK_MONOTONIC, &encoder->start);
+
+  return (encoder);
+}
+
+
+/*
+ * 'EncoderPut()' - Return an encoder to the shared pool.
+ */
+static void
+EncoderPut(tpclapp_job_t *encoder)	/* I - Encoder */
+{
+  encoder->device = NULL;
+
+  pthread_mutex_lock(&PoolMutex);
+  if (PoolSize < TPCLAPP_POOL)
+  {
+    encoder->next = Pool;
+    Pool          = encoder;
+    PoolSize ++;
+    encoder       = NULL;
+  }
+  pthread_mutex_unlock(&PoolMutex);
+
+  if (encoder)
+  {
+    tpclJobDelete(encoder->tpcl);
+    free(encoder);
+  }
+}
+
+
+/*
+ * 'PrintFileCB()' - Send a TPCL file to the printer unchanged.
+ */
+static bool				/* O - true on success */
+PrintFileCB(
+    pappl_job_t        *job,		/* I - Job */
+    pappl_pr_options_t *options,	/* I - Job options */
+    pappl_device_t     *device)		/* I - Printer connection */
+{
+  int		fd;			/* Job file */
+  ssize_t	bytes;			/* Bytes read */
+  char		buffer[65536];		/* Copy buffer */
+
+
+  (void)options;
+
+  if ((fd = open(papplJobGetFilename(job), O_RDONLY)) < 0)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR, "Unable to open print file '%s': %s",
+                papplJobGetFilename(job), strerror(errno));
+    return (false);
+  }
+
+  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    if (papplDeviceWrite(device, buffer, (size_t)bytes) < 0)
+    {
+      papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+                  "Unable to send %d bytes to printer.", (int)bytes);
+      close(fd);
+      return (false);
+    }
+  }
+
+  close(fd);
+  papplJobSetImpressions(job, 1);
+  papplJobSetImpressionsCompleted(job, 1);
+
+  return (true);
+}
+
+
+/*
+ * 'StartJobCB()' - Start a raster job.
+ */
+static bool				/* O - true on success */
+StartJobCB(
+    pappl_job_t        *job,		/* I - Job */
+    pappl_pr_options_t *options,	/* I - Job options */
+    pappl_device_t     *device)		/* I - Printer connection */
+{
+  tpclapp_job_t	*encoder;		/* Encoder */
+  tpcl_setup_t	setup;			/* Printer setup */
+
+
+  (void)options;
+
+  if ((encoder = EncoderGet(device)) == NULL)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR, "Unable to allocate encoder.");
+    return (false);
+  }
+
+  papplJobSetData(job, encoder);
+
+  memset(&setup, 0, sizeof(setup));
+
+  return (!tpclStartJob(encoder->tpcl, &setup));
+}
+
+
+/*
+ * 'StartPageCB()' - Start a page of a raster job.
+ */
+static bool				/* O - true on success */
+StartPageCB(
+    pappl_job_t        *job,		/* I - Job */
+    pappl_pr_options_t *options,	/* I - Job options */
+    pappl_device_t     *device,		/* I - Printer connection */
+    unsigned           page)		/* I - Page number */
+{
+  tpclapp_job_t		*encoder = papplJobGetData(job);
+					/* Encoder */
+  pappl_pr_driver_data_t driver_data;	/* Driver data */
+  tpclapp_stats_t	*stats;		/* Throughput counters */
+  const tpcl_model_t	*model;		/* Printer model */
+  tpcl_page_t		settings;	/* Page settings */
+  const char		*method;	/* Print method */
+  int			darkness,	/* Darkness, 0 to 100 */
+			speed;		/* Speed in inches/sec */
+
+
+  (void)device;
+  (void)page;
+
+  papplPrinterGetDriverData(papplJobGetPrinter(job), &driver_data);
+  stats = driver_data.extension;
+  model = stats->model;
+
+  memset(&settings, 0, sizeof(settings));
+
+ /*
+  * Label geometry in 0.1 mm, like the CUPS filter...
+  */
+  settings.width          = (int)(options->header.cupsPageSize[0] * 254 / 72);
+  settings.length         = (int)(options->header.cupsPageSize[1] * 254 / 72);
+  settings.gap            = 20;
+  settings.bytes_per_line = options->header.cupsBytesPerLine;
+  settings.lines          = options->header.cupsHeight;
+  settings.gmode          = TEC_GMODE_TOPIX;
+  settings.copies         = 1;
+
+ /*
+  * Darkness of the printer adjusted by the job, mapped to -10 to +10...
+  */
+  darkness = options->darkness_configured + options->print_darkness;
+  if (darkness < 0)
+    darkness = 0;
+  else if (darkness > 100)
+    darkness = 100;
+
+  settings.darkness = (darkness - 50) / 5;
+
+ /*
+  * Print method...
+  */
+  method = cupsGetOption("tec-print-method", options->num_vendor,
+                         options->vendor);
+
+  if (method && !strcmp(method, Methods[TPCL_MEDIA_THERMAL]))
+    settings.media = TPCL_MEDIA_THERMAL;
+  else if (method && !strcmp(method, Methods[TPCL_MEDIA_THERMAL2]))
+    settings.media = TPCL_MEDIA_THERMAL2;
+  else
+    settings.media = TPCL_MEDIA_DIRECT;
+
+ /*
+  * Media tracking...
+  */
+  switch (options->media.tracking)
+  {
+    case PAPPL_MEDIA_TRACKING_CONTINUOUS :
+        settings.detect = 0;
+        break;
+    case PAPPL_MEDIA_TRACKING_MARK :
+        settings.detect = 1;
+        break;
+    default :
+        settings.detect = 2;
+        break;
+  }
+
+ /*
+  * Label mode...
+  */
+  settings.mode = 'C';
+
+  switch (driver_data.mode_configured)
+  {
+    case PAPPL_LABEL_MODE_PEEL_OFF :
+        settings.mode = 'D';
+        break;
+    case PAPPL_LABEL_MODE_CUTTER :
+        settings.cut_interval = 1;
+        settings.eject        = 1;
+        break;
+    case PAPPL_LABEL_MODE_CUTTER_DELAYED :
+        settings.eject = 1;
+        break;
+    default :
+        break;
+  }
+
+ /*
+  * Speed, 0 for the default of the model; the size, media and speed are
+  * then limited to what the model supports...
+  */
+  speed = options->print_speed > 0 ?
+              (int)lround(options->print_speed / 2540.0) : 0;
+
+  if (speed >= 10)
+    settings.speed = 'A';
+  else if (speed > 0)
+    settings.speed = (char)('0' + speed);
+
+  tpclModelCheck(model, &settings);
+
+  return (!tpclStartPage(encoder->tpcl, &settings));
+}
+
+
+/*
+ * 'WriteLineCB()' - Encode a line of graphics.
+ */
+static bool				/* O - true on success */
+WriteLineCB(
+    pappl_job_t         *job,		/* I - Job */
+    pappl_pr_options_t  *options,	/* I - Job options */
+    pappl_device_t      *device,	/* I - Printer connection */
+    unsigned            y,		/* I - Line number */
+    const unsigned char *line)		/* I - Line of graphics */
+{
+  tpclapp_job_t	*encoder = papplJobGetData(job);
+					/* Encoder */
+
+
+  (void)options;
+  (void)device;
+
+  return (!tpclWriteLine(encoder->tpcl, line, y));
+}
+
+
+/*
+ * 'EndPageCB()' - Finish a page of a raster job.
+ */
+static bool				/* O - true on success */
+EndPageCB(
+    pappl_job_t        *job,		/* I - Job */
+    pappl_pr_options_t *options,	/* I - Job options */
+    pappl_device_t     *device,		/* I - Printer connection */
+    unsigned           page)		/* I - Page number */
+{
+  tpclapp_job_t	*encoder = papplJobGetData(job);
+					/* Encoder */
+
+
+  (void)options;
+  (void)page;
+
+  if (tpclEndPage(encoder->tpcl, papplJobIsCanceled(job)))
+    return (false);
+
+  papplDeviceFlush(device);
+
+  return (true);
+}
+
+
+/*
+ * 'EndJobCB()' - Finish a raster job.
+ */
+static bool				/* O - true on success */
+EndJobCB(
+    pappl_job_t        *job,		/* I - Job */
+    pappl_pr_options_t *options,	/* I - Job options */
+    pappl_device_t     *device)		/* I - Printer connection */
+{
+  tpclapp_job_t		*encoder = papplJobGetData(job);
+					/* Encoder */
+  pappl_pr_driver_data_t driver_data;	/* Driver data */
+  tpclapp_stats_t	*stats;		/* Throughput counters */
+  struct timespec	end;		/* End of job */
+  double		secs;		/* Duration of job */
+  bool			ret;		/* Return value */
+
+
+  (void)options;
+  (void)device;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  secs = (double)(end.tv_sec - encoder->start.tv_sec) +
+         (end.tv_nsec - encoder->start.tv_nsec) / 1000000000.0;
+
+  papplPrinterGetDriverData(papplJobGetPrinter(job), &driver_data);
+  stats = driver_data.extension;
+
+  pthread_mutex_lock(&stats->mutex);
+  stats->jobs ++;
+  stats->pages += (unsigned)tpclJobPages(encoder->tpcl);
+  stats->bytes += tpclJobBytes(encoder->tpcl);
+  stats->busy  += secs;
+  pthread_mutex_unlock(&stats->mutex);
+
+  papplLogJob(job, PAPPL_LOGLEVEL_INFO,
+              "Sent %lu bytes for %d labels in %.3f seconds (%.0f bytes/sec), "
+              "first byte after %.3f ms.",
+              (unsigned long)tpclJobBytes(encoder->tpcl),
+              tpclJobPages(encoder->tpcl), secs,
+              secs > 0.0 ? tpclJobBytes(encoder->tpcl) / secs : 0.0,
+              tpclJobFirstByte(encoder->tpcl) * 1000.0);
+
+  ret = !tpclJobError(encoder->tpcl);
+
+  papplJobSetData(job, NULL);
+  EncoderPut(encoder);
+
+  return (ret);
+}
+
+
+/*
+ * 'StatusCB()' - Query the printer status.
+ */
+static bool				/* O - true on success */
+StatusCB(pappl_printer_t *printer)	/* I - Printer */
+{
+  pappl_device_t	*device;	/* Printer connection */
+  unsigned char		buffer[256];	/* Status response */
+  ssize_t		bytes;		/* Bytes read */
+  size_t		used;		/* Bytes parsed */
+  int			status,		/* Status code */
+			remaining;	/* Labels remaining */
+  pappl_preason_t	reasons;	/* State reasons */
+
+
+  if ((device = papplPrinterOpenDevice(printer)) == NULL)
+    return (true);
+
+  papplDevicePuts(device, "{WS|}\n");
+  papplDeviceFlush(device);
+
+  bytes  = papplDeviceRead(device, buffer, sizeof(buffer));
+  status = bytes > 0 ? tpclParseStatus(buffer, (size_t)bytes, &used,
+                                       &remaining) : -1;
+
+  papplPrinterCloseDevice(printer);
+
+  if (status < 0)
+    return (true);
+
+  switch (status)
+  {
+    case 1 :
+    case 15 :
+        reasons = PAPPL_PREASON_COVER_OPEN;
+        break;
+    case 11 :
+    case 12 :
+        reasons = PAPPL_PREASON_MEDIA_JAM;
+        break;
+    case 13 :
+        reasons = PAPPL_PREASON_MEDIA_EMPTY;
+        break;
+    default :
+        reasons = tpclStatusOk(status) ? PAPPL_PREASON_NONE :
+                                         PAPPL_PREASON_OTHER;
+        break;
+  }
+
+  if (reasons != PAPPL_PREASON_NONE)
+    papplLogPrinter(printer, PAPPL_LOGLEVEL_WARN, "Printer status %02d.",
+                    status);
+
+  papplPrinterSetReasons(printer, reasons,
+                         PAPPL_PREASON_COVER_OPEN | PAPPL_PREASON_MEDIA_JAM |
+                         PAPPL_PREASON_MEDIA_EMPTY | PAPPL_PREASON_OTHER);
+
+  return (true);
+}
+
+
+/*
+ * 'StatsCB()' - Report throughput of all printers.
+ */
+static bool				/* O - true on success */
+StatsCB(pappl_client_t *client,		/* I - Client */
+        void           *data)		/* I - System */
+{
+  if (!papplClientRespond(client, HTTP_STATUS_OK, NULL, "text/plain", 0, 0))
+    return (false);
+
+  papplClientPrintf(client,
+                    "# printer model jobs labels bytes seconds bytes/sec "
+                    "labels/min\n");
+  papplSystemIteratePrinters((pappl_system_t *)data, StatsPrinter, client);
+
+  return (true);
+}
+
+
+/*
+ * 'StatsPrinter()' - Report throughput of a printer.
+ */
+static void
+StatsPrinter(pappl_printer_t *printer,	/* I - Printer */
+             void            *data)	/* I - Client */
+{
+  pappl_pr_driver_data_t driver_data;	/* Driver data */
+  tpclapp_stats_t	*stats;		/* Throughput counters */
+  tpclapp_stats_t	copy;		/* Snapshot of counters */
+
+
+  papplPrinterGetDriverData(printer, &driver_data);
+  if ((stats = driver_data.extension) == NULL)
+    return;
+
+  pthread_mutex_lock(&stats->mutex);
+  copy = *stats;
+  pthread_mutex_unlock(&stats->mutex);
+
+  papplClientPrintf((pappl_client_t *)data,
+                    "%s \"%s\" %u %u %llu %.3f %.0f %.1f\n",
+                    papplPrinterGetName(printer), copy.model->model,
+                    copy.jobs, copy.pages, copy.bytes, copy.busy,
+                    copy.busy > 0.0 ? copy.bytes / copy.busy : 0.0,
+                    copy.busy > 0.0 ? copy.pages * 60.0 / copy.busy : 0.0);
+}
+
+
+/*
+ * 'SystemCB()' - Create the printer application system.
+ */
+static pappl_system_t *			/* O - System */
+SystemCB(int           num_options,	/* I - Number of options */
+         cups_option_t *options,	/* I - Options */
+         void          *data)		/* I - Unused */
+{
+  pappl_system_t	*system;	/* System */
+  const char		*val,		/* Current option value */
+			*logfile,	/* Log file */
+			*spooldir,	/* Spool directory */
+			*statefile;	/* State file */
+  pappl_loglevel_t	loglevel = PAPPL_LOGLEVEL_WARN;
+					/* Log level */
+  int			port = 0;	/* Port number */
+  static pappl_version_t versions[1] =	/* Firmware version info */
+  {
+    { "tpclapp", "", "1.0", { 1, 0, 0, 0 } }
+  };
+
+
+  (void)data;
+
+  if ((val = cupsGetOption("log-level", num_options, options)) != NULL)
+  {
+    if (!strcmp(val, "fatal"))
+      loglevel = PAPPL_LOGLEVEL_FATAL;
+    else if (!strcmp(val, "error"))
+      loglevel = PAPPL_LOGLEVEL_ERROR;
+    else if (!strcmp(val, "info"))
+      loglevel = PAPPL_LOGLEVEL_INFO;
+    else if (!strcmp(val, "debug"))
+      loglevel = PAPPL_LOGLEVEL_DEBUG;
+  }
+
+  if ((val = cupsGetOption("server-port", num_options, options)) != NULL)
+    port = atoi(val);
+
+  logfile   = cupsGetOption("log-file", num_options, options);
+  spooldir  = cupsGetOption("spool-directory", num_options, options);
+  if ((statefile = getenv("TPCLAPP_STATE")) == NULL)
+    statefile = TPCLAPP_STATE;
+
+  system = papplSystemCreate(PAPPL_SOPTIONS_MULTI_QUEUE |
+                             PAPPL_SOPTIONS_WEB_INTERFACE,
+                             "TPCL Printer Application", port,
+                             "_print,_universal", spooldir, logfile,
+                             loglevel, NULL, false);
+
+  papplSystemAddListeners(system, NULL);
+  papplSystemSetPrinterDrivers(system, NumDrivers, Drivers, AutoAdd, NULL,
+                               DriverCB, NULL);
+  papplSystemSetVersions(system, 1, versions);
+  papplSystemAddResourceCallback(system, "/tpcl-stats", "text/plain", StatsCB,
+                                 system);
+
+  if (!papplSystemLoadState(system, statefile))
+    papplSystemSetDefaultPrintGroup(system, NULL);
+
+  papplSystemSetSaveCallback(system, (pappl_save_cb_t)papplSystemSaveState,
+                             (void *)statefile);
+
+  return (system);
+}
+
+
+/*
+ * 'WriteDevice()' - Write encoded data to the printer.
+ */
+static ssize_t				/* O - Bytes written or -1 */
+WriteDevice(void       *data,		/* I - Encoder */
+            const void *buffer,		/* I - Data */
+            size_t     bytes)		/* I - Number of bytes */
+{
+  tpclapp_job_t	*encoder = data;	/* Encoder */
+
+
+  return (papplDeviceWrite(encoder->device, buffer, bytes));
+}
@@ -0,0 +1,789 @@
+/*
+ *   Encoder benchmark for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   Usage()      - Show program usage.
+ *   Random()     - Return the next pseudo random number.
+ *   MakeLine()   - Render a line of a synthetic label.
+ *   Discard()    - Count and drop encoder output.
+ *   Validate()   - Compare size estimates with the encoded labels.
+ *   PackLine()   - Compress a line as CUPS raster.
+ *   Decode()     - Time the raster reader on the corpus.
+ *   DecodeCUPS() - Time the libcups raster reader on the same file.
+ *   main()       - Encode a corpus of synthetic labels.
+ *
+ *   __wrap_malloc()         - Count a malloc() call.
+ *   __wrap_calloc()         - Count a calloc() call.
+ *   __wrap_realloc()        - Count a realloc() call.
+ *   __wrap_posix_memalign() - Count a posix_memalign() call.
+ *   __wrap_free()           - Count a free() call.
+ *
+ * The corpus cycles through four kinds of labels, which cover the cases
+ * TOPIX handles differently: text (short runs, many changed lines), bar
+ * codes (long runs of identical lines), dithered images (mostly changed
+ * bytes) and sparse labels (mostly blank lines). All labels are rendered
+ * before the clock starts, so only the encoder is measured. The corpus is
+ * the same on every run and is used to train profile-guided builds.
+ *
+ * Pages after the first one must not touch the heap. On Linux, the
+ * Makefile links with -Wl,--wrap for malloc(), calloc(), realloc(),
+ * posix_memalign() and free(), so every call made by the program and
+ * libtpcl goes through the counters at the end of this file. The calls
+ * made after the first page are printed, and the benchmark fails if there
+ * are any. Linkers without --wrap only get the count of tpclJobAllocs().
+ *
+ * With -e, the size estimates of tpclEstimatePage() are checked against
+ * the encoded size of every kind of label. With -r, the corpus is written
+ * as compressed CUPS raster and the time taken by the raster reader of
+ * the filter is measured instead of the encoder. With -c as well, the same
+ * file is decoded with cupsRasterReadPixels() of libcups, so the two
+ * readers can be compared.
+ */
+
+#include "tpcl.h"
+#include "raster.h"
+#include <cups/raster.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+ * Constants...
+ */
+#define BENCH_KINDS 4			/* Kinds of synthetic labels */
+
+
+/*
+ * Heap calls, counted with -DBENCH_WRAP, otherwise only libtpcl's own...
+ */
+static unsigned long	HeapAllocs = 0,	/* malloc() and friends */
+			HeapFrees = 0;	/* free() */
+
+#ifdef BENCH_WRAP
+#  define BENCH_ALLOCS(job) HeapAllocs
+#else
+#  define BENCH_ALLOCS(job) (unsigned long)tpclJobAllocs(job)
+#endif /* BENCH_WRAP */
+
+
+/*
+ * Local functions...
+ */
+static void	Usage(void);
+static unsigned	Random(unsigned *seed);
+static void	MakeLine(unsigned char *line, unsigned bytes, unsigned y,
+		         int kind, unsigned *seed);
+static ssize_t	Discard(void *data, const void *buffer, size_t bytes);
+static int	Validate(tpcl_page_t *page, const unsigned char *corpus,
+		         unsigned step);
+static size_t	PackLine(unsigned char *out, const unsigned char *line,
+		         unsigned bytes, unsigned repeat);
+static int	Decode(const unsigned char *corpus, unsigned bytes,
+		       unsigned lines, int num_labels, int compare);
+static double	DecodeCUPS(FILE *fp, const unsigned char *corpus,
+		           unsigned bytes, unsigned lines, int *labels,
+		           int *errors);
+#ifdef BENCH_WRAP
+extern void	*__real_malloc(size_t size);
+extern void	*__real_calloc(size_t count, size_t size);
+extern void	*__real_realloc(void *ptr, size_t size);
+extern int	__real_posix_memalign(void **ptr, size_t align, size_t size);
+extern void	__real_free(void *ptr);
+extern void	*__wrap_malloc(size_t size);
+extern void	*__wrap_calloc(size_t count, size_t size);
+extern void	*__wrap_realloc(void *ptr, size_t size);
+extern int	__wrap_posix_memalign(void **ptr, size_t align, size_t size);
+extern void	__wrap_free(void *ptr);
+#endif /* BENCH_WRAP */
+
+
+/*
+ * 'Usage()' - Show program usage.
+ */
+static void
+Usage(void)
+{
+  fputs("Usage: tpclbench [options]\n"
+        "Options:\n"
+        "  -c              With -r, compare with the libcups raster reader\n"
+        "  -g topix|hex|nibble\n"
+        "                  Graphics mode (default topix)\n"
+        "  -l lines        Lines per label (default 1200)\n"
+        "  -e step         Check size estimates sampling every step lines\n"
+        "  -L              Low latency mode, send first bands early\n"
+        "  -n labels       Number of labels (default 400)\n"
+        "  -r              Time the raster reader instead of the encoder\n"
+        "  -w dots         Label width in dots (default 832)\n",
+        stderr);
+  exit(1);
+}
+
+
+/*
+ * 'Random()' - Return the next pseudo random number.
+ */
+static unsigned				/* O - Number from 0 to 32767 */
+Random(unsigned *seed)			/* IO - Generator state */
+{
+  *seed = *seed * 1103515245 + 12345;
+
+  return ((*seed >> 16) & 0x7FFF);
+}
+
+
+/*
+ * 'MakeLine()' - Render a line of a synthetic label.
+ */
+static void
+MakeLine(unsigned char *line,		/* O - Line of graphics */
+         unsigned      bytes,		/* I - Bytes per line */
+         unsigned      y,		/* I - Line number */
+         int           kind,		/* I - Kind of label */
+         unsigned      *seed)		/* IO - Generator state */
+{
+  unsigned	x;			/* Byte in line */
+
+
+  memset(line, 0, bytes);
+
+  switch (kind)
+  {
+    case 0 :				/* Text, 24 line rows of glyphs */
+        if (y % 32 < 24)
+          for (x = 2; x < bytes - 2; x ++)
+            if ((x * 7 + y / 32 * 13) % 11 > 2)
+              line[x] = (unsigned char)(((x * 31 + y / 32) % 5 == 0 ?
+                                         0x3C : 0x66) << (y % 3 == 0));
+        break;
+
+    case 1 :				/* Bar code over a line of text */
+        if (y < bytes * 6)
+        {
+          for (x = 4; x < bytes - 4; x ++)
+            line[x] = (unsigned char)((x * 2654435761u >> 24) & 0xEE);
+        }
+        else if (y % 32 < 24)
+        {
+          for (x = bytes / 4; x < bytes * 3 / 4; x ++)
+            line[x] = (x + y / 32) % 3 ? 0x7E : 0x18;
+        }
+        break;
+
+    case 2 :				/* Dithered image */
+        for (x = 0; x < bytes; x ++)
+          if (Random(seed) % 256 < (x + y) % 256)
+            line[x] = (unsigned char)Random(seed);
+        break;
+
+    default :				/* Sparse, frame and a logo */
+        if (y < 8 || y % 400 < 8)
+          memset(line, 0xFF, bytes);
+        else
+        {
+          line[0]         = 0xC0;
+          line[bytes - 1] = 0x03;
+
+          if (y % 400 > 100 && y % 400 < 180)
+            for (x = bytes / 3; x < bytes / 2; x ++)
+              line[x] = 0xFF;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'Discard()' - Count and drop encoder output.
+ */
+static ssize_t				/* O - Bytes taken */
+Discard(void       *data,		/* I - Unused */
+        const void *buffer,		/* I - Data */
+        size_t     bytes)		/* I - Number of bytes */
+{
+  (void)data;
+  (void)buffer;
+
+  return ((ssize_t)bytes);
+}
+
+
+/*
+ * 'Validate()' - Compare size estimates with the encoded labels.
+ *
+ * Prints one line per kind of label with the estimate, its bounds and the
+ * size, and returns the number of labels outside the bounds.
+ */
+static int				/* O - Labels outside the bounds */
+Validate(tpcl_page_t         *page,	/* I - Label settings */
+         const unsigned char *corpus,	/* I - Rendered labels */
+         unsigned            step)	/* I - Lines per sample */
+{
+  int		kind,			/* Kind of label */
+		misses = 0;		/* Labels outside the bounds */
+  unsigned	y;			/* Line number */
+  size_t	before;			/* Bytes before the label */
+  const unsigned char *raster;		/* Lines of the label */
+  tpcl_job_t	*job;			/* Encoder */
+  tpcl_setup_t	setup;			/* Printer setup */
+  tpcl_estimate_t est;			/* Size estimate */
+  struct timespec start,		/* Start of estimate */
+		end;			/* End of estimate */
+  double	secs;			/* Estimate time */
+
+
+  if ((job = tpclJobNew(Discard, NULL)) == NULL)
+    return (BENCH_KINDS);
+
+  memset(&setup, 0, sizeof(setup));
+  tpclStartJob(job, &setup);
+
+  for (kind = 0; kind < BENCH_KINDS; kind ++)
+  {
+    raster = corpus + (size_t)kind * page->lines * page->bytes_per_line;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tpclEstimatePage(page, raster, step, 0.0, &est);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (double)(end.tv_sec - start.tv_sec) +
+           (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    tpclFlush(job);
+    before = tpclJobBytes(job);
+
+    tpclStartPage(job, page);
+    for (y = 0; y < page->lines; y ++)
+      tpclWriteLine(job, raster + (size_t)y * page->bytes_per_line, y);
+    tpclEndPage(job, 0);
+
+    before = tpclJobBytes(job) - before;
+
+    if (before < est.low || before > est.high)
+      misses ++;
+
+    printf("kind %d sampled %u estimate %lu low %lu high %lu bytes %lu "
+           "error_pct %+.2f estimate_ms %.3f\n", kind, est.sampled,
+           (unsigned long)est.bytes, (unsigned long)est.low,
+           (unsigned long)est.high, (unsigned long)before,
+           100.0 * ((double)est.bytes - (double)before) / (double)before,
+           secs * 1000.0);
+  }
+
+  tpclJobDelete(job);
+
+  return (misses);
+}
+
+
+/*
+ * 'PackLine()' - Compress a line as CUPS raster.
+ *
+ * Uses the PackBits variant of cupsRasterWritePixels() for 1 byte pixels:
+ * a line repeat count, then runs of repeated bytes and literal bytes of up
+ * to 128 each.
+ */
+static size_t				/* O - Bytes written */
+PackLine(unsigned char       *out,	/* O - Compressed line */
+         const unsigned char *line,	/* I - Line of graphics */
+         unsigned            bytes,	/* I - Bytes per line */
+         unsigned            repeat)	/* I - Times the line is used */
+{
+  unsigned char	*ptr = out;		/* Output pointer */
+  unsigned	x = 0,			/* Byte in line */
+		count;			/* Bytes in run */
+
+
+  *ptr++ = (unsigned char)(repeat - 1);
+
+  while (x < bytes)
+  {
+    if (x + 1 < bytes && line[x] == line[x + 1])
+    {
+      for (count = 2; x + count < bytes && count < 128 &&
+                      line[x + count] == line[x]; count ++);
+
+      *ptr++ = (unsigned char)(count - 1);
+      *ptr++ = line[x];
+    }
+    else
+    {
+      for (count = 1; x + count < bytes && count < 128 &&
+                      (x + count + 1 >= bytes ||
+                       line[x + count] != line[x + count + 1]); count ++);
+
+      *ptr++ = (unsigned char)(257 - count);
+      memcpy(ptr, line + x, count);
+      ptr += count;
+    }
+
+    x += count;
+  }
+
+  return ((size_t)(ptr - out));
+}
+
+
+/*
+ * 'Decode()' - Time the raster reader on the corpus.
+ *
+ * The labels are written to a temporary file first, so the time includes
+ * reading the file but not rendering or compressing the labels.
+ */
+static int				/* O - Exit status */
+Decode(const unsigned char *corpus,	/* I - Rendered labels */
+       unsigned            bytes,	/* I - Bytes per line */
+       unsigned            lines,	/* I - Lines per label */
+       int                 num_labels,	/* I - Number of labels */
+       int                 compare)	/* I - Compare with libcups */
+{
+  int		i,			/* Looping var */
+		errors = 0,		/* Lines read back wrong */
+		cups_labels,		/* Labels read by libcups */
+		cups_errors;		/* Lines libcups read back wrong */
+  unsigned	y,			/* Line number */
+		repeat;			/* Times the line is used */
+  unsigned	sync = 0x52615332;	/* "RaS2" */
+  FILE		*fp;			/* Raster file */
+  unsigned char	*packed;		/* Compressed line */
+  const unsigned char *label,		/* Lines of the label */
+		*line;			/* Decoded line */
+  cups_page_header2_t header;		/* Page header */
+  raster_t	*ras;			/* Raster stream */
+  long		size;			/* Size of the raster file */
+  struct timespec start,		/* Start of decoding */
+		end;			/* End of decoding */
+  double	secs,			/* Decoding time */
+		cups_secs,		/* Decoding time of libcups */
+		raster;			/* Raster bytes decoded */
+
+
+  if ((fp = tmpfile()) == NULL || (packed = malloc(2 * bytes + 2)) == NULL)
+  {
+    perror("tpclbench");
+    return (1);
+  }
+
+  memset(&header, 0, sizeof(header));
+
+  header.cupsWidth        = bytes * 8;
+  header.cupsHeight       = lines;
+  header.cupsBitsPerColor = 1;
+  header.cupsBitsPerPixel = 1;
+  header.cupsBytesPerLine = bytes;
+  header.NumCopies        = 1;
+
+  fwrite(&sync, sizeof(sync), 1, fp);
+
+  for (i = 0; i < num_labels; i ++)
+  {
+    label = corpus + (size_t)(i % BENCH_KINDS) * lines * bytes;
+
+    fwrite(&header, sizeof(header), 1, fp);
+
+    for (y = 0; y < lines; y += repeat)
+    {
+      for (repeat = 1; y + repeat < lines && repeat < 256 &&
+                       !memcmp(label + (size_t)y * bytes,
+                               label + (size_t)(y + repeat) * bytes, bytes);
+           repeat ++);
+
+      fwrite(packed, PackLine(packed, label + (size_t)y * bytes, bytes,
+                              repeat), 1, fp);
+    }
+  }
+
+  free(packed);
+
+  fflush(fp);
+  size = ftell(fp);
+  rewind(fp);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ((ras = rasterOpen(fileno(fp))) == NULL)
+  {
+    perror("tpclbench");
+    return (1);
+  }
+
+  for (i = 0; rasterReadHeader(ras, &header); i ++)
+  {
+    label = corpus + (size_t)(i % BENCH_KINDS) * lines * bytes;
+
+    for (y = 0; y < header.cupsHeight; y ++)
+      if ((line = rasterReadLine(ras)) == NULL ||
+          memcmp(line, label + (size_t)y * bytes, bytes))
+        errors ++;
+  }
+
+  rasterClose(ras);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  secs   = (double)(end.tv_sec - start.tv_sec) +
+           (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+  raster = (double)num_labels * lines * bytes;
+
+  if (!compare)
+  {
+    fclose(fp);
+
+    printf("labels %d seconds %.3f labels_per_sec %.1f raster_mb_per_sec %.1f "
+           "ratio %.2f errors %d\n", i, secs, i / secs,
+           raster / secs / 1048576.0, raster / (double)size, errors);
+
+    return (errors != 0 || i != num_labels);
+  }
+
+ /*
+  * Both readers are checked against the rendered labels, so lines that
+  * pass are the same from both...
+  */
+  rewind(fp);
+
+  cups_secs = DecodeCUPS(fp, corpus, bytes, lines, &cups_labels,
+                         &cups_errors);
+
+  fclose(fp);
+
+  printf("labels %d seconds %.3f raster_mb_per_sec %.1f errors %d "
+         "cups_seconds %.3f cups_raster_mb_per_sec %.1f cups_errors %d "
+         "speedup %.2f\n", i, secs, raster / secs / 1048576.0, errors,
+         cups_secs, raster / cups_secs / 1048576.0, cups_errors,
+         cups_secs / secs);
+
+  return (errors != 0 || cups_errors != 0 || i != num_labels ||
+          cups_labels != num_labels);
+}
+
+
+/*
+ * 'DecodeCUPS()' - Time the libcups raster reader on the same file.
+ *
+ * Lines are copied into a buffer with cupsRasterReadPixels(), as the
+ * filter did before it had a raster reader of its own.
+ */
+static double				/* O - Seconds taken */
+DecodeCUPS(FILE                *fp,	/* I - Raster file */
+           const unsigned char *corpus,	/* I - Rendered labels */
+           unsigned            bytes,	/* I - Bytes per line */
+           unsigned            lines,	/* I - Lines per label */
+           int                 *labels,	/* O - Labels read */
+           int                 *errors)	/* O - Lines read back wrong */
+{
+  unsigned	y;			/* Line number */
+  unsigned char	*buffer;		/* Decoded line */
+  const unsigned char *label;		/* Lines of the label */
+  cups_page_header2_t header;		/* Page header */
+  cups_raster_t	*ras;			/* Raster stream */
+  struct timespec start,		/* Start of decoding */
+		end;			/* End of decoding */
+
+
+  *labels = 0;
+  *errors = 0;
+
+  if ((buffer = malloc(bytes)) == NULL)
+  {
+    perror("tpclbench");
+    return (0.0);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  ras = cupsRasterOpen(fileno(fp), CUPS_RASTER_READ);
+
+  while (cupsRasterReadHeader2(ras, &header))
+  {
+    label = corpus + (size_t)(*labels % BENCH_KINDS) * lines * bytes;
+
+    for (y = 0; y < header.cupsHeight; y ++)
+      if (cupsRasterReadPixels(ras, buffer, bytes) != bytes ||
+          memcmp(buffer, label + (size_t)y * bytes, bytes))
+        (*errors) ++;
+
+    (*labels) ++;
+  }
+
+  cupsRasterClose(ras);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  free(buffer);
+
+  return ((double)(end.tv_sec - start.tv_sec) +
+          (end.tv_nsec - start.tv_nsec) / 1000000000.0);
+}
+
+
+/*
+ * 'main()' - Encode a corpus of synthetic labels.
+ *
+ * The result is printed as one line of "name value" pairs, so runs of
+ * different builds can be compared with a script.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		ch;			/* Option */
+  int		i,			/* Looping var */
+		num_labels = 400,	/* Labels to encode */
+		kind;			/* Kind of label */
+  unsigned	y,			/* Line number */
+		step = 0,		/* Lines per estimate sample */
+		width = 832,		/* Width in dots */
+		lines = 1200,		/* Lines per label */
+		bytes,			/* Bytes per line */
+		seed = 1;		/* Generator state */
+  unsigned long	allocs = 0,		/* Allocations after the first page */
+		frees = 0;		/* Frees after the first page */
+  int		gmode = TEC_GMODE_TOPIX,/* Graphics mode */
+		latency = 0,		/* Low latency mode */
+		decode = 0,		/* Time the raster reader */
+		compare = 0,		/* Compare with libcups */
+		validate = 0;		/* Check size estimates */
+  unsigned char	*corpus;		/* Rendered labels */
+  tpcl_job_t	*job;			/* Encoder */
+  tpcl_setup_t	setup;			/* Printer setup */
+  tpcl_page_t	page;			/* Label settings */
+  struct timespec start,		/* Start of encoding */
+		end;			/* End of encoding */
+  double	secs,			/* Encoding time */
+		raster;			/* Raster bytes encoded */
+
+
+  while ((ch = getopt(argc, argv, "ce:g:l:Ln:rw:")) != -1)
+  {
+    switch (ch)
+    {
+      case 'c' :
+          compare = 1;
+          break;
+      case 'e' :
+          step     = (unsigned)atoi(optarg);
+          validate = 1;
+          break;
+      case 'g' :
+          if (!strcmp(optarg, "topix"))
+            gmode = TEC_GMODE_TOPIX;
+          else if (!strcmp(optarg, "hex"))
+            gmode = TEC_GMODE_HEX_OR;
+          else if (!strcmp(optarg, "nibble"))
+            gmode = TEC_GMODE_NIBBLE_OR;
+          else
+            Usage();
+          break;
+      case 'l' :
+          if ((lines = (unsigned)atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'L' :
+          latency = 1;
+          break;
+      case 'n' :
+          if ((num_labels = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'r' :
+          decode = 1;
+          break;
+      case 'w' :
+          if ((width = (unsigned)atoi(optarg)) < 64)
+            Usage();
+          break;
+      default :
+          Usage();
+    }
+  }
+
+  if (optind < argc || (compare && !decode))
+    Usage();
+
+ /*
+  * Render the corpus...
+  */
+  bytes = (width + 7) / 8;
+
+  if ((corpus = malloc((size_t)BENCH_KINDS * lines * bytes)) == NULL)
+  {
+    perror("tpclbench");
+    return (1);
+  }
+
+  for (kind = 0; kind < BENCH_KINDS; kind ++)
+    for (y = 0; y < lines; y ++)
+      MakeLine(corpus + ((size_t)kind * lines + y) * bytes, bytes, y, kind,
+               &seed);
+
+  if (decode)
+  {
+    i = Decode(corpus, bytes, lines, num_labels, compare);
+    free(corpus);
+    return (i);
+  }
+
+ /*
+  * Encode all labels as one job...
+  */
+  if ((job = tpclJobNew(Discard, NULL)) == NULL)
+  {
+    perror("tpclbench");
+    return (1);
+  }
+
+  if (latency)
+    tpclSetLatency(job, TPCL_BAND_LINES, TPCL_BAND_MSECS);
+
+  memset(&setup, 0, sizeof(setup));
+  memset(&page, 0, sizeof(page));
+
+  page.width          = (int)(width * 254 / 2030);
+  page.length         = (int)(lines * 254 / 2030);
+  page.gap            = 20;
+  page.bytes_per_line = bytes;
+  page.lines          = lines;
+  page.gmode          = gmode;
+  page.copies         = 1;
+  page.mode           = 'C';
+  page.speed          = '3';
+
+  if (validate)
+  {
+    i = Validate(&page, corpus, step);
+    free(corpus);
+    return (i != 0);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  tpclStartJob(job, &setup);
+
+  for (i = 0; i < num_labels; i ++)
+  {
+    kind = i % BENCH_KINDS;
+
+    tpclStartPage(job, &page);
+    for (y = 0; y < lines; y ++)
+      tpclWriteLine(job, corpus + ((size_t)kind * lines + y) * bytes, y);
+    tpclEndPage(job, 0);
+
+    if (i == 0)
+    {
+      allocs = BENCH_ALLOCS(job);
+      frees  = HeapFrees;
+    }
+  }
+
+  tpclFlush(job);
+
+  allocs = BENCH_ALLOCS(job) - allocs;
+  frees  = HeapFrees - frees;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  secs   = (double)(end.tv_sec - start.tv_sec) +
+           (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+  raster = (double)num_labels * lines * bytes;
+
+  printf("labels %d seconds %.3f labels_per_sec %.1f raster_mb_per_sec %.1f "
+         "ratio %.2f first_byte_ms %.3f page_allocs %lu page_frees %lu\n",
+         num_labels, secs, num_labels / secs, raster / secs / 1048576.0,
+         raster / (double)tpclJobBytes(job),
+         tpclJobFirstByte(job) * 1000.0, allocs, frees);
+
+  if (allocs || frees)
+    fprintf(stderr, "tpclbench: %lu heap allocations and %lu frees after the "
+                    "first page\n", allocs, frees);
+
+  tpclJobDelete(job);
+  free(corpus);
+
+  return (allocs != 0 || frees != 0);
+}
+
+
+#ifdef BENCH_WRAP
+/*
+ * '__wrap_malloc()' - Count a malloc() call.
+ */
+void *					/* O - Memory or NULL */
+__wrap_malloc(size_t size)		/* I - Bytes to allocate */
+{
+  __atomic_fetch_add(&HeapAllocs, 1, __ATOMIC_RELAXED);
+
+  return (__real_malloc(size));
+}
+
+
+/*
+ * '__wrap_calloc()' - Count a calloc() call.
+ */
+void *					/* O - Memory or NULL */
+__wrap_calloc(size_t count,		/* I - Number of elements */
+              size_t size)		/* I - Size of an element */
+{
+  __atomic_fetch_add(&HeapAllocs, 1, __ATOMIC_RELAXED);
+
+  return (__real_calloc(count, size));
+}
+
+
+/*
+ * '__wrap_realloc()' - Count a realloc() call.
+ */
+void *					/* O - Memory or NULL */
+__wrap_realloc(void   *ptr,		/* I - Memory or NULL */
+               size_t size)		/* I - New size */
+{
+  __atomic_fetch_add(&HeapAllocs, 1, __ATOMIC_RELAXED);
+
+  return (__real_realloc(ptr, size));
+}
+
+
+/*
+ * '__wrap_posix_memalign()' - Count a posix_memalign() call.
+ */
+int					/* O - 0 or error number */
+__wrap_posix_memalign(void   **ptr,	/* O - Memory */
+                      size_t align,	/* I - Alignment */
+                      size_t size)	/* I - Bytes to allocate */
+{
+  __atomic_fetch_add(&HeapAllocs, 1, __ATOMIC_RELAXED);
+
+  return (__real_posix_memalign(ptr, align, size));
+}
+
+
+/*
+ * '__wrap_free()' - Count a free() call.
+ */
+void
+__wrap_free(void *ptr)			/* I - Memory or NULL */
+{
+  if (ptr)
+    __atomic_fetch_add(&HeapFrees, 1, __ATOMIC_RELAXED);
+
+  __real_free(ptr);
+}
+#endif /* BENCH_WRAP */
@@ -0,0 +1,837 @@
+/*
+ *   Prefork filter daemon for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   tpcldSubmit()  - Hand a job to the daemon.
+ *   tpcldRun()     - Run the supervisor of the worker pool.
+ *   tpcldMetrics() - Get the counters of a printer for the current worker.
+ *   Log()          - Write a message to stderr.
+ *   ReadFull()     - Read an exact number of bytes.
+ *   SubmitCancel() - Note a cancel request while waiting for a worker.
+ *   Spawn()        - Start a worker in a free slot.
+ *   Worker()       - Main loop of a worker.
+ *   ServeJob()     - Run one job handed to a worker.
+ *   ServeMetrics() - Answer a metrics scrape with the pool state added.
+ *   StopDaemon()   - Ask the supervisor or a worker to shut down.
+ *   Wakeup()       - Interrupt the supervisor's sleep.
+ *
+ * The supervisor keeps a pool of forked workers, each with the PPDs loaded
+ * by the caller and its encoder buffers allocated before the first job.
+ * Workers accept connections on a Unix socket themselves. A client, i.e.
+ * the filter started by CUPS, passes its standard input, output and error
+ * with SCM_RIGHTS along with its arguments, so the worker reads the
+ * raster and writes TPCL exactly as the filter would, and then waits for
+ * the exit status.
+ *
+ * The pool grows by one worker whenever all workers are busy, up to the
+ * maximum, and workers idle for TPCLD_IDLE seconds are retired down to
+ * the minimum. Workers still warming up count as idle for growing, as
+ * they take jobs as soon as they are ready, but are never retired. A
+ * worker that crashes only fails its own job; the supervisor replaces it.
+ *
+ * Each worker slot owns one shard of the metrics (see metrics.c), which
+ * the supervisor sums up when scraped.
+ */
+
+#include "tpcld.h"
+#include "metrics.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/*
+ * Limits...
+ */
+#define TPCLD_MAGIC   0x5450434c	/* "TPCL" */
+#define TPCLD_REQUEST 65536		/* Largest request */
+#define TPCLD_IDLE    30		/* Seconds before an idle worker retires */
+#define TPCLD_TICK    250		/* Supervisor interval in ms */
+
+
+/*
+ * Types...
+ */
+typedef struct tpcld_header_s		/* Request header */
+{
+  uint32_t	magic,			/* TPCLD_MAGIC */
+		argc,			/* Number of arguments */
+		length;			/* Bytes of strings that follow */
+} tpcld_header_t;
+
+typedef struct tpcld_slot_s		/* Worker slot, shared with workers */
+{
+  pid_t		pid;			/* Process ID or 0 if free */
+  int		quitting;		/* Non-zero once asked to quit */
+  volatile int	warming,		/* Non-zero until warmed up */
+		busy;			/* Non-zero while running a job */
+  volatile time_t idle;			/* Time the worker became idle */
+  volatile unsigned jobs;		/* Jobs run */
+} tpcld_slot_t;
+
+
+/*
+ * Globals...
+ */
+static tpcld_slot_t	*Slots = NULL;	/* Worker slots */
+static int		NumSlots = 0,	/* Number of slots */
+			Shard = -1,	/* Slot of this worker */
+			MetricsFd = -1;	/* Metrics listener */
+static unsigned		Crashes = 0;	/* Workers lost */
+static metrics_t	*Metrics = NULL;/* Counters of all workers */
+static volatile sig_atomic_t Stop = 0,	/* Non-zero to shut down */
+			Cancel = 0;	/* Non-zero after SIGTERM in client */
+static tpcld_warm_cb_t	WarmCB = NULL;	/* Worker preparation */
+static tpcld_job_cb_t	JobCB = NULL;	/* Job function */
+
+
+/*
+ * Local functions...
+ */
+static void	Log(const char *level, const char *format, ...)
+		__attribute__((format(printf, 2, 3)));
+static int	ReadFull(int fd, void *buffer, size_t bytes);
+static void	SubmitCancel(int sig);
+static int	Spawn(int listener, int slot);
+static void	Worker(int listener, int slot);
+static void	ServeJob(int fd, const int *saved);
+static void	ServeMetrics(void);
+static void	StopDaemon(int sig);
+static void	Wakeup(int sig);
+
+
+/*
+ * 'tpcldSubmit()' - Hand a job to the daemon.
+ *
+ * Returns -1 if no daemon took the job, in which case nothing has been
+ * read from standard input and the caller should process the job itself.
+ */
+int					/* O - Exit status or -1 */
+tpcldSubmit(const char *sockname,	/* I - Socket of the daemon */
+            int        argc,		/* I - Number of arguments */
+            char       *argv[])		/* I - Arguments */
+{
+  int			fd,		/* Connection to daemon */
+			i,		/* Looping var */
+			fds[3] = { 0, 1, 2 };
+					/* Descriptors to pass */
+  int32_t		reply[2];	/* Worker PID and exit status */
+  char			*buffer;	/* Request strings */
+  const char		*ppd,		/* PPD file */
+			*str;		/* Current string */
+  size_t		len,		/* Length of current string */
+			length = 0;	/* Length of request strings */
+  tpcld_header_t	header;		/* Request header */
+  struct sockaddr_un	addr;		/* Socket address */
+  struct iovec		iov[2];		/* Header and strings */
+  struct msghdr		msg;		/* Request message */
+  union
+  {
+    struct cmsghdr	align;		/* Alignment */
+    char		buf[CMSG_SPACE(sizeof(fds))];
+  }			control;	/* Descriptors */
+  struct cmsghdr	*cmsg;		/* Control message */
+  struct sigaction	action,		/* Cancel handler */
+			oldaction;	/* Previous handler */
+  ssize_t		bytes;		/* Bytes read */
+
+
+  if (strlen(sockname) >= sizeof(addr.sun_path))
+    return (-1);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockname);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return (-1);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+  {
+    close(fd);
+    return (-1);
+  }
+
+ /*
+  * Build the request: all arguments and the PPD file name...
+  */
+
+  if ((ppd = getenv("PPD")) == NULL)
+    ppd = "";
+
+  if ((buffer = malloc(TPCLD_REQUEST)) == NULL)
+  {
+    close(fd);
+    return (-1);
+  }
+
+  for (i = 0; i <= argc; i ++)
+  {
+    str = i < argc ? argv[i] : ppd;
+
+    if ((len = strlen(str) + 1) > TPCLD_REQUEST - length)
+    {
+      free(buffer);
+      close(fd);
+      return (-1);
+    }
+
+    memcpy(buffer + length, str, len);
+    length += len;
+  }
+
+  header.magic  = TPCLD_MAGIC;
+  header.argc   = (uint32_t)argc;
+  header.length = (uint32_t)length;
+
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = buffer;
+  iov[1].iov_len  = length;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov        = iov;
+  msg.msg_iovlen     = 2;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  cmsg             = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  bytes = sendmsg(fd, &msg, 0);
+  free(buffer);
+
+ /*
+  * The worker answers with its PID before touching the job; without it
+  * the job is still ours to print...
+  */
+
+  if (bytes != (ssize_t)(sizeof(header) + length) ||
+      ReadFull(fd, reply, sizeof(reply[0])))
+  {
+    close(fd);
+    return (-1);
+  }
+
+  fprintf(stderr, "DEBUG: Job handed to filter daemon worker %d.\n",
+          (int)reply[0]);
+
+ /*
+  * Wait for the exit status, passing a cancel on to the worker...
+  */
+
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = SubmitCancel;
+  sigaction(SIGTERM, &action, &oldaction);
+
+  for (;;)
+  {
+    if ((bytes = read(fd, reply + 1, sizeof(reply[1]))) == sizeof(reply[1]))
+      break;
+
+    if (bytes < 0 && errno == EINTR)
+    {
+      if (Cancel)
+      {
+        kill((pid_t)reply[0], SIGTERM);
+        Cancel = 0;
+      }
+      continue;
+    }
+
+    fputs("ERROR: Filter daemon worker stopped unexpectedly.\n", stderr);
+    reply[1] = 1;
+    break;
+  }
+
+  sigaction(SIGTERM, &oldaction, NULL);
+  close(fd);
+
+  return ((int)reply[1]);
+}
+
+
+/*
+ * 'tpcldRun()' - Run the supervisor of the worker pool.
+ */
+int					/* O - Exit status */
+tpcldRun(const char      *sockname,	/* I - Socket to listen on */
+         int             min_workers,	/* I - Workers kept running */
+         int             max_workers,	/* I - Most workers at a time */
+         const char      *metrics,	/* I - Metrics address or NULL */
+         tpcld_warm_cb_t warm_cb,	/* I - Worker preparation or NULL */
+         tpcld_job_cb_t  job_cb)	/* I - Job function */
+{
+  int			listener,	/* Listening socket */
+			i,		/* Looping var */
+			status,		/* Exit status of worker */
+			total,		/* Running workers */
+			idle;		/* Idle workers */
+  pid_t			pid;		/* Exited worker */
+  time_t		now;		/* Current time */
+  struct sockaddr_un	addr;		/* Socket address */
+  struct sigaction	action;		/* Signal actions */
+  struct pollfd		pfd;		/* Metrics listener poll */
+  mode_t		mask;		/* Saved umask */
+
+
+  if (min_workers < 1)
+    min_workers = 1;
+  if (max_workers < min_workers)
+    max_workers = min_workers;
+
+  WarmCB   = warm_cb;
+  JobCB    = job_cb;
+  NumSlots = max_workers;
+
+  if ((Slots = mmap(NULL, (size_t)NumSlots * sizeof(tpcld_slot_t),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1,
+                    0)) == MAP_FAILED)
+  {
+    Log("ERROR", "Unable to allocate worker slots - %s", strerror(errno));
+    return (1);
+  }
+
+  memset(Slots, 0, (size_t)NumSlots * sizeof(tpcld_slot_t));
+
+  if ((Metrics = metricsNew(NumSlots)) == NULL)
+    Log("ERROR", "Unable to allocate metrics - %s", strerror(errno));
+
+  if (metrics && Metrics && (MetricsFd = metricsListen(metrics)) < 0)
+  {
+    Log("ERROR", "Unable to serve metrics on %s - %s", metrics,
+        strerror(errno));
+    return (1);
+  }
+
+ /*
+  * Listen on the socket...
+  */
+
+  if (strlen(sockname) >= sizeof(addr.sun_path))
+  {
+    Log("ERROR", "Socket name %s is too long.", sockname);
+    return (1);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockname);
+
+  unlink(sockname);
+
+ /*
+  * Only the user of the daemon, i.e. the CUPS filters, may connect; the
+  * socket is never accessible to others, not even between bind() and
+  * chmod()...
+  */
+
+  mask = umask(077);
+
+  if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      chmod(sockname, 0600) || listen(listener, 128))
+  {
+    Log("ERROR", "Unable to listen on %s - %s", sockname, strerror(errno));
+    umask(mask);
+    return (1);
+  }
+
+  umask(mask);
+
+  fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+  fcntl(listener, F_SETFD, FD_CLOEXEC);
+
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = StopDaemon;
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+  action.sa_handler = Wakeup;
+  sigaction(SIGCHLD, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  Log("INFO", "Listening on %s with %d to %d workers.", sockname, min_workers,
+      max_workers);
+
+ /*
+  * Supervise the pool...
+  */
+
+  while (!Stop)
+  {
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+      for (i = 0; i < NumSlots; i ++)
+        if (Slots[i].pid == pid)
+        {
+          if (WIFSIGNALED(status))
+          {
+            Log("ERROR", "Worker %d crashed with signal %d after %u jobs.",
+                (int)pid, WTERMSIG(status), Slots[i].jobs);
+            Crashes ++;
+          }
+          else if (!Slots[i].quitting)
+          {
+            Log("ERROR", "Worker %d exited with status %d.", (int)pid,
+                WEXITSTATUS(status));
+            Crashes ++;
+          }
+          else
+            Log("DEBUG", "Worker %d retired after %u jobs.", (int)pid,
+                Slots[i].jobs);
+
+          memset(Slots + i, 0, sizeof(tpcld_slot_t));
+          break;
+        }
+    }
+
+    now = time(NULL);
+
+    for (i = 0, total = 0, idle = 0; i < NumSlots; i ++)
+      if (Slots[i].pid && !Slots[i].quitting)
+      {
+        total ++;
+        if (Slots[i].warming || !Slots[i].busy)
+          idle ++;
+      }
+
+    if (total < min_workers || (idle == 0 && total < max_workers))
+    {
+     /*
+      * Replace lost workers, or grow by one when all are busy...
+      */
+
+      for (i = 0; i < NumSlots; i ++)
+        if (!Slots[i].pid)
+        {
+          if (!Spawn(listener, i) && total >= min_workers)
+            Log("DEBUG", "All workers busy, started worker %d of %d.",
+                total + 1, max_workers);
+          break;
+        }
+    }
+    else if (idle > 1 && total > min_workers)
+    {
+     /*
+      * Retire one worker that has been idle for a while...
+      */
+
+      for (i = 0; i < NumSlots; i ++)
+        if (Slots[i].pid && !Slots[i].quitting && !Slots[i].warming &&
+            !Slots[i].busy && now - Slots[i].idle >= TPCLD_IDLE)
+        {
+          Slots[i].quitting = 1;
+          kill(Slots[i].pid, SIGUSR1);
+          break;
+        }
+    }
+
+    pfd.fd     = MetricsFd;
+    pfd.events = POLLIN;
+
+    if (poll(&pfd, MetricsFd >= 0, total < min_workers ? 0 : TPCLD_TICK) > 0)
+      ServeMetrics();
+  }
+
+ /*
+  * Shut down, letting busy workers finish their job...
+  */
+
+  Log("INFO", "Shutting down.");
+
+  for (i = 0; i < NumSlots; i ++)
+    if (Slots[i].pid)
+      kill(Slots[i].pid, SIGUSR1);
+
+  while (wait(NULL) > 0 || errno == EINTR);
+
+  close(listener);
+  unlink(sockname);
+
+  if (MetricsFd >= 0)
+  {
+    close(MetricsFd);
+
+    if (strchr(metrics, '/'))
+      unlink(metrics);
+  }
+
+  metricsDelete(Metrics);
+
+  return (0);
+}
+
+
+/*
+ * 'tpcldMetrics()' - Get the counters of a printer for the current worker.
+ *
+ * Outside of a daemon worker the counters are valid but not reported.
+ */
+metrics_counters_t *			/* O - Counters */
+tpcldMetrics(const char *printer)	/* I - Printer name */
+{
+  return (metricsGet(Metrics, Shard, printer));
+}
+
+
+/*
+ * 'Log()' - Write a message to stderr.
+ */
+static void
+Log(const char *level,			/* I - Message level */
+    const char *format,			/* I - printf-style format */
+    ...)				/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+
+
+  fprintf(stderr, "%s: ", level);
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  putc('\n', stderr);
+}
+
+
+/*
+ * 'ReadFull()' - Read an exact number of bytes.
+ */
+static int				/* O - 0 on success, -1 on error */
+ReadFull(int    fd,			/* I - File descriptor */
+         void   *buffer,		/* I - Buffer */
+         size_t bytes)			/* I - Bytes to read */
+{
+  char		*ptr = buffer;		/* Pointer into buffer */
+  ssize_t	count;			/* Bytes read */
+
+
+  while (bytes > 0)
+  {
+    if ((count = read(fd, ptr, bytes)) < 0 && errno == EINTR)
+      continue;
+
+    if (count <= 0)
+      return (-1);
+
+    ptr   += count;
+    bytes -= (size_t)count;
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'SubmitCancel()' - Note a cancel request while waiting for a worker.
+ */
+static void
+SubmitCancel(int sig)			/* I - Signal */
+{
+  (void)sig;
+  Cancel = 1;
+}
+
+
+/*
+ * 'Spawn()' - Start a worker in a free slot.
+ */
+static int				/* O - 0 on success, -1 on error */
+Spawn(int listener,			/* I - Listening socket */
+      int slot)				/* I - Slot index */
+{
+  pid_t	pid;				/* Worker process */
+
+
+  Slots[slot].warming = 1;
+  Slots[slot].busy    = 0;
+  Slots[slot].idle    = time(NULL);
+  Slots[slot].jobs    = 0;
+
+  if ((pid = fork()) < 0)
+  {
+    Log("ERROR", "Unable to start worker - %s", strerror(errno));
+    return (-1);
+  }
+  else if (pid == 0)
+  {
+    Worker(listener, slot);
+    exit(0);
+  }
+
+  Slots[slot].pid      = pid;
+  Slots[slot].quitting = 0;
+
+  return (0);
+}
+
+
+/*
+ * 'Worker()' - Main loop of a worker.
+ */
+static void
+Worker(int listener,			/* I - Listening socket */
+       int slot)			/* I - Slot index */
+{
+  int			fd,		/* Job connection */
+			saved[3];	/* Own standard descriptors */
+  struct pollfd		pfd;		/* Listener poll */
+  struct sigaction	action;		/* Signal actions */
+
+
+ /*
+  * SIGTERM cancels jobs and is handled by the job function; SIGUSR1 asks
+  * the worker to finish...
+  */
+
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = SIG_IGN;
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+  action.sa_handler = SIG_DFL;
+  sigaction(SIGCHLD, &action, NULL);
+  action.sa_handler = StopDaemon;
+  sigaction(SIGUSR1, &action, NULL);
+
+  Stop  = 0;
+  Shard = slot;
+
+  if (MetricsFd >= 0)
+    close(MetricsFd);
+
+  saved[0] = dup(0);
+  saved[1] = dup(1);
+  saved[2] = dup(2);
+
+  if (WarmCB)
+    (WarmCB)();
+
+  Slots[slot].warming = 0;
+
+  pfd.fd     = listener;
+  pfd.events = POLLIN;
+
+  while (!Stop)
+  {
+    Slots[slot].idle = time(NULL);
+    Slots[slot].busy = 0;
+
+    if (poll(&pfd, 1, 1000) <= 0)
+      continue;
+
+    if ((fd = accept(listener, NULL, NULL)) < 0)
+      continue;				/* Another worker got it */
+
+    Slots[slot].busy = 1;
+    Slots[slot].jobs ++;
+
+    ServeJob(fd, saved);
+    close(fd);
+  }
+}
+
+
+/*
+ * 'ServeJob()' - Run one job handed to a worker.
+ */
+static void
+ServeJob(int       fd,			/* I - Job connection */
+         const int *saved)		/* I - Own standard descriptors */
+{
+  int			i,		/* Looping var */
+			fds[3];		/* Passed descriptors */
+  int32_t		reply;		/* PID, then exit status */
+  static char		buffer[TPCLD_REQUEST + 1];
+					/* Request strings */
+  char			*ptr,		/* Pointer into strings */
+			*argv[8];	/* Job arguments */
+  tpcld_header_t	header;		/* Request header */
+  struct iovec		iov;		/* Header */
+  struct msghdr		msg;		/* Request message */
+  union
+  {
+    struct cmsghdr	align;		/* Alignment */
+    char		buf[CMSG_SPACE(sizeof(fds))];
+  }			control;	/* Descriptors */
+  struct cmsghdr	*cmsg;		/* Control message */
+
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+  iov.iov_base = &header;
+  iov.iov_len  = sizeof(header);
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  if (recvmsg(fd, &msg, MSG_WAITALL) != sizeof(header) ||
+      (cmsg = CMSG_FIRSTHDR(&msg)) == NULL ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+  {
+    Log("ERROR", "Bad request, no descriptors passed.");
+    return;
+  }
+
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  if (header.magic != TPCLD_MAGIC || header.argc < 1 ||
+      header.argc > sizeof(argv) / sizeof(argv[0]) - 1 ||
+      header.length > TPCLD_REQUEST ||
+      ReadFull(fd, buffer, header.length))
+  {
+    Log("ERROR", "Bad request.");
+    goto done;
+  }
+
+  buffer[header.length] = '\0';
+
+  for (i = 0, ptr = buffer; i <= (int)header.argc; i ++)
+  {
+    if (ptr >= buffer + header.length)
+    {
+      Log("ERROR", "Bad request, missing arguments.");
+      goto done;
+    }
+
+    argv[i] = ptr;
+    ptr    += strlen(ptr) + 1;
+  }
+
+ /*
+  * Take over the client's standard descriptors and run the job...
+  */
+
+  for (i = 0; i < 3; i ++)
+    dup2(fds[i], i);
+
+  reply = (int32_t)getpid();
+  if (write(fd, &reply, sizeof(reply)) != sizeof(reply))
+    goto restore;
+
+  reply = (int32_t)(JobCB)((int)header.argc, argv, argv[header.argc]);
+
+ /*
+  * Give the descriptors back, so the client sees end of file...
+  */
+
+  restore:
+
+  for (i = 0; i < 3; i ++)
+    dup2(saved[i], i);
+
+  if (write(fd, &reply, sizeof(reply)) != sizeof(reply))
+    Log("DEBUG", "Client went away before the job finished.");
+
+  done:
+
+  for (i = 0; i < 3; i ++)
+    close(fds[i]);
+}
+
+
+/*
+ * 'ServeMetrics()' - Answer a metrics scrape with the pool state added.
+ */
+static void
+ServeMetrics(void)
+{
+  int		i,			/* Looping var */
+		warming = 0,		/* Workers warming up */
+		busy = 0,		/* Busy workers */
+		idle = 0;		/* Idle workers */
+  unsigned long	jobs = 0;		/* Jobs run by current workers */
+  char		extra[1024];		/* Pool metrics */
+
+
+  for (i = 0; i < NumSlots; i ++)
+    if (Slots[i].pid)
+    {
+      if (Slots[i].warming)
+        warming ++;
+      else if (Slots[i].busy)
+        busy ++;
+      else
+        idle ++;
+
+      jobs += Slots[i].jobs;
+    }
+
+  snprintf(extra, sizeof(extra),
+           "# HELP tpcl_daemon_workers Worker processes by state.\n"
+           "# TYPE tpcl_daemon_workers gauge\n"
+           "tpcl_daemon_workers{state=\"warming\"} %d\n"
+           "tpcl_daemon_workers{state=\"busy\"} %d\n"
+           "tpcl_daemon_workers{state=\"idle\"} %d\n"
+           "# HELP tpcl_daemon_workers_max Most worker processes.\n"
+           "# TYPE tpcl_daemon_workers_max gauge\n"
+           "tpcl_daemon_workers_max %d\n"
+           "# HELP tpcl_daemon_worker_jobs Jobs run by current workers.\n"
+           "# TYPE tpcl_daemon_worker_jobs gauge\n"
+           "tpcl_daemon_worker_jobs %lu\n"
+           "# HELP tpcl_daemon_worker_failures_total Workers crashed or "
+           "exited.\n"
+           "# TYPE tpcl_daemon_worker_failures_total counter\n"
+           "tpcl_daemon_worker_failures_total %u\n",
+           warming, busy, idle, NumSlots, jobs, Crashes);
+
+  metricsServe(MetricsFd, Metrics, extra);
+}
+
+
+/*
+ * 'StopDaemon()' - Ask the supervisor or a worker to shut down.
+ */
+static void
+StopDaemon(int sig)			/* I - Signal */
+{
+  (void)sig;
+  Stop = 1;
+}
+
+
+/*
+ * 'Wakeup()' - Interrupt the supervisor's sleep.
+ */
+static void
+Wakeup(int sig)				/* I - Signal */
+{
+  (void)sig;
+}
@@ -0,0 +1,50 @@
+/*
+ *   Prefork filter daemon for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPCLD_H_
+#define _TPCLD_H_
+
+#include "metrics.h"
+
+/*
+ * Default socket of the daemon, in a directory owned by the CUPS user
+ * (see the install target of the Makefile)...
+ */
+#define TPCLD_SOCKET "/var/run/tpcld/tpcld.sock"
+
+
+/*
+ * Types...
+ */
+typedef void (*tpcld_warm_cb_t)(void);
+					/* Prepare a new worker */
+typedef int (*tpcld_job_cb_t)(int argc, char *argv[], const char *ppd);
+					/* Run a job, returns exit status */
+
+
+/*
+ * Prototypes...
+ */
+extern int	tpcldSubmit(const char *sockname, int argc, char *argv[]);
+extern int	tpcldRun(const char *sockname, int min_workers,
+		         int max_workers, const char *metrics,
+		         tpcld_warm_cb_t warm_cb, tpcld_job_cb_t job_cb);
+extern metrics_counters_t *tpcldMetrics(const char *printer);
+
+#endif /* !_TPCLD_H_ */
@@ -0,0 +1,705 @@
+/*
+ *   Differential fuzzing harness for the TPCL encoder and raster reader.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   LLVMFuzzerTestOneInput() - Check all encoder variants on one input.
+ *   main()                   - Run inputs from files or stdin.
+ *   MakeRaster()             - Build a page of graphics from fuzz input.
+ *   Encode()                 - Encode a page with one encoder variant.
+ *   Collect()                - Append encoder output to a buffer.
+ *   Verify()                 - Decode encoder output and compare it.
+ *   CheckRaster()            - Compare the raster reader builds.
+ *   ReadRaster()             - Read a raster page with one reader build.
+ *   CheckModels()            - Check the label settings of every model.
+ *   Fail()                   - Report a mismatch and abort.
+ *
+ * The input describes a page: two bytes of line width (1 to 640 bytes, so
+ * lines too wide for TOPIX are covered), a flag byte selecting the
+ * graphics mode and the first band of low latency mode, and a program of
+ * line operations (blank, repeat, change a byte, literal bytes, invert,
+ * noise) with repeat counts. Every encoder variant encodes the page; the
+ * output of each is parsed with the TPCL parser, its graphics are
+ * decoded, and the result must equal the page. Variants that must produce
+ * the same bytes are compared byte for byte as well, and the size must be
+ * within the bounds of the size estimate. Before the first input, the
+ * settings tpclModelCheck() returns are checked for every model and speed.
+ *
+ * The same input is also read as a page of CUPS raster: the first three
+ * bytes give the line width, height, byte order, version and bits per
+ * pixel of the header, and the rest is the page data, so truncated pages,
+ * runs past the end of a line and data past the last line all occur. The
+ * page is read with raster.c as built, which uses SSE2 or NEON stores, and
+ * with a second build of raster.c with -DRASTER_SCALAR and its functions
+ * renamed (see the Makefile); both must return the same header and the
+ * same lines byte for byte, and stop at the same line.
+ *
+ * Built with -fsanitize=fuzzer for libFuzzer. With -DTPCL_FUZZ_MAIN, it
+ * reads inputs from the files named on the command line or from stdin,
+ * for AFL or to replay crashes.
+ */
+
+#include "tpcl.h"
+#include "tpclparse.h"
+#include "tpclmodel.h"
+#include "raster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Limits...
+ */
+#define FUZZ_WIDTH  640			/* Widest line in bytes */
+#define FUZZ_LINES  65535		/* Most lines of a page */
+#define FUZZ_RASTER (4 * 1024 * 1024)	/* Most bytes of a page */
+#define FUZZ_HEIGHT 2048		/* Most lines of a CUPS raster page */
+
+
+/*
+ * Types...
+ */
+typedef struct fuzz_output_s		/* Encoder output */
+{
+  unsigned char	*data;			/* Output bytes */
+  size_t	length,			/* Bytes in data */
+		size;			/* Size of data */
+} fuzz_output_t;
+
+typedef struct fuzz_reader_s		/* Raster reader build */
+{
+  const char	*name;			/* Name of the build */
+  raster_t	*(*open)(int fd);	/* rasterOpen() */
+  void		(*close)(raster_t *r);	/* rasterClose() */
+  int		(*header)(raster_t *r, cups_page_header2_t *header);
+					/* rasterReadHeader() */
+  const unsigned char *(*line)(raster_t *r);
+					/* rasterReadLine() */
+} fuzz_reader_t;
+
+typedef struct fuzz_variant_s		/* Encoder variant */
+{
+  const char	*name;			/* Name of the variant */
+  int		fresh,			/* Use a new job for every input */
+		latency,		/* Send early bands */
+		same_as;		/* Variant with identical output or -1 */
+} fuzz_variant_t;
+
+
+/*
+ * Local functions...
+ */
+extern int	LLVMFuzzerTestOneInput(const unsigned char *data, size_t size);
+static unsigned	MakeRaster(const unsigned char *data, size_t size,
+		           unsigned bytes, unsigned char *raster);
+static void	Encode(const fuzz_variant_t *variant, tpcl_job_t *job,
+		       const tpcl_page_t *page, const unsigned char *raster,
+		       unsigned band, fuzz_output_t *out);
+static ssize_t	Collect(void *data, const void *buffer, size_t bytes);
+static void	Verify(const char *name, const fuzz_output_t *out,
+		       const tpcl_page_t *page, const unsigned char *raster);
+static void	CheckRaster(const unsigned char *data, size_t size);
+static unsigned	ReadRaster(const fuzz_reader_t *reader, int fd,
+		           cups_page_header2_t *header, unsigned char *page);
+static void	CheckModels(void);
+static void	Fail(const char *name, const char *message);
+
+/*
+ * raster.c built with -DRASTER_SCALAR...
+ */
+extern raster_t	*rasterScalarOpen(int fd);
+extern void	rasterScalarClose(raster_t *r);
+extern int	rasterScalarReadHeader(raster_t *r,
+		                       cups_page_header2_t *header);
+extern const unsigned char *rasterScalarReadLine(raster_t *r);
+
+
+/*
+ * Local globals...
+ */
+static const fuzz_variant_t Variants[] =
+{					/* Encoder variants */
+  { "fresh",   1, 0, -1 },
+  { "reused",  0, 0,  0 },
+  { "latency", 0, 1, -1 }
+};
+#define FUZZ_VARIANTS (int)(sizeof(Variants) / sizeof(Variants[0]))
+
+static const int	Modes[4] =	/* Graphics modes by input flags */
+{
+  TEC_GMODE_TOPIX,
+  TEC_GMODE_HEX_OR,
+  TEC_GMODE_TOPIX,
+  TEC_GMODE_NIBBLE_OR
+};
+static const fuzz_reader_t Readers[2] =
+{					/* Raster reader builds */
+  { "raster", rasterOpen, rasterClose, rasterReadHeader, rasterReadLine },
+  { "raster-scalar", rasterScalarOpen, rasterScalarClose,
+    rasterScalarReadHeader, rasterScalarReadLine }
+};
+static const unsigned	Bits[8] =	/* Bits per pixel by input flags */
+{
+  1, 1, 1, 8, 16, 24, 32, 48
+};
+static tpcl_job_t	*Jobs[FUZZ_VARIANTS];
+					/* Jobs kept across inputs */
+static fuzz_output_t	Outputs[FUZZ_VARIANTS];
+					/* Output of each variant */
+static unsigned char	Raster[FUZZ_RASTER],
+					/* Page from the input */
+			Decoded[FUZZ_RASTER],
+					/* Page from the encoder output */
+			Pages[2][FUZZ_HEIGHT * FUZZ_WIDTH];
+					/* Pages from the raster readers */
+
+
+/*
+ * 'LLVMFuzzerTestOneInput()' - Check all encoder variants on one input.
+ */
+int					/* O - Always 0 */
+LLVMFuzzerTestOneInput(
+    const unsigned char *data,		/* I - Fuzz input */
+    size_t              size)		/* I - Bytes of input */
+{
+  int		i;			/* Looping var */
+  unsigned	bytes;			/* Bytes per line */
+  tpcl_page_t	page;			/* Page settings */
+  tpcl_job_t	*job;			/* Encoder */
+  tpcl_estimate_t est;			/* Size estimate */
+  static int	checked = 0;		/* Models checked */
+
+
+  if (!checked)
+  {
+    CheckModels();
+    checked = 1;
+  }
+
+  if (size < 3)
+    return (0);
+
+  CheckRaster(data, size);
+
+  bytes = (((unsigned)data[0] << 8) | data[1]) % FUZZ_WIDTH + 1;
+
+  memset(&page, 0, sizeof(page));
+  page.width          = 1000;
+  page.length         = 1000;
+  page.bytes_per_line = bytes;
+  page.gmode          = Modes[data[2] & 3];
+  page.copies         = 1;
+  page.mode           = 'C';
+  page.speed          = '3';
+
+  if ((page.lines = MakeRaster(data + 3, size - 3, bytes, Raster)) == 0)
+    return (0);
+
+  for (i = 0; i < FUZZ_VARIANTS; i ++)
+  {
+    if (Variants[i].fresh)
+      job = tpclJobNew(Collect, Outputs + i);
+    else if (!Jobs[i])
+      job = Jobs[i] = tpclJobNew(Collect, Outputs + i);
+    else
+      job = Jobs[i];
+
+    if (!job)
+      Fail(Variants[i].name, "Unable to create job");
+
+    Encode(Variants + i, job, &page, Raster, (unsigned)(data[2] >> 2) + 1,
+           Outputs + i);
+
+    if (Variants[i].fresh)
+      tpclJobDelete(job);
+
+    Verify(Variants[i].name, Outputs + i, &page, Raster);
+
+    if (Variants[i].same_as >= 0 &&
+        (Outputs[i].length != Outputs[Variants[i].same_as].length ||
+         memcmp(Outputs[i].data, Outputs[Variants[i].same_as].data,
+                Outputs[i].length)))
+      Fail(Variants[i].name, "Output differs");
+  }
+
+ /*
+  * Measuring every line, the size estimate must bound the output...
+  */
+  if (tpclEstimatePage(&page, Raster, 1, 0.0, &est) ||
+      Outputs[0].length < est.low || Outputs[0].length > est.high)
+    Fail("estimate", "Size out of bounds");
+
+  return (0);
+}
+
+
+#ifdef TPCL_FUZZ_MAIN
+/*
+ * 'main()' - Run inputs from files or stdin.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  FILE		*fp;			/* Input file */
+  static unsigned char data[1024 * 1024];
+					/* Input */
+  size_t	size;			/* Bytes of input */
+
+
+  for (i = 1; i < argc || i == 1; i ++)
+  {
+    if (i >= argc)
+      fp = stdin;
+    else if ((fp = fopen(argv[i], "rb")) == NULL)
+    {
+      perror(argv[i]);
+      return (1);
+    }
+
+    size = fread(data, 1, sizeof(data), fp);
+
+    if (fp != stdin)
+      fclose(fp);
+
+    LLVMFuzzerTestOneInput(data, size);
+  }
+
+  return (0);
+}
+#endif /* TPCL_FUZZ_MAIN */
+
+
+/*
+ * 'MakeRaster()' - Build a page of graphics from fuzz input.
+ *
+ * Each operation byte holds the operation in the low 3 bits and a repeat
+ * count in the high 5 bits.
+ */
+static unsigned				/* O - Number of lines */
+MakeRaster(const unsigned char *data,	/* I - Line program */
+           size_t              size,	/* I - Bytes of program */
+           unsigned            bytes,	/* I - Bytes per line */
+           unsigned char       *raster)	/* O - Page */
+{
+  size_t	pos = 0,		/* Position in program */
+		n;			/* Literal bytes */
+  unsigned	y = 0,			/* Current line */
+		x,			/* Byte in line */
+		count,			/* Repeat count */
+		seed = 1;		/* Noise generator */
+  unsigned char	op,			/* Operation */
+		*line,			/* Current line */
+		*prev;			/* Previous line */
+  unsigned	max_lines = FUZZ_RASTER / bytes;
+					/* Most lines that fit */
+
+
+  if (max_lines > FUZZ_LINES)
+    max_lines = FUZZ_LINES;
+
+  while (pos < size && y < max_lines)
+  {
+    op    = data[pos ++];
+    count = (unsigned)(op >> 3) + 1;
+
+    while (count -- > 0 && y < max_lines)
+    {
+      line = raster + (size_t)y * bytes;
+      prev = y ? line - bytes : NULL;
+
+      switch (op & 7)
+      {
+        case 0 :			/* Blank */
+            memset(line, 0, bytes);
+            break;
+
+        case 1 :			/* Repeat */
+        case 6 :
+            if (prev)
+              memcpy(line, prev, bytes);
+            else
+              memset(line, 0, bytes);
+            break;
+
+        case 2 :			/* Change a byte */
+            if (prev)
+              memcpy(line, prev, bytes);
+            else
+              memset(line, 0, bytes);
+
+            if (pos + 3 <= size)
+            {
+              line[(((unsigned)data[pos] << 8) | data[pos + 1]) % bytes] =
+                  data[pos + 2];
+              pos += 3;
+            }
+            break;
+
+        case 3 :			/* Literal bytes */
+            memset(line, 0, bytes);
+            n = size - pos < bytes ? size - pos : bytes;
+            memcpy(line, data + pos, n);
+            pos += n;
+            break;
+
+        case 4 :			/* Invert */
+            for (x = 0; x < bytes; x ++)
+              line[x] = prev ? (unsigned char)~prev[x] : 0xFF;
+            break;
+
+        default :			/* Noise */
+            for (x = 0; x < bytes; x ++)
+            {
+              seed   = seed * 1103515245 + 12345;
+              line[x] = (unsigned char)(seed >> 16);
+            }
+            break;
+      }
+
+      y ++;
+    }
+  }
+
+  return (y);
+}
+
+
+/*
+ * 'Encode()' - Encode a page with one encoder variant.
+ */
+static void
+Encode(const fuzz_variant_t *variant,	/* I - Encoder variant */
+       tpcl_job_t           *job,	/* I - Encoder */
+       const tpcl_page_t    *page,	/* I - Page settings */
+       const unsigned char  *raster,	/* I - Page */
+       unsigned             band,	/* I - Lines of first early band */
+       fuzz_output_t        *out)	/* O - Encoder output */
+{
+  unsigned	y;			/* Current line */
+
+
+  out->length = 0;
+
+  tpclJobReset(job);
+  tpclSetLatency(job, variant->latency ? band : 0, 0);
+
+  tpclStartPage(job, page);
+  for (y = 0; y < page->lines; y ++)
+    tpclWriteLine(job, raster + (size_t)y * page->bytes_per_line, y);
+  tpclEndPage(job, 0);
+
+  if (tpclJobError(job))
+    Fail(variant->name, "Encoder error");
+}
+
+
+/*
+ * 'Collect()' - Append encoder output to a buffer.
+ */
+static ssize_t				/* O - Bytes taken */
+Collect(void       *data,		/* I - Output buffer */
+        const void *buffer,		/* I - Data */
+        size_t     bytes)		/* I - Number of bytes */
+{
+  fuzz_output_t	*out = (fuzz_output_t *)data;
+					/* Output buffer */
+  unsigned char	*temp;			/* New buffer */
+
+
+  if (out->length + bytes > out->size)
+  {
+    if ((temp = realloc(out->data, 2 * (out->length + bytes))) == NULL)
+      return (-1);
+
+    out->data = temp;
+    out->size = 2 * (out->length + bytes);
+  }
+
+  memcpy(out->data + out->length, buffer, bytes);
+  out->length += bytes;
+
+  return ((ssize_t)bytes);
+}
+
+
+/*
+ * 'Verify()' - Decode encoder output and compare it.
+ *
+ * Graphics commands must follow each other without gaps, start at the
+ * left edge and have the width of the page.
+ */
+static void
+Verify(const char          *name,	/* I - Variant name */
+       const fuzz_output_t *out,	/* I - Encoder output */
+       const tpcl_page_t   *page,	/* I - Page settings */
+       const unsigned char *raster)	/* I - Page */
+{
+  tpcl_parser_t	parser;			/* TPCL parser */
+  tpcl_command_t cmd;			/* Current command */
+  size_t	pos = 0,		/* Position in output */
+		used,			/* Bytes consumed */
+		i;			/* Looping var */
+  unsigned	y = 0,			/* Next line expected */
+		bytes = page->bytes_per_line;
+					/* Bytes per line */
+  int		lines;			/* Lines of a command */
+  const unsigned char *payload;		/* Graphics data */
+
+
+  tpclParserInit(&parser);
+
+  while (pos < out->length)
+  {
+    if (tpclParserFeed(&parser, out->data + pos, out->length - pos, &used,
+                       &cmd) != TPCL_EVENT_END)
+    {
+      pos += used;
+      continue;
+    }
+
+    pos += used;
+
+    if (strcmp(cmd.name, "SG"))
+      continue;
+
+    if (cmd.sg[0] != 0 || cmd.sg[1] != (int)y ||
+        cmd.sg[2] != (int)bytes * 8 || cmd.offset + cmd.length > out->length)
+      Fail(name, "Bad graphics command");
+
+    payload = out->data + cmd.offset + cmd.length - 2 - cmd.data;
+
+    if (cmd.sg[4] == TEC_GMODE_TOPIX)
+    {
+      if (bytes > TPCL_TOPIX_WIDTH)
+        Fail(name, "TOPIX used for a line that is too wide");
+
+      if ((lines = tpclDecodeTOPIX(payload, cmd.data, bytes,
+                                   Decoded + (size_t)y * bytes,
+                                   page->lines - y)) <= 0)
+        Fail(name, "Bad TOPIX data");
+    }
+    else if (cmd.sg[4] == TEC_GMODE_NIBBLE_AND ||
+             cmd.sg[4] == TEC_GMODE_NIBBLE_OR)
+    {
+      if (cmd.data != 2 * (size_t)bytes * page->lines || y)
+        Fail(name, "Bad nibble graphics");
+
+      for (i = 0; i < cmd.data; i ++)
+        if ((payload[i] & 0xF0) != 0x30)
+          Fail(name, "Bad nibble character");
+
+      for (i = 0; i < cmd.data / 2; i ++)
+        Decoded[i] = (unsigned char)((payload[2 * i] << 4) |
+                                     (payload[2 * i + 1] & 0x0F));
+
+      lines = (int)page->lines;
+    }
+    else
+    {
+      if (cmd.data != (size_t)bytes * page->lines || y)
+        Fail(name, "Bad raw graphics");
+
+      memcpy(Decoded, payload, cmd.data);
+      lines = (int)page->lines;
+    }
+
+    y += (unsigned)lines;
+  }
+
+  if (y != page->lines)
+    Fail(name, "Lines missing");
+
+  if (memcmp(Decoded, raster, (size_t)bytes * page->lines))
+    Fail(name, "Decoded page differs");
+}
+
+
+/*
+ * 'CheckRaster()' - Compare the raster reader builds.
+ */
+static void
+CheckRaster(const unsigned char *data,	/* I - Fuzz input */
+            size_t              size)	/* I - Bytes of input */
+{
+  int			i;		/* Looping var */
+  unsigned		bits,		/* Bits per pixel */
+			bpp,		/* Bytes per pixel */
+			bytes,		/* Bytes per line */
+			sync,		/* Sync word */
+			*word,		/* Word to swap */
+			lines[2];	/* Lines read by each build */
+  cups_page_header2_t	header,		/* Header written */
+			headers[2];	/* Headers read by each build */
+  static FILE		*fp = NULL;	/* Raster file */
+
+
+  if (!fp && (fp = tmpfile()) == NULL)
+    Fail("raster", "Unable to create temporary file");
+
+ /*
+  * Header from the first three bytes of input, the page data after it...
+  */
+  bits  = Bits[(data[2] >> 2) & 7];
+  bpp   = (bits + 7) / 8;
+  bytes = (((unsigned)data[0] << 8) | data[1]) % FUZZ_WIDTH + 1;
+  bytes = bytes < bpp ? bpp : bytes - bytes % bpp;
+
+  memset(&header, 0, sizeof(header));
+  header.cupsWidth        = bytes * 8 / bits;
+  header.cupsHeight       = (((unsigned)data[1] << 8) | data[0]) %
+                            FUZZ_HEIGHT + 1;
+  header.cupsBitsPerColor = bits;
+  header.cupsBitsPerPixel = bits;
+  header.cupsBytesPerLine = bytes;
+  header.cupsColorOrder   = CUPS_ORDER_CHUNKED;
+  header.cupsNumColors    = 1;
+
+  if (data[2] & 0x40)
+    sync = data[2] & 0x80 ? 0x33536152 : 0x52615333;
+  else
+    sync = data[2] & 0x80 ? 0x32536152 : 0x52615332;
+
+  if (data[2] & 0x80)
+    for (i = 81, word = &header.AdvanceDistance; i > 0; i --, word ++)
+      *word = __builtin_bswap32(*word);
+
+  if (ftruncate(fileno(fp), 0) || fseek(fp, 0, SEEK_SET) ||
+      fwrite(&sync, sizeof(sync), 1, fp) != 1 ||
+      fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      fwrite(data + 3, 1, size - 3, fp) != size - 3 || fflush(fp))
+    Fail("raster", "Unable to write temporary file");
+
+ /*
+  * Both builds must read the same...
+  */
+  for (i = 0; i < 2; i ++)
+    lines[i] = ReadRaster(Readers + i, fileno(fp), headers + i, Pages[i]);
+
+  if (lines[0] != lines[1])
+    Fail(Readers[1].name, "Number of lines differs");
+
+  if (lines[0] && memcmp(headers, headers + 1, sizeof(headers[0])))
+    Fail(Readers[1].name, "Header differs");
+
+  if (memcmp(Pages[0], Pages[1], (size_t)lines[0] * bytes))
+    Fail(Readers[1].name, "Lines differ");
+}
+
+
+/*
+ * 'ReadRaster()' - Read a raster page with one reader build.
+ */
+static unsigned				/* O - Lines read, 0 if no header */
+ReadRaster(const fuzz_reader_t *reader,	/* I - Reader build */
+           int                 fd,	/* I - Raster file */
+           cups_page_header2_t *header,	/* O - Page header */
+           unsigned char       *page)	/* O - Lines read */
+{
+  raster_t		*r;		/* Raster stream */
+  const unsigned char	*line;		/* Current line */
+  unsigned		y = 0;		/* Lines read */
+
+
+  if (lseek(fd, 0, SEEK_SET) || (r = reader->open(fd)) == NULL)
+    Fail(reader->name, "Unable to open raster");
+
+  if (reader->header(r, header))
+  {
+    if (header->cupsHeight > FUZZ_HEIGHT ||
+        header->cupsBytesPerLine > FUZZ_WIDTH)
+      Fail(reader->name, "Bad header");
+
+    for (; (line = reader->line(r)) != NULL; y ++)
+    {
+      if (y >= header->cupsHeight)
+        Fail(reader->name, "Lines past the end of the page");
+
+      memcpy(page + (size_t)y * header->cupsBytesPerLine, line,
+             header->cupsBytesPerLine);
+    }
+  }
+
+  reader->close(r);
+
+  return (y);
+}
+
+
+/*
+ * 'CheckModels()' - Check the label settings of every model.
+ *
+ * Every speed from 1 to 'A' must come back as one the model offers, and a
+ * speed of 0 as the default speed of the model, without being reported as
+ * a change.
+ */
+static void
+CheckModels(void)
+{
+  int			i, j,		/* Looping vars */
+			changed,	/* Changed settings */
+			speed;		/* Speed returned */
+  const tpcl_model_t	*model;		/* Current model */
+  tpcl_page_t		page;		/* Label settings */
+  static const char	speeds[] = "0123456789A";
+					/* Speeds asked for */
+
+
+  for (i = 0; (model = tpclModelIndex(i)) != NULL; i ++)
+    for (j = 0; speeds[j]; j ++)
+    {
+      memset(&page, 0, sizeof(page));
+      page.width  = model->min_width * 254 / 72 + 1;
+      page.length = model->min_length * 254 / 72 + 1;
+      page.media  = model->media_default;
+      page.speed  = speeds[j] == '0' ? 0 : speeds[j];
+
+      changed = tpclModelCheck(model, &page);
+      speed   = page.speed == 'A' ? 10 : page.speed - '0';
+
+      if (changed & ~TPCL_CHECK_SPEED)
+        Fail(model->name, "Valid label settings changed");
+
+      if (!page.speed)
+        Fail(model->name, "Speed left at 0");
+
+      if (speeds[j] == '0' &&
+          (speed != model->speed || (changed & TPCL_CHECK_SPEED)))
+        Fail(model->name, "Speed 0 does not select the default speed");
+
+      if (speed != model->speed &&
+          speed != model->speeds[0] && speed != model->speeds[1] &&
+          speed != model->speeds[2] && speed != model->speeds[3])
+        Fail(model->name, "Speed not offered by the model");
+    }
+}
+
+
+/*
+ * 'Fail()' - Report a mismatch and abort.
+ */
+static void
+Fail(const char *name,			/* I - Variant name */
+     const char *message)		/* I - What went wrong */
+{
+  fprintf(stderr, "tpclfuzz: %s: %s\n", name, message);
+  abort();
+}
@@ -0,0 +1,214 @@
+/*
+ *   Printer models for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   tpclModelCount()   - Return the number of models.
+ *   tpclModelIndex()   - Return a model by number.
+ *   tpclModelFind()    - Find a model by name.
+ *   tpclModelDefault() - Return the default choice of an option.
+ *   tpclModelCheck()   - Clamp label settings to what a model supports.
+ *
+ * The tables in tpclmodels.h are generated from tectpcl2.drv when libtpcl
+ * is built (see mkmodels.awk), so they always match the PPD files. They
+ * hold what the filter would otherwise learn from the PPD: label sizes,
+ * resolutions, media types, print speeds and the defaults of all options.
+ */
+
+#include "tpclmodel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "tpclmodels.h"
+
+#define NUM_MODELS	(int)(sizeof(Models) / sizeof(Models[0]))
+#define NUM_DEFAULTS	(int)(sizeof(Defaults) / sizeof(Defaults[0]))
+
+
+/*
+ * 'tpclModelCount()' - Return the number of models.
+ */
+int					/* O - Number of models */
+tpclModelCount(void)
+{
+  return (NUM_MODELS);
+}
+
+
+/*
+ * 'tpclModelIndex()' - Return a model by number.
+ */
+const tpcl_model_t *			/* O - Model or NULL */
+tpclModelIndex(int i)			/* I - Model number, from 0 */
+{
+  return (i >= 0 && i < NUM_MODELS ? Models + i : NULL);
+}
+
+
+/*
+ * 'tpclModelFind()' - Find a model by name.
+ *
+ * Takes the model name ("B-SX4"), the PPD file name with or without
+ * extension ("tecbsx4.ppd"), or a name ending in the model name, such as
+ * the "*ModelName" of a PPD file. Case is ignored.
+ */
+const tpcl_model_t *			/* O - Model or NULL */
+tpclModelFind(const char *name)		/* I - Name of model */
+{
+  int		i;			/* Looping var */
+  size_t	len,			/* Length of name */
+		mlen,			/* Length of model name */
+		plen;			/* Length of PPD file name */
+
+
+  if (!name)
+    return (NULL);
+
+  len = strlen(name);
+
+  for (i = 0; i < NUM_MODELS; i ++)
+  {
+    mlen = strlen(Models[i].model);
+    plen = strlen(Models[i].name);
+
+    if (!strcasecmp(name, Models[i].model))
+      return (Models + i);
+
+    if (!strncasecmp(name, Models[i].name, plen) &&
+        (!name[plen] || !strcasecmp(name + plen, ".ppd")))
+      return (Models + i);
+
+    if (len > mlen && name[len - mlen - 1] == ' ' &&
+        !strcasecmp(name + len - mlen, Models[i].model))
+      return (Models + i);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'tpclModelDefault()' - Return the default choice of an option.
+ *
+ * Same as the default of the PPD file of the model: per model for
+ * "tePrintRate", "MediaType" and "Resolution", from the shared options
+ * otherwise.
+ */
+const char *				/* O - Choice or NULL if unknown */
+tpclModelDefault(const tpcl_model_t *model,	/* I - Model or NULL */
+                 const char         *option)	/* I - Option name */
+{
+  int		i;			/* Looping var */
+  static const char * const Media[] =	/* MediaType choices */
+  {
+    "Direct", "Thermal", "Thermal2"
+  };
+  static const char * const Numbers[] =	/* tePrintRate choices */
+  {
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10"
+  };
+
+
+  if (model && !strcmp(option, "tePrintRate"))
+    return (model->speed >= 0 && model->speed <= 10 ?
+                Numbers[model->speed] : NULL);
+  else if (model && !strcmp(option, "MediaType"))
+    return (Media[model->media_default]);
+  else if (model && !strcmp(option, "Resolution"))
+    return (model->resolution == 300 ? "300dpi" : "203dpi");
+
+  for (i = 0; i < NUM_DEFAULTS; i ++)
+    if (!strcmp(option, Defaults[i][0]))
+      return (Defaults[i][1]);
+
+  return (NULL);
+}
+
+
+/*
+ * 'tpclModelCheck()' - Clamp label settings to what a model supports.
+ *
+ * The label size is limited to the MinSize and MaxSize of the model, the
+ * speed is set to the closest one the model offers, and media types the
+ * model does not support fall back to its default. Limits are rounded
+ * outwards to 0.1 mm, and labels on continuous media may be longer than
+ * MaxSize, they are sent in segments. A speed of 0 selects the default
+ * speed of the model.
+ */
+int					/* O - TPCL_CHECK_xxx of changed settings */
+tpclModelCheck(const tpcl_model_t *model,	/* I - Model */
+               tpcl_page_t        *page)	/* IO - Label settings */
+{
+  int	changed = 0,			/* Changed settings */
+	i,				/* Looping var */
+	speed,				/* Speed asked for */
+	best,				/* Closest speed */
+	min,				/* Lower limit in 0.1 mm */
+	max;				/* Upper limit in 0.1 mm */
+
+
+  min = model->min_width * 254 / 72;
+  max = (model->max_width * 254 + 71) / 72;
+
+  if (page->width < min || page->width > max)
+  {
+    page->width = page->width < min ? min : max;
+    changed    |= TPCL_CHECK_WIDTH;
+  }
+
+  min = model->min_length * 254 / 72;
+  max = (model->max_length * 254 + 71) / 72;
+
+  if (page->length < min || (page->length > max && page->detect != 0))
+  {
+    page->length = page->length < min ? min : max;
+    changed     |= TPCL_CHECK_LENGTH;
+  }
+
+  if (page->media < 0 || page->media > TPCL_MEDIA_THERMAL2 ||
+      !(model->media & TPCL_MEDIA_BIT(page->media)))
+  {
+    page->media = model->media_default;
+    changed    |= TPCL_CHECK_MEDIA;
+  }
+
+  speed = page->speed == 'A' ? 10 : page->speed - '0';
+  best  = model->speed;
+
+  if (!page->speed)
+  {
+   /*
+    * The default speed was asked for, which is not a change...
+    */
+    page->speed = best >= 10 ? 'A' : (char)('0' + best);
+    return (changed);
+  }
+
+  for (i = 0; i < 4 && model->speeds[i]; i ++)
+    if (abs(model->speeds[i] - speed) < abs(best - speed))
+      best = model->speeds[i];
+
+  if (best != speed)
+  {
+    page->speed = best >= 10 ? 'A' : (char)('0' + best);
+    changed    |= TPCL_CHECK_SPEED;
+  }
+
+  return (changed);
+}
@@ -0,0 +1,69 @@
+/*
+ *   Printer models for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPCLMODEL_H_
+#define _TPCLMODEL_H_
+
+#include "tpcl.h"
+
+/*
+ * Bit of a TPCL_MEDIA_xxx value in the media of a model...
+ */
+#define TPCL_MEDIA_BIT(m) (1 << (m))
+
+/*
+ * Settings changed by tpclModelCheck()...
+ */
+#define TPCL_CHECK_WIDTH  1		/* Label width */
+#define TPCL_CHECK_LENGTH 2		/* Label length */
+#define TPCL_CHECK_MEDIA  4		/* Media type */
+#define TPCL_CHECK_SPEED  8		/* Print speed */
+
+
+/*
+ * Types...
+ */
+typedef struct tpcl_model_s		/* Printer model, from tectpcl2.drv */
+{
+  const char	*name,			/* PPD file name without extension */
+		*model;			/* Model name */
+  int		resolutions[2],		/* Resolutions in dpi, 0 if unused */
+		resolution,		/* Default resolution */
+		min_width,		/* Smallest label width in points */
+		min_length,		/* Smallest label length in points */
+		max_width,		/* Largest label width in points */
+		max_length,		/* Largest label length in points */
+		media,			/* Supported TPCL_MEDIA_BIT()s */
+		media_default,		/* Default TPCL_MEDIA_xxx */
+		speeds[4],		/* Speeds in inches/sec, 0 if unused */
+		speed;			/* Default speed */
+} tpcl_model_t;
+
+
+/*
+ * Prototypes...
+ */
+extern int	tpclModelCount(void);
+extern const tpcl_model_t *tpclModelIndex(int i);
+extern const tpcl_model_t *tpclModelFind(const char *name);
+extern const char *tpclModelDefault(const tpcl_model_t *model,
+		                    const char *option);
+extern int	tpclModelCheck(const tpcl_model_t *model, tpcl_page_t *page);
+
+#endif /* !_TPCLMODEL_H_ */
@@ -0,0 +1,433 @@
+/*
+ *   Streaming TPCL command parser for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   tpclParserInit()  - Reset a parser to the start of a stream.
+ *   tpclParserFeed()  - Feed bytes to the parser until the next event.
+ *   tpclParserIdle()  - Check whether the parser is between commands.
+ *   tpclParserSafe()  - Get the offset up to which data can be forwarded.
+ *   tpclParseStatus() - Find a status response in printer output.
+ *   tpclStatusOk()    - Check whether a status code allows printing.
+ *   tpclDecodeTOPIX() - Decode the TOPIX payload of a graphics command.
+ *
+ * The parser never buffers stream data. It only tracks enough state to
+ * find command boundaries, so callers can forward the bytes they already
+ * hold. Graphics payloads of the SG command are skipped by length, as
+ * TOPIX and raw graphics may contain the "|}" terminator.
+ */
+
+#include "tpclparse.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Parser states...
+ */
+#define PARSE_FILLER  0			/* Between commands */
+#define PARSE_NAME    1			/* Reading command name */
+#define PARSE_ARGS    2			/* Reading parameters up to "|}" */
+#define PARSE_SGHEAD  3			/* Reading SG parameters */
+#define PARSE_SGLEN   4			/* Reading TOPIX length bytes */
+#define PARSE_DATA    5			/* Skipping graphics payload */
+#define PARSE_TERM    6			/* Expecting "|}" after payload */
+
+
+/*
+ * 'tpclParserInit()' - Reset a parser to the start of a stream.
+ */
+void
+tpclParserInit(tpcl_parser_t *p)	/* I - Parser */
+{
+  memset(p, 0, sizeof(tpcl_parser_t));
+  p->state = PARSE_FILLER;
+}
+
+
+/*
+ * 'ParserArg()' - Append a byte to the parameter text.
+ */
+static void
+ParserArg(tpcl_parser_t *p,		/* I - Parser */
+          unsigned char c)		/* I - Byte */
+{
+  if (p->argslen < sizeof(p->cmd.args) - 1)
+  {
+    p->cmd.args[p->argslen++] = (char)c;
+    p->cmd.args[p->argslen]   = '\0';
+  }
+}
+
+
+/*
+ * 'ParserGraphics()' - Work out the payload size of an SG command.
+ */
+static void
+ParserGraphics(tpcl_parser_t *p)	/* I - Parser */
+{
+  int	*sg = p->cmd.sg;		/* SG fields */
+  size_t bpl;				/* Bytes per graphics line */
+
+
+  if (sscanf(p->cmd.args, ";%d,%d,%d,%d,%d", sg, sg + 1, sg + 2, sg + 3,
+             sg + 4) != 5 || sg[2] < 0 || sg[3] < 0)
+  {
+    p->state = PARSE_ARGS;
+    return;
+  }
+
+  bpl = ((size_t)sg[2] + 7) / 8;
+
+  switch (sg[4])
+  {
+    case 3 :				/* TOPIX, 16-bit big-endian length */
+      p->state    = PARSE_SGLEN;
+      p->lenbytes = 0;
+      p->remaining = 0;
+      return;
+    case 1 :				/* Hex mode, 8 dots per byte */
+    case 5 :
+      p->remaining = bpl * (size_t)sg[3];
+      break;
+    case 0 :				/* Nibble mode, 4 dots per byte */
+    case 4 :
+      p->remaining = 2 * bpl * (size_t)sg[3];
+      break;
+    default :				/* BMP/PCX, scan for terminator */
+      p->state = PARSE_TERM;
+      return;
+  }
+
+  p->cmd.data = p->remaining;
+  p->state    = p->remaining ? PARSE_DATA : PARSE_TERM;
+}
+
+
+/*
+ * 'tpclParserFeed()' - Feed bytes to the parser until the next event.
+ *
+ * Returns TPCL_EVENT_BEGIN once the name of a command has been read and
+ * TPCL_EVENT_END once the command is complete; "cmd" is filled in for
+ * both. "used" is set to the number of bytes consumed, the caller feeds
+ * the remainder again. TPCL_EVENT_NONE means all bytes were consumed.
+ */
+int					/* O - Event */
+tpclParserFeed(tpcl_parser_t       *p,	/* I - Parser */
+               const unsigned char *data,	/* I - Stream data */
+               size_t              len,	/* I - Bytes available */
+               size_t              *used,	/* O - Bytes consumed */
+               tpcl_command_t      *cmd)	/* O - Command */
+{
+  size_t	i;			/* Index into data */
+  size_t	skip;			/* Bytes to skip */
+  const unsigned char *brace;		/* Next opening brace */
+  unsigned char	c;			/* Current byte */
+  size_t	namelen;		/* Length of command name */
+
+
+  for (i = 0; i < len;)
+  {
+    switch (p->state)
+    {
+      case PARSE_FILLER :
+          if ((brace = memchr(data + i, '{', len - i)) == NULL)
+          {
+            p->filler += len - i;
+            i = len;
+            break;
+          }
+
+          p->filler += (size_t)(brace - data) - i;
+          i = (size_t)(brace - data) + 1;
+
+          memset(&p->cmd, 0, sizeof(p->cmd));
+          p->cmd.offset = p->offset + i - 1;
+          p->cmd.filler = p->filler;
+          p->filler     = 0;
+          p->argslen    = 0;
+          p->bar        = 0;
+          p->fields     = 0;
+          p->state      = PARSE_NAME;
+          break;
+
+      case PARSE_NAME :
+          c       = data[i++];
+          namelen = strlen(p->cmd.name);
+
+          if (c >= 'A' && c <= 'Z' && namelen < sizeof(p->cmd.name) - 1)
+          {
+            p->cmd.name[namelen] = (char)c;
+            break;
+          }
+
+          if (!strcmp(p->cmd.name, "SG"))
+            p->state = PARSE_SGHEAD;
+          else
+            p->state = PARSE_ARGS;
+
+          if (c == '|')
+          {
+            p->bar   = 1;
+            p->state = PARSE_ARGS;
+          }
+          else
+            ParserArg(p, c);
+
+          *used = i;
+          p->offset += i;
+          *cmd = p->cmd;
+          return (TPCL_EVENT_BEGIN);
+
+      case PARSE_SGHEAD :
+          c = data[i++];
+          if (c == '|')
+          {
+           /*
+            * Malformed SG command, treat as a plain command...
+            */
+
+            p->bar   = 1;
+            p->state = PARSE_ARGS;
+            break;
+          }
+
+          ParserArg(p, c);
+          if (c == ',' && ++p->fields == 5)
+            ParserGraphics(p);
+          break;
+
+      case PARSE_SGLEN :
+          p->remaining = (p->remaining << 8) | data[i++];
+          if (++p->lenbytes == 2)
+          {
+            p->cmd.data = p->remaining;
+            p->state    = p->remaining ? PARSE_DATA : PARSE_TERM;
+          }
+          break;
+
+      case PARSE_DATA :
+          skip = len - i;
+          if (skip > p->remaining)
+            skip = p->remaining;
+
+          i            += skip;
+          p->remaining -= skip;
+
+          if (!p->remaining)
+            p->state = PARSE_TERM;
+          break;
+
+      case PARSE_ARGS :
+      case PARSE_TERM :
+          c = data[i++];
+
+          if (p->bar && c == '}')
+          {
+            if (p->argslen > 0 && p->cmd.args[p->argslen - 1] == '|')
+              p->cmd.args[--p->argslen] = '\0';
+
+            p->state      = PARSE_FILLER;
+            p->offset    += i;
+            p->cmd.length = p->offset - p->cmd.offset;
+            *used         = i;
+            *cmd          = p->cmd;
+            return (TPCL_EVENT_END);
+          }
+
+          p->bar = (c == '|');
+          if (p->state == PARSE_ARGS)
+            ParserArg(p, c);
+          break;
+    }
+  }
+
+  p->offset += len;
+  *used      = len;
+
+  return (TPCL_EVENT_NONE);
+}
+
+
+/*
+ * 'tpclParserIdle()' - Check whether the parser is between commands.
+ */
+int					/* O - 1 if between commands */
+tpclParserIdle(tpcl_parser_t *p)	/* I - Parser */
+{
+  return (p->state == PARSE_FILLER);
+}
+
+
+/*
+ * 'tpclParserSafe()' - Get the offset up to which data can be forwarded.
+ *
+ * Bytes of a command whose name has not been reported yet are held back,
+ * so a caller routing by command name never splits a command.
+ */
+size_t					/* O - Stream offset */
+tpclParserSafe(tpcl_parser_t *p)	/* I - Parser */
+{
+  return (p->state == PARSE_NAME ? p->cmd.offset : p->offset);
+}
+
+
+/*
+ * 'tpclParseStatus()' - Find a status response in printer output.
+ *
+ * A status response is framed as SOH STX, two status digits, the status
+ * type and an optional four digit count of remaining labels, then ETX EOT.
+ * Returns the status code or -1 if no complete response was found; "used"
+ * is set to the number of bytes that can be discarded.
+ */
+int					/* O - Status code or -1 */
+tpclParseStatus(
+    const unsigned char *data,		/* I - Printer output */
+    size_t              len,		/* I - Bytes available */
+    size_t              *used,		/* O - Bytes consumed */
+    int                 *remaining)	/* O - Labels still to issue or -1 */
+{
+  size_t	i,			/* Start of response */
+		j;			/* End of response */
+
+
+  for (i = 0; i + 1 < len; i ++)
+    if (data[i] == 0x01 && data[i + 1] == 0x02)
+      break;
+
+  if (i + 1 >= len)
+  {
+   /*
+    * Keep a trailing SOH around for the next read...
+    */
+
+    *used = (len > 0 && data[len - 1] == 0x01) ? len - 1 : len;
+    return (-1);
+  }
+
+  for (j = i + 2; j < len && data[j] != 0x04; j ++);
+
+  if (j >= len)
+  {
+    *used = i;
+    return (-1);
+  }
+
+  *used = j + 1;
+
+  if (j - i < 5 || data[i + 2] < '0' || data[i + 2] > '9' ||
+      data[i + 3] < '0' || data[i + 3] > '9')
+    return (-1);
+
+  if (remaining)
+  {
+    if (j - i >= 10)
+      *remaining = (data[i + 5] - '0') * 1000 + (data[i + 6] - '0') * 100 +
+                   (data[i + 7] - '0') * 10 + (data[i + 8] - '0');
+    else
+      *remaining = -1;
+  }
+
+  return ((data[i + 2] - '0') * 10 + data[i + 3] - '0');
+}
+
+
+/*
+ * 'tpclStatusOk()' - Check whether a status code allows printing.
+ */
+int					/* O - 1 if the printer can take jobs */
+tpclStatusOk(int status)		/* I - Status code */
+{
+  return (status == TPCL_STATUS_READY || status == TPCL_STATUS_OPERATING ||
+          status == TPCL_STATUS_ISSUED || status == TPCL_STATUS_FED);
+}
+
+
+/*
+ * 'tpclDecodeTOPIX()' - Decode the TOPIX payload of a graphics command.
+ *
+ * Every graphics command starts from a blank line, and each line is the
+ * previous one with the changed bytes XORed in. Malformed data, i.e.
+ * truncated lines, bytes past the end of a line or more than max_lines
+ * lines, is reported as an error.
+ */
+int					/* O - Lines decoded or -1 on error */
+tpclDecodeTOPIX(
+    const unsigned char *data,		/* I - TOPIX data */
+    size_t              len,		/* I - Bytes of TOPIX data */
+    unsigned            bytes_per_line,	/* I - Bytes per line */
+    unsigned char       *lines,		/* O - Decoded lines */
+    unsigned            max_lines)	/* I - Size of lines in lines */
+{
+  size_t	pos = 0;		/* Position in data */
+  unsigned	y,			/* Current line */
+		x,			/* Byte in line */
+		l1, l2, l3;		/* Positions in line */
+  unsigned char	cl1, cl2, cl3,		/* Flag bytes */
+		*line;			/* Current line */
+
+
+  for (y = 0; pos < len; y ++)
+  {
+    if (y >= max_lines)
+      return (-1);
+
+    line = lines + (size_t)y * bytes_per_line;
+
+    if (y)
+      memcpy(line, line - bytes_per_line, bytes_per_line);
+    else
+      memset(line, 0, bytes_per_line);
+
+    cl1 = data[pos ++];
+
+    for (l1 = 0; l1 < 8; l1 ++)
+    {
+      if (!(cl1 & (0x80 >> l1)))
+        continue;
+
+      if (pos >= len)
+        return (-1);
+
+      cl2 = data[pos ++];
+
+      for (l2 = 0; l2 < 8; l2 ++)
+      {
+        if (!(cl2 & (0x80 >> l2)))
+          continue;
+
+        if (pos >= len)
+          return (-1);
+
+        cl3 = data[pos ++];
+
+        for (l3 = 0; l3 < 8; l3 ++)
+        {
+          if (!(cl3 & (0x80 >> l3)))
+            continue;
+
+          if ((x = l1 * 64 + l2 * 8 + l3) >= bytes_per_line || pos >= len)
+            return (-1);
+
+          line[x] ^= data[pos ++];
+        }
+      }
+    }
+  }
+
+  return ((int)y);
+}
@@ -0,0 +1,87 @@
+/*
+ *   Streaming TPCL command parser for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPCLPARSE_H_
+#define _TPCLPARSE_H_
+
+#include <stddef.h>
+
+/*
+ * Parser events returned by tpclParserFeed()...
+ */
+#define TPCL_EVENT_NONE   0		/* All data consumed, nothing to report */
+#define TPCL_EVENT_BEGIN  1		/* Command name complete */
+#define TPCL_EVENT_END    2		/* Command complete, including "|}" */
+
+/*
+ * Printer status codes (two digit field of the status response)...
+ */
+#define TPCL_STATUS_READY     0		/* No error */
+#define TPCL_STATUS_OPERATING 2		/* Printing or feeding */
+#define TPCL_STATUS_ISSUED    40	/* Issue completed */
+#define TPCL_STATUS_FED       41	/* Feed completed */
+
+
+/*
+ * A single TPCL command as seen by the parser.
+ */
+typedef struct tpcl_command_s
+{
+  char		name[4];		/* Command name ("D", "SG", "XS", ...) */
+  char		args[64];		/* Leading parameter text */
+  size_t	offset,			/* Stream offset of the opening '{' */
+		length,			/* Bytes of command including braces */
+		filler,			/* Filler bytes preceding the command */
+		data;			/* Graphics payload bytes (SG only) */
+  int		sg[5];			/* SG x, y, width, height and mode */
+} tpcl_command_t;
+
+/*
+ * Parser state, one per TPCL stream.
+ */
+typedef struct tpcl_parser_s
+{
+  int		state;			/* Current parser state */
+  size_t	offset;			/* Bytes consumed so far */
+  size_t	filler;			/* Filler bytes since last command */
+  size_t	argslen;		/* Bytes in cmd.args */
+  size_t	remaining;		/* Payload bytes still to skip */
+  int		fields;			/* SG fields seen */
+  int		lenbytes;		/* TOPIX length bytes seen */
+  int		bar;			/* Non-zero if last byte was '|' */
+  tpcl_command_t cmd;			/* Command being assembled */
+} tpcl_parser_t;
+
+
+/*
+ * Prototypes...
+ */
+extern void	tpclParserInit(tpcl_parser_t *p);
+extern int	tpclParserFeed(tpcl_parser_t *p, const unsigned char *data,
+		               size_t len, size_t *used, tpcl_command_t *cmd);
+extern int	tpclParserIdle(tpcl_parser_t *p);
+extern size_t	tpclParserSafe(tpcl_parser_t *p);
+extern int	tpclParseStatus(const unsigned char *data, size_t len,
+		                size_t *used, int *remaining);
+extern int	tpclStatusOk(int status);
+extern int	tpclDecodeTOPIX(const unsigned char *data, size_t len,
+		                unsigned bytes_per_line, unsigned char *lines,
+		                unsigned max_lines);
+
+#endif /* !_TPCLPARSE_H_ */
@@ -0,0 +1,660 @@
+/*
+ *   Direct printing of bitmaps for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   tpclEncodeBitmap()    - Encode a bitmap as a label.
+ *   tpclPrinterOpen()     - Open a printer on the network.
+ *   tpclPrinterOpenFd()   - Open a printer on a connected file.
+ *   tpclPrinterClose()    - Print what was submitted and close a printer.
+ *   tpclPrinterCancel()   - Cancel all labels submitted to a printer.
+ *   tpclPrinterSubmit()   - Queue a bitmap for printing.
+ *   tpclPrinterPending()  - Return the number of labels not completed.
+ *   tpclPrinterSetModel() - Set the model to check labels against.
+ *
+ *   PrinterNew()          - Create a printer and start its thread.
+ *   PrinterConnect()      - Connect to the printer.
+ *   PrinterDisconnect()   - Drop the connection after an error.
+ *   PrinterWrite()        - Write encoded data to the printer.
+ *   PrinterPrint()        - Print a label.
+ *   PrinterThread()       - Print the queued labels of a printer.
+ *   EncodeLines()         - Encode the lines of a bitmap.
+ *
+ * For programs that render labels themselves and would otherwise go
+ * through a PDF, CUPS and Ghostscript to reach the filter. Bitmaps are
+ * encoded where they are, line by line, with the same encoder and label
+ * settings as the filter. Every printer has a thread of its own that
+ * connects, encodes and writes, so tpclPrinterSubmit() returns at once
+ * and the label is reported through a callback, in the order submitted.
+ * The bitmap must stay valid until then.
+ *
+ * A label is complete once all of its data was written to the connection.
+ * On a write error the connection is closed and opened again for the next
+ * label, with the printer setup sent again.
+ */
+
+#include "tpclprint.h"
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0		/* SIGPIPE is ignored by the caller */
+#endif /* !MSG_NOSIGNAL */
+
+
+/*
+ * Types...
+ */
+typedef struct tpcl_request_s		/* Label waiting to be printed */
+{
+  struct tpcl_request_s	*next;		/* Next label */
+  tpcl_page_t		page;		/* Label settings */
+  tpcl_bitmap_t		bitmap;		/* Graphics */
+  tpcl_done_cb_t	cb;		/* Completion callback */
+  void			*data;		/* Callback data */
+} tpcl_request_t;
+
+struct tpcl_printer_s			/* Printer connection */
+{
+  char			*host,		/* Host name or NULL for a file */
+			*port;		/* Port number or service name */
+  int			fd,		/* Connection or -1 */
+			started,	/* Non-zero once the setup was sent */
+			error;		/* errno of the last failed write */
+  tpcl_setup_t		setup;		/* Printer setup */
+  const tpcl_model_t	*model;		/* Model or NULL */
+  tpcl_job_t		*job;		/* Encoder */
+  pthread_t		thread;		/* Printing thread */
+  pthread_mutex_t	lock;		/* Lock for the fields below */
+  pthread_cond_t	cond;		/* Signalled on queue changes */
+  tpcl_request_t	*first,		/* Queued labels */
+			*last,
+			*dropped;	/* Canceled labels to report */
+  int			pending,	/* Labels not completed */
+			busy,		/* Non-zero while printing a label */
+			abort,		/* Non-zero to stop the current label */
+			closing;	/* Non-zero once closed */
+};
+
+
+/*
+ * Local functions...
+ */
+static tpcl_printer_t *PrinterNew(const char *host, const char *port,
+				  int fd, const tpcl_setup_t *setup);
+static int	PrinterConnect(tpcl_printer_t *printer);
+static void	PrinterDisconnect(tpcl_printer_t *printer);
+static ssize_t	PrinterWrite(void *data, const void *buffer, size_t bytes);
+static int	PrinterPrint(tpcl_printer_t *printer, tpcl_request_t *req);
+static void	*PrinterThread(void *data);
+static int	EncodeLines(tpcl_job_t *job, const tpcl_page_t *page,
+		            const tpcl_bitmap_t *bitmap, const int *abort);
+
+
+/*
+ * 'tpclEncodeBitmap()' - Encode a bitmap as a label.
+ *
+ * The lines are read straight from the bitmap, without a copy. Bytes per
+ * line and lines of the page come from the bitmap; copies, issue mode and
+ * speed default to 1, 'C' and '3' when zero. Bits past the width in the
+ * last byte of a line are printed, so they must be 0.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclEncodeBitmap(
+    tpcl_job_t          *job,		/* I - Job */
+    const tpcl_page_t   *page,		/* I - Label settings */
+    const tpcl_bitmap_t *bitmap)	/* I - Graphics */
+{
+  return (EncodeLines(job, page, bitmap, NULL));
+}
+
+
+/*
+ * 'tpclPrinterOpen()' - Open a printer on the network.
+ *
+ * The connection is made by the printer thread when the first label is
+ * submitted, so this does not block. A NULL port selects TPCL_PRINT_PORT.
+ */
+tpcl_printer_t *			/* O - Printer or NULL on error */
+tpclPrinterOpen(const char         *host,	/* I - Host name or address */
+                const char         *port,	/* I - Port or NULL */
+                const tpcl_setup_t *setup)	/* I - Printer setup or NULL */
+{
+  if (!host)
+  {
+    errno = EINVAL;
+    return (NULL);
+  }
+
+  return (PrinterNew(host, port ? port : TPCL_PRINT_PORT, -1, setup));
+}
+
+
+/*
+ * 'tpclPrinterOpenFd()' - Open a printer on a connected file.
+ *
+ * For USB and serial devices, or connections made by the caller. The file
+ * is not closed by tpclPrinterClose().
+ */
+tpcl_printer_t *			/* O - Printer or NULL on error */
+tpclPrinterOpenFd(int                fd,	/* I - File to write to */
+                  const tpcl_setup_t *setup)	/* I - Printer setup or NULL */
+{
+  if (fd < 0)
+  {
+    errno = EINVAL;
+    return (NULL);
+  }
+
+  return (PrinterNew(NULL, NULL, fd, setup));
+}
+
+
+/*
+ * 'tpclPrinterClose()' - Print what was submitted and close a printer.
+ *
+ * Blocks until all labels are completed; call tpclPrinterCancel() first
+ * to drop them instead.
+ */
+void
+tpclPrinterClose(tpcl_printer_t *printer)	/* I - Printer */
+{
+  if (!printer)
+    return;
+
+  pthread_mutex_lock(&printer->lock);
+  printer->closing = 1;
+  pthread_cond_broadcast(&printer->cond);
+  pthread_mutex_unlock(&printer->lock);
+
+  pthread_join(printer->thread, NULL);
+
+  if (printer->host && printer->fd >= 0)
+    close(printer->fd);
+
+  tpclJobDelete(printer->job);
+  pthread_cond_destroy(&printer->cond);
+  pthread_mutex_destroy(&printer->lock);
+  free(printer->host);
+  free(printer->port);
+  free(printer);
+}
+
+
+/*
+ * 'tpclPrinterCancel()' - Cancel all labels submitted to a printer.
+ *
+ * Queued labels are completed with ECANCELED. A label being printed is
+ * stopped and the printer reset, see tpclCancel(). Labels submitted after
+ * this call print as usual.
+ */
+void
+tpclPrinterCancel(tpcl_printer_t *printer)	/* I - Printer */
+{
+  tpcl_request_t	*req;		/* Last dropped label */
+
+
+  pthread_mutex_lock(&printer->lock);
+
+  if (printer->first)
+  {
+    for (req = printer->first; req->next; req = req->next);
+
+    req->next        = printer->dropped;
+    printer->dropped = printer->first;
+    printer->first   = NULL;
+    printer->last    = NULL;
+  }
+
+  if (printer->busy)
+    __atomic_store_n(&printer->abort, 1, __ATOMIC_RELAXED);
+
+  pthread_cond_broadcast(&printer->cond);
+  pthread_mutex_unlock(&printer->lock);
+}
+
+
+/*
+ * 'tpclPrinterSubmit()' - Queue a bitmap for printing.
+ *
+ * The page settings are copied, the bitmap data is not: it must stay valid
+ * until the callback is called. The callback runs on the printer thread
+ * with a status of 0 or an errno value, and may submit further labels.
+ */
+int					/* O - 0 on success, -1 on error */
+tpclPrinterSubmit(tpcl_printer_t      *printer,	/* I - Printer */
+                  const tpcl_page_t   *page,	/* I - Label settings */
+                  const tpcl_bitmap_t *bitmap,	/* I - Graphics */
+                  tpcl_done_cb_t      cb,	/* I - Completion callback */
+                  void                *data)	/* I - Callback data */
+{
+  tpcl_request_t	*req;		/* New label */
+
+
+  if (!printer || !page || !bitmap || !bitmap->data || !bitmap->width ||
+      !bitmap->height || bitmap->stride < (bitmap->width + 7) / 8)
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  if ((req = calloc(1, sizeof(tpcl_request_t))) == NULL)
+    return (-1);
+
+  req->page   = *page;
+  req->bitmap = *bitmap;
+  req->cb     = cb;
+  req->data   = data;
+
+  pthread_mutex_lock(&printer->lock);
+
+  if (printer->closing)
+  {
+    pthread_mutex_unlock(&printer->lock);
+    free(req);
+    errno = EPIPE;
+    return (-1);
+  }
+
+  if (printer->model)
+    tpclModelCheck(printer->model, &req->page);
+
+  if (printer->last)
+    printer->last->next = req;
+  else
+    printer->first = req;
+
+  printer->last = req;
+  printer->pending ++;
+
+  pthread_cond_broadcast(&printer->cond);
+  pthread_mutex_unlock(&printer->lock);
+
+  return (0);
+}
+
+
+/*
+ * 'tpclPrinterPending()' - Return the number of labels not completed.
+ */
+int					/* O - Labels queued or printing */
+tpclPrinterPending(tpcl_printer_t *printer)	/* I - Printer */
+{
+  int	pending;			/* Labels not completed */
+
+
+  pthread_mutex_lock(&printer->lock);
+  pending = printer->pending;
+  pthread_mutex_unlock(&printer->lock);
+
+  return (pending);
+}
+
+
+/*
+ * 'tpclPrinterSetModel()' - Set the model to check labels against.
+ *
+ * Labels submitted afterwards are limited to the sizes, media types and
+ * speeds of the model, see tpclModelCheck(); NULL turns this off.
+ */
+void
+tpclPrinterSetModel(
+    tpcl_printer_t     *printer,	/* I - Printer */
+    const tpcl_model_t *model)		/* I - Model or NULL */
+{
+  pthread_mutex_lock(&printer->lock);
+  printer->model = model;
+  pthread_mutex_unlock(&printer->lock);
+}
+
+
+/*
+ * 'PrinterNew()' - Create a printer and start its thread.
+ */
+static tpcl_printer_t *			/* O - Printer or NULL on error */
+PrinterNew(const char         *host,	/* I - Host name or NULL */
+           const char         *port,	/* I - Port or NULL */
+           int                fd,	/* I - File or -1 */
+           const tpcl_setup_t *setup)	/* I - Printer setup or NULL */
+{
+  tpcl_printer_t	*printer;	/* New printer */
+
+
+  if ((printer = calloc(1, sizeof(tpcl_printer_t))) == NULL)
+    return (NULL);
+
+  printer->fd = fd;
+
+  if (setup)
+    printer->setup = *setup;
+
+  if ((host && ((printer->host = strdup(host)) == NULL ||
+                (printer->port = strdup(port)) == NULL)) ||
+      (printer->job = tpclJobNew(PrinterWrite, printer)) == NULL)
+  {
+    free(printer->host);
+    free(printer->port);
+    free(printer);
+    return (NULL);
+  }
+
+  tpclSetSegment(printer->job, TPCL_SEGMENT_LENGTH);
+
+  pthread_mutex_init(&printer->lock, NULL);
+  pthread_cond_init(&printer->cond, NULL);
+
+  if ((errno = pthread_create(&printer->thread, NULL, PrinterThread,
+                              printer)) != 0)
+  {
+    pthread_cond_destroy(&printer->cond);
+    pthread_mutex_destroy(&printer->lock);
+    tpclJobDelete(printer->job);
+    free(printer->host);
+    free(printer->port);
+    free(printer);
+    return (NULL);
+  }
+
+  return (printer);
+}
+
+
+/*
+ * 'PrinterConnect()' - Connect to the printer.
+ */
+static int				/* O - 0 on success, errno on error */
+PrinterConnect(tpcl_printer_t *printer)	/* I - Printer */
+{
+  struct addrinfo	hints,		/* Address lookup hints */
+			*addrs,		/* Addresses of the host */
+			*addr;		/* Current address */
+  int			fd = -1,	/* Socket */
+			one = 1,	/* Option value */
+			status;		/* Lookup status */
+
+
+  if (printer->fd >= 0)
+    return (0);
+
+  if (!printer->host)
+    return (EBADF);
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if ((status = getaddrinfo(printer->host, printer->port, &hints,
+                            &addrs)) != 0)
+    return (status == EAI_SYSTEM ? errno : EHOSTUNREACH);
+
+  for (addr = addrs; addr; addr = addr->ai_next)
+  {
+    if ((fd = socket(addr->ai_family, addr->ai_socktype,
+                     addr->ai_protocol)) < 0)
+      continue;
+
+    if (!connect(fd, addr->ai_addr, addr->ai_addrlen))
+      break;
+
+    status = errno;
+    close(fd);
+    fd    = -1;
+    errno = status;
+  }
+
+  freeaddrinfo(addrs);
+
+  if (fd < 0)
+    return (errno ? errno : ECONNREFUSED);
+
+ /*
+  * The end of a label is a short command, send it without delay...
+  */
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  printer->fd      = fd;
+  printer->started = 0;
+
+  return (0);
+}
+
+
+/*
+ * 'PrinterDisconnect()' - Drop the connection after an error.
+ *
+ * Files passed by the caller stay open; the setup is sent again anyway,
+ * as the printer state is unknown.
+ */
+static void
+PrinterDisconnect(tpcl_printer_t *printer)	/* I - Printer */
+{
+  if (printer->host && printer->fd >= 0)
+  {
+    close(printer->fd);
+    printer->fd = -1;
+  }
+
+  printer->started = 0;
+
+  tpclJobReset(printer->job);
+}
+
+
+/*
+ * 'PrinterWrite()' - Write encoded data to the printer.
+ */
+static ssize_t				/* O - Bytes written or -1 on error */
+PrinterWrite(void       *data,		/* I - Printer */
+             const void *buffer,	/* I - Data */
+             size_t     bytes)		/* I - Number of bytes */
+{
+  tpcl_printer_t	*printer = (tpcl_printer_t *)data;
+					/* Printer */
+  ssize_t		count;		/* Bytes written */
+
+
+  do
+  {
+    if (printer->host)
+      count = send(printer->fd, buffer, bytes, MSG_NOSIGNAL);
+    else
+      count = write(printer->fd, buffer, bytes);
+  }
+  while (count < 0 && errno == EINTR);
+
+  if (count < 0)
+    printer->error = errno;
+
+  return (count);
+}
+
+
+/*
+ * 'PrinterPrint()' - Print a label.
+ */
+static int				/* O - 0 on success, errno on error */
+PrinterPrint(tpcl_printer_t *printer,	/* I - Printer */
+             tpcl_request_t *req)	/* I - Label */
+{
+  int	status;				/* Connection status */
+
+
+  if ((status = PrinterConnect(printer)) != 0)
+    return (status);
+
+  printer->error = 0;
+
+  if (!printer->started)
+  {
+    tpclStartJob(printer->job, &printer->setup);
+    printer->started = 1;
+  }
+
+  if (EncodeLines(printer->job, &req->page, &req->bitmap, &printer->abort))
+  {
+    if (tpclJobError(printer->job))
+    {
+      status = printer->error ? printer->error : EIO;
+      PrinterDisconnect(printer);
+      return (status);
+    }
+
+    return (errno);
+  }
+
+  if (__atomic_load_n(&printer->abort, __ATOMIC_RELAXED))
+  {
+    if (tpclCancel(printer->job))
+      PrinterDisconnect(printer);
+
+    return (ECANCELED);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'PrinterThread()' - Print the queued labels of a printer.
+ */
+static void *				/* O - Unused */
+PrinterThread(void *data)		/* I - Printer */
+{
+  tpcl_printer_t	*printer = (tpcl_printer_t *)data;
+					/* Printer */
+  tpcl_request_t	*req,		/* Current label */
+			*next;		/* Next dropped label */
+  int			status,		/* Completion status */
+			count;		/* Labels completed */
+
+
+  pthread_mutex_lock(&printer->lock);
+
+  for (;;)
+  {
+    while (!printer->first && !printer->dropped && !printer->closing)
+      pthread_cond_wait(&printer->cond, &printer->lock);
+
+    if (printer->dropped)
+    {
+      req              = printer->dropped;
+      printer->dropped = NULL;
+
+      pthread_mutex_unlock(&printer->lock);
+
+      for (count = 0; req; req = next, count ++)
+      {
+        next = req->next;
+
+        if (req->cb)
+          (req->cb)(printer, req->data, ECANCELED);
+
+        free(req);
+      }
+
+      pthread_mutex_lock(&printer->lock);
+      printer->pending -= count;
+      continue;
+    }
+
+    if ((req = printer->first) == NULL)
+      break;
+
+    if ((printer->first = req->next) == NULL)
+      printer->last = NULL;
+
+    printer->busy  = 1;
+    printer->abort = 0;
+
+    pthread_mutex_unlock(&printer->lock);
+
+    status = PrinterPrint(printer, req);
+
+    if (req->cb)
+      (req->cb)(printer, req->data, status);
+
+    free(req);
+
+    pthread_mutex_lock(&printer->lock);
+    printer->busy = 0;
+    printer->pending --;
+  }
+
+  pthread_mutex_unlock(&printer->lock);
+
+  return (NULL);
+}
+
+
+/*
+ * 'EncodeLines()' - Encode the lines of a bitmap.
+ *
+ * Stops early, without issuing the label, when abort is set.
+ */
+static int				/* O - 0 on success, -1 on error */
+EncodeLines(tpcl_job_t          *job,	/* I - Job */
+            const tpcl_page_t   *page,	/* I - Label settings */
+            const tpcl_bitmap_t *bitmap,/* I - Graphics */
+            const int           *abort)	/* I - Stop flag or NULL */
+{
+  tpcl_page_t		settings;	/* Settings with the bitmap size */
+  const unsigned char	*line;		/* Current line */
+  unsigned		y;		/* Line number */
+
+
+  if (!bitmap->data || !bitmap->width || !bitmap->height ||
+      bitmap->stride < (bitmap->width + 7) / 8 || page->width <= 0 ||
+      page->length <= 0)
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  settings                = *page;
+  settings.bytes_per_line = (bitmap->width + 7) / 8;
+  settings.lines          = bitmap->height;
+
+  if (settings.copies < 1)
+    settings.copies = 1;
+  if (!settings.mode)
+    settings.mode = 'C';
+  if (!settings.speed)
+    settings.speed = '3';
+
+  if (tpclStartPage(job, &settings))
+    return (-1);
+
+  for (y = 0, line = bitmap->data; y < bitmap->height;
+       y ++, line += bitmap->stride)
+  {
+    if (abort && __atomic_load_n(abort, __ATOMIC_RELAXED))
+      return (0);
+
+    if (tpclWriteLine(job, line, y))
+      return (-1);
+  }
+
+  return (tpclEndPage(job, 0));
+}
@@ -0,0 +1,68 @@
+/*
+ *   Direct printing of bitmaps for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPCLPRINT_H_
+#define _TPCLPRINT_H_
+
+#include "tpclmodel.h"
+
+/*
+ * Default TCP port of the printers...
+ */
+#define TPCL_PRINT_PORT "8000"
+
+
+/*
+ * Types...
+ */
+typedef struct tpcl_bitmap_s		/* Label graphics, 1 bit per dot */
+{
+  const unsigned char *data;		/* First line, MSB is the left dot */
+  size_t	stride;			/* Bytes from one line to the next */
+  unsigned	width,			/* Width in dots */
+		height;			/* Height in lines */
+} tpcl_bitmap_t;
+
+typedef struct tpcl_printer_s tpcl_printer_t;
+					/* Printer connection */
+
+typedef void (*tpcl_done_cb_t)(tpcl_printer_t *printer, void *data,
+                               int status);
+					/* Completion callback */
+
+
+/*
+ * Prototypes...
+ */
+extern int	tpclEncodeBitmap(tpcl_job_t *job, const tpcl_page_t *page,
+		                 const tpcl_bitmap_t *bitmap);
+extern tpcl_printer_t *tpclPrinterOpen(const char *host, const char *port,
+		                       const tpcl_setup_t *setup);
+extern tpcl_printer_t *tpclPrinterOpenFd(int fd, const tpcl_setup_t *setup);
+extern void	tpclPrinterClose(tpcl_printer_t *printer);
+extern void	tpclPrinterCancel(tpcl_printer_t *printer);
+extern int	tpclPrinterSubmit(tpcl_printer_t *printer,
+		                  const tpcl_page_t *page,
+		                  const tpcl_bitmap_t *bitmap,
+		                  tpcl_done_cb_t cb, void *data);
+extern int	tpclPrinterPending(tpcl_printer_t *printer);
+extern void	tpclPrinterSetModel(tpcl_printer_t *printer,
+			            const tpcl_model_t *model);
+
+#endif /* !_TPCLPRINT_H_ */
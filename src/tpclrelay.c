@@ -0,0 +1,1952 @@
+/*
+ *   Printer pool relay for Toshiba TEC TPCL label printers.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   Log()            - Write a message to stderr.
+ *   Usage()          - Show program usage.
+ *   AddQueue()       - Add a queue and its printer pool.
+ *   ListenQueue()    - Listen for jobs of a queue lane.
+ *   PrinterCB()      - Handle printer connection events.
+ *   ReadPrinter()    - Read status responses from a printer.
+ *   AcquirePrinter() - Lease the least loaded printer to a job.
+ *   ReleasePrinter() - Return the printer of a job to the pool.
+ *   ResetSession()   - Forget what a printer was last sent.
+ *   HoldCommand()    - Hold back a command that may be redundant.
+ *   Redundant()      - Check a held command against the printer session.
+ *   RestoreJob()     - Resend the label settings of a job to a new printer.
+ *   UrgentWaiting()  - Check for urgent jobs waiting for a printer.
+ *   ConsumeJob()     - Remove leading data from the pending job data.
+ *   TrimLine()       - Drop the line end after a dropped command.
+ *   SendPrinter()    - Queue data for a printer.
+ *   MarkLabel()      - Remember where a label ends in the printer stream.
+ *   MarkCommand()    - Remember where a command starts in the printer stream.
+ *   CancelPrinter()  - Drop queued data of a canceled job.
+ *   Lookahead()      - Look for a cancel behind a held command.
+ *   Admit()          - Check whether a printer may be sent more data.
+ *   RouteJob()       - Route leading job data to its current destination.
+ *   ProcessJob()     - Parse and route the pending data of a job.
+ *   UpdateJob()      - Start or stop reading from a job connection.
+ *   Dispatch()       - Resume jobs waiting for a printer.
+ *   QueueCB()        - Accept new job connections.
+ *   UrgentCB()       - Accept new job connections on the urgent lane.
+ *   AcceptJob()      - Start a new job.
+ *   JobCB()          - Handle job connection events.
+ *   ReadJob()        - Read data from a job connection.
+ *   CloseJob()       - Finish a job.
+ *   PollPrinters()   - Query printers excluded from the pool.
+ *   Copies()         - Get the number of labels of an issue command.
+ *   MetricsCB()      - Accept new scrape connections.
+ *   ScrapeCB()       - Answer a metrics scrape.
+ *   main()           - Main entry for the relay.
+ *
+ * The relay accepts raw TPCL jobs on one or more ports, like a printer
+ * would, and spreads the jobs of each port across a pool of identical
+ * printers. Each job connection is one job. Jobs either go to one printer
+ * as a whole, or in groups of labels split at issue commands
+ * ({XS;...|}); the job setup commands ({WS|}, {AX;...|}, {RM;...|}) are
+ * replayed to every printer a job is spread to. A printer is leased to
+ * one job at a time, so labels never interleave.
+ *
+ * A queue may have a second, urgent lane ("port+urgent-port=..."). Jobs
+ * on it take the next free printer before any batch job, and a batch job
+ * holding a printer hands it over after the label it is sending, i.e. at
+ * the next issue command boundary. When the batch job gets a printer
+ * again, its job setup and its last label size and temperature commands
+ * ({D...|}, {AY;...|}) are replayed, so the remaining labels print as
+ * before.
+ *
+ * Back-to-back jobs on a printer form one session: when a printer is
+ * leased again within the session window, the job setup is only sent if
+ * it differs from the setup the printer already has, and label size and
+ * temperature commands ({D...|}, {AY;...|}) equal to the last ones sent
+ * are dropped. Micro-jobs of one label then cost little more than the
+ * label itself.
+ *
+ * Data sent to a printer but not yet taken by it is capped, so jobs do not
+ * pile up in the printer and socket buffers. The byte cap follows the
+ * drain rate measured while the printer is backed up, aiming for -a msecs
+ * of data in flight within the bounds of -b; the label cap (-n) counts
+ * issue commands the printer has not fully received. A job over either
+ * cap is held at the next command in its bounded pending buffer, and the
+ * sender sees TCP flow control. An error status halves the byte cap.
+ *
+ * A reset ({WR|}) inside a job cancels it, as the filter sends it when a
+ * job is canceled. Data queued for the printer is dropped back to the
+ * first command the printer has not started to receive, and the reset is
+ * sent in its place, bypassing the byte and label caps. A job held by
+ * the caps is still read, up to 4 MB, and parsed ahead, so a cancel
+ * behind data buffered on the way from the sender is found without
+ * waiting for the printer.
+ *
+ * All connections are driven by one transport, so the number of printers
+ * served by one relay process is limited by bandwidth, not processes.
+ *
+ * With -p the relay serves per-printer counters in Prometheus text format
+ * (see metrics.c) on the same transport.
+ */
+
+#include "metrics.h"
+#include "tpclparse.h"
+#include "transport.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Limits...
+ */
+#define RELAY_PENDING    131072		/* Job data read at once */
+#define RELAY_LOOKAHEAD  4194304	/* Job data read ahead while held */
+#define RELAY_CONNECT    10000		/* Printer connect timeout in ms */
+#define RELAY_CACHED     2		/* Commands cached per session */
+#define RELAY_MARKS      64		/* Most labels tracked in flight */
+#define RELAY_SAMPLE     20		/* Drain rate sample interval in ms */
+
+/*
+ * Dispatch modes...
+ */
+#define RELAY_MODE_JOB  0		/* Whole jobs to one printer */
+#define RELAY_MODE_PAGE 1		/* Groups of labels */
+
+
+/*
+ * Types...
+ */
+typedef struct relay_job_s relay_job_t;
+typedef struct relay_printer_s relay_printer_t;
+
+typedef struct relay_queue_s		/* Queue with its printer pool */
+{
+  transport_conn_t	*listener,	/* Listening socket */
+			*urgent;	/* Urgent lane or NULL */
+  relay_printer_t	**printers;	/* Printer pool */
+  int			num_printers,	/* Number of printers */
+			next_printer;	/* Round-robin start for ties */
+} relay_queue_t;
+
+struct relay_printer_s			/* Pool printer */
+{
+  relay_queue_t	*queue;			/* Queue of this printer */
+  transport_conn_t *conn;		/* Connection */
+  int		status,			/* Last status code or -1 */
+		faulted,		/* Non-zero if error status */
+		stalled;		/* Non-zero if writes stalled */
+  relay_job_t	*owner,			/* Job holding the lease */
+		*last;			/* Job receiving status responses */
+  unsigned char	input[256];		/* Partial status response */
+  size_t	inputlen;		/* Bytes in input */
+  unsigned char	*session;		/* Job setup last sent */
+  size_t	sessionlen;		/* Bytes in session */
+  long long	idle,			/* Time of last release, 0 if no session */
+		blocked,		/* Time writes backed up, 0 if not */
+		sampled;		/* Time of last drain sample */
+  unsigned long long sent,		/* Bytes sent since connect */
+		consumed,		/* Bytes taken at last sample */
+		leased,			/* Bytes sent before the current lease */
+		marks[RELAY_MARKS],	/* Ends of labels in flight */
+		starts[RELAY_MARKS];	/* Starts of commands in flight */
+  int		firstmark,		/* Oldest label in flight */
+		nmarks,			/* Labels in flight */
+		firststart,		/* Oldest command start */
+		nstarts,		/* Command starts in flight */
+		backlogged;		/* Non-zero if backed up at last sample */
+  size_t	rate,			/* Drain rate in bytes/sec, 0 if unknown */
+		cap;			/* Bytes allowed in flight */
+  char		cached[RELAY_CACHED][64];
+					/* Last D and AY parameters sent */
+  metrics_counters_t *metrics;		/* Counters of this printer */
+};
+
+struct relay_job_s			/* Job connection */
+{
+  relay_job_t	*next;			/* Next job */
+  relay_queue_t	*queue;			/* Queue the job came in on */
+  transport_conn_t *conn;		/* Connection or NULL */
+  int		id,			/* Job number for messages */
+		started,		/* Non-zero after the job setup */
+		waiting,		/* Non-zero if waiting for a printer */
+		lost,			/* Non-zero if printer was lost */
+		eof,			/* Non-zero after end of data */
+		labels,			/* Labels sent in current group */
+		held,			/* Non-zero while a command is held */
+		trim,			/* Non-zero to drop a line end */
+		throttled,		/* Non-zero if held by admission control */
+		urgent,			/* Non-zero for jobs on the urgent lane */
+		boundary;		/* Non-zero right after an issue command */
+  tpcl_parser_t	parser,			/* Command parser */
+		ahead;			/* Parser looking past a held command */
+  relay_printer_t *printer;		/* Leased printer */
+  unsigned char	*setup;			/* Job setup commands */
+  size_t	setuplen,		/* Bytes in setup */
+		setupsize;		/* Allocated setup bytes */
+  unsigned char	*pending;		/* Data not yet routed */
+  size_t	pendsize,		/* Allocated bytes of pending */
+		pendlen,		/* Bytes in pending */
+		parsed,			/* Bytes of pending already parsed */
+		scanned,		/* Bytes of pending seen by ahead */
+		base,			/* Stream offset of pending[0] */
+		dropped;		/* Redundant bytes not sent */
+  char		saved[RELAY_CACHED][64];
+					/* Last D and AY parameters of the job */
+};
+
+typedef struct relay_scrape_s		/* Metrics scrape connection */
+{
+  char		request[1024];		/* Request received */
+  size_t	len;			/* Bytes of request */
+  int		answered;		/* Non-zero once answered */
+} relay_scrape_t;
+
+
+/*
+ * Globals...
+ */
+static transport_t	*Transport;	/* Connection core */
+static relay_queue_t	**Queues = NULL;/* Queues */
+static int		NumQueues = 0;	/* Number of queues */
+static relay_job_t	*Jobs = NULL;	/* Job connections, oldest first */
+static metrics_t	*Metrics = NULL;/* Counters of all printers */
+static int		JobId = 0,	/* Last job number */
+			Mode = RELAY_MODE_JOB,
+					/* Dispatch mode */
+			Group = 1,	/* Labels kept together in page mode */
+			Interval = 5,	/* Status poll interval in seconds */
+			Stall = 60,	/* Write stall timeout in seconds */
+			Window = 2000,	/* Session window in ms, 0 for none */
+			MaxLabels = 8,	/* Labels in flight, 0 for no limit */
+			Target = 500,	/* Data in flight in ms of draining */
+			Throttled = 0,	/* Jobs held by admission control */
+			Debug = 0;	/* Show debug messages */
+static size_t		MinInFlight = 16384,
+					/* Lower bound of byte cap */
+			MaxInFlight = 262144;
+					/* Upper bound of byte cap */
+
+
+static const char * const Cached[RELAY_CACHED] =
+{					/* Commands cached per session */
+  "D",
+  "AY"
+};
+
+
+/*
+ * Prototypes...
+ */
+static void	Log(const char *level, const char *format, ...)
+		__attribute__((format(printf, 2, 3)));
+static void	Usage(void);
+static int	AddQueue(const char *listen, char *printers);
+static transport_conn_t *ListenQueue(const char *address, transport_cb_t cb,
+		            relay_queue_t *queue);
+static void	PrinterCB(transport_conn_t *conn, int event, void *data);
+static void	ReadPrinter(relay_printer_t *printer);
+static int	AcquirePrinter(relay_job_t *job);
+static void	ReleasePrinter(relay_job_t *job);
+static void	ResetSession(relay_printer_t *printer);
+static void	HoldCommand(relay_job_t *job);
+static int	Redundant(relay_printer_t *printer, tpcl_command_t *cmd);
+static void	RestoreJob(relay_job_t *job);
+static int	UrgentWaiting(relay_queue_t *queue);
+static void	ConsumeJob(relay_job_t *job, size_t len);
+static void	TrimLine(relay_job_t *job);
+static void	SendPrinter(relay_printer_t *printer, const void *buffer,
+		            size_t len);
+static void	MarkLabel(relay_printer_t *printer, unsigned long long end);
+static void	MarkCommand(relay_printer_t *printer);
+static void	CancelPrinter(relay_printer_t *printer, relay_job_t *job);
+static int	Lookahead(relay_job_t *job);
+static int	Admit(relay_printer_t *printer);
+static void	RouteJob(relay_job_t *job, size_t len);
+static void	ProcessJob(relay_job_t *job);
+static void	UpdateJob(relay_job_t *job);
+static void	Dispatch(void);
+static void	QueueCB(transport_conn_t *conn, int event, void *data);
+static void	UrgentCB(transport_conn_t *conn, int event, void *data);
+static void	AcceptJob(transport_conn_t *conn, relay_queue_t *queue,
+		          int urgent);
+static void	JobCB(transport_conn_t *conn, int event, void *data);
+static void	ReadJob(relay_job_t *job);
+static void	CloseJob(relay_job_t *job);
+static void	PollPrinters(transport_t *t, void *data);
+static int	Copies(tpcl_command_t *cmd);
+static void	MetricsCB(transport_conn_t *conn, int event, void *data);
+static void	ScrapeCB(transport_conn_t *conn, int event, void *data);
+static void	StopRelay(int sig);
+
+
+/*
+ * 'Log()' - Write a message to stderr.
+ */
+static void
+Log(const char *level,			/* I - Message level */
+    const char *format,			/* I - printf-style format */
+    ...)				/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+
+
+  if (!Debug && !strcmp(level, "DEBUG"))
+    return;
+
+  fprintf(stderr, "%s: ", level);
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  putc('\n', stderr);
+}
+
+
+/*
+ * 'Usage()' - Show program usage.
+ */
+static void
+Usage(void)
+{
+  fputs("Usage: tpclrelay [options] queue [... queue]\n"
+        "Queues:\n"
+        "  [host:]port[+[host:]port]=printer[:port][,printer[:port]...]\n"
+        "  printer[:port]  Printer for the queue given with -l\n"
+        "  A second address is the urgent lane of the queue.\n"
+        "Options:\n"
+        "  -a msecs        Data in flight per printer, in ms of draining\n"
+        "  -b min,max      Bounds of bytes in flight per printer\n"
+        "  -d              Show debug messages\n"
+        "  -g labels       Labels kept together on one printer (page mode)\n"
+        "  -l [host:]port[+[host:]port]\n"
+        "                  Listen address (default localhost:8000)\n"
+        "  -m job|page     Dispatch whole jobs or groups of labels\n"
+        "  -n labels       Labels in flight per printer (0 = no limit)\n"
+        "  -p [host:]port  Serve Prometheus metrics\n"
+        "  -s seconds      Status poll interval for faulted printers\n"
+        "  -t seconds      Write stall timeout before a printer is skipped\n"
+        "  -w msecs        Session window for back-to-back jobs (0 = off)\n",
+        stderr);
+  exit(1);
+}
+
+
+/*
+ * 'AddQueue()' - Add a queue and its printer pool.
+ */
+static int				/* O - 0 on success, -1 on error */
+AddQueue(const char *listen,		/* I - [host:]port to listen on */
+         char       *printers)		/* I - Comma-separated printers */
+{
+  relay_queue_t		*queue;		/* New queue */
+  relay_printer_t	*printer;	/* Current printer */
+  char			address[256],	/* Listen address */
+			*urgent,	/* Urgent lane address */
+			host[256],	/* Host name */
+			*port,		/* Port number */
+			*name,		/* Current printer */
+			*saveptr;	/* strtok_r() state */
+
+
+  if ((queue = calloc(1, sizeof(relay_queue_t))) == NULL ||
+      (Queues = realloc(Queues, (size_t)(NumQueues + 1) *
+                                    sizeof(relay_queue_t *))) == NULL)
+    return (-1);
+
+  Queues[NumQueues ++] = queue;
+
+  snprintf(address, sizeof(address), "%s", listen);
+  if ((urgent = strchr(address, '+')) != NULL)
+    *urgent++ = '\0';
+
+  if ((queue->listener = ListenQueue(address, QueueCB, queue)) == NULL ||
+      (urgent && (queue->urgent = ListenQueue(urgent, UrgentCB,
+                                              queue)) == NULL))
+    return (-1);
+
+  for (name = strtok_r(printers, ",", &saveptr); name;
+       name = strtok_r(NULL, ",", &saveptr))
+  {
+    if ((printer = calloc(1, sizeof(relay_printer_t))) == NULL ||
+        (queue->printers = realloc(queue->printers,
+                                   (size_t)(queue->num_printers + 1) *
+                                       sizeof(relay_printer_t *))) == NULL)
+      return (-1);
+
+    snprintf(host, sizeof(host), "%s", name);
+    if ((port = strrchr(host, ':')) != NULL)
+      *port++ = '\0';
+    else
+      port = "8000";
+
+    printer->queue  = queue;
+    printer->status = -1;
+    printer->cap    = MaxInFlight;
+
+    if ((printer->conn = transportConnect(Transport, host, port,
+                                          TRANSPORT_RECONNECT, PrinterCB,
+                                          printer)) == NULL)
+      return (-1);
+
+    transportSetTimeouts(printer->conn, RELAY_CONNECT, Stall * 1000, 0);
+
+    printer->metrics = metricsGet(Metrics, 0, transportName(printer->conn));
+
+    queue->printers[queue->num_printers ++] = printer;
+  }
+
+  Log("INFO", "Relaying %s to %d printers in %s mode.",
+      transportName(queue->listener), queue->num_printers,
+      Mode == RELAY_MODE_JOB ? "job" : "page");
+
+  if (queue->urgent)
+    Log("INFO", "Urgent jobs for %s on %s.", transportName(queue->listener),
+        transportName(queue->urgent));
+
+  return (0);
+}
+
+
+/*
+ * 'ListenQueue()' - Listen for jobs of a queue lane.
+ */
+static transport_conn_t *		/* O - Listener or NULL on error */
+ListenQueue(const char     *address,	/* I - [host:]port to listen on */
+            transport_cb_t cb,		/* I - Accept callback */
+            relay_queue_t  *queue)	/* I - Queue */
+{
+  transport_conn_t	*listener;	/* Listener */
+  char			host[256],	/* Host name */
+			*port;		/* Port number */
+
+
+  snprintf(host, sizeof(host), "%s", address);
+  if ((port = strrchr(host, ':')) != NULL)
+    *port++ = '\0';
+  else
+  {
+    strcpy(host, "localhost");
+    port = (char *)address;
+  }
+
+  if ((listener = transportListen(Transport, host, port, cb, queue)) == NULL)
+    Log("ERROR", "Unable to listen on %s - %s", address, strerror(errno));
+
+  return (listener);
+}
+
+
+/*
+ * 'PrinterCB()' - Handle printer connection events.
+ */
+static void
+PrinterCB(transport_conn_t *conn,	/* I - Connection */
+          int              event,	/* I - Event */
+          void             *data)	/* I - Printer */
+{
+  relay_printer_t	*printer = data;/* Printer */
+  relay_job_t		*job;		/* Current job */
+
+
+  switch (event)
+  {
+    case TRANSPORT_EVENT_CONNECTED :
+        Log("INFO", "Connected to printer %s.", transportName(conn));
+        printer->status   = -1;
+        printer->faulted  = 0;
+        printer->stalled  = 0;
+        printer->inputlen = 0;
+        printer->sent     = 0;
+        printer->leased   = 0;
+        printer->nmarks   = 0;
+        printer->nstarts  = 0;
+        printer->sampled  = 0;
+        ResetSession(printer);
+        break;
+
+    case TRANSPORT_EVENT_READ :
+        ReadPrinter(printer);
+        break;
+
+    case TRANSPORT_EVENT_DRAINED :
+        if (printer->stalled)
+          Log("INFO", "Printer %s is taking data again.", transportName(conn));
+
+        printer->stalled = 0;
+
+        if (printer->blocked)
+        {
+          metricsObserve(&printer->metrics->stall,
+                         (transportNow() - printer->blocked) / 1000.0);
+          printer->blocked = 0;
+        }
+
+        if (printer->owner)
+          UpdateJob(printer->owner);
+        break;
+
+    case TRANSPORT_EVENT_TIMEOUT :
+        Log("ERROR", "Printer %s stopped taking data, skipped for new jobs.",
+            transportName(conn));
+        printer->stalled = 1;
+        break;
+
+    case TRANSPORT_EVENT_CLOSED :
+        if (transportQueued(conn))
+          Log("ERROR", "Lost connection to printer %s, discarded %lu bytes.",
+              transportName(conn), (unsigned long)transportQueued(conn));
+        else if (errno)
+          Log("ERROR", "Lost connection to printer %s - %s",
+              transportName(conn), strerror(errno));
+        else
+          Log("ERROR", "Printer %s closed the connection.",
+              transportName(conn));
+
+        if (printer->blocked)
+        {
+          metricsObserve(&printer->metrics->stall,
+                         (transportNow() - printer->blocked) / 1000.0);
+          printer->blocked = 0;
+        }
+
+        if ((job = printer->owner) != NULL)
+        {
+         /*
+          * The current label group is broken, skip to the next label...
+          */
+
+          ReleasePrinter(job);
+          job->lost = 1;
+          UpdateJob(job);
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'ReadPrinter()' - Read status responses from a printer.
+ *
+ * Responses are passed on to the job that last held the printer, so the
+ * sender sees the same back-channel data as with a direct connection.
+ */
+static void
+ReadPrinter(relay_printer_t *printer)	/* I - Printer */
+{
+  ssize_t	bytes;			/* Bytes read */
+  size_t	used;			/* Bytes consumed */
+  int		status;			/* Status code */
+
+
+  if ((bytes = transportRead(printer->conn, printer->input + printer->inputlen,
+                             sizeof(printer->input) - printer->inputlen)) <= 0)
+    return;
+
+  if (printer->last && printer->last->conn)
+    transportWrite(printer->last->conn, printer->input + printer->inputlen,
+                   (size_t)bytes);
+
+  printer->inputlen += (size_t)bytes;
+
+  while (printer->inputlen > 0)
+  {
+    status = tpclParseStatus(printer->input, printer->inputlen, &used, NULL);
+
+    memmove(printer->input, printer->input + used, printer->inputlen - used);
+    printer->inputlen -= used;
+
+    if (status < 0)
+    {
+      if (printer->inputlen == sizeof(printer->input))
+        printer->inputlen = 0;		/* Garbage, start over */
+      break;
+    }
+
+    Log("DEBUG", "Printer %s status %02d.", transportName(printer->conn),
+        status);
+
+    printer->status = status;
+
+    if (tpclStatusOk(status))
+    {
+      if (printer->faulted)
+      {
+        Log("INFO", "Printer %s is back in the pool.",
+            transportName(printer->conn));
+        printer->faulted = 0;
+      }
+    }
+    else if (!printer->faulted)
+    {
+      Log("ERROR", "Printer %s reported status %02d, removed from pool.",
+          transportName(printer->conn), status);
+      printer->faulted = 1;
+      ResetSession(printer);
+
+      if ((printer->cap /= 2) < MinInFlight)
+        printer->cap = MinInFlight;
+    }
+  }
+}
+
+
+/*
+ * 'AcquirePrinter()' - Lease the least loaded printer to a job.
+ *
+ * Printers are ranked by outstanding bytes; ties go round-robin so an idle
+ * pool still spreads jobs. The job setup commands are sent first, unless
+ * the printer has them already from a job in the same session.
+ */
+static int				/* O - 1 if leased, 0 if all busy */
+AcquirePrinter(relay_job_t *job)	/* I - Job */
+{
+  relay_queue_t		*queue = job->queue;
+					/* Queue */
+  int			i,		/* Looping var */
+			index,		/* Index of current printer */
+			bestindex = 0;	/* Index of least loaded printer */
+  relay_printer_t	*printer,	/* Current printer */
+			*best = NULL;	/* Least loaded printer */
+  size_t		load,		/* Current load */
+			bestload = 0;	/* Least load */
+
+
+  if (!job->urgent && queue->urgent && UrgentWaiting(queue))
+    return (0);
+
+  for (i = 0; i < queue->num_printers; i ++)
+  {
+    index   = (queue->next_printer + i) % queue->num_printers;
+    printer = queue->printers[index];
+
+    if (!transportIsOpen(printer->conn) || printer->faulted ||
+        printer->stalled || printer->owner)
+      continue;
+
+    load = transportOutstanding(printer->conn);
+    if (!best || load < bestload)
+    {
+      best      = printer;
+      bestload  = load;
+      bestindex = index;
+    }
+  }
+
+  if (!best)
+    return (0);
+
+  queue->next_printer = (bestindex + 1) % queue->num_printers;
+
+  if (best->last != job)
+    metricsAdd(&best->metrics->jobs, 1);
+
+  best->owner  = job;
+  best->last   = job;
+  best->leased = best->sent;
+  job->printer = best;
+  job->labels  = 0;
+  job->lost    = 0;
+
+  Log("DEBUG", "Job %d leased printer %s (%lu bytes outstanding).", job->id,
+      transportName(best->conn), (unsigned long)bestload);
+
+  if (Window && best->idle && transportNow() - best->idle <= Window &&
+      best->sessionlen == job->setuplen &&
+      (!job->setuplen || !memcmp(best->session, job->setup, job->setuplen)))
+  {
+    Log("DEBUG", "Job %d continues the session on printer %s.", job->id,
+        transportName(best->conn));
+    job->dropped += job->setuplen;
+    metricsAdd(&best->metrics->bytes_in, job->setuplen);
+  }
+  else
+  {
+    ResetSession(best);
+
+    if (job->setuplen)
+    {
+      SendPrinter(best, job->setup, job->setuplen);
+      metricsAdd(&best->metrics->bytes_in, job->setuplen);
+
+      if ((best->session = malloc(job->setuplen)) != NULL)
+      {
+        memcpy(best->session, job->setup, job->setuplen);
+        best->sessionlen = job->setuplen;
+      }
+    }
+  }
+
+  RestoreJob(job);
+  HoldCommand(job);
+
+  return (1);
+}
+
+
+/*
+ * 'ReleasePrinter()' - Return the printer of a job to the pool.
+ */
+static void
+ReleasePrinter(relay_job_t *job)	/* I - Job */
+{
+  if (!job->printer)
+    return;
+
+  Log("DEBUG", "Job %d released printer %s after %d labels.", job->id,
+      transportName(job->printer->conn), job->labels);
+
+  if (job->printer->session || !job->setuplen)
+    job->printer->idle = transportNow();
+
+  job->printer->owner = NULL;
+  job->printer        = NULL;
+}
+
+
+/*
+ * 'ResetSession()' - Forget what a printer was last sent.
+ */
+static void
+ResetSession(relay_printer_t *printer)	/* I - Printer */
+{
+  free(printer->session);
+
+  printer->session    = NULL;
+  printer->sessionlen = 0;
+  printer->idle       = 0;
+
+  memset(printer->cached, 0, sizeof(printer->cached));
+}
+
+
+/*
+ * 'HoldCommand()' - Hold back a command that may be redundant.
+ *
+ * Called with the name of the current command parsed; cached commands are
+ * not routed until they are complete and can be compared.
+ */
+static void
+HoldCommand(relay_job_t *job)		/* I - Job */
+{
+  int	i;				/* Looping var */
+
+
+  job->held = 0;
+
+  if (!Window || !job->printer || tpclParserIdle(&job->parser))
+    return;
+
+  for (i = 0; i < RELAY_CACHED; i ++)
+    if (!strcmp(job->parser.cmd.name, Cached[i]))
+      job->held = 1;
+}
+
+
+/*
+ * 'Redundant()' - Check a held command against the printer session.
+ *
+ * Returns 1 if the printer was last sent the same command, otherwise the
+ * command is remembered as the last one sent.
+ */
+static int				/* O - 1 if redundant */
+Redundant(relay_printer_t *printer,	/* I - Printer */
+          tpcl_command_t  *cmd)		/* I - Complete command */
+{
+  int	i;				/* Looping var */
+  int	complete;			/* Non-zero if args hold all parameters */
+
+
+  complete = cmd->length == strlen(cmd->name) + strlen(cmd->args) + 3;
+
+  for (i = 0; i < RELAY_CACHED; i ++)
+    if (!strcmp(cmd->name, Cached[i]))
+    {
+      if (complete && printer->cached[i][0] &&
+          !strcmp(printer->cached[i], cmd->args))
+        return (1);
+
+      if (complete)
+        strcpy(printer->cached[i], cmd->args);
+      else
+        printer->cached[i][0] = '\0';
+      break;
+    }
+
+  return (0);
+}
+
+
+/*
+ * 'RestoreJob()' - Resend the label settings of a job to a new printer.
+ *
+ * A job continuing on another printer, or on the same printer after an
+ * urgent job, needs its label size and temperature again; commands the
+ * printer already has are skipped.
+ */
+static void
+RestoreJob(relay_job_t *job)		/* I - Job with a printer */
+{
+  int			i;		/* Looping var */
+  char			buffer[80];	/* Command */
+  tpcl_command_t	cmd;		/* Saved command */
+
+
+  for (i = 0; i < RELAY_CACHED; i ++)
+  {
+    if (!job->saved[i][0])
+      continue;
+
+    memset(&cmd, 0, sizeof(cmd));
+    strcpy(cmd.name, Cached[i]);
+    strcpy(cmd.args, job->saved[i]);
+    cmd.length = strlen(cmd.name) + strlen(cmd.args) + 3;
+
+    if (Redundant(job->printer, &cmd))
+      continue;
+
+    snprintf(buffer, sizeof(buffer), "{%s%s|}\n", cmd.name, cmd.args);
+    SendPrinter(job->printer, buffer, strlen(buffer));
+
+    Log("DEBUG", "Job %d restored %s on printer %s.", job->id, buffer,
+        transportName(job->printer->conn));
+  }
+}
+
+
+/*
+ * 'UrgentWaiting()' - Check for urgent jobs waiting for a printer.
+ */
+static int				/* O - 1 if urgent jobs wait */
+UrgentWaiting(relay_queue_t *queue)	/* I - Queue */
+{
+  relay_job_t	*job;			/* Current job */
+
+
+  for (job = Jobs; job; job = job->next)
+    if (job->queue == queue && job->urgent && job->waiting)
+      return (1);
+
+  return (0);
+}
+
+
+/*
+ * 'RouteJob()' - Route leading job data to its current destination.
+ *
+ * Data goes to the leased printer; before the first label it is kept as
+ * job setup to be replayed on every leased printer. Data without either
+ * destination is filler between label groups, or the rest of a label
+ * whose printer was lost, and is dropped.
+ */
+static void
+RouteJob(relay_job_t *job,		/* I - Job */
+         size_t      len)		/* I - Bytes of pending to route */
+{
+  unsigned char	*setup;			/* New setup buffer */
+
+
+  if (len == 0)
+    return;
+
+  if (job->printer)
+  {
+    SendPrinter(job->printer, job->pending, len);
+    metricsAdd(&job->printer->metrics->bytes_in, len);
+  }
+  else if (!job->started)
+  {
+    if (job->setuplen + len > job->setupsize)
+    {
+      if ((setup = realloc(job->setup, job->setuplen + len)) == NULL)
+      {
+        Log("ERROR", "Unable to allocate setup buffer for job %d.", job->id);
+        return;
+      }
+
+      job->setup     = setup;
+      job->setupsize = job->setuplen + len;
+    }
+
+    memcpy(job->setup + job->setuplen, job->pending, len);
+    job->setuplen += len;
+  }
+
+  ConsumeJob(job, len);
+}
+
+
+/*
+ * 'ConsumeJob()' - Remove leading data from the pending job data.
+ */
+static void
+ConsumeJob(relay_job_t *job,		/* I - Job */
+           size_t      len)		/* I - Bytes to remove */
+{
+  memmove(job->pending, job->pending + len, job->pendlen - len);
+  job->pendlen -= len;
+  job->parsed  -= len;
+  job->scanned  = job->scanned > len ? job->scanned - len : 0;
+  job->base    += len;
+}
+
+
+/*
+ * 'TrimLine()' - Drop the line end after a dropped command.
+ *
+ * The CR/LF behind a redundant command would reach the printer as an
+ * empty line. The bytes are removed before the parser sees them, so the
+ * stream offsets of the parser stay valid; a line end split across reads
+ * is trimmed when the rest arrives.
+ */
+static void
+TrimLine(relay_job_t *job)		/* I - Job */
+{
+  size_t	n = 0;			/* Bytes to drop */
+
+
+  while (job->parsed + n < job->pendlen)
+  {
+    if (job->pending[job->parsed + n] == '\r')
+    {
+      n ++;
+      continue;
+    }
+
+    if (job->pending[job->parsed + n] == '\n')
+      n ++;
+
+    job->trim = 0;
+    break;
+  }
+
+  if (n == 0)
+    return;
+
+  memmove(job->pending + job->parsed, job->pending + job->parsed + n,
+          job->pendlen - job->parsed - n);
+  job->pendlen -= n;
+  job->dropped += n;
+
+  if (job->scanned > job->parsed)
+    job->scanned = job->scanned - job->parsed > n ? job->scanned - n :
+                                                    job->parsed;
+
+  if (job->printer)
+    metricsAdd(&job->printer->metrics->bytes_in, n);
+}
+
+
+/*
+ * 'SendPrinter()' - Queue data for a printer.
+ */
+static void
+SendPrinter(relay_printer_t *printer,	/* I - Printer */
+            const void      *buffer,	/* I - Data */
+            size_t          len)	/* I - Bytes of data */
+{
+  if (transportWrite(printer->conn, buffer, len))
+    return;
+
+  printer->sent += len;
+  metricsAdd(&printer->metrics->bytes_out, len);
+}
+
+
+/*
+ * 'MarkLabel()' - Remember where a label ends in the printer stream.
+ *
+ * Without a label cap more labels than can be tracked may be in flight;
+ * the oldest are then forgotten.
+ */
+static void
+MarkLabel(relay_printer_t    *printer,	/* I - Printer */
+          unsigned long long end)	/* I - Stream offset after label */
+{
+  if (printer->nmarks == RELAY_MARKS)
+  {
+    printer->firstmark = (printer->firstmark + 1) % RELAY_MARKS;
+    printer->nmarks --;
+  }
+
+  printer->marks[(printer->firstmark + printer->nmarks) % RELAY_MARKS] = end;
+  printer->nmarks ++;
+}
+
+
+/*
+ * 'MarkCommand()' - Remember where a command starts in the printer stream.
+ */
+static void
+MarkCommand(relay_printer_t *printer)	/* I - Printer */
+{
+  if (printer->nstarts == RELAY_MARKS)
+  {
+    printer->firststart = (printer->firststart + 1) % RELAY_MARKS;
+    printer->nstarts --;
+  }
+
+  printer->starts[(printer->firststart + printer->nstarts) % RELAY_MARKS] =
+      printer->sent;
+  printer->nstarts ++;
+}
+
+
+/*
+ * 'CancelPrinter()' - Drop queued data of a canceled job.
+ *
+ * The queue is cut at the oldest command start the socket has not taken
+ * yet, so the printer never sees part of a command, and that belongs to
+ * the canceled job. The reset of the job then follows right away.
+ */
+static void
+CancelPrinter(relay_printer_t *printer,	/* I - Printer */
+              relay_job_t     *job)	/* I - Canceled job */
+{
+  int			i;		/* Looping var */
+  unsigned long long	written,	/* Bytes handed to the socket */
+			start;		/* Command start */
+
+
+  written = printer->sent - transportQueued(printer->conn);
+
+  for (i = 0; i < printer->nstarts; i ++)
+  {
+    start = printer->starts[(printer->firststart + i) % RELAY_MARKS];
+
+    if (start < written || start < printer->leased)
+      continue;
+
+    if (start >= printer->sent ||
+        transportTruncate(printer->conn, (size_t)(start - written)))
+      break;
+
+    Log("DEBUG", "Job %d canceled, %llu bytes for printer %s dropped.",
+        job->id, printer->sent - start, transportName(printer->conn));
+
+    printer->sent    = start;
+    printer->nstarts = i;
+
+    while (printer->nmarks > 0 &&
+           printer->marks[(printer->firstmark + printer->nmarks - 1) %
+                          RELAY_MARKS] > start)
+      printer->nmarks --;
+    break;
+  }
+}
+
+
+/*
+ * 'Lookahead()' - Look for a cancel behind a held command.
+ *
+ * While a job waits for its printer to drain, the data read behind the
+ * held command is parsed ahead. A reset in it cancels the job: all
+ * commands up to the reset are dropped, so it is routed next.
+ */
+static int				/* O - 1 if the job was canceled */
+Lookahead(relay_job_t *job)		/* I - Job */
+{
+  int			event;		/* Parser event */
+  size_t		used;		/* Bytes consumed */
+  tpcl_command_t	cmd;		/* Current command */
+
+
+  while (job->scanned < job->pendlen)
+  {
+    event = tpclParserFeed(&job->ahead, job->pending + job->scanned,
+                           job->pendlen - job->scanned, &used, &cmd);
+    job->scanned += used;
+
+    if (event == TPCL_EVENT_BEGIN && !strcmp(cmd.name, "WR"))
+    {
+      Log("DEBUG", "Job %d canceled, %lu bytes of it dropped.", job->id,
+          (unsigned long)(cmd.offset - job->base));
+
+      job->parsed = cmd.offset - job->base;
+      job->held   = 0;
+      ConsumeJob(job, cmd.offset - job->base);
+
+      tpclParserInit(&job->parser);
+      job->parser.offset = cmd.offset;
+
+      return (1);
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'Admit()' - Check whether a printer may be sent more data.
+ *
+ * Bytes in flight are those queued in the relay or unacknowledged in the
+ * socket. The drain rate is only sampled while the printer stays backed
+ * up, as an idle printer says nothing about how fast it can go.
+ */
+static int				/* O - 1 if admitted, 0 to hold */
+Admit(relay_printer_t *printer)		/* I - Printer */
+{
+  long long		now = transportNow();
+					/* Current time */
+  size_t		outstanding,	/* Bytes in flight */
+			rate,		/* Current drain rate */
+			cap;		/* New byte cap */
+  unsigned long long	consumed;	/* Bytes taken by the printer */
+
+
+  outstanding = transportOutstanding(printer->conn);
+  consumed    = printer->sent > outstanding ? printer->sent - outstanding : 0;
+
+  while (printer->nmarks > 0 && printer->marks[printer->firstmark] <= consumed)
+  {
+    printer->firstmark = (printer->firstmark + 1) % RELAY_MARKS;
+    printer->nmarks --;
+  }
+
+  if (now - printer->sampled >= RELAY_SAMPLE)
+  {
+    if (printer->sampled && printer->backlogged && outstanding > 0)
+    {
+      rate          = (size_t)((consumed - printer->consumed) * 1000 /
+                               (unsigned long long)(now - printer->sampled));
+      printer->rate = printer->rate ? (3 * printer->rate + rate) / 4 : rate;
+
+      if ((cap = printer->rate / 1000 * (size_t)Target) < MinInFlight)
+        cap = MinInFlight;
+      else if (cap > MaxInFlight)
+        cap = MaxInFlight;
+
+      if (cap > printer->cap + printer->cap / 4 ||
+          cap < printer->cap - printer->cap / 4)
+        Log("DEBUG", "Printer %s drains %lu bytes/sec, %lu bytes in flight "
+                     "allowed.", transportName(printer->conn),
+            (unsigned long)printer->rate, (unsigned long)cap);
+
+      printer->cap = cap;
+    }
+
+    printer->sampled    = now;
+    printer->consumed   = consumed;
+    printer->backlogged = outstanding > 0;
+  }
+
+  return (outstanding < printer->cap &&
+          (!MaxLabels || printer->nmarks < MaxLabels));
+}
+
+
+/*
+ * 'ProcessJob()' - Parse and route the pending data of a job.
+ */
+static void
+ProcessJob(relay_job_t *job)		/* I - Job */
+{
+  int			i,		/* Looping var */
+			event;		/* Parser event */
+  size_t		used;		/* Bytes consumed */
+  tpcl_command_t	cmd;		/* Current command */
+
+
+  for (;;)
+  {
+    if (job->waiting)
+    {
+      if (!AcquirePrinter(job))
+        return;
+
+      job->waiting = 0;
+      HoldCommand(job);
+    }
+
+    if (job->throttled)
+    {
+      if (job->printer && !Admit(job->printer) && !Lookahead(job))
+        return;
+
+      job->throttled = 0;
+    }
+
+    if (job->trim)
+      TrimLine(job);
+
+    if (job->parsed >= job->pendlen)
+      break;
+
+    event = tpclParserFeed(&job->parser, job->pending + job->parsed,
+                           job->pendlen - job->parsed, &used, &cmd);
+    job->parsed += used;
+
+    if (event == TPCL_EVENT_END)
+    {
+      for (i = 0; i < RELAY_CACHED; i ++)
+        if (!strcmp(cmd.name, Cached[i]))
+        {
+          if (cmd.length == strlen(cmd.name) + strlen(cmd.args) + 3)
+            strcpy(job->saved[i], cmd.args);
+          else
+            job->saved[i][0] = '\0';	/* Too long to replay */
+        }
+
+      if (job->held)
+      {
+       /*
+        * The held command is complete, drop it if the printer has it...
+        */
+
+        job->held = 0;
+
+        if (job->printer && Redundant(job->printer, &cmd))
+        {
+          ConsumeJob(job, cmd.length);
+          job->dropped += cmd.length;
+          job->trim     = 1;
+          metricsAdd(&job->printer->metrics->bytes_in, cmd.length);
+        }
+      }
+      else if (!strcmp(cmd.name, "XS"))
+      {
+        job->labels ++;
+        job->boundary = 1;
+
+        if (job->printer)
+        {
+          MarkLabel(job->printer, job->printer->sent + cmd.offset +
+                                      cmd.length - job->base);
+          metricsAdd(&job->printer->metrics->pages, 1);
+          metricsAdd(&job->printer->metrics->labels, (unsigned)Copies(&cmd));
+        }
+      }
+    }
+    else if (event == TPCL_EVENT_BEGIN)
+    {
+     /*
+      * Everything up to this command belongs to the previous destination...
+      */
+
+      RouteJob(job, cmd.offset - job->base);
+
+      if (!job->started && (!strcmp(cmd.name, "WS") ||
+                            !strcmp(cmd.name, "WR") ||
+                            !strcmp(cmd.name, "AX") ||
+                            !strcmp(cmd.name, "RM")))
+        continue;
+
+      job->started = 1;
+
+      if (job->lost && strcmp(cmd.name, "D"))
+        continue;
+
+      if (job->printer && Mode == RELAY_MODE_PAGE && job->labels >= Group &&
+          strcmp(cmd.name, "IB") && strcmp(cmd.name, "WR"))
+        ReleasePrinter(job);
+      else if (job->printer && job->boundary && !job->urgent &&
+               job->queue->urgent && strcmp(cmd.name, "IB") &&
+               UrgentWaiting(job->queue))
+      {
+        Log("DEBUG", "Job %d hands printer %s to an urgent job.", job->id,
+            transportName(job->printer->conn));
+        ReleasePrinter(job);
+      }
+
+      if (strcmp(cmd.name, "IB"))
+        job->boundary = 0;
+
+      if (!strcmp(cmd.name, "WR") && job->printer)
+      {
+       /*
+        * A reset inside a job cancels it...
+        */
+
+        CancelPrinter(job->printer, job);
+        ResetSession(job->printer);
+      }
+
+      if (!job->printer && !AcquirePrinter(job))
+      {
+        job->waiting = 1;
+        return;
+      }
+
+      HoldCommand(job);
+      MarkCommand(job->printer);
+
+      if (strcmp(cmd.name, "WR") && !Admit(job->printer))
+      {
+       /*
+        * Hold the rest of the job until the printer catches up, looking
+        * ahead for a cancel...
+        */
+
+        job->throttled = 1;
+        job->ahead     = job->parser;
+        job->scanned   = job->parsed;
+        return;
+      }
+    }
+  }
+
+ /*
+  * Route what is safe to route, keeping partial command names back...
+  */
+
+  if (job->held && job->pendlen >= RELAY_PENDING)
+  {
+   /*
+    * Not a command we can cache after all, send it unchecked...
+    */
+
+    job->held = 0;
+    memset(job->printer->cached, 0, sizeof(job->printer->cached));
+  }
+
+  if (!job->held)
+    RouteJob(job, tpclParserSafe(&job->parser) - job->base);
+
+  if (job->eof)
+    CloseJob(job);
+}
+
+
+/*
+ * 'UpdateJob()' - Start or stop reading from a job connection.
+ *
+ * Jobs waiting for a printer, held by admission control, or whose
+ * printer is backed up, are not read so the sender sees TCP flow control.
+ */
+static void
+UpdateJob(relay_job_t *job)		/* I - Job */
+{
+  if (!job->conn)
+    return;
+
+  if (job->printer && !job->printer->blocked &&
+      transportQueued(job->printer->conn) > MaxInFlight)
+    job->printer->blocked = transportNow();
+
+  transportPause(job->conn, job->waiting || job->eof ||
+                            job->pendlen >= (job->throttled ? RELAY_LOOKAHEAD :
+                                                              RELAY_PENDING) ||
+                            (job->printer &&
+                             transportQueued(job->printer->conn) >
+                                 MaxInFlight));
+}
+
+
+/*
+ * 'Dispatch()' - Resume jobs waiting for a printer or held back.
+ *
+ * Called after every round of events, as any event may free a printer.
+ * Urgent jobs are resumed first, then jobs in the order they were
+ * accepted.
+ */
+static void
+Dispatch(void)
+{
+  relay_job_t	*job,			/* Current job */
+		*next;			/* Next job */
+  int		urgent;			/* Lane to resume */
+
+
+  for (urgent = 1; urgent >= 0; urgent --)
+  {
+    for (job = Jobs; job; job = next)
+    {
+      next = job->next;
+
+      if (job->urgent != urgent || (!job->waiting && !job->throttled))
+        continue;
+
+      if (job->eof)
+      {
+        ProcessJob(job);		/* May free the job */
+        continue;
+      }
+
+      ProcessJob(job);
+
+      if (!job->waiting && !job->throttled)
+        UpdateJob(job);
+    }
+  }
+
+  for (job = Jobs, Throttled = 0; job; job = job->next)
+    if (job->throttled)
+      Throttled ++;
+}
+
+
+/*
+ * 'QueueCB()' - Accept new job connections.
+ */
+static void
+QueueCB(transport_conn_t *conn,		/* I - New connection */
+        int              event,		/* I - Event */
+        void             *data)		/* I - Queue */
+{
+  if (event == TRANSPORT_EVENT_ACCEPT)
+    AcceptJob(conn, data, 0);
+}
+
+
+/*
+ * 'UrgentCB()' - Accept new job connections on the urgent lane.
+ */
+static void
+UrgentCB(transport_conn_t *conn,	/* I - New connection */
+         int              event,	/* I - Event */
+         void             *data)	/* I - Queue */
+{
+  if (event == TRANSPORT_EVENT_ACCEPT)
+    AcceptJob(conn, data, 1);
+}
+
+
+/*
+ * 'AcceptJob()' - Start a new job.
+ */
+static void
+AcceptJob(transport_conn_t *conn,	/* I - New connection */
+          relay_queue_t    *queue,	/* I - Queue */
+          int              urgent)	/* I - Non-zero for the urgent lane */
+{
+  relay_job_t	*job,			/* New job */
+		**last;			/* End of job list */
+
+
+  if ((job = calloc(1, sizeof(relay_job_t))) == NULL ||
+      (job->pending = malloc(RELAY_PENDING)) == NULL)
+  {
+    Log("ERROR", "Unable to allocate job, refusing connection.");
+    free(job);
+    transportClose(conn);
+    return;
+  }
+
+  job->queue    = queue;
+  job->conn     = conn;
+  job->pendsize = RELAY_PENDING;
+  job->id       = ++ JobId;
+  job->urgent   = urgent;
+  tpclParserInit(&job->parser);
+
+  for (last = &Jobs; *last; last = &(*last)->next);
+  *last = job;
+
+  transportSetCallback(conn, JobCB, job);
+
+  Log("DEBUG", "Job %d connected to %s%s.", job->id, transportName(conn),
+      urgent ? " (urgent)" : "");
+}
+
+
+/*
+ * 'JobCB()' - Handle job connection events.
+ */
+static void
+JobCB(transport_conn_t *conn,		/* I - Connection */
+      int              event,		/* I - Event */
+      void             *data)		/* I - Job */
+{
+  relay_job_t	*job = data;		/* Job */
+
+
+  (void)conn;
+
+  if (event == TRANSPORT_EVENT_READ)
+    ReadJob(job);
+  else if (event == TRANSPORT_EVENT_CLOSED)
+  {
+    job->conn = NULL;
+    job->eof  = 1;
+
+    if (!job->waiting)
+      ProcessJob(job);
+  }
+}
+
+
+/*
+ * 'ReadJob()' - Read data from a job connection.
+ */
+static void
+ReadJob(relay_job_t *job)		/* I - Job */
+{
+  ssize_t	bytes;			/* Bytes read */
+  size_t	limit = job->throttled ? RELAY_LOOKAHEAD : RELAY_PENDING;
+					/* Most bytes to keep pending */
+  unsigned char	*pending;		/* Grown pending buffer */
+
+
+  while (job->pendlen < limit && !job->eof)
+  {
+    if (job->pendlen == job->pendsize)
+    {
+     /*
+      * Held jobs are read ahead to find a cancel, grow the buffer...
+      */
+
+      if ((pending = realloc(job->pending, 2 * job->pendsize)) == NULL)
+        break;
+
+      job->pending  = pending;
+      job->pendsize *= 2;
+    }
+
+    if ((bytes = transportRead(job->conn, job->pending + job->pendlen,
+                               job->pendsize - job->pendlen)) < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+
+      Log("ERROR", "Unable to read job %d - %s", job->id, strerror(errno));
+      bytes = 0;
+    }
+
+    if (bytes == 0)
+      job->eof = 1;
+    else
+      job->pendlen += (size_t)bytes;
+  }
+
+  if (job->eof)
+    transportPause(job->conn, 1);
+
+  ProcessJob(job);				/* May free the job */
+}
+
+
+/*
+ * 'CloseJob()' - Finish a job.
+ */
+static void
+CloseJob(relay_job_t *job)		/* I - Job */
+{
+  relay_job_t	**prev;			/* Pointer to current job */
+  relay_printer_t *printer = job->printer;
+					/* Leased printer */
+  int		i;			/* Looping var */
+
+
+  if (printer)
+    RouteJob(job, job->pendlen);
+
+  ReleasePrinter(job);
+
+  if (printer && !tpclParserIdle(&job->parser))
+    ResetSession(printer);		/* Job ended inside a command */
+
+  for (i = 0; i < job->queue->num_printers; i ++)
+    if (job->queue->printers[i]->last == job)
+      job->queue->printers[i]->last = NULL;
+
+  for (prev = &Jobs; *prev; prev = &(*prev)->next)
+    if (*prev == job)
+    {
+      *prev = job->next;
+      break;
+    }
+
+  Log("DEBUG", "Job %d finished, %lu redundant bytes dropped.", job->id,
+      (unsigned long)job->dropped);
+
+  if (job->conn)
+    transportClose(job->conn);
+
+  free(job->setup);
+  free(job->pending);
+  free(job);
+}
+
+
+/*
+ * 'PollPrinters()' - Query printers excluded from the pool.
+ */
+static void
+PollPrinters(transport_t *t,		/* I - Transport */
+             void        *data)		/* I - Unused */
+{
+  relay_printer_t	*printer;	/* Current printer */
+  int			i, j;		/* Looping vars */
+
+
+  (void)t;
+  (void)data;
+
+  for (i = 0; i < NumQueues; i ++)
+    for (j = 0; j < Queues[i]->num_printers; j ++)
+    {
+      printer = Queues[i]->printers[j];
+
+      if (printer->faulted && !printer->owner &&
+          transportIsOpen(printer->conn) && !transportQueued(printer->conn))
+        SendPrinter(printer, "{WS|}\n", 6);
+    }
+}
+
+
+/*
+ * 'Copies()' - Get the number of labels of an issue command.
+ */
+static int				/* O - Number of labels */
+Copies(tpcl_command_t *cmd)		/* I - Issue command */
+{
+  int	copies;				/* Number of copies */
+
+
+  if (sscanf(cmd->args, ";%*c,%d", &copies) != 1 || copies < 1)
+    copies = 1;
+
+  return (copies);
+}
+
+
+/*
+ * 'MetricsCB()' - Accept new scrape connections.
+ */
+static void
+MetricsCB(transport_conn_t *conn,	/* I - New connection */
+          int              event,	/* I - Event */
+          void             *data)	/* I - Unused */
+{
+  relay_scrape_t	*scrape;	/* Scrape state */
+
+
+  (void)data;
+
+  if (event != TRANSPORT_EVENT_ACCEPT)
+    return;
+
+  if ((scrape = calloc(1, sizeof(relay_scrape_t))) == NULL)
+  {
+    transportClose(conn);
+    return;
+  }
+
+  transportSetCallback(conn, ScrapeCB, scrape);
+  transportSetTimeouts(conn, 0, RELAY_CONNECT, RELAY_CONNECT);
+}
+
+
+/*
+ * 'ScrapeCB()' - Answer a metrics scrape.
+ *
+ * Gauges are brought up to date first; jobs are counted per queue as
+ * service metrics, as they are not tied to a printer while waiting.
+ */
+static void
+ScrapeCB(transport_conn_t *conn,	/* I - Connection */
+         int              event,	/* I - Event */
+         void             *data)	/* I - Scrape state */
+{
+  relay_scrape_t	*scrape = data;	/* Scrape state */
+  relay_printer_t	*printer;	/* Current printer */
+  relay_job_t		*job;		/* Current job */
+  int			i, j,		/* Looping vars */
+			waiting,	/* Jobs waiting in queue */
+			printing;	/* Jobs printing in queue */
+  ssize_t		bytes;		/* Bytes read */
+  size_t		length,		/* Bytes of response */
+			extralen = 0,	/* Bytes of service metrics */
+			extrasize,	/* Allocated service metrics */
+			n;		/* Bytes of one queue */
+  char			*extra,		/* Service metrics */
+			*response;	/* Response */
+
+
+  if (event == TRANSPORT_EVENT_READ && !scrape->answered)
+  {
+    bytes = transportRead(conn, scrape->request + scrape->len,
+                          sizeof(scrape->request) - 1 - scrape->len);
+
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    if (bytes > 0)
+    {
+      scrape->len += (size_t)bytes;
+      scrape->request[scrape->len] = '\0';
+
+      if (scrape->len < sizeof(scrape->request) - 1 &&
+          !strstr(scrape->request, "\r\n\r\n") &&
+          !strstr(scrape->request, "\n\n"))
+        return;				/* Wait for the rest of the request */
+    }
+
+    for (i = 0; i < NumQueues; i ++)
+      for (j = 0; j < Queues[i]->num_printers; j ++)
+      {
+        printer = Queues[i]->printers[j];
+
+        metricsSet(&printer->metrics->queued,
+                   (long long)transportQueued(printer->conn));
+        metricsAdd(&printer->metrics->reconnects,
+                   transportReconnects(printer->conn) -
+                       printer->metrics->reconnects);
+      }
+
+   /*
+    * Each queue takes its name twice plus about 90 bytes of text...
+    */
+    for (i = 0, extrasize = 256; i < NumQueues; i ++)
+      extrasize += 2 * strlen(transportName(Queues[i]->listener)) + 128;
+
+    if ((extra = malloc(extrasize)) != NULL)
+    {
+      extralen += (size_t)snprintf(extra + extralen, extrasize - extralen,
+                                   "# HELP tpcl_relay_jobs_total Job "
+                                   "connections accepted.\n"
+                                   "# TYPE tpcl_relay_jobs_total counter\n"
+                                   "tpcl_relay_jobs_total %d\n"
+                                   "# HELP tpcl_relay_jobs Job connections "
+                                   "by state.\n"
+                                   "# TYPE tpcl_relay_jobs gauge\n", JobId);
+
+      for (i = 0; i < NumQueues; i ++)
+      {
+        for (job = Jobs, waiting = 0, printing = 0; job; job = job->next)
+          if (job->queue == Queues[i])
+          {
+            if (job->printer)
+              printing ++;
+            else
+              waiting ++;
+          }
+
+        n = (size_t)snprintf(extra + extralen, extrasize - extralen,
+                             "tpcl_relay_jobs{queue=\"%s\","
+                             "state=\"waiting\"} %d\n"
+                             "tpcl_relay_jobs{queue=\"%s\","
+                             "state=\"printing\"} %d\n",
+                             transportName(Queues[i]->listener), waiting,
+                             transportName(Queues[i]->listener), printing);
+
+        if (n >= extrasize - extralen)
+        {
+          extra[extralen] = '\0';	/* Drop the truncated queue */
+          break;
+        }
+
+        extralen += n;
+      }
+    }
+
+    if ((response = metricsResponse(Metrics, scrape->request, extra,
+                                    &length)) != NULL)
+    {
+      transportWrite(conn, response, length);
+      free(response);
+    }
+
+    free(extra);
+
+    scrape->answered = 1;
+    transportPause(conn, 1);
+  }
+  else if ((event == TRANSPORT_EVENT_DRAINED && scrape->answered) ||
+           event == TRANSPORT_EVENT_TIMEOUT ||
+           event == TRANSPORT_EVENT_CLOSED)
+  {
+    transportClose(conn);
+    free(scrape);
+  }
+}
+
+
+/*
+ * 'StopRelay()' - Ask the main loop to shut down.
+ */
+static void
+StopRelay(int sig)			/* I - Signal */
+{
+  (void)sig;
+  transportStop(Transport);
+}
+
+
+/*
+ * 'main()' - Main entry for the relay.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  int		ch;			/* Option character */
+  char		*listen = "localhost:8000",
+					/* Default listen address */
+		*metrics = NULL,	/* Metrics address */
+		*host,			/* Metrics host */
+		*port,			/* Metrics port */
+		*printers = NULL,	/* Printers of the default queue */
+		*ptr;			/* Pointer into argument */
+  size_t	len = 0,		/* Length of printers */
+		arglen;			/* Length of argument */
+
+
+  setbuf(stderr, NULL);
+
+  while ((ch = getopt(argc, argv, "a:b:dg:l:m:n:p:s:t:w:")) != -1)
+  {
+    switch (ch)
+    {
+      case 'a' :
+          if ((Target = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'b' :
+          MinInFlight = (size_t)strtoul(optarg, &ptr, 10);
+          if (*ptr == ',')
+            MaxInFlight = (size_t)strtoul(ptr + 1, &ptr, 10);
+          if (*ptr || MinInFlight < 1 || MaxInFlight < MinInFlight)
+            Usage();
+          break;
+      case 'd' :
+          Debug = 1;
+          break;
+      case 'g' :
+          if ((Group = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'l' :
+          listen = optarg;
+          break;
+      case 'm' :
+          if (!strcmp(optarg, "job"))
+            Mode = RELAY_MODE_JOB;
+          else if (!strcmp(optarg, "page"))
+            Mode = RELAY_MODE_PAGE;
+          else
+            Usage();
+          break;
+      case 'n' :
+          if ((MaxLabels = atoi(optarg)) < 0 || MaxLabels > RELAY_MARKS)
+            Usage();
+          break;
+      case 'p' :
+          metrics = optarg;
+          break;
+      case 's' :
+          if ((Interval = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 't' :
+          if ((Stall = atoi(optarg)) < 1)
+            Usage();
+          break;
+      case 'w' :
+          if ((Window = atoi(optarg)) < 0)
+            Usage();
+          break;
+      default :
+          Usage();
+    }
+  }
+
+  if (optind >= argc)
+    Usage();
+
+  if ((Transport = transportNew()) == NULL)
+  {
+    Log("ERROR", "Unable to create transport - %s", strerror(errno));
+    return (1);
+  }
+
+  if (transportHasRing(Transport))
+    Log("DEBUG", "Writing to printers with io_uring.");
+
+  if ((Metrics = metricsNew(1)) == NULL)
+    Log("ERROR", "Unable to allocate metrics - %s", strerror(errno));
+
+  if (metrics && Metrics)
+  {
+    if ((port = strrchr(metrics, ':')) != NULL)
+    {
+      *port++ = '\0';
+      host    = metrics;
+    }
+    else
+    {
+      host = "localhost";
+      port = metrics;
+    }
+
+    if (!transportListen(Transport, host, port, MetricsCB, NULL))
+    {
+      Log("ERROR", "Unable to serve metrics on %s:%s - %s", host, port,
+          strerror(errno));
+      return (1);
+    }
+  }
+
+ /*
+  * Set up the queues; plain printer arguments form the default queue...
+  */
+
+  for (i = optind; i < argc; i ++)
+  {
+    if ((ptr = strchr(argv[i], '=')) != NULL)
+    {
+      *ptr++ = '\0';
+
+      if (AddQueue(argv[i], ptr))
+        return (1);
+    }
+    else
+    {
+      arglen = strlen(argv[i]);
+
+      if ((printers = realloc(printers, len + arglen + 2)) == NULL)
+        return (1);
+
+      if (len)
+        printers[len ++] = ',';
+
+      memcpy(printers + len, argv[i], arglen + 1);
+      len += arglen;
+    }
+  }
+
+  if (printers && AddQueue(listen, printers))
+    return (1);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGTERM, StopRelay);
+  signal(SIGINT, StopRelay);
+
+  transportSetTick(Transport, Interval * 1000, PollPrinters, NULL);
+
+ /*
+  * Main loop...
+  */
+
+  while (!transportRun(Transport, Throttled ? RELAY_SAMPLE : 1000))
+    Dispatch();
+
+ /*
+  * Shut down...
+  */
+
+  while (Jobs)
+    CloseJob(Jobs);
+
+  transportDelete(Transport);
+  metricsDelete(Metrics);
+  free(printers);
+
+  return (0);
+}
@@ -0,0 +1,569 @@
+/*
+ *   TPCL stream analyzer for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   Usage()       - Show program usage.
+ *   ParseSpeeds() - Parse a list of link speeds.
+ *   Analyze()     - Read a TPCL stream and collect statistics.
+ *   CountFiller() - Classify filler bytes between commands.
+ *   AddCommand()  - Account for a complete command.
+ *   TOPIXLines()  - Count the lines of a TOPIX payload.
+ *   AddRange()    - Add a value to a range.
+ *   Report()      - Show the statistics of a stream.
+ *   main()        - Main entry for the analyzer.
+ *
+ * The stream, e.g. the captured output of rastertotpcl, is split into
+ * commands by the TPCL parser, which skips graphics payloads by length.
+ * Only the tail of the stream that may hold the payload of the current
+ * graphics command is kept, so captures of any size are read in one pass.
+ * Counting the lines of TOPIX bands walks their flag bytes at about
+ * 700 MB/s; without it (-n), the analyzer keeps up with any disk.
+ */
+
+#include "tpclparse.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Limits...
+ */
+#define STAT_BUFFER   (4 * 1024 * 1024)	/* Read buffer */
+#define STAT_KEEP     65552		/* Largest TOPIX payload and length */
+#define STAT_COMMANDS 64		/* Distinct command names */
+#define STAT_SPEEDS   16		/* Link speeds */
+
+
+/*
+ * Globals...
+ */
+static int	CountLines = 1;		/* Count lines of TOPIX bands */
+
+
+/*
+ * Types...
+ */
+typedef struct stat_command_s		/* Totals of one command name */
+{
+  char			name[4];	/* Command name */
+  unsigned long long	count,		/* Number of commands */
+			bytes;		/* Bytes including braces */
+} stat_command_t;
+
+typedef struct stat_range_s		/* Minimum, maximum and sum */
+{
+  unsigned long long	count,		/* Number of values */
+			min,		/* Smallest value */
+			max,		/* Largest value */
+			sum;		/* Sum of values */
+} stat_range_t;
+
+typedef struct stat_s			/* Statistics of a stream */
+{
+  unsigned long long	bytes,		/* Bytes in stream */
+			labels,		/* Issue commands */
+			copies,		/* Labels including copies */
+			spaces,		/* Space padding */
+			nuls,		/* NUL padding */
+			newlines,	/* Line breaks between commands */
+			other,		/* Other bytes between commands */
+			topix,		/* TOPIX bands */
+			raw,		/* Raw graphics bands */
+			malformed;	/* TOPIX bands that did not decode */
+  stat_range_t		heights,	/* Lines per band */
+			widths,		/* Dots per line */
+			lengths;	/* TOPIX bytes per band */
+  int			num_commands;	/* Distinct command names */
+  stat_command_t	commands[STAT_COMMANDS];
+					/* Totals per command name */
+  int			truncated;	/* Stream ends inside a command */
+} stat_t;
+
+
+/*
+ * Local functions...
+ */
+static void	Usage(void);
+static int	ParseSpeeds(const char *s, double *speeds);
+static int	Analyze(int fd, stat_t *st);
+static void	CountFiller(stat_t *st, const unsigned char *data,
+		            size_t len);
+static void	AddCommand(stat_t *st, const tpcl_command_t *cmd,
+		           const unsigned char *payload);
+static long	TOPIXLines(const unsigned char *data, size_t len);
+static void	AddRange(stat_range_t *r, unsigned long long value);
+static void	Report(const char *name, const stat_t *st,
+		       const double *speeds, int num_speeds);
+
+
+/*
+ * 'Usage()' - Show program usage.
+ */
+static void
+Usage(void)
+{
+  fputs("Usage: tpclstat [options] [file ...]\n"
+        "Options:\n"
+        "  -n              Do not count the lines of TOPIX bands\n"
+        "  -s bps[,bps...] Link speeds for transmission times, with k, M or G\n"
+        "                  (default 9600,115200,10M,100M)\n",
+        stderr);
+  exit(1);
+}
+
+
+/*
+ * 'ParseSpeeds()' - Parse a list of link speeds.
+ */
+static int				/* O - Number of speeds or -1 on error */
+ParseSpeeds(const char *s,		/* I - Comma separated speeds */
+            double     *speeds)		/* O - Speeds in bits per second */
+{
+  int		num_speeds = 0;		/* Number of speeds */
+  char		*end;			/* End of number */
+  double	speed;			/* Current speed */
+
+
+  while (*s)
+  {
+    if (num_speeds >= STAT_SPEEDS)
+      return (-1);
+
+    speed = strtod(s, &end);
+    if (end == s)
+      return (-1);
+
+    switch (*end)
+    {
+      case 'k' :
+      case 'K' :
+          speed *= 1000.0;
+          end ++;
+          break;
+      case 'm' :
+      case 'M' :
+          speed *= 1000000.0;
+          end ++;
+          break;
+      case 'g' :
+      case 'G' :
+          speed *= 1000000000.0;
+          end ++;
+          break;
+    }
+
+    if (speed <= 0.0 || (*end && *end != ','))
+      return (-1);
+
+    speeds[num_speeds ++] = speed;
+
+    s = *end ? end + 1 : end;
+  }
+
+  return (num_speeds);
+}
+
+
+/*
+ * 'Analyze()' - Read a TPCL stream and collect statistics.
+ */
+static int				/* O - 0 on success, -1 on error */
+Analyze(int    fd,			/* I - File to read */
+        stat_t *st)			/* O - Statistics */
+{
+  static unsigned char buffer[STAT_BUFFER];
+					/* Read buffer */
+  tpcl_parser_t	parser;			/* TPCL parser */
+  tpcl_command_t cmd;			/* Current command */
+  size_t	have = 0,		/* Bytes in buffer */
+		pos = 0,		/* Parse position in buffer */
+		keep,			/* Bytes kept for the next read */
+		used;			/* Bytes consumed by the parser */
+  unsigned long long base = 0,		/* Stream offset of buffer */
+		payload;		/* Stream offset of graphics data */
+  ssize_t	bytes;			/* Bytes read */
+  const unsigned char *brace;		/* Start of next command */
+
+
+  memset(st, 0, sizeof(stat_t));
+  tpclParserInit(&parser);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* POSIX_FADV_SEQUENTIAL */
+
+  for (;;)
+  {
+    if (pos >= have)
+    {
+     /*
+      * Keep the tail that may hold the current graphics payload, and
+      * read more...
+      */
+      keep  = have < STAT_KEEP ? have : STAT_KEEP;
+      memmove(buffer, buffer + have - keep, keep);
+      base += have - keep;
+      have  = pos = keep;
+
+      while ((bytes = read(fd, buffer + have, sizeof(buffer) - have)) < 0 &&
+             errno == EINTR);
+
+      if (bytes < 0)
+        return (-1);
+      else if (bytes == 0)
+        break;
+
+      have      += (size_t)bytes;
+      st->bytes += (unsigned long long)bytes;
+    }
+
+    if (tpclParserIdle(&parser))
+    {
+      if ((brace = memchr(buffer + pos, '{', have - pos)) == NULL)
+        brace = buffer + have;
+
+      CountFiller(st, buffer + pos, (size_t)(brace - buffer) - pos);
+    }
+
+    if (tpclParserFeed(&parser, buffer + pos, have - pos, &used,
+                       &cmd) == TPCL_EVENT_END)
+    {
+      payload = cmd.offset + cmd.length - 2 - cmd.data;
+
+      AddCommand(st, &cmd, payload >= base ? buffer + (payload - base) : NULL);
+    }
+
+    pos += used;
+  }
+
+  st->truncated = !tpclParserIdle(&parser);
+
+  return (0);
+}
+
+
+/*
+ * 'CountFiller()' - Classify filler bytes between commands.
+ */
+static void
+CountFiller(stat_t              *st,	/* I - Statistics */
+            const unsigned char *data,	/* I - Filler bytes */
+            size_t              len)	/* I - Number of bytes */
+{
+  size_t	i;			/* Looping var */
+
+
+  for (i = 0; i < len; i ++)
+  {
+    switch (data[i])
+    {
+      case ' ' :
+          st->spaces ++;
+          break;
+      case '\0' :
+          st->nuls ++;
+          break;
+      case '\n' :
+      case '\r' :
+          st->newlines ++;
+          break;
+      default :
+          st->other ++;
+          break;
+    }
+  }
+}
+
+
+/*
+ * 'AddCommand()' - Account for a complete command.
+ */
+static void
+AddCommand(stat_t               *st,	/* I - Statistics */
+           const tpcl_command_t *cmd,	/* I - Command */
+           const unsigned char  *payload)
+					/* I - Graphics payload or NULL */
+{
+  int		i;			/* Looping var */
+  int		copies;			/* Copies of a label */
+  long		lines;			/* Lines of a TOPIX band */
+
+
+  for (i = 0; i < st->num_commands; i ++)
+    if (!strcmp(st->commands[i].name, cmd->name))
+      break;
+
+  if (i == st->num_commands && i < STAT_COMMANDS)
+  {
+    strcpy(st->commands[i].name, cmd->name);
+    st->num_commands ++;
+  }
+
+  if (i < STAT_COMMANDS)
+  {
+    st->commands[i].count ++;
+    st->commands[i].bytes += cmd->length;
+  }
+
+  if (!strcmp(cmd->name, "XS"))
+  {
+    st->labels ++;
+    st->copies += sscanf(cmd->args, ";I,%d", &copies) == 1 && copies > 0 ?
+                      (unsigned)copies : 1;
+  }
+  else if (!strcmp(cmd->name, "SG") && cmd->sg[2] > 0)
+  {
+    AddRange(&st->widths, (unsigned long long)cmd->sg[2]);
+
+    if (cmd->sg[4] == 3)
+    {
+     /*
+      * The height field of TOPIX bands is not the number of lines, so
+      * count them...
+      */
+      st->topix ++;
+      AddRange(&st->lengths, cmd->data);
+
+      if (!CountLines)
+        return;
+      else if (payload && (lines = TOPIXLines(payload, cmd->data)) >= 0)
+        AddRange(&st->heights, (unsigned long long)lines);
+      else
+        st->malformed ++;
+    }
+    else
+    {
+      st->raw ++;
+      AddRange(&st->heights, (unsigned long long)cmd->sg[3]);
+    }
+  }
+}
+
+
+/*
+ * 'TOPIXLines()' - Count the lines of a TOPIX payload.
+ *
+ * Only the flag bytes are looked at. A group of 64 bytes takes at most 73
+ * bytes of TOPIX data, so groups far enough from the end are walked
+ * without bounds checks.
+ */
+static long				/* O - Lines or -1 if malformed */
+TOPIXLines(const unsigned char *data,	/* I - TOPIX data */
+           size_t              len)	/* I - Bytes of data */
+{
+  size_t	pos = 0;		/* Position in data */
+  long		lines = 0;		/* Lines counted */
+  unsigned	cl1, cl2;		/* Flag bytes */
+  static unsigned char bits[256];	/* Bits set per byte value */
+
+
+  if (!bits[255])
+    for (cl1 = 1; cl1 < 256; cl1 ++)
+      bits[cl1] = (unsigned char)(bits[cl1 >> 1] + (cl1 & 1));
+
+  while (pos < len)
+  {
+    cl1 = data[pos ++];
+
+    for (; cl1; cl1 &= cl1 - 1)
+    {
+      if (pos + 73 <= len)
+      {
+        for (cl2 = data[pos ++]; cl2; cl2 &= cl2 - 1)
+          pos += 1 + (size_t)bits[data[pos]];
+        continue;
+      }
+
+      if (pos >= len)
+        return (-1);
+
+      for (cl2 = data[pos ++]; cl2; cl2 &= cl2 - 1)
+      {
+        if (pos >= len)
+          return (-1);
+
+        pos += 1 + (size_t)bits[data[pos]];
+      }
+    }
+
+    if (pos > len)
+      return (-1);
+
+    lines ++;
+  }
+
+  return (lines);
+}
+
+
+/*
+ * 'AddRange()' - Add a value to a range.
+ */
+static void
+AddRange(stat_range_t       *r,		/* I - Range */
+         unsigned long long value)	/* I - Value */
+{
+  if (!r->count || value < r->min)
+    r->min = value;
+  if (value > r->max)
+    r->max = value;
+
+  r->count ++;
+  r->sum += value;
+}
+
+
+/*
+ * 'Report()' - Show the statistics of a stream.
+ */
+static void
+Report(const char   *name,		/* I - Stream name */
+       const stat_t *st,		/* I - Statistics */
+       const double *speeds,		/* I - Link speeds */
+       int          num_speeds)		/* I - Number of link speeds */
+{
+  int		i;			/* Looping var */
+  unsigned long long padding,		/* Padding bytes */
+		filler;			/* Bytes between commands */
+  double	total = st->bytes ? (double)st->bytes : 1.0;
+					/* Divisor for percentages */
+
+
+  padding = st->spaces + st->nuls;
+  filler  = padding + st->newlines + st->other;
+
+  printf("%s: %llu bytes, %llu labels (%llu with copies)%s\n", name,
+         st->bytes, st->labels, st->copies,
+         st->truncated ? ", ends inside a command" : "");
+
+  printf("\n  Command        Count          Bytes      %%\n");
+  for (i = 0; i < st->num_commands; i ++)
+    printf("  %-7s %12llu %14llu %6.2f\n", st->commands[i].name,
+           st->commands[i].count, st->commands[i].bytes,
+           100.0 * st->commands[i].bytes / total);
+  printf("  %-7s %12s %14llu %6.2f\n", "filler", "", filler,
+         100.0 * filler / total);
+
+  if (st->topix || st->raw)
+  {
+    printf("\n  Graphics bands: %llu TOPIX, %llu raw", st->topix, st->raw);
+    if (st->malformed)
+      printf(", %llu TOPIX not decoded", st->malformed);
+    putchar('\n');
+
+    printf("  %-14s %10s %10s %10s\n", "", "min", "avg", "max");
+    if (st->heights.count)
+      printf("  %-14s %10llu %10.1f %10llu\n", "lines", st->heights.min,
+             (double)st->heights.sum / st->heights.count, st->heights.max);
+    printf("  %-14s %10llu %10.1f %10llu\n", "width (dots)", st->widths.min,
+           (double)st->widths.sum / st->widths.count, st->widths.max);
+    if (st->lengths.count)
+      printf("  %-14s %10llu %10.1f %10llu\n", "TOPIX bytes", st->lengths.min,
+             (double)st->lengths.sum / st->lengths.count, st->lengths.max);
+  }
+
+  printf("\n  Padding: %llu spaces, %llu NULs, %.2f%% of the stream", st->spaces,
+         st->nuls, 100.0 * padding / total);
+  if (st->labels)
+    printf(", %.0f bytes per label", (double)padding / st->labels);
+  putchar('\n');
+
+  if (num_speeds > 0)
+  {
+    printf("\n  %-14s %12s %16s\n", "Link (bit/s)", "Seconds",
+           "Without padding");
+    for (i = 0; i < num_speeds; i ++)
+      printf("  %-14.0f %12.3f %16.3f\n", speeds[i],
+             8.0 * st->bytes / speeds[i],
+             8.0 * (st->bytes - padding) / speeds[i]);
+  }
+}
+
+
+/*
+ * 'main()' - Main entry for the analyzer.
+ */
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		ch;			/* Option */
+  int		i,			/* Looping var */
+		fd,			/* Input file */
+		status = 0;		/* Exit status */
+  double	speeds[STAT_SPEEDS];	/* Link speeds */
+  int		num_speeds;		/* Number of link speeds */
+  static stat_t	st;			/* Statistics */
+
+
+  num_speeds = ParseSpeeds("9600,115200,10M,100M", speeds);
+
+  while ((ch = getopt(argc, argv, "ns:")) != -1)
+  {
+    switch (ch)
+    {
+      case 'n' :
+          CountLines = 0;
+          break;
+      case 's' :
+          if ((num_speeds = ParseSpeeds(optarg, speeds)) < 0)
+            Usage();
+          break;
+      default :
+          Usage();
+    }
+  }
+
+  if (optind >= argc)
+  {
+    if (Analyze(0, &st))
+    {
+      perror("tpclstat: stdin");
+      return (1);
+    }
+
+    Report("stdin", &st, speeds, num_speeds);
+    return (0);
+  }
+
+  for (i = optind; i < argc; i ++)
+  {
+    if ((fd = open(argv[i], O_RDONLY)) < 0 || Analyze(fd, &st))
+    {
+      fprintf(stderr, "tpclstat: %s: %s\n", argv[i], strerror(errno));
+      status = 1;
+    }
+    else
+    {
+      if (i > optind)
+        putchar('\n');
+
+      Report(argv[i], &st, speeds, num_speeds);
+    }
+
+    if (fd >= 0)
+      close(fd);
+  }
+
+  return (status);
+}
@@ -0,0 +1,1485 @@
+/*
+ *   Event-driven connection core for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   transportNew()         - Create a transport.
+ *   transportDelete()      - Close all connections and free a transport.
+ *   transportRun()         - Wait for and dispatch events once.
+ *   transportStop()        - Make transportRun() return an error.
+ *   transportSetTick()     - Set a periodic callback.
+ *   transportListen()      - Listen for incoming connections.
+ *   transportConnect()     - Open an outgoing connection.
+ *   transportClose()       - Close a connection.
+ *   transportSetCallback() - Change the callback of a connection.
+ *   transportSetTimeouts() - Set connect, write stall and idle timeouts.
+ *   transportRead()        - Read from a connection.
+ *   transportWrite()       - Queue data for a connection.
+ *   transportPause()       - Stop or resume reading from a connection.
+ *   transportDiscard()     - Drop data not yet written.
+ *   transportTruncate()    - Drop queued data after the first bytes.
+ *   transportIsOpen()      - Check whether a connection is established.
+ *   transportQueued()      - Get the bytes queued for a connection.
+ *   transportOutstanding() - Get queued plus unsent socket bytes.
+ *   transportReconnects()  - Get the number of reconnects.
+ *   transportName()        - Get the "host:port" name of a connection.
+ *   transportHasRing()     - Check whether writes go through io_uring.
+ *   transportNow()         - Get the time used for timeouts.
+ *
+ * One transport multiplexes any number of non-blocking connections with
+ * epoll, so a single thread can drive many printers. Every connection has
+ * its own write queue. Outgoing connections may reconnect on their own,
+ * with exponential backoff; data queued when a connection is lost is
+ * discarded, as the printer state is unknown at that point.
+ *
+ * Where the kernel supports it, queued chunks are written with io_uring
+ * instead of writev(): the chunks come from slabs registered as fixed
+ * buffers, each connection gets a chain of linked writes so its data stays
+ * in order, and the chains of all connections that became writable during
+ * one pass of the event loop are submitted with a single system call.
+ * Completions are signalled through an eventfd watched by epoll. Without
+ * io_uring, or if setting it up fails, plain writev() is used.
+ */
+
+#define _GNU_SOURCE
+#include "transport.h"
+#include "uring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+/*
+ * Limits...
+ */
+#define TRANSPORT_CHUNK    65536	/* Size of write queue chunks */
+#define TRANSPORT_EVENTS   64		/* Events per epoll_wait() */
+#define TRANSPORT_IOV      16		/* Chunks per writev() */
+#define TRANSPORT_BACKOFF  500		/* First reconnect delay in ms */
+#define TRANSPORT_MAXDELAY 30000	/* Longest reconnect delay in ms */
+#define TRANSPORT_SLABS    64		/* Chunks registered with io_uring */
+#define TRANSPORT_OPS      256		/* io_uring writes in flight */
+
+/*
+ * Connection states...
+ */
+#define STATE_LISTEN     0		/* Listening socket */
+#define STATE_CONNECTING 1		/* Connect in progress */
+#define STATE_OPEN       2		/* Established */
+#define STATE_WAITING    3		/* Waiting to reconnect */
+#define STATE_CLOSED     4		/* Closed, to be freed */
+
+
+/*
+ * Types...
+ */
+typedef struct transport_chunk_s	/* Write queue chunk */
+{
+  struct transport_chunk_s *next;	/* Next chunk */
+  size_t		len,		/* Bytes in chunk */
+			off;		/* Bytes already written */
+  int			index,		/* Registered buffer or -1 */
+			busy,		/* Non-zero while being written */
+			orphan;		/* Non-zero if discarded while busy */
+  unsigned char		data[TRANSPORT_CHUNK];
+					/* Data */
+} transport_chunk_t;
+
+struct transport_conn_s			/* Connection */
+{
+  transport_t		*transport;	/* Owning transport */
+  transport_conn_t	*next;		/* Next connection */
+  int			fd,		/* Socket or -1 */
+			state,		/* Connection state */
+			flags,		/* TRANSPORT_RECONNECT */
+			events,		/* Events registered with epoll */
+			paused,		/* Non-zero if not reading */
+			eof,		/* Non-zero after end of file */
+			stalled,	/* Non-zero after write timeout */
+			backoff;	/* Next reconnect delay */
+  char			host[256],	/* Host name or address */
+			port[32],	/* Port number */
+			name[290];	/* "host:port" */
+  transport_cb_t	cb;		/* Callback */
+  void			*data;		/* Callback data */
+  transport_chunk_t	*head,		/* First queued chunk */
+			*tail;		/* Last queued chunk */
+  size_t		queued;		/* Bytes queued */
+  long long		deadline,	/* Connect or reconnect deadline */
+			progress,	/* Last write progress */
+			activity;	/* Last read or write */
+  int			connect_timeout,/* Connect timeout in ms */
+			write_timeout,	/* Write stall timeout in ms */
+			idle_timeout;	/* Idle timeout in ms */
+  unsigned		reconnects;	/* Number of reconnects */
+  unsigned		gen;		/* Write chain generation */
+  int			pending,	/* Writes of current chain in flight */
+			inflight,	/* Writes of any chain in flight */
+			failed;		/* errno of current chain or 0 */
+};
+
+typedef struct transport_op_s		/* io_uring write in flight */
+{
+  transport_conn_t	*conn;		/* Connection */
+  transport_chunk_t	*chunk;		/* Chunk being written */
+  size_t		bytes;		/* Bytes submitted */
+  unsigned		gen;		/* Chain generation */
+  int			next;		/* Next free slot or -1 */
+} transport_op_t;
+
+struct transport_s			/* Transport */
+{
+  int			epfd,		/* epoll instance */
+			stop;		/* Non-zero to stop */
+  transport_conn_t	*conns;		/* All connections */
+  int			tick;		/* Tick interval in ms */
+  long long		nexttick;	/* Time of next tick */
+  transport_tick_cb_t	tickcb;		/* Tick callback */
+  void			*tickdata;	/* Tick callback data */
+  uring_t		ring;		/* io_uring, fd is -1 if unused */
+  int			ringfd;		/* Completion eventfd */
+  transport_chunk_t	*slabs,		/* Registered chunks */
+			*freeslabs;	/* Unused registered chunks */
+  transport_op_t	ops[TRANSPORT_OPS];
+					/* Writes in flight */
+  int			freeops;	/* First free write slot or -1 */
+};
+
+
+/*
+ * Local functions...
+ */
+static long long	Now(void);
+static transport_conn_t	*ConnNew(transport_t *t, int fd, int state,
+			         transport_cb_t cb, void *data);
+static void		ConnUpdate(transport_conn_t *conn);
+static void		ConnStart(transport_conn_t *conn);
+static void		ConnLost(transport_conn_t *conn, int error);
+static void		ConnFlush(transport_conn_t *conn);
+static void		ConnAccept(transport_conn_t *listener);
+static void		ConnTimers(transport_t *t, long long now);
+static void		ConnReap(transport_t *t);
+static void		ConnConsume(transport_conn_t *conn, size_t bytes);
+static transport_chunk_t *ChunkNew(transport_t *t);
+static void		ChunkFree(transport_t *t, transport_chunk_t *chunk);
+static void		RingInit(transport_t *t);
+static void		RingFree(transport_t *t);
+static int		RingFlush(transport_conn_t *conn);
+static void		RingComplete(transport_t *t);
+
+
+/*
+ * 'transportNew()' - Create a transport.
+ */
+transport_t *				/* O - Transport or NULL */
+transportNew(void)
+{
+  transport_t	*t;			/* Transport */
+
+
+  if ((t = calloc(1, sizeof(transport_t))) == NULL)
+    return (NULL);
+
+  if ((t->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+  {
+    free(t);
+    return (NULL);
+  }
+
+  RingInit(t);
+
+  return (t);
+}
+
+
+/*
+ * 'transportDelete()' - Close all connections and free a transport.
+ */
+void
+transportDelete(transport_t *t)		/* I - Transport */
+{
+  transport_conn_t	*conn;		/* Current connection */
+
+
+  for (conn = t->conns; conn; conn = conn->next)
+    transportClose(conn);
+
+  RingFree(t);
+  ConnReap(t);
+  close(t->epfd);
+  free(t->slabs);
+  free(t);
+}
+
+
+/*
+ * 'transportRun()' - Wait for and dispatch events once.
+ *
+ * Waits at most "timeout" milliseconds, less if a timer is due.
+ */
+int					/* O - 0 on success, -1 when stopped */
+transportRun(transport_t *t,		/* I - Transport */
+             int         timeout)	/* I - Timeout in ms */
+{
+  struct epoll_event	events[TRANSPORT_EVENTS];
+					/* Ready events */
+  int			i,		/* Looping var */
+			nevents;	/* Number of events */
+  transport_conn_t	*conn;		/* Current connection */
+  long long		now,		/* Current time */
+			wait;		/* Time to next deadline */
+  int			error;		/* Socket error */
+  socklen_t		len;		/* Length of error */
+
+
+  if (t->stop)
+    return (-1);
+
+  now = Now();
+
+  if (t->tickcb && t->nexttick - now < timeout)
+    timeout = t->nexttick > now ? (int)(t->nexttick - now) : 0;
+
+  for (conn = t->conns; conn; conn = conn->next)
+  {
+    if (conn->state == STATE_CONNECTING || conn->state == STATE_WAITING)
+      wait = conn->deadline - now;
+    else if (conn->state == STATE_OPEN && conn->queued &&
+             conn->write_timeout && !conn->stalled)
+      wait = conn->progress + conn->write_timeout - now;
+    else if (conn->state == STATE_OPEN && !conn->queued && conn->idle_timeout)
+      wait = conn->activity + conn->idle_timeout - now;
+    else
+      continue;
+
+    if (wait < timeout)
+      timeout = wait > 0 ? (int)wait : 0;
+  }
+
+  if ((nevents = epoll_wait(t->epfd, events, TRANSPORT_EVENTS, timeout)) < 0)
+  {
+    if (errno != EINTR)
+      return (-1);
+
+    nevents = 0;
+  }
+
+  for (i = 0; i < nevents; i ++)
+  {
+    if (events[i].data.ptr == &t->ring)
+    {
+      RingComplete(t);
+      continue;
+    }
+
+    conn = events[i].data.ptr;
+
+    if (conn->state == STATE_CLOSED || conn->fd < 0)
+      continue;
+
+    switch (conn->state)
+    {
+      case STATE_LISTEN :
+          ConnAccept(conn);
+          break;
+
+      case STATE_CONNECTING :
+          len = sizeof(error);
+          if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) ||
+              error)
+          {
+            ConnLost(conn, error);
+            break;
+          }
+
+          conn->state    = STATE_OPEN;
+          conn->backoff  = TRANSPORT_BACKOFF;
+          conn->progress = conn->activity = Now();
+          ConnUpdate(conn);
+          (conn->cb)(conn, TRANSPORT_EVENT_CONNECTED, conn->data);
+          break;
+
+      case STATE_OPEN :
+          if ((events[i].events & EPOLLOUT) && conn->head)
+            ConnFlush(conn);
+
+          if (conn->state == STATE_OPEN &&
+              (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+          {
+            if (!(events[i].events & EPOLLIN) && conn->head)
+            {
+              ConnLost(conn, ECONNRESET);
+              break;
+            }
+
+            (conn->cb)(conn, TRANSPORT_EVENT_READ, conn->data);
+
+            if (conn->eof && conn->state == STATE_OPEN &&
+                (conn->flags & TRANSPORT_RECONNECT))
+              ConnLost(conn, 0);
+          }
+          break;
+    }
+  }
+
+  if (t->ring.fd >= 0)
+    uringSubmit(&t->ring);
+
+  now = Now();
+  ConnTimers(t, now);
+
+  if (t->tickcb && now >= t->nexttick)
+  {
+    t->nexttick = now + t->tick;
+    (t->tickcb)(t, t->tickdata);
+  }
+
+  ConnReap(t);
+
+  return (t->stop ? -1 : 0);
+}
+
+
+/*
+ * 'transportStop()' - Make transportRun() return an error.
+ */
+void
+transportStop(transport_t *t)		/* I - Transport */
+{
+  t->stop = 1;
+}
+
+
+/*
+ * 'transportSetTick()' - Set a periodic callback.
+ */
+void
+transportSetTick(
+    transport_t         *t,		/* I - Transport */
+    int                 interval,	/* I - Interval in ms */
+    transport_tick_cb_t cb,		/* I - Callback */
+    void                *data)		/* I - Callback data */
+{
+  t->tick     = interval;
+  t->tickcb   = cb;
+  t->tickdata = data;
+  t->nexttick = Now() + interval;
+}
+
+
+/*
+ * 'transportListen()' - Listen for incoming connections.
+ *
+ * Accepted connections start with the callback of the listener and report
+ * TRANSPORT_EVENT_ACCEPT first.
+ */
+transport_conn_t *			/* O - Listener or NULL */
+transportListen(transport_t    *t,	/* I - Transport */
+                const char     *host,	/* I - Address or NULL for any */
+                const char     *port,	/* I - Port number */
+                transport_cb_t cb,	/* I - Callback */
+                void           *data)	/* I - Callback data */
+{
+  struct addrinfo	hints,		/* Lookup hints */
+			*addr;		/* Listen address */
+  int			fd,		/* Listening socket */
+			val = 1;	/* Option value */
+  transport_conn_t	*conn;		/* Listener */
+
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = AI_PASSIVE;
+
+  if (getaddrinfo(host, port, &hints, &addr))
+  {
+    errno = EADDRNOTAVAIL;
+    return (NULL);
+  }
+
+  if ((fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK |
+                   SOCK_CLOEXEC, addr->ai_protocol)) < 0)
+  {
+    freeaddrinfo(addr);
+    return (NULL);
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+
+  if (bind(fd, addr->ai_addr, addr->ai_addrlen) || listen(fd, 64))
+  {
+    freeaddrinfo(addr);
+    close(fd);
+    return (NULL);
+  }
+
+  freeaddrinfo(addr);
+
+  if ((conn = ConnNew(t, fd, STATE_LISTEN, cb, data)) == NULL)
+    return (NULL);
+
+  snprintf(conn->host, sizeof(conn->host), "%s", host ? host : "*");
+  snprintf(conn->port, sizeof(conn->port), "%s", port);
+  snprintf(conn->name, sizeof(conn->name), "%s:%s", conn->host, conn->port);
+
+  return (conn);
+}
+
+
+/*
+ * 'transportConnect()' - Open an outgoing connection.
+ *
+ * The connect completes asynchronously and is reported with
+ * TRANSPORT_EVENT_CONNECTED. Data written before that is queued.
+ */
+transport_conn_t *			/* O - Connection or NULL */
+transportConnect(transport_t    *t,	/* I - Transport */
+                 const char     *host,	/* I - Host name or address */
+                 const char     *port,	/* I - Port number */
+                 int            flags,	/* I - TRANSPORT_RECONNECT */
+                 transport_cb_t cb,	/* I - Callback */
+                 void           *data)	/* I - Callback data */
+{
+  transport_conn_t	*conn;		/* Connection */
+
+
+  if ((conn = ConnNew(t, -1, STATE_WAITING, cb, data)) == NULL)
+    return (NULL);
+
+  snprintf(conn->host, sizeof(conn->host), "%s", host);
+  snprintf(conn->port, sizeof(conn->port), "%s", port);
+  snprintf(conn->name, sizeof(conn->name), "%s:%s", host, port);
+
+  conn->flags = flags;
+
+  ConnStart(conn);
+
+  return (conn);
+}
+
+
+/*
+ * 'transportClose()' - Close a connection.
+ *
+ * The connection is freed once the current events are dispatched, so
+ * callbacks may close any connection, including their own.
+ */
+void
+transportClose(transport_conn_t *conn)	/* I - Connection */
+{
+  if (conn->state == STATE_CLOSED)
+    return;
+
+  transportDiscard(conn);
+
+  if (conn->fd >= 0)
+  {
+    epoll_ctl(conn->transport->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+  }
+
+  conn->state = STATE_CLOSED;
+}
+
+
+/*
+ * 'transportSetCallback()' - Change the callback of a connection.
+ */
+void
+transportSetCallback(
+    transport_conn_t *conn,		/* I - Connection */
+    transport_cb_t   cb,		/* I - Callback */
+    void             *data)		/* I - Callback data */
+{
+  conn->cb   = cb;
+  conn->data = data;
+}
+
+
+/*
+ * 'transportSetTimeouts()' - Set connect, write stall and idle timeouts.
+ *
+ * Timeouts are in milliseconds, 0 disables them. A connect timeout counts
+ * as connection loss; write stalls and idle connections are reported with
+ * TRANSPORT_EVENT_TIMEOUT and left to the callback.
+ */
+void
+transportSetTimeouts(
+    transport_conn_t *conn,		/* I - Connection */
+    int              connect_timeout,	/* I - Connect timeout */
+    int              write_timeout,	/* I - Write stall timeout */
+    int              idle_timeout)	/* I - Idle timeout */
+{
+  conn->connect_timeout = connect_timeout;
+  conn->write_timeout   = write_timeout;
+  conn->idle_timeout    = idle_timeout;
+}
+
+
+/*
+ * 'transportRead()' - Read from a connection.
+ *
+ * Returns 0 at end of file and -1 with errno set to EAGAIN if there is
+ * nothing to read.
+ */
+ssize_t					/* O - Bytes read */
+transportRead(transport_conn_t *conn,	/* I - Connection */
+              void             *buffer,	/* I - Buffer */
+              size_t           bytes)	/* I - Size of buffer */
+{
+  ssize_t	rbytes;			/* Bytes read */
+
+
+  if (conn->state != STATE_OPEN)
+  {
+    errno = ENOTCONN;
+    return (-1);
+  }
+
+  while ((rbytes = read(conn->fd, buffer, bytes)) < 0 && errno == EINTR);
+
+  if (rbytes == 0)
+    conn->eof = 1;
+  else if (rbytes > 0)
+    conn->activity = Now();
+  else if (errno != EAGAIN && errno != EWOULDBLOCK)
+    conn->eof = 1;
+
+  return (rbytes);
+}
+
+
+/*
+ * 'transportWrite()' - Queue data for a connection.
+ *
+ * Data is written as soon as the connection accepts it.
+ */
+int					/* O - 0 on success, -1 on error */
+transportWrite(transport_conn_t *conn,	/* I - Connection */
+               const void       *buffer,/* I - Data */
+               size_t           bytes)	/* I - Number of bytes */
+{
+  transport_chunk_t	*chunk;		/* Current chunk */
+  const unsigned char	*ptr = buffer;	/* Pointer into data */
+  size_t		count;		/* Bytes to copy */
+  int			empty = !conn->head;
+					/* Queue was empty */
+
+
+  if (conn->state == STATE_CLOSED || conn->state == STATE_LISTEN)
+  {
+    errno = ENOTCONN;
+    return (-1);
+  }
+
+  while (bytes > 0)
+  {
+    if ((chunk = conn->tail) == NULL || chunk->len == TRANSPORT_CHUNK)
+    {
+      if ((chunk = ChunkNew(conn->transport)) == NULL)
+        return (-1);
+
+      if (conn->tail)
+        conn->tail->next = chunk;
+      else
+        conn->head = chunk;
+
+      conn->tail = chunk;
+    }
+
+    count = TRANSPORT_CHUNK - chunk->len;
+    if (count > bytes)
+      count = bytes;
+
+    memcpy(chunk->data + chunk->len, ptr, count);
+    chunk->len   += count;
+    conn->queued += count;
+    ptr          += count;
+    bytes        -= count;
+  }
+
+  if (empty && conn->state == STATE_OPEN)
+  {
+    conn->progress = Now();
+    ConnUpdate(conn);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'transportPause()' - Stop or resume reading from a connection.
+ */
+void
+transportPause(transport_conn_t *conn,	/* I - Connection */
+               int              paused)	/* I - 1 to stop, 0 to resume */
+{
+  conn->paused = paused;
+
+  if (conn->state == STATE_OPEN)
+    ConnUpdate(conn);
+}
+
+
+/*
+ * 'transportDiscard()' - Drop data not yet written.
+ */
+void
+transportDiscard(transport_conn_t *conn)/* I - Connection */
+{
+  transport_chunk_t	*chunk;		/* Current chunk */
+
+
+  while ((chunk = conn->head) != NULL)
+  {
+    conn->head = chunk->next;
+    ChunkFree(conn->transport, chunk);
+  }
+
+  conn->tail   = NULL;
+  conn->queued = 0;
+
+  if (conn->pending)
+  {
+   /*
+    * Completions of writes still in flight no longer apply to the queue...
+    */
+
+    conn->gen ++;
+    conn->pending = 0;
+    conn->failed  = 0;
+  }
+
+  if (conn->state == STATE_OPEN)
+    ConnUpdate(conn);
+}
+
+
+/*
+ * 'transportTruncate()' - Drop queued data after the first bytes.
+ *
+ * Data already handed to a write in flight cannot be taken back; the
+ * queue is left as it is if the cut would fall into it.
+ */
+int					/* O - 0 on success, -1 if in flight */
+transportTruncate(
+    transport_conn_t *conn,		/* I - Connection */
+    size_t           keep)		/* I - Queued bytes to keep */
+{
+  transport_chunk_t	*chunk,		/* Current chunk */
+			*prev = NULL,	/* Last chunk kept */
+			*next;		/* Next chunk */
+  size_t		pos = 0;	/* Queued bytes before chunk */
+
+
+  if (keep >= conn->queued)
+    return (0);
+
+  for (chunk = conn->head; pos + chunk->len - chunk->off <= keep;
+       prev = chunk, chunk = chunk->next)
+    pos += chunk->len - chunk->off;
+
+  if (chunk->busy)
+    return (-1);
+
+  if (keep > pos)
+  {
+    chunk->len = chunk->off + keep - pos;
+    prev       = chunk;
+    chunk      = chunk->next;
+  }
+
+  if (prev)
+    prev->next = NULL;
+  else
+    conn->head = NULL;
+
+  conn->tail   = prev;
+  conn->queued = keep;
+
+  for (; chunk; chunk = next)
+  {
+    next = chunk->next;
+    ChunkFree(conn->transport, chunk);
+  }
+
+  if (conn->state == STATE_OPEN)
+    ConnUpdate(conn);
+
+  return (0);
+}
+
+
+/*
+ * 'transportIsOpen()' - Check whether a connection is established.
+ */
+int					/* O - 1 if open */
+transportIsOpen(transport_conn_t *conn)	/* I - Connection */
+{
+  return (conn->state == STATE_OPEN && !conn->eof);
+}
+
+
+/*
+ * 'transportQueued()' - Get the bytes queued for a connection.
+ */
+size_t					/* O - Queued bytes */
+transportQueued(transport_conn_t *conn)	/* I - Connection */
+{
+  return (conn->queued);
+}
+
+
+/*
+ * 'transportOutstanding()' - Get queued plus unsent socket bytes.
+ */
+size_t					/* O - Outstanding bytes */
+transportOutstanding(
+    transport_conn_t *conn)		/* I - Connection */
+{
+  size_t	load = conn->queued;	/* Outstanding bytes */
+  int		outq;			/* Unsent socket bytes */
+
+
+  if (conn->state == STATE_OPEN && !ioctl(conn->fd, SIOCOUTQ, &outq) &&
+      outq > 0)
+    load += (size_t)outq;
+
+  return (load);
+}
+
+
+/*
+ * 'transportReconnects()' - Get the number of reconnects.
+ */
+unsigned				/* O - Reconnects */
+transportReconnects(
+    transport_conn_t *conn)		/* I - Connection */
+{
+  return (conn->reconnects);
+}
+
+
+/*
+ * 'transportName()' - Get the "host:port" name of a connection.
+ */
+const char *				/* O - Name */
+transportName(transport_conn_t *conn)	/* I - Connection */
+{
+  return (conn->name);
+}
+
+
+/*
+ * 'transportHasRing()' - Check whether writes go through io_uring.
+ */
+int					/* O - 1 if io_uring is used */
+transportHasRing(transport_t *t)	/* I - Transport */
+{
+  return (t->ring.fd >= 0);
+}
+
+
+/*
+ * 'transportNow()' - Get the time used for timeouts.
+ */
+long long				/* O - Monotonic time in ms */
+transportNow(void)
+{
+  return (Now());
+}
+
+
+/*
+ * 'Now()' - Get a monotonic time in milliseconds.
+ */
+static long long			/* O - Time in ms */
+Now(void)
+{
+  struct timespec	ts;		/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+
+/*
+ * 'ConnNew()' - Create a connection.
+ */
+static transport_conn_t *		/* O - Connection or NULL */
+ConnNew(transport_t    *t,		/* I - Transport */
+        int            fd,		/* I - Socket or -1 */
+        int            state,		/* I - Initial state */
+        transport_cb_t cb,		/* I - Callback */
+        void           *data)		/* I - Callback data */
+{
+  transport_conn_t	*conn;		/* Connection */
+
+
+  if ((conn = calloc(1, sizeof(transport_conn_t))) == NULL)
+  {
+    if (fd >= 0)
+      close(fd);
+
+    return (NULL);
+  }
+
+  conn->transport = t;
+  conn->fd        = fd;
+  conn->state     = state;
+  conn->cb        = cb;
+  conn->data      = data;
+  conn->backoff   = TRANSPORT_BACKOFF;
+  conn->progress  = conn->activity = Now();
+
+  if (fd >= 0)
+  {
+    struct epoll_event ev;		/* Event registration */
+
+    conn->events = EPOLLIN;
+    ev.events    = EPOLLIN;
+    ev.data.ptr  = conn;
+
+    if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev))
+    {
+      close(fd);
+      free(conn);
+      return (NULL);
+    }
+  }
+
+  conn->next = t->conns;
+  t->conns   = conn;
+
+  return (conn);
+}
+
+
+/*
+ * 'ConnUpdate()' - Register the events a connection is interested in.
+ */
+static void
+ConnUpdate(transport_conn_t *conn)	/* I - Connection */
+{
+  struct epoll_event	ev;		/* Event registration */
+  int			events;		/* Wanted events */
+
+
+  if (conn->state == STATE_CONNECTING)
+    events = EPOLLOUT;
+  else
+    events = (conn->paused ? 0 : EPOLLIN) |
+             (conn->head && !conn->pending ? EPOLLOUT : 0);
+
+  if (events == conn->events)
+    return;
+
+  ev.events   = (unsigned)events;
+  ev.data.ptr = conn;
+
+  if (!epoll_ctl(conn->transport->epfd, EPOLL_CTL_MOD, conn->fd, &ev))
+    conn->events = events;
+}
+
+
+/*
+ * 'ConnStart()' - Start a non-blocking connect.
+ */
+static void
+ConnStart(transport_conn_t *conn)	/* I - Connection */
+{
+  struct addrinfo	hints,		/* Lookup hints */
+			*addrs;		/* Addresses */
+  struct epoll_event	ev;		/* Event registration */
+  int			fd,		/* Socket */
+			val = 1;	/* Option value */
+
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo(conn->host, conn->port, &hints, &addrs))
+  {
+    ConnLost(conn, EHOSTUNREACH);
+    return;
+  }
+
+  if ((fd = socket(addrs->ai_family, addrs->ai_socktype | SOCK_NONBLOCK |
+                   SOCK_CLOEXEC, addrs->ai_protocol)) < 0)
+  {
+    freeaddrinfo(addrs);
+    ConnLost(conn, errno);
+    return;
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+
+  if (connect(fd, addrs->ai_addr, addrs->ai_addrlen) && errno != EINPROGRESS)
+  {
+    freeaddrinfo(addrs);
+    close(fd);
+    ConnLost(conn, errno);
+    return;
+  }
+
+  freeaddrinfo(addrs);
+
+  ev.events   = EPOLLOUT;
+  ev.data.ptr = conn;
+
+  if (epoll_ctl(conn->transport->epfd, EPOLL_CTL_ADD, fd, &ev))
+  {
+    close(fd);
+    ConnLost(conn, errno);
+    return;
+  }
+
+  conn->fd       = fd;
+  conn->events   = EPOLLOUT;
+  conn->eof      = 0;
+  conn->stalled  = 0;
+  conn->state    = STATE_CONNECTING;
+  conn->deadline = conn->connect_timeout ?
+                       Now() + conn->connect_timeout : LLONG_MAX;
+}
+
+
+/*
+ * 'ConnLost()' - Handle a failed or lost connection.
+ *
+ * Queued data is discarded. Reconnecting connections wait for their
+ * backoff delay, all others are closed.
+ */
+static void
+ConnLost(transport_conn_t *conn,	/* I - Connection */
+         int              error)	/* I - errno value or 0 for EOF */
+{
+  int	was_open = (conn->state == STATE_OPEN);
+					/* Connection was established */
+
+
+  if (conn->fd >= 0)
+  {
+    epoll_ctl(conn->transport->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+  }
+
+  conn->events = 0;
+  errno        = error;
+
+  if (!(conn->flags & TRANSPORT_RECONNECT))
+  {
+    conn->state = STATE_CLOSED;
+    (conn->cb)(conn, TRANSPORT_EVENT_CLOSED, conn->data);
+    transportDiscard(conn);
+    return;
+  }
+
+  conn->state    = STATE_WAITING;
+  conn->deadline = Now() + conn->backoff;
+
+  if ((conn->backoff *= 2) > TRANSPORT_MAXDELAY)
+    conn->backoff = TRANSPORT_MAXDELAY;
+
+  if (was_open)
+    conn->reconnects ++;
+
+  (conn->cb)(conn, TRANSPORT_EVENT_CLOSED, conn->data);
+  transportDiscard(conn);
+}
+
+
+/*
+ * 'ConnFlush()' - Write queued data to a connection.
+ */
+static void
+ConnFlush(transport_conn_t *conn)	/* I - Connection */
+{
+  struct iovec		iov[TRANSPORT_IOV];
+					/* Chunks to write */
+  int			i;		/* Looping var */
+  transport_chunk_t	*chunk;		/* Current chunk */
+  ssize_t		bytes;		/* Bytes written */
+
+
+  if (conn->transport->ring.fd >= 0 && RingFlush(conn))
+    return;
+
+  while (conn->head)
+  {
+    for (i = 0, chunk = conn->head; chunk && i < TRANSPORT_IOV;
+         i ++, chunk = chunk->next)
+    {
+      iov[i].iov_base = chunk->data + chunk->off;
+      iov[i].iov_len  = chunk->len - chunk->off;
+    }
+
+    if ((bytes = writev(conn->fd, iov, i)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ConnLost(conn, errno);
+
+      return;
+    }
+
+    ConnConsume(conn, (size_t)bytes);
+  }
+
+  ConnUpdate(conn);
+  (conn->cb)(conn, TRANSPORT_EVENT_DRAINED, conn->data);
+}
+
+
+/*
+ * 'ConnAccept()' - Accept connections on a listener.
+ */
+static void
+ConnAccept(transport_conn_t *listener)	/* I - Listener */
+{
+  int			fd;		/* New socket */
+  transport_conn_t	*conn;		/* New connection */
+
+
+  while ((fd = accept4(listener->fd, NULL, NULL,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    if ((conn = ConnNew(listener->transport, fd, STATE_OPEN, listener->cb,
+                        listener->data)) == NULL)
+      continue;
+
+    snprintf(conn->name, sizeof(conn->name), "%s", listener->name);
+
+    (conn->cb)(conn, TRANSPORT_EVENT_ACCEPT, conn->data);
+  }
+}
+
+
+/*
+ * 'ConnTimers()' - Handle connect, reconnect, stall and idle timers.
+ */
+static void
+ConnTimers(transport_t *t,		/* I - Transport */
+           long long   now)		/* I - Current time */
+{
+  transport_conn_t	*conn;		/* Current connection */
+
+
+  for (conn = t->conns; conn; conn = conn->next)
+  {
+    switch (conn->state)
+    {
+      case STATE_WAITING :
+          if (now >= conn->deadline)
+            ConnStart(conn);
+          break;
+
+      case STATE_CONNECTING :
+          if (now >= conn->deadline)
+            ConnLost(conn, ETIMEDOUT);
+          break;
+
+      case STATE_OPEN :
+          if (conn->queued && conn->write_timeout && !conn->stalled &&
+              now - conn->progress >= conn->write_timeout)
+          {
+            conn->stalled = 1;
+            (conn->cb)(conn, TRANSPORT_EVENT_TIMEOUT, conn->data);
+          }
+          else if (conn->idle_timeout && !conn->queued &&
+                   now - conn->activity >= conn->idle_timeout)
+          {
+            conn->activity = now;
+            (conn->cb)(conn, TRANSPORT_EVENT_TIMEOUT, conn->data);
+          }
+          break;
+    }
+  }
+}
+
+
+/*
+ * 'ConnReap()' - Free closed connections.
+ */
+static void
+ConnReap(transport_t *t)		/* I - Transport */
+{
+  transport_conn_t	*conn,		/* Current connection */
+			**prev;		/* Pointer to current connection */
+
+
+  for (prev = &t->conns; (conn = *prev) != NULL;)
+  {
+    if (conn->state == STATE_CLOSED && !conn->inflight)
+    {
+      *prev = conn->next;
+      transportDiscard(conn);
+      free(conn);
+    }
+    else
+      prev = &conn->next;
+  }
+}
+
+
+/*
+ * 'ConnConsume()' - Remove written bytes from the write queue.
+ */
+static void
+ConnConsume(transport_conn_t *conn,	/* I - Connection */
+            size_t           bytes)	/* I - Bytes written */
+{
+  transport_chunk_t	*chunk;		/* Current chunk */
+  size_t		count;		/* Bytes of current chunk */
+
+
+  conn->progress = conn->activity = Now();
+  conn->stalled  = 0;
+  conn->queued  -= bytes;
+
+  while (bytes > 0)
+  {
+    chunk = conn->head;
+    count = chunk->len - chunk->off;
+
+    if (bytes < count)
+    {
+      chunk->off += bytes;
+      break;
+    }
+
+    bytes -= count;
+
+    if ((conn->head = chunk->next) == NULL)
+      conn->tail = NULL;
+
+    ChunkFree(conn->transport, chunk);
+  }
+}
+
+
+/*
+ * 'ChunkNew()' - Get an empty write queue chunk.
+ *
+ * Registered chunks are preferred, so they can be written as fixed
+ * buffers.
+ */
+static transport_chunk_t *		/* O - Chunk or NULL */
+ChunkNew(transport_t *t)		/* I - Transport */
+{
+  transport_chunk_t	*chunk;		/* Chunk */
+
+
+  if ((chunk = t->freeslabs) != NULL)
+    t->freeslabs = chunk->next;
+  else if ((chunk = malloc(sizeof(transport_chunk_t))) != NULL)
+    chunk->index = -1;
+  else
+    return (NULL);
+
+  chunk->next   = NULL;
+  chunk->len    = 0;
+  chunk->off    = 0;
+  chunk->busy   = 0;
+  chunk->orphan = 0;
+
+  return (chunk);
+}
+
+
+/*
+ * 'ChunkFree()' - Release a write queue chunk.
+ *
+ * Chunks still being written by the kernel are released once their write
+ * completes.
+ */
+static void
+ChunkFree(transport_t       *t,		/* I - Transport */
+          transport_chunk_t *chunk)	/* I - Chunk */
+{
+  if (chunk->busy)
+  {
+    chunk->orphan = 1;
+    return;
+  }
+
+  if (chunk->index >= 0)
+  {
+    chunk->next  = t->freeslabs;
+    t->freeslabs = chunk;
+  }
+  else
+    free(chunk);
+}
+
+
+/*
+ * 'RingInit()' - Set up io_uring writes if the kernel supports them.
+ */
+static void
+RingInit(transport_t *t)		/* I - Transport */
+{
+  struct iovec		iov[TRANSPORT_SLABS];
+					/* Registered buffers */
+  struct epoll_event	ev;		/* Event registration */
+  int			i;		/* Looping var */
+
+
+  t->ringfd  = -1;
+  t->freeops = -1;
+
+  if (uringInit(&t->ring, TRANSPORT_OPS))
+    return;
+
+  if ((t->ringfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+      uringRegisterEventfd(&t->ring, t->ringfd))
+  {
+    RingFree(t);
+    return;
+  }
+
+  ev.events   = EPOLLIN;
+  ev.data.ptr = &t->ring;
+
+  if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->ringfd, &ev))
+  {
+    RingFree(t);
+    return;
+  }
+
+  for (i = TRANSPORT_OPS - 1; i >= 0; i --)
+  {
+    t->ops[i].next = t->freeops;
+    t->freeops     = i;
+  }
+
+ /*
+  * Register the slabs; if the locked memory limit does not allow that,
+  * writes simply go without fixed buffers...
+  */
+
+  if ((t->slabs = calloc(TRANSPORT_SLABS, sizeof(transport_chunk_t))) == NULL)
+    return;
+
+  for (i = 0; i < TRANSPORT_SLABS; i ++)
+  {
+    iov[i].iov_base = t->slabs[i].data;
+    iov[i].iov_len  = TRANSPORT_CHUNK;
+  }
+
+  if (uringRegisterBuffers(&t->ring, iov, TRANSPORT_SLABS))
+  {
+    free(t->slabs);
+    t->slabs = NULL;
+    return;
+  }
+
+  for (i = TRANSPORT_SLABS - 1; i >= 0; i --)
+  {
+    t->slabs[i].index = i;
+    t->slabs[i].next  = t->freeslabs;
+    t->freeslabs      = t->slabs + i;
+  }
+}
+
+
+/*
+ * 'RingFree()' - Tear down io_uring and forget writes in flight.
+ */
+static void
+RingFree(transport_t *t)		/* I - Transport */
+{
+  int			i;		/* Looping var */
+  transport_op_t	*op;		/* Write in flight */
+
+
+  if (t->ring.fd >= 0)
+  {
+    uringFree(&t->ring);
+
+    for (i = 0, op = t->ops; i < TRANSPORT_OPS; i ++, op ++)
+      if (op->chunk)
+      {
+        op->conn->inflight --;
+        op->chunk->busy = 0;
+
+        if (op->chunk->orphan)
+          ChunkFree(t, op->chunk);
+
+        op->chunk = NULL;
+      }
+  }
+
+  if (t->ringfd >= 0)
+  {
+    close(t->ringfd);
+    t->ringfd = -1;
+  }
+
+  t->ring.fd = -1;
+}
+
+
+/*
+ * 'RingFlush()' - Queue a chain of linked writes for a connection.
+ *
+ * Returns 0 if no write could be queued, the caller then writes directly.
+ */
+static int				/* O - 1 if queued, 0 otherwise */
+RingFlush(transport_conn_t *conn)	/* I - Connection */
+{
+  transport_t		*t = conn->transport;
+					/* Transport */
+  transport_chunk_t	*chunk;		/* Current chunk */
+  transport_op_t	*op;		/* Write slot */
+  int			count,		/* Number of writes */
+			slot;		/* Current slot */
+
+
+  if (conn->pending)
+    return (1);
+
+ /*
+  * Every write slot maps to at most one unsubmitted ring entry, so a free
+  * slot always means the ring has room as well...
+  */
+
+  for (count = 0, slot = t->freeops, chunk = conn->head;
+       chunk && slot >= 0 && count < TRANSPORT_IOV;
+       count ++, slot = t->ops[slot].next, chunk = chunk->next);
+
+  if (!count)
+    return (0);
+
+  for (chunk = conn->head; count > 0; count --, chunk = chunk->next)
+  {
+    slot       = t->freeops;
+    op         = t->ops + slot;
+    t->freeops = op->next;
+
+    op->conn  = conn;
+    op->chunk = chunk;
+    op->bytes = chunk->len - chunk->off;
+    op->gen   = conn->gen;
+
+    uringWrite(&t->ring, conn->fd, chunk->data + chunk->off, op->bytes,
+               chunk->index, count > 1, (unsigned long long)slot);
+
+    chunk->busy = 1;
+    conn->pending ++;
+    conn->inflight ++;
+  }
+
+  ConnUpdate(conn);
+
+  return (1);
+}
+
+
+/*
+ * 'RingComplete()' - Process completed writes.
+ *
+ * A failed or short write cancels the rest of its chain; the remaining
+ * data stays queued and is written once the socket is writable again.
+ */
+static void
+RingComplete(transport_t *t)		/* I - Transport */
+{
+  unsigned long long	tag;		/* Completion tag */
+  int			res,		/* Result of write */
+			error;		/* Error of chain */
+  eventfd_t		count;		/* eventfd counter */
+  transport_op_t	*op;		/* Write slot */
+  transport_conn_t	*conn;		/* Connection */
+  transport_chunk_t	*chunk;		/* Chunk written */
+
+
+  while (read(t->ringfd, &count, sizeof(count)) > 0);
+
+  while (t->ring.fd >= 0 && uringComplete(&t->ring, &tag, &res))
+  {
+    op    = t->ops + tag;
+    conn  = op->conn;
+    chunk = op->chunk;
+
+    op->chunk  = NULL;
+    op->next   = t->freeops;
+    t->freeops = (int)tag;
+
+    chunk->busy = 0;
+    conn->inflight --;
+
+    if (op->gen != conn->gen)
+    {
+      if (chunk->orphan)
+        ChunkFree(t, chunk);
+
+      continue;
+    }
+
+    if (!conn->failed)
+    {
+      if (res > 0)
+        ConnConsume(conn, (size_t)res);
+
+      if (res < 0)
+        conn->failed = -res;
+      else if ((size_t)res < op->bytes)
+        conn->failed = EAGAIN;
+    }
+
+    if (-- conn->pending > 0)
+      continue;
+
+    error        = conn->failed;
+    conn->failed = 0;
+
+    if (error && error != EAGAIN && error != EWOULDBLOCK &&
+        error != ECANCELED && error != EINTR)
+      ConnLost(conn, error);
+    else
+    {
+      ConnUpdate(conn);
+
+      if (!conn->head)
+        (conn->cb)(conn, TRANSPORT_EVENT_DRAINED, conn->data);
+    }
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ *   Event-driven connection core for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Connection events...
+ */
+#define TRANSPORT_EVENT_ACCEPT    0	/* New connection on a listener */
+#define TRANSPORT_EVENT_CONNECTED 1	/* Outgoing connection established */
+#define TRANSPORT_EVENT_READ      2	/* Data or end of file to read */
+#define TRANSPORT_EVENT_DRAINED   3	/* Write queue is empty */
+#define TRANSPORT_EVENT_TIMEOUT   4	/* Write stalled or connection idle */
+#define TRANSPORT_EVENT_CLOSED    5	/* Connection lost */
+
+/*
+ * Connection flags...
+ */
+#define TRANSPORT_RECONNECT 1		/* Reconnect after connection loss */
+
+
+/*
+ * Types...
+ */
+typedef struct transport_s transport_t;
+typedef struct transport_conn_s transport_conn_t;
+
+typedef void (*transport_cb_t)(transport_conn_t *conn, int event, void *data);
+					/* Connection callback */
+typedef void (*transport_tick_cb_t)(transport_t *t, void *data);
+					/* Periodic callback */
+
+
+/*
+ * Prototypes...
+ */
+extern transport_t	*transportNew(void);
+extern void		transportDelete(transport_t *t);
+extern int		transportRun(transport_t *t, int timeout);
+extern void		transportStop(transport_t *t);
+extern void		transportSetTick(transport_t *t, int interval,
+			                 transport_tick_cb_t cb, void *data);
+
+extern transport_conn_t	*transportListen(transport_t *t, const char *host,
+			                 const char *port, transport_cb_t cb,
+			                 void *data);
+extern transport_conn_t	*transportConnect(transport_t *t, const char *host,
+			                  const char *port, int flags,
+			                  transport_cb_t cb, void *data);
+extern void		transportClose(transport_conn_t *conn);
+extern void		transportSetCallback(transport_conn_t *conn,
+			                     transport_cb_t cb, void *data);
+extern void		transportSetTimeouts(transport_conn_t *conn,
+			                     int connect_timeout,
+			                     int write_timeout, int idle_timeout);
+
+extern ssize_t		transportRead(transport_conn_t *conn, void *buffer,
+			              size_t bytes);
+extern int		transportWrite(transport_conn_t *conn,
+			               const void *buffer, size_t bytes);
+extern void		transportPause(transport_conn_t *conn, int paused);
+extern void		transportDiscard(transport_conn_t *conn);
+extern int		transportTruncate(transport_conn_t *conn,
+			                  size_t keep);
+
+extern int		transportIsOpen(transport_conn_t *conn);
+extern size_t		transportQueued(transport_conn_t *conn);
+extern size_t		transportOutstanding(transport_conn_t *conn);
+extern unsigned		transportReconnects(transport_conn_t *conn);
+extern const char	*transportName(transport_conn_t *conn);
+extern int		transportHasRing(transport_t *t);
+extern long long	transportNow(void);
+
+#endif /* !_TRANSPORT_H_ */
@@ -0,0 +1,374 @@
+/*
+ *   Minimal io_uring interface for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contents:
+ *
+ *   uringInit()            - Set up a ring.
+ *   uringFree()            - Tear down a ring.
+ *   uringRegisterBuffers() - Register fixed buffers with a ring.
+ *   uringRegisterEventfd() - Signal completions on an eventfd.
+ *   uringWrite()           - Prepare a write.
+ *   uringSubmit()          - Submit all prepared writes.
+ *   uringComplete()        - Get the next completion.
+ *
+ * Only the few operations the transport needs are implemented, directly on
+ * top of the system calls, so no extra library is required. All functions
+ * fail with ENOSYS when io_uring is not available at build time; at run
+ * time uringInit() fails on kernels without io_uring or where it has been
+ * disabled, and callers keep using plain writes.
+ */
+
+#include "uring.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+#ifdef HAVE_IO_URING
+/*
+ * 'uringInit()' - Set up a ring.
+ */
+int					/* O - 0 on success, -1 on error */
+uringInit(uring_t  *ring,		/* I - Ring */
+          unsigned entries)		/* I - Submission entries */
+{
+  struct io_uring_params params;	/* Ring parameters */
+  unsigned char	*sq,			/* Submission ring */
+		*cq;			/* Completion ring */
+
+
+  memset(ring, 0, sizeof(uring_t));
+  memset(&params, 0, sizeof(params));
+
+  if ((ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params)) < 0)
+  {
+    ring->fd = -1;
+    return (-1);
+  }
+
+  if (!(params.features & IORING_FEAT_FAST_POLL))
+  {
+   /*
+    * Older kernels lack plain writes and poll sockets with worker threads,
+    * not worth it...
+    */
+
+    close(ring->fd);
+    ring->fd = -1;
+    errno    = ENOSYS;
+    return (-1);
+  }
+
+  ring->sq_size   = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size   = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (ring->cq_size > ring->sq_size)
+      ring->sq_size = ring->cq_size;
+
+    ring->cq_size = 0;
+  }
+
+  ring->sq_map = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED)
+    goto error;
+
+  if (ring->cq_size)
+  {
+    ring->cq_map = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED)
+    {
+      ring->cq_map = NULL;
+      goto error;
+    }
+  }
+  else
+    ring->cq_map = ring->sq_map;
+
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+  {
+    ring->sqes = NULL;
+    goto error;
+  }
+
+  sq = ring->sq_map;
+  cq = ring->cq_map;
+
+  ring->sq_head    = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail    = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask    = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array   = (unsigned *)(sq + params.sq_off.array);
+  ring->sq_entries = params.sq_entries;
+  ring->cq_head    = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail    = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask    = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes       = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  return (0);
+
+  error :
+
+  uringFree(ring);
+  return (-1);
+}
+
+
+/*
+ * 'uringFree()' - Tear down a ring.
+ */
+void
+uringFree(uring_t *ring)		/* I - Ring */
+{
+  if (ring->sqes)
+    munmap(ring->sqes, ring->sqes_size);
+
+  if (ring->cq_map && ring->cq_map != ring->sq_map)
+    munmap(ring->cq_map, ring->cq_size);
+
+  if (ring->sq_map && ring->sq_map != MAP_FAILED)
+    munmap(ring->sq_map, ring->sq_size);
+
+  if (ring->fd >= 0)
+    close(ring->fd);
+
+  memset(ring, 0, sizeof(uring_t));
+  ring->fd = -1;
+}
+
+
+/*
+ * 'uringRegisterBuffers()' - Register fixed buffers with a ring.
+ *
+ * Registered buffers stay mapped in the kernel, so writes from them skip
+ * the page lookups of a normal write.
+ */
+int					/* O - 0 on success, -1 on error */
+uringRegisterBuffers(
+    uring_t            *ring,		/* I - Ring */
+    const struct iovec *iov,		/* I - Buffers */
+    unsigned           count)		/* I - Number of buffers */
+{
+  return ((int)syscall(__NR_io_uring_register, ring->fd,
+                       IORING_REGISTER_BUFFERS, iov, count) < 0 ? -1 : 0);
+}
+
+
+/*
+ * 'uringRegisterEventfd()' - Signal completions on an eventfd.
+ */
+int					/* O - 0 on success, -1 on error */
+uringRegisterEventfd(uring_t *ring,	/* I - Ring */
+                     int     fd)	/* I - eventfd */
+{
+  return ((int)syscall(__NR_io_uring_register, ring->fd,
+                       IORING_REGISTER_EVENTFD, &fd, 1) < 0 ? -1 : 0);
+}
+
+
+/*
+ * 'uringWrite()' - Prepare a write.
+ *
+ * A "buffer_index" of -1 writes from ordinary memory, anything else names
+ * a registered buffer containing the data. With "link" set, the next
+ * write prepared on the ring only starts once this one has completed in
+ * full. Nothing is sent to the kernel before uringSubmit().
+ */
+int					/* O - 0 on success, -1 if full */
+uringWrite(uring_t            *ring,	/* I - Ring */
+           int                fd,	/* I - File descriptor */
+           const void         *buffer,	/* I - Data */
+           size_t             bytes,	/* I - Number of bytes */
+           int                buffer_index,
+					/* I - Registered buffer or -1 */
+           int                link,	/* I - Link to next write? */
+           unsigned long long user_data)/* I - Completion tag */
+{
+  unsigned		tail,		/* Submission queue tail */
+			index;		/* Entry index */
+  struct io_uring_sqe	*sqe;		/* Submission entry */
+
+
+  tail = *ring->sq_tail;
+
+  if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >=
+      ring->sq_entries)
+  {
+    errno = EAGAIN;
+    return (-1);
+  }
+
+  index = tail & *ring->sq_mask;
+  sqe   = ring->sqes + index;
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode    = buffer_index >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->flags     = link ? IOSQE_IO_LINK : 0;
+  sqe->fd        = fd;
+  sqe->addr      = (unsigned long long)(size_t)buffer;
+  sqe->len       = (unsigned)bytes;
+  sqe->buf_index = buffer_index >= 0 ? (unsigned short)buffer_index : 0;
+  sqe->user_data = user_data;
+
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->unsubmitted ++;
+
+  return (0);
+}
+
+
+/*
+ * 'uringSubmit()' - Submit all prepared writes.
+ *
+ * Writes prepared for any number of connections go to the kernel with a
+ * single system call.
+ */
+int					/* O - Writes submitted or -1 */
+uringSubmit(uring_t *ring)		/* I - Ring */
+{
+  int	ret,				/* Return value */
+	total = 0;			/* Total submitted */
+
+
+  while (ring->unsubmitted > 0)
+  {
+    if ((ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted,
+                            0, 0, NULL, 0)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return (total ? total : -1);
+    }
+
+    if (ret == 0)
+      break;
+
+    ring->unsubmitted -= (unsigned)ret;
+    total             += ret;
+  }
+
+  return (total);
+}
+
+
+/*
+ * 'uringComplete()' - Get the next completion.
+ */
+int					/* O - 1 if found, 0 if none */
+uringComplete(uring_t            *ring,	/* I - Ring */
+              unsigned long long *user_data,
+					/* O - Completion tag */
+              int                *result)
+					/* O - Bytes written or -errno */
+{
+  unsigned		head;		/* Completion queue head */
+  struct io_uring_cqe	*cqe;		/* Completion entry */
+
+
+  head = *ring->cq_head;
+
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    return (0);
+
+  cqe        = ring->cqes + (head & *ring->cq_mask);
+  *user_data = cqe->user_data;
+  *result    = cqe->res;
+
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+  return (1);
+}
+
+
+#else
+/*
+ * Stubs for systems without io_uring...
+ */
+
+int
+uringInit(uring_t *ring, unsigned entries)
+{
+  (void)entries;
+
+  ring->fd = -1;
+  errno    = ENOSYS;
+  return (-1);
+}
+
+void
+uringFree(uring_t *ring)
+{
+  ring->fd = -1;
+}
+
+int
+uringRegisterBuffers(uring_t *ring, const struct iovec *iov, unsigned count)
+{
+  (void)ring; (void)iov; (void)count;
+
+  errno = ENOSYS;
+  return (-1);
+}
+
+int
+uringRegisterEventfd(uring_t *ring, int fd)
+{
+  (void)ring; (void)fd;
+
+  errno = ENOSYS;
+  return (-1);
+}
+
+int
+uringWrite(uring_t *ring, int fd, const void *buffer, size_t bytes,
+           int buffer_index, int link, unsigned long long user_data)
+{
+  (void)ring; (void)fd; (void)buffer; (void)bytes; (void)buffer_index;
+  (void)link; (void)user_data;
+
+  errno = ENOSYS;
+  return (-1);
+}
+
+int
+uringSubmit(uring_t *ring)
+{
+  (void)ring;
+
+  errno = ENOSYS;
+  return (-1);
+}
+
+int
+uringComplete(uring_t *ring, unsigned long long *user_data, int *result)
+{
+  (void)ring; (void)user_data; (void)result;
+
+  return (0);
+}
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,79 @@
+/*
+ *   Minimal io_uring interface for the Toshiba TEC TPCL tools.
+ *
+ *   Copyright 2026 by Mark Dornbach
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/*
+ * io_uring is only used if the system headers know about it, everything
+ * else falls back to plain writes...
+ */
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#  define HAVE_IO_URING 1
+#  include <linux/io_uring.h>
+#endif /* __linux__ && __NR_io_uring_setup */
+
+
+/*
+ * Types...
+ */
+typedef struct uring_s			/* Submission and completion rings */
+{
+  int			fd;		/* Ring file descriptor or -1 */
+#ifdef HAVE_IO_URING
+  unsigned		*sq_head,	/* Submission queue head */
+			*sq_tail,	/* Submission queue tail */
+			*sq_mask,	/* Submission queue index mask */
+			*sq_array,	/* Submission queue index array */
+			*cq_head,	/* Completion queue head */
+			*cq_tail,	/* Completion queue tail */
+			*cq_mask;	/* Completion queue index mask */
+  unsigned		sq_entries,	/* Number of submission entries */
+			unsubmitted;	/* Published but not yet submitted */
+  struct io_uring_sqe	*sqes;		/* Submission entries */
+  struct io_uring_cqe	*cqes;		/* Completion entries */
+  void			*sq_map,	/* Submission ring mapping */
+			*cq_map;	/* Completion ring mapping */
+  size_t		sq_size,	/* Size of submission ring mapping */
+			cq_size,	/* Size of completion ring mapping */
+			sqes_size;	/* Size of submission entries */
+#endif /* HAVE_IO_URING */
+} uring_t;
+
+
+/*
+ * Prototypes...
+ */
+extern int	uringInit(uring_t *ring, unsigned entries);
+extern void	uringFree(uring_t *ring);
+extern int	uringRegisterBuffers(uring_t *ring, const struct iovec *iov,
+		                     unsigned count);
+extern int	uringRegisterEventfd(uring_t *ring, int fd);
+extern int	uringWrite(uring_t *ring, int fd, const void *buffer,
+		           size_t bytes, int buffer_index, int link,
+		           unsigned long long user_data);
+extern int	uringSubmit(uring_t *ring);
+extern int	uringComplete(uring_t *ring, unsigned long long *user_data,
+		              int *result);
+
+#endif /* !_URING_H_ */